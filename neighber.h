@@ -1,3 +1,51 @@
-#include "sr_pwospf.h"
+/*-----------------------------------------------------------------------------
+ * file:  neighber.h
+ *
+ * Description:
+ *
+ * PWOSPF neighbors of one interface, in an open addressing table keyed
+ * by router id so a hello finds its neighbor with one probe.  Each
+ * neighbor carries the pwospf clock time it expires at, see
+ * pwospf_expire_neighbors().
+ *
+ *---------------------------------------------------------------------------*/
 
-void add_neighbor(neighbor_list* ngh_head, neighbor_list* new_neighbor);
+#ifndef NEIGHBER_H
+#define NEIGHBER_H
+
+#include <stdint.h>
+
+struct pwospf_neighbor
+{
+    uint32_t router_id;   /* 0 marks a free slot */
+    uint32_t ip;          /* address its hellos come from */
+    uint64_t expires;     /* pwospf clock msec */
+
+    /* -- fast liveness, see pwospf_send_echoes() -- */
+    uint8_t echo_up;      /* it answered an echo, missing them takes it down */
+    uint8_t echo_pending; /* the last echo is not answered yet */
+    uint8_t echo_missed;  /* echoes missed in a row */
+    uint64_t echo_last;   /* pwospf clock msec of the last reply */
+    uint32_t echo_replies;
+    uint64_t echo_cpu_ns; /* thread cpu time spent on its echoes */
+};
+
+struct pwospf_nbr_table
+{
+    struct pwospf_neighbor* slots;
+    uint32_t bits;        /* 1 << bits slots, 0 before the first neighbor */
+    uint32_t num;
+};
+
+struct pwospf_neighbor* nbr_find(struct pwospf_nbr_table* table, uint32_t router_id);
+struct pwospf_neighbor* nbr_add(struct pwospf_nbr_table* table, uint32_t router_id);
+void nbr_remove(struct pwospf_nbr_table* table, struct pwospf_neighbor* neighbor);
+void nbr_clear(struct pwospf_nbr_table* table);
+
+/* -- walk the neighbors with for (i = 0; i < nbr_slots(t); i++) if (t->slots[i].router_id) -- */
+static inline uint32_t nbr_slots(const struct pwospf_nbr_table* table)
+{
+    return table->bits ? 1U << table->bits : 0;
+}
+
+#endif /* NEIGHBER_H */
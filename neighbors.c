@@ -1,15 +1,109 @@
-#include "pwospf_protocol.h"
 #include "neighber.h"
 
-void add_neighbor(neighbor_list* ngh_head, neighbor_list* new_neighbor)
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define NBR_MIN_BITS 2
+
+static uint32_t nbr_home(struct pwospf_nbr_table* table, uint32_t router_id)
+{
+    return (router_id * 0x9e3779b1U) >> (32 - table->bits);
+}
+
+// Slot of router_id, or the free slot it would go to
+static uint32_t nbr_slot(struct pwospf_nbr_table* table, uint32_t router_id)
+{
+    uint32_t mask = (1U << table->bits) - 1;
+    uint32_t slot = nbr_home(table, router_id);
+
+    while (table->slots[slot].router_id != 0 && table->slots[slot].router_id != router_id)
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void nbr_resize(struct pwospf_nbr_table* table, uint32_t bits)
+{
+    struct pwospf_neighbor* old = table->slots;
+    uint32_t old_slots = nbr_slots(table);
+
+    table->bits = bits;
+    table->slots = (struct pwospf_neighbor*)calloc(1U << bits, sizeof(struct pwospf_neighbor));
+    assert(table->slots);
+
+    for (uint32_t i = 0; i < old_slots; i++)
+    {
+        if (old[i].router_id != 0)
+        {
+            table->slots[nbr_slot(table, old[i].router_id)] = old[i];
+        }
+    }
+    free(old);
+}
+
+struct pwospf_neighbor* nbr_find(struct pwospf_nbr_table* table, uint32_t router_id)
 {
-    if (ngh_head->next != NULL)
+    if (table->num == 0)
     {
-        new_neighbor->next = first_neighbor->next;
-        first_neighbor->next = new_neighbor;
+        return NULL;
     }
-    else
+
+    struct pwospf_neighbor* neighbor = &table->slots[nbr_slot(table, router_id)];
+    return neighbor->router_id != 0 ? neighbor : NULL;
+}
+
+// The new neighbor has no address and expiry yet, the caller sets them
+struct pwospf_neighbor* nbr_add(struct pwospf_nbr_table* table, uint32_t router_id)
+{
+    assert(router_id != 0 && nbr_find(table, router_id) == NULL);
+
+    // Kept at most half full
+    if (2 * (table->num + 1) > nbr_slots(table))
+    {
+        nbr_resize(table, table->bits ? table->bits + 1 : NBR_MIN_BITS);
+    }
+
+    struct pwospf_neighbor* neighbor = &table->slots[nbr_slot(table, router_id)];
+    memset(neighbor, 0, sizeof(struct pwospf_neighbor));
+    neighbor->router_id = router_id;
+    table->num++;
+    return neighbor;
+}
+
+// Backward shift deletion: a neighbor further on may move into this slot,
+// so a walk over the slots checks the same slot again after a removal.
+void nbr_remove(struct pwospf_nbr_table* table, struct pwospf_neighbor* neighbor)
+{
+    uint32_t mask = (1U << table->bits) - 1;
+    uint32_t hole = (uint32_t)(neighbor - table->slots);
+    uint32_t slot = hole;
+
+    table->slots[hole].router_id = 0;
+    table->num--;
+    while (1)
+    {
+        slot = (slot + 1) & mask;
+        if (table->slots[slot].router_id == 0)
+        {
+            break;
+        }
+        uint32_t home = nbr_home(table, table->slots[slot].router_id);
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            table->slots[hole] = table->slots[slot];
+            table->slots[slot].router_id = 0;
+            hole = slot;
+        }
+    }
+}
+
+void nbr_clear(struct pwospf_nbr_table* table)
+{
+    if (table->slots != NULL)
     {
-        first_neighbor->next = new_neighbor;
+        memset(table->slots, 0, nbr_slots(table) * sizeof(struct pwospf_neighbor));
     }
+    table->num = 0;
 }
@@ -19,6 +19,7 @@ static const uint32_t OSPF_AllSPFRouters = 0xe0000005; /*"224.0.0.5"*/
 static const uint8_t OSPF_TYPE_HELLO = 1;
 static const uint8_t OSPF_TYPE_LSU   = 4;
 static const uint8_t OSPF_TYPE_LSUPDATE = 4;
+static const uint8_t OSPF_TYPE_ECHO  = 8;  /* fast liveness, not part of OSPF */
 static const uint8_t OSPF_NET_BROADCAST = 1;
 static const uint8_t OSPF_DEFAULT_HELLOINT  =  5; /* seconds */
 static const uint8_t OSPF_DEFAULT_LSUINT    = 30; /* seconds */
@@ -26,6 +27,16 @@ static const uint8_t OSPF_NEIGHBOR_TIMEOUT  = 20; /* seconds */
 
 static const uint8_t OSPF_TOPO_ENTRY_TIMEOUT = 35; /* seconds */ 
 
+static const uint32_t OSPF_SPF_INITIAL_DELAY = 50;   /* msec, first SPF after a quiet period */
+static const uint32_t OSPF_SPF_HOLD_TIME     = 200;  /* msec, between SPFs, doubles while busy */
+static const uint32_t OSPF_SPF_MAX_WAIT      = 5000; /* msec, cap of the hold time */
+
+static const uint32_t OSPF_LSU_MIN_INTERVAL = 200; /* msec, changes within it go in one LSU */
+static const uint8_t  OSPF_MAX_LSU_FRAGMENTS = 15;  /* an LSU over OSPF_MAX_LSU_SIZE is split in up to */
+
+static const uint32_t OSPF_ECHO_INTERVAL   = 50; /* msec between echoes, when enabled */
+static const uint32_t OSPF_ECHO_MULTIPLIER = 3;  /* echoes missed in a row before the neighbor is down */
+
 static const uint8_t OSPF_DEFAULT_AUTHKEY  =  0; /* ignored */
 
 static const uint16_t OSPF_MAX_HELLO_SIZE  = 1024; /* bytes */
@@ -55,11 +66,19 @@ struct ospfv2_hello_hdr
 struct ospfv2_lsu_hdr
 {
     uint16_t seq;
-    uint8_t  unused;
+    uint8_t  frag;     /* fragment index << 4 | fragment count, 0 if the LSU is one packet */
     uint8_t  ttl;
     uint32_t num_adv;  /* number of advertisements */
 }__attribute__ ((packed));
 
+struct ospfv2_echo_hdr
+{
+    uint32_t origin;   /* router id the echo was sent by */
+    uint32_t seq;      /* of the sender, echoed back as is */
+    uint8_t  reply;    /* 0 request, 1 reply */
+    uint8_t  padding[3];
+}__attribute__ ((packed));
+
 struct ospfv2_lsu
 {
     uint32_t subnet; /* -- link subnet -- */
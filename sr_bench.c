@@ -0,0 +1,804 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ * date:  Sun Oct 18 23:59:59 PDT 2026
+ *
+ * Description:
+ *
+ * Forwarding microbenchmark.  Builds one router in memory, its frames
+ * going out through sr->transmit instead of the server, with a generated
+ * routing table and arp cache, and feeds it traffic of one mix at a time
+ * through sr_handlepacket():
+ *
+ *   uniform   udp to destinations spread evenly over the routes
+ *   zipf      udp to Zipf distributed routes, a few take most packets
+ *   single    one udp flow
+ *   icmp      half echo requests to the router, a quarter expiring
+ *             TTLs, the rest uniform
+ *   arpmiss   half to hosts of the lan interface not in the arp cache,
+ *             the rest uniform
+ *
+ * Routes get a prefix length drawn from the shape of a full internet
+ * table (bgp: mostly /24, then /22 and /23, few below /16), evenly from
+ * 8 to 30 (uniform), or all one length.  The interfaces but the last are
+ * point to point links with a gateway each that the routes point at, the
+ * last is a /16 lan whose -A hosts are in the arp cache ahead of the
+ * gateways.  A host not in the cache answers the router's arp request
+ * right after the frame and its entry is removed again, so each arpmiss
+ * frame to the lan costs a whole resolution.
+ *
+ * Each frame is copied from a pool of generated ones into the buffer the
+ * router gets, as a NIC would write it, and the copy is in the time.
+ * Reported per mix, with the flow cache off and on: Mpps, ns, TSC ticks,
+ * and where perf_event_open is allowed cpu cycles, instructions, cache
+ * and branch misses per packet, heap allocations of the router per packet
+ * (malloc, calloc and realloc wrapped at link time) and the share of
+ * packets the fast path forwarded.  -o appends the rows to a CSV file
+ * (make bench), one line per mix and flow cache setting.
+ *
+ * The numbers are of the build as configured, see CFLAGS.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pwospf.h"
+#include "sr_fib.h"
+#include "sr_fcache.h"
+#include "sr_stats.h"
+
+#define DEFAULT_ROUTES    1000
+#define DEFAULT_IFACES    8
+#define DEFAULT_ARP_HOSTS 256
+#define DEFAULT_PACKETS   200000
+#define BENCH_FRAME_LEN   64      /* bytes of every generated frame */
+#define BENCH_POOL        65536   /* generated frames, replayed round robin */
+#define BENCH_ZIPF_S      1.0
+#define BENCH_MAX_ASKED   16      /* arp requests of one frame */
+#define BENCH_LAN_SPARE   4096    /* unresolved lan hosts the arpmiss mix picks from */
+#define BENCH_LAN_NET     0x0a010000  /* 10.1.0.0/16, the last interface */
+#define BENCH_LINK_NET    0x0a000000  /* 10.0.i.0/24, interface i */
+
+enum bench_mix
+{
+    MIX_UNIFORM,
+    MIX_ZIPF,
+    MIX_SINGLE,
+    MIX_ICMP,
+    MIX_ARPMISS,
+    MIX_NUM
+};
+
+static const char* mix_names[] = { "uniform", "zipf", "single", "icmp", "arpmiss" };
+
+/* -- share of routes per prefix length, /8 to /24, of a full internet table -- */
+static const int bgp_weights[] =
+    { 1, 1, 2, 4, 8, 15, 25, 45, 250, 100, 150, 300, 400, 400, 1200, 1000, 6000 };
+
+#define BENCH_PERF_NUM 4
+
+#ifdef _LINUX_
+static const uint64_t perf_configs[BENCH_PERF_NUM] =
+    { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+#endif /* _LINUX_ */
+
+struct bench
+{
+    struct sr_instance sr;
+    int num_ifaces;
+    int num_routes;
+    const char* prefixes;   /* bgp, uniform or a length */
+    int arp_hosts;
+    int packets;
+
+    uint32_t* dsts;         /* an address inside each generated route */
+    double* zipf_cdf;       /* by rank */
+    int* zipf_route;        /* route of each rank */
+    uint8_t* frames;
+    int pool;
+
+    uint32_t asked[BENCH_MAX_ASKED];  /* lan hosts the router sent arp requests for */
+    int num_asked;
+    uint64_t sent;
+
+    int perf_fd[BENCH_PERF_NUM];
+};
+
+struct bench_result
+{
+    double seconds;
+    uint64_t ticks;
+    uint64_t perf[BENCH_PERF_NUM];
+    int have_perf;
+    uint64_t allocs;
+    uint64_t fast;          /* forwarded from the flow cache or the fast path */
+};
+
+static void usage(char* );
+
+/* -- sr_vns_comm.c needs this from the main program -- */
+int sr_verify_routing_table(struct sr_instance* sr)
+{
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * allocations of the router, counted by wrapping malloc at link time
+ *---------------------------------------------------------------------------*/
+
+static uint64_t bench_allocs;
+
+#ifdef _LINUX_
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    bench_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size)
+{
+    bench_allocs++;
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    bench_allocs++;
+    return __real_realloc(ptr, size);
+}
+#endif /* _LINUX_ */
+
+/*-----------------------------------------------------------------------------
+ * hardware counters, where the kernel lets us have them
+ *---------------------------------------------------------------------------*/
+
+static void bench_perf_open(struct bench* b)
+{
+    int i;
+
+    for (i = 0; i < BENCH_PERF_NUM; i++)
+    {
+        b->perf_fd[i] = -1;
+#ifdef _LINUX_
+        {
+            struct perf_event_attr attr;
+
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = perf_configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            b->perf_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif /* _LINUX_ */
+    }
+}
+
+static void bench_perf_start(struct bench* b)
+{
+#ifdef _LINUX_
+    int i;
+
+    for (i = 0; i < BENCH_PERF_NUM; i++)
+    {
+        if (b->perf_fd[i] >= 0)
+        {
+            ioctl(b->perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(b->perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif /* _LINUX_ */
+}
+
+static void bench_perf_stop(struct bench* b, struct bench_result* res)
+{
+    int i;
+
+    res->have_perf = 0;
+    for (i = 0; i < BENCH_PERF_NUM; i++)
+    {
+        res->perf[i] = 0;
+#ifdef _LINUX_
+        if (b->perf_fd[i] >= 0)
+        {
+            ioctl(b->perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(b->perf_fd[i], &res->perf[i], sizeof(uint64_t)) == sizeof(uint64_t))
+            { res->have_perf |= 1 << i; }
+        }
+#endif /* _LINUX_ */
+    }
+}
+
+static double bench_wall(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_uniform(void)
+{ return random() / ((double)RAND_MAX + 1.0); }
+
+/*-----------------------------------------------------------------------------
+ * the router
+ *---------------------------------------------------------------------------*/
+
+static int bench_transmit(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                          struct sr_if* iface)
+{
+    struct bench* b = (struct bench*)sr->transmit_arg;
+    struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)buf;
+    struct sr_arphdr* arp_hdr = (struct sr_arphdr*)(buf + sizeof(struct sr_ethernet_hdr));
+
+    b->sent++;
+
+    /* -- a request is broadcast on every interface, take it once -- */
+    if (eth_hdr->ether_type == htons(ETHERTYPE_ARP) && arp_hdr->ar_op == htons(ARP_REQUEST) &&
+        (ntohl(arp_hdr->ar_tip) & 0xffff0000) == BENCH_LAN_NET &&
+        (b->num_asked == 0 || b->asked[b->num_asked - 1] != arp_hdr->ar_tip) &&
+        b->num_asked < BENCH_MAX_ASKED)
+    { b->asked[b->num_asked++] = arp_hdr->ar_tip; }
+
+    return 0;
+}
+
+static void bench_host_mac(uint8_t* mac, int iface, uint32_t host)
+{
+    mac[0] = 0x02;
+    mac[1] = (uint8_t)iface;
+    mac[2] = (uint8_t)(host >> 24);
+    mac[3] = (uint8_t)(host >> 16);
+    mac[4] = (uint8_t)(host >> 8);
+    mac[5] = (uint8_t)host;
+}
+
+/* -- the owner of ip_nbo answers the router on iface -- */
+static void bench_arp_reply(struct bench* b, struct sr_if* iface, uint32_t ip_nbo)
+{
+    uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arphdr)];
+    struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)reply;
+    struct sr_arphdr* arp_hdr = (struct sr_arphdr*)(reply + sizeof(struct sr_ethernet_hdr));
+    uint8_t mac[ETHER_ADDR_LEN];
+
+    bench_host_mac(mac, iface->index, ntohl(ip_nbo));
+    memset(reply, 0, sizeof(reply));
+    memcpy(eth_hdr->ether_dhost, iface->addr, ETHER_ADDR_LEN);
+    memcpy(eth_hdr->ether_shost, mac, ETHER_ADDR_LEN);
+    eth_hdr->ether_type = htons(ETHERTYPE_ARP);
+    arp_hdr->ar_hrd = htons(ARPHDR_ETHER);
+    arp_hdr->ar_pro = htons(ETHERTYPE_IP);
+    arp_hdr->ar_hln = ETHER_ADDR_LEN;
+    arp_hdr->ar_pln = 4;
+    arp_hdr->ar_op = htons(ARP_REPLY);
+    memcpy(arp_hdr->ar_sha, mac, ETHER_ADDR_LEN);
+    arp_hdr->ar_sip = ip_nbo;
+    memcpy(arp_hdr->ar_tha, iface->addr, ETHER_ADDR_LEN);
+    arp_hdr->ar_tip = iface->ip;
+    sr_handlepacket(&b->sr, reply, sizeof(reply), iface);
+}
+
+/* -- what the arp timeout does to an entry, at once -- */
+static void bench_forget_arp(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    struct arp_cache** walker;
+
+    pthread_mutex_lock(&(sr->arp_lock));
+    for (walker = &sr->arp_cache; *walker; walker = &(*walker)->next)
+    {
+        if ((*walker)->ip.s_addr == ip_nbo)
+        {
+            struct arp_cache* entry = *walker;
+            *walker = entry->next;
+            free(entry);
+            __atomic_add_fetch(&sr->arp_generation, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(sr->arp_lock));
+}
+
+/* -- lan hosts asked for during the last frame answer, then time out -- */
+static void bench_answer_arp(struct bench* b)
+{
+    struct sr_if* lan = sr_get_interface_by_index(&b->sr, b->num_ifaces - 1);
+    uint32_t asked[BENCH_MAX_ASKED];
+    int i, num = b->num_asked;
+
+    memcpy(asked, b->asked, num * sizeof(uint32_t));
+    b->num_asked = 0;
+    for (i = 0; i < num; i++)
+    {
+        bench_arp_reply(b, lan, asked[i]);
+        bench_forget_arp(&b->sr, asked[i]);
+    }
+}
+
+static int bench_prefix_len(const char* prefixes)
+{
+    int i, total = 0, pick;
+
+    if (strcmp(prefixes, "uniform") == 0)
+    { return 8 + random() % 23; }
+    if (strcmp(prefixes, "bgp") != 0)
+    { return atoi(prefixes); }
+
+    for (i = 0; i < sizeof(bgp_weights) / sizeof(bgp_weights[0]); i++)
+    { total += bgp_weights[i]; }
+    pick = random() % total;
+    for (i = 0; pick >= bgp_weights[i]; i++)
+    { pick -= bgp_weights[i]; }
+    return 8 + i;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: bench_build(..)
+ * Scope: Local
+ *
+ * The router, its interfaces, arp cache and routing table, published,
+ * with counters like a real router has.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int bench_build(struct bench* b)
+{
+    struct sr_instance* sr = &b->sr;
+    struct sr_rt* tail = 0;
+    struct in_addr dest, gw, mask;
+    char name[SR_IFACE_NAMELEN];
+    unsigned char addr[ETHER_ADDR_LEN];
+    double sum = 0.0;
+    int i;
+
+    sr->sockfd = -1;
+    snprintf(sr->host, sizeof(sr->host), "bench");
+    sr->transmit = bench_transmit;
+    sr->transmit_arg = b;
+    pthread_mutex_init(&(sr->arp_lock), 0);
+    pwospf_init_subsys(sr);
+
+    for (i = 0; i < b->num_ifaces; i++)
+    {
+        int lan = i == b->num_ifaces - 1;
+
+        snprintf(name, sizeof(name), "eth%d", i);
+        memset(addr, 0, sizeof(addr));
+        addr[0] = 0x02;
+        addr[1] = 0xff;
+        addr[5] = (uint8_t)i;
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, addr);
+        sr_set_ether_ip(sr, htonl(lan ? BENCH_LAN_NET + 1 : BENCH_LINK_NET + (i << 8) + 1));
+        sr_set_ether_mask(sr, htonl(lan ? 0xffff0000 : 0xffffff00));
+
+        /* -- connected subnets first, the table is matched in order -- */
+        dest.s_addr = htonl(lan ? BENCH_LAN_NET : BENCH_LINK_NET + (i << 8));
+        gw.s_addr = 0;
+        mask.s_addr = htonl(lan ? 0xffff0000 : 0xffffff00);
+        tail = sr_add_rt_entry_after(sr, tail, dest, gw, mask, name, 1);
+    }
+    sr->hw_init = 1;
+
+    /* -- arp cache, lan hosts ahead of the gateways -- */
+    for (i = 0; i < b->arp_hosts; i++)
+    { bench_arp_reply(b, sr_get_interface_by_index(sr, b->num_ifaces - 1),
+                      htonl(BENCH_LAN_NET + 2 + i)); }
+    for (i = 0; i < b->num_ifaces - 1; i++)
+    { bench_arp_reply(b, sr_get_interface_by_index(sr, i), htonl(BENCH_LINK_NET + (i << 8) + 2)); }
+
+    b->dsts = (uint32_t*)malloc(b->num_routes * sizeof(uint32_t));
+    b->zipf_cdf = (double*)malloc(b->num_routes * sizeof(double));
+    b->zipf_route = (int*)malloc(b->num_routes * sizeof(int));
+    b->frames = (uint8_t*)malloc((size_t)BENCH_POOL * BENCH_FRAME_LEN);
+    if (b->dsts == 0 || b->zipf_cdf == 0 || b->zipf_route == 0 || b->frames == 0)
+    { return -1; }
+
+    for (i = 0; i < b->num_routes; i++)
+    {
+        int len = bench_prefix_len(b->prefixes);
+        uint32_t m = len ? 0xffffffffU << (32 - len) : 0;
+        uint32_t net;
+        int out = i % (b->num_ifaces - 1);
+
+        /* -- anywhere in 11.0.0.0 to 223.255.255.255 -- */
+        net = ((uint32_t)(11 + random() % 213) << 24 | (random() & 0xffffff)) & m;
+        dest.s_addr = htonl(net);
+        gw.s_addr = htonl(BENCH_LINK_NET + (out << 8) + 2);
+        mask.s_addr = htonl(m);
+        snprintf(name, sizeof(name), "eth%d", out);
+        tail = sr_add_rt_entry_after(sr, tail, dest, gw, mask, name, 1);
+
+        b->dsts[i] = htonl(net | (random() & ~m));
+    }
+    sr_fib_publish(sr);
+
+    /* -- zipf ranks in no relation to table order -- */
+    for (i = 0; i < b->num_routes; i++)
+    {
+        int j = random() % (i + 1);
+        b->zipf_route[i] = b->zipf_route[j];
+        b->zipf_route[j] = i;
+        sum += 1.0 / pow(i + 1, BENCH_ZIPF_S);
+        b->zipf_cdf[i] = sum;
+    }
+
+    return sr_stats_init(sr);
+} /* -- bench_build -- */
+
+/*-----------------------------------------------------------------------------
+ * traffic
+ *---------------------------------------------------------------------------*/
+
+static uint32_t bench_zipf_dst(struct bench* b)
+{
+    double u = bench_uniform() * b->zipf_cdf[b->num_routes - 1];
+    int lo = 0, hi = b->num_routes - 1;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (b->zipf_cdf[mid] < u)
+        { lo = mid + 1; }
+        else
+        { hi = mid; }
+    }
+    return b->dsts[b->zipf_route[lo]];
+}
+
+static void bench_frame(struct bench* b, uint8_t* frame, uint32_t dst, uint8_t proto,
+                        uint8_t ttl, uint32_t ports)
+{
+    struct sr_if* in = sr_get_interface_by_index(&b->sr, 0);
+    struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)frame;
+    struct ip* ip_hdr = (struct ip*)(frame + sizeof(struct sr_ethernet_hdr));
+    uint8_t* l4 = frame + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+    unsigned int l4_len = BENCH_FRAME_LEN - sizeof(struct sr_ethernet_hdr) - sizeof(struct ip);
+
+    memset(frame, 0, BENCH_FRAME_LEN);
+    memcpy(eth_hdr->ether_dhost, in->addr, ETHER_ADDR_LEN);
+    bench_host_mac(eth_hdr->ether_shost, 0, BENCH_LINK_NET + 2);
+    eth_hdr->ether_type = htons(ETHERTYPE_IP);
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = 5;
+    ip_hdr->ip_len = htons(BENCH_FRAME_LEN - sizeof(struct sr_ethernet_hdr));
+    ip_hdr->ip_ttl = ttl;
+    ip_hdr->ip_p = proto;
+    ip_hdr->ip_src.s_addr = b->dsts[random() % b->num_routes];
+    ip_hdr->ip_dst.s_addr = dst;
+    if (proto == IPPROTO_ICMP)
+    {
+        struct sr_ICMPhdr* icmp_hdr = (struct sr_ICMPhdr*)l4;
+        icmp_hdr->type = 8;
+        memcpy(l4 + sizeof(struct sr_ICMPhdr), &ports, 4);
+        icmp_hdr->checksum = cal_ICMPcksum(l4, l4_len);
+    }
+    else
+    { memcpy(l4, &ports, 4); }
+    ip_hdr->ip_sum = 0;
+    ip_hdr->ip_sum = cal_IPchecksum(ip_hdr);
+}
+
+static void bench_gen(struct bench* b, enum bench_mix mix)
+{
+    struct sr_if* in = sr_get_interface_by_index(&b->sr, 0);
+    int i;
+
+    for (i = 0; i < b->pool; i++)
+    {
+        uint8_t* frame = b->frames + (size_t)i * BENCH_FRAME_LEN;
+        uint32_t uniform = b->dsts[random() % b->num_routes];
+        uint32_t ports = random();
+        int quarter = random() % 4;
+
+        switch (mix)
+        {
+            case MIX_UNIFORM:
+                bench_frame(b, frame, uniform, IPPROTO_UDP, 64, ports);
+                break;
+            case MIX_ZIPF:
+                bench_frame(b, frame, bench_zipf_dst(b), IPPROTO_UDP, 64, ports);
+                break;
+            case MIX_SINGLE:
+                bench_frame(b, frame, b->dsts[0], IPPROTO_UDP, 64, 0x35003500);
+                ((struct ip*)(frame + sizeof(struct sr_ethernet_hdr)))->ip_src.s_addr = b->dsts[0];
+                ((struct ip*)(frame + sizeof(struct sr_ethernet_hdr)))->ip_sum = 0;
+                ((struct ip*)(frame + sizeof(struct sr_ethernet_hdr)))->ip_sum =
+                    cal_IPchecksum((struct ip*)(frame + sizeof(struct sr_ethernet_hdr)));
+                break;
+            case MIX_ICMP:
+                if (quarter < 2)
+                { bench_frame(b, frame, in->ip, IPPROTO_ICMP, 64, ports); }
+                else
+                { bench_frame(b, frame, uniform, IPPROTO_UDP, quarter == 2 ? 1 : 64, ports); }
+                break;
+            case MIX_ARPMISS:
+                if (quarter < 2)
+                { bench_frame(b, frame, htonl(BENCH_LAN_NET + 2 + b->arp_hosts +
+                                              random() % BENCH_LAN_SPARE),
+                              IPPROTO_UDP, 64, ports); }
+                else
+                { bench_frame(b, frame, uniform, IPPROTO_UDP, 64, ports); }
+                break;
+            case MIX_NUM:
+                break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: bench_run(..)
+ * Scope: Local
+ *
+ * A tenth of the packets to warm up, then the measured ones.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void bench_run(struct bench* b, enum bench_mix mix, struct bench_result* res)
+{
+    struct sr_instance* sr = &b->sr;
+    struct sr_if* in = sr_get_interface_by_index(sr, 0);
+    struct sr_stats_snapshot before, after;
+    uint8_t frame[BENCH_FRAME_LEN];
+    uint64_t allocs, t0;
+    double w0;
+    int i, warm = b->packets / 10;
+
+    bench_gen(b, mix);
+
+    for (i = 0; i < warm; i++)
+    {
+        memcpy(frame, b->frames + (size_t)(i % b->pool) * BENCH_FRAME_LEN, BENCH_FRAME_LEN);
+        sr_handlepacket(sr, frame, BENCH_FRAME_LEN, in);
+        if (b->num_asked)
+        { bench_answer_arp(b); }
+    }
+
+    sr_stats_snapshot(sr, &before);
+    allocs = bench_allocs;
+    bench_perf_start(b);
+    w0 = bench_wall();
+    t0 = sr_stats_ticks();
+
+    for (i = 0; i < b->packets; i++)
+    {
+        memcpy(frame, b->frames + (size_t)(i % b->pool) * BENCH_FRAME_LEN, BENCH_FRAME_LEN);
+        sr_handlepacket(sr, frame, BENCH_FRAME_LEN, in);
+        if (b->num_asked)
+        { bench_answer_arp(b); }
+    }
+
+    res->ticks = sr_stats_ticks() - t0;
+    res->seconds = bench_wall() - w0;
+    bench_perf_stop(b, res);
+    res->allocs = bench_allocs - allocs;
+    sr_stats_snapshot(sr, &after);
+    res->fast = after.counter[SR_STAT_FWD_CACHE] - before.counter[SR_STAT_FWD_CACHE] +
+        after.counter[SR_STAT_FWD_FAST] - before.counter[SR_STAT_FWD_FAST];
+} /* -- bench_run -- */
+
+/*-----------------------------------------------------------------------------
+ * output
+ *---------------------------------------------------------------------------*/
+
+static void bench_print(FILE* out, struct bench* b, enum bench_mix mix, unsigned int slots,
+                        struct bench_result* res)
+{
+    double n = b->packets;
+    int i;
+
+    fprintf(out, "%-8s %6u %8.3f %8.1f %8.1f", mix_names[mix], slots,
+            n / res->seconds / 1e6, res->seconds * 1e9 / n, res->ticks / n);
+    for (i = 0; i < BENCH_PERF_NUM; i++)
+    {
+        if (res->have_perf & (1 << i))
+        { fprintf(out, " %8.2f", res->perf[i] / n); }
+        else
+        { fprintf(out, " %8s", "-"); }
+    }
+    fprintf(out, " %7.2f %6.1f\n", res->allocs / n, 100.0 * res->fast / n);
+}
+
+static void bench_csv(FILE* csv, const char* when, const char* label, struct bench* b,
+                      enum bench_mix mix, unsigned int slots, struct bench_result* res)
+{
+    double n = b->packets;
+    int i;
+
+    fprintf(csv, "%s,%s,%s,%d,%s,%d,%d,%d,%u,%.4f,%.2f,%.2f", when, label, mix_names[mix],
+            b->num_routes, b->prefixes, b->num_ifaces, b->arp_hosts, b->packets, slots,
+            n / res->seconds / 1e6, res->seconds * 1e9 / n, res->ticks / n);
+    for (i = 0; i < BENCH_PERF_NUM; i++)
+    {
+        if (res->have_perf & (1 << i))
+        { fprintf(csv, ",%.3f", res->perf[i] / n); }
+        else
+        { fprintf(csv, ","); }
+    }
+    fprintf(csv, ",%.3f,%.2f\n", res->allocs / n, 100.0 * res->fast / n);
+}
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+    struct bench b;
+    struct bench_result res;
+    unsigned int fcache_slots = FCACHE_DEFAULT_SLOTS;
+    unsigned int seed = 1;
+    char* mixes = "all";
+    char* csv_file = 0;
+    char* label = "";
+    char when[32];
+    time_t now = time(0);
+    FILE* csv = 0;
+    int run_mix[MIX_NUM];
+    int c, m, run;
+
+    memset(&b, 0, sizeof(b));
+    b.num_ifaces = DEFAULT_IFACES;
+    b.num_routes = DEFAULT_ROUTES;
+    b.prefixes = "bgp";
+    b.arp_hosts = DEFAULT_ARP_HOSTS;
+    b.packets = DEFAULT_PACKETS;
+
+    while ((c = getopt(argc, argv, "hR:d:i:A:n:m:C:s:o:l:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 'R':
+                b.num_routes = atoi((char *) optarg);
+                break;
+            case 'd':
+                b.prefixes = optarg;
+                break;
+            case 'i':
+                b.num_ifaces = atoi((char *) optarg);
+                break;
+            case 'A':
+                b.arp_hosts = atoi((char *) optarg);
+                break;
+            case 'n':
+                b.packets = atoi((char *) optarg);
+                break;
+            case 'm':
+                mixes = optarg;
+                break;
+            case 'C':
+                fcache_slots = atoi((char *) optarg);
+                break;
+            case 's':
+                seed = atoi((char *) optarg);
+                break;
+            case 'o':
+                csv_file = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    for (m = 0; m < MIX_NUM; m++)
+    {
+        size_t len = strlen(mix_names[m]);
+        char* at = strstr(mixes, mix_names[m]);
+
+        run_mix[m] = strcmp(mixes, "all") == 0 ||
+            (at && (at == mixes || at[-1] == ',') && (at[len] == 0 || at[len] == ','));
+    }
+    if (b.num_routes < 1 || b.num_ifaces < 2 || b.num_ifaces > 255 || b.packets < 1 ||
+        b.arp_hosts < 0 || b.arp_hosts > 0xffff - 2 - BENCH_LAN_SPARE ||
+        (strcmp(b.prefixes, "bgp") && strcmp(b.prefixes, "uniform") &&
+         (atoi(b.prefixes) < 1 || atoi(b.prefixes) > 32)))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    b.pool = b.packets < BENCH_POOL ? b.packets : BENCH_POOL;
+    srandom(seed);
+
+    if (csv_file)
+    {
+        if ((csv = fopen(csv_file, "a")) == 0)
+        {
+            perror(csv_file);
+            exit(1);
+        }
+        if (ftell(csv) == 0)
+        { fprintf(csv, "time,label,mix,routes,prefixes,ifaces,arp_hosts,packets,fcache,"
+                  "mpps,ns_pkt,tsc_pkt,cycles_pkt,instr_pkt,cache_miss_pkt,branch_miss_pkt,"
+                  "allocs_pkt,fast_pct\n"); }
+    }
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    if (bench_build(&b) != 0)
+    {
+        fprintf(stderr, "Error setting up the router\n");
+        exit(1);
+    }
+    bench_perf_open(&b);
+
+    printf("forwarding bench, %d routes (%s), %d interfaces, %d arp hosts, %d packets a run\n",
+           b.num_routes, b.prefixes, b.num_ifaces, b.arp_hosts, b.packets);
+    printf("%-8s %6s %8s %8s %8s %8s %8s %8s %8s %7s %6s\n", "mix", "fcache", "Mpps", "ns/pkt",
+           "tsc/pkt", "cyc/pkt", "ins/pkt", "miss/pkt", "brm/pkt", "alloc", "fast%");
+
+    for (m = 0; m < MIX_NUM; m++)
+    {
+        if (!run_mix[m])
+        { continue; }
+        for (run = 0; run < (fcache_slots ? 2 : 1); run++)
+        {
+            unsigned int slots = run ? fcache_slots : 0;
+
+            if (slots && sr_fcache_init(&b.sr, slots) != 0)
+            {
+                fprintf(stderr, "Error allocating the flow cache\n");
+                exit(1);
+            }
+            bench_run(&b, m, &res);
+            bench_print(stdout, &b, m, slots, &res);
+            if (csv)
+            { bench_csv(csv, when, label, &b, m, slots, &res); }
+            sr_fcache_free(&b.sr);
+        }
+    }
+
+    if (csv && fclose(csv) != 0)
+    { perror(csv_file); }
+    sr_stats_free(&b.sr);
+    sr_fib_free(&b.sr);
+    return 0;
+} /* -- main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: usage(..)
+ * Scope: local
+ *---------------------------------------------------------------------------*/
+
+static void usage(char* argv0)
+{
+    printf("Forwarding microbenchmark\n");
+    printf("Format: %s [-h] [-R routes] [-d bgp|uniform|prefix length] [-i interfaces]\n", argv0);
+    printf("           [-A arp hosts] [-n packets] [-m mix,...] [-C flow cache slots]\n");
+    printf("           [-s seed] [-o csv file] [-l label]\n");
+    printf("   mixes uniform zipf single icmp arpmiss, or all\n");
+    printf("   defaults -R %d -d bgp -i %d -A %d -n %d -m all -C %d, -C 0 runs without\n",
+           DEFAULT_ROUTES, DEFAULT_IFACES, DEFAULT_ARP_HOSTS, DEFAULT_PACKETS,
+           FCACHE_DEFAULT_SLOTS);
+    printf("   the flow cache only, -o appends a line per run\n");
+} /* -- usage -- */
@@ -0,0 +1,966 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ * date:  Sun Oct 18 18:05:44 PDT 2026
+ *
+ * Description:
+ *
+ * Asynchronous tcpdump writer behind sr_log_packet, see sr_capture.h.
+ *
+ * Each ring holds variable sized records, a 32 bit record size followed by
+ * the on-disk pcap packet header and the captured bytes, 8 byte aligned.
+ * A record never wraps, a zero size tells the reader to skip to the start
+ * of the ring.  head is only written by the producer and tail only by the
+ * writer thread, so neither side takes a lock.
+ *
+ * The writer copies records straight from the rings into the mapped window
+ * of the current segment.  The unused tail of a segment is cut off when the
+ * writer leaves it, so a closed segment is a regular tcpdump file.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifdef _LINUX_
+#define _GNU_SOURCE /* fallocate */
+#endif /* _LINUX_ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#include "sr_dumper.h"
+#include "sr_protocol.h"
+#include "sr_if.h"
+#include "sr_capture.h"
+#include "sr_log.h"
+
+#define CAPTURE_REC_ALIGN(x) (((x) + 7) & ~7U)
+#define CAPTURE_IDLE_NSEC    1000000 /* writer sleep when the rings are empty */
+
+struct capture_ring
+{
+    /* -- producer side -- */
+    uint64_t head __attribute__ ((aligned (64)));   /* bytes produced */
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t passed;             /* frames through the filter, for sampling */
+    uint64_t filtered;           /* frames the filter or sampling skipped */
+
+    /* -- writer side -- */
+    uint64_t tail __attribute__ ((aligned (64)));   /* bytes consumed */
+
+    uint8_t* data;
+    struct sr_capture* owner;
+};
+
+/* -- checks of a filter term -- */
+#define CAPTURE_M_ETHER 0x01
+#define CAPTURE_M_PROTO 0x02
+#define CAPTURE_M_SRC   0x04
+#define CAPTURE_M_DST   0x08
+#define CAPTURE_M_NET   0x10
+#define CAPTURE_M_IFACE 0x20
+#define CAPTURE_M_IP    (CAPTURE_M_PROTO | CAPTURE_M_SRC | CAPTURE_M_DST | CAPTURE_M_NET)
+
+struct capture_term
+{
+    unsigned int match;          /* CAPTURE_M_* */
+    uint16_t ethertype;
+    uint8_t ip_proto;
+    uint32_t src_net, src_mask;  /* network byte order */
+    uint32_t dst_net, dst_mask;
+    uint32_t net, net_mask;      /* source or destination */
+    int dir;
+    char iface[SR_IFACE_NAMELEN];
+};
+
+struct capture_segment
+{
+    unsigned int seq;
+    struct pcap_timeval first;   /* first and last frame in the segment */
+    struct pcap_timeval last;
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+struct sr_capture
+{
+    char* fname;
+    char* path;                  /* scratch for segment file names */
+    int snaplen;
+    struct sr_capture_config config;
+    struct capture_term terms[CAPTURE_FILTER_TERMS];
+    int num_terms;               /* 0 keeps every frame */
+
+    struct capture_ring* rings[CAPTURE_MAX_RINGS];
+    int num_rings;               /* published after the ring is set up */
+    pthread_mutex_t ring_lock;   /* only taken to add a producer */
+    uint64_t overflow_dropped;   /* frames of threads beyond CAPTURE_MAX_RINGS */
+
+    int stop;
+    pthread_t writer;
+
+    /* -- writer side, current segment -- */
+    int fd;                      /* -1 when no segment could be opened */
+    unsigned int seq;            /* segments opened so far */
+    time_t opened;
+    uint64_t used;               /* bytes written to the segment */
+    uint8_t* win;                /* mapped part of the segment */
+    uint64_t win_off;
+    uint64_t win_len;
+    struct capture_segment* segments; /* config.segments, by seq */
+    uint64_t lost;               /* frames without a segment to go to */
+    uint64_t lost_failed;        /* lost when the last segment failed */
+    time_t retry;                /* next try at a segment while fd is -1 */
+    int failed;                  /* the failure was reported */
+};
+
+/* -- ring of the calling thread -- */
+static __thread struct capture_ring* capture_ring_tls;
+
+static void* capture_writer_thread(void* arg);
+static int capture_open_segment(struct sr_capture* cap);
+static int capture_compile_filter(struct sr_capture* cap, const char* filter);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_open(..)
+ * Scope: Global
+ *
+ * Create the first segment and start the writer thread.  config may be 0
+ * for the defaults in sr_capture.h.
+ *
+ * RETURN VALUES:
+ *
+ *  the capture on success
+ *  0 if the filter does not compile or the file could not be opened
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(const char* fname, int snaplen,
+                                   const struct sr_capture_config* config)
+{
+    struct sr_capture* cap;
+
+    cap = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    assert(cap);
+
+    cap->config.segment_size = CAPTURE_SEGMENT_SIZE;
+    cap->config.segment_secs = 0;
+    cap->config.segments = CAPTURE_SEGMENTS;
+    if (config)
+    { cap->config = *config; }
+    if (cap->config.segment_size < CAPTURE_SEGMENT_MIN)
+    { cap->config.segment_size = CAPTURE_SEGMENT_MIN; }
+    if (cap->config.segments == 0)
+    { cap->config.segments = 1; }
+
+    if (cap->config.filter && capture_compile_filter(cap, cap->config.filter))
+    {
+        free(cap);
+        return 0;
+    }
+    cap->config.filter = 0; /* -- the caller's string, not ours to keep -- */
+
+    cap->fname = strdup(fname);
+    cap->path = (char*)malloc(strlen(fname) + 16);
+    cap->segments = (struct capture_segment*)
+        calloc(cap->config.segments, sizeof(struct capture_segment));
+    assert(cap->fname && cap->path && cap->segments);
+    cap->snaplen = snaplen > 0 && snaplen < IP_MAXPACKET ? snaplen : IP_MAXPACKET;
+    cap->fd = -1;
+
+    if (capture_open_segment(cap))
+    {
+        free(cap->segments);
+        free(cap->path);
+        free(cap->fname);
+        free(cap);
+        return 0;
+    }
+
+    pthread_mutex_init(&cap->ring_lock, 0);
+
+    if (pthread_create(&cap->writer, 0, capture_writer_thread, cap))
+    {
+        perror("pthread_create");
+        assert(0);
+    }
+
+    return cap;
+} /* -- sr_capture_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_parse_prefix(..)
+ * Scope: Local
+ *
+ * a.b.c.d or a.b.c.d/len into network and mask, both network byte order.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_parse_prefix(const char* str, uint32_t* net, uint32_t* mask)
+{
+    char addr[32];
+    const char* slash = strchr(str, '/');
+    int len = 32;
+    struct in_addr in;
+
+    if (slash)
+    {
+        if ((size_t)(slash - str) >= sizeof(addr))
+        { return -1; }
+        memcpy(addr, str, slash - str);
+        addr[slash - str] = 0;
+        len = atoi(slash + 1);
+        if (len < 0 || len > 32)
+        { return -1; }
+    }
+    else
+    {
+        if (strlen(str) >= sizeof(addr))
+        { return -1; }
+        strcpy(addr, str);
+    }
+
+    if (inet_aton(addr, &in) == 0)
+    { return -1; }
+
+    *mask = len == 0 ? 0 : htonl(0xffffffffU << (32 - len));
+    *net = in.s_addr & *mask;
+    return 0;
+} /* -- capture_parse_prefix -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_compile_prim(..)
+ * Scope: Local
+ *
+ * Add one primitive to a filter term.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_compile_prim(struct capture_term* term, const char* prim)
+{
+    const char* arg = strchr(prim, '=');
+
+    arg = arg ? arg + 1 : "";
+
+    if (strcmp(prim, "arp") == 0)
+    {
+        term->match |= CAPTURE_M_ETHER;
+        term->ethertype = ETHERTYPE_ARP;
+    }
+    else if (strcmp(prim, "ip") == 0)
+    {
+        term->match |= CAPTURE_M_ETHER;
+        term->ethertype = ETHERTYPE_IP;
+    }
+    else if (strncmp(prim, "ether=", 6) == 0)
+    {
+        term->match |= CAPTURE_M_ETHER;
+        term->ethertype = (uint16_t)strtoul(arg, 0, 0);
+    }
+    else if (strcmp(prim, "icmp") == 0)
+    {
+        term->match |= CAPTURE_M_PROTO;
+        term->ip_proto = IPPROTO_ICMP;
+    }
+    else if (strcmp(prim, "tcp") == 0)
+    {
+        term->match |= CAPTURE_M_PROTO;
+        term->ip_proto = IPPROTO_TCP;
+    }
+    else if (strcmp(prim, "udp") == 0)
+    {
+        term->match |= CAPTURE_M_PROTO;
+        term->ip_proto = IPPROTO_UDP;
+    }
+    else if (strcmp(prim, "ospf") == 0)
+    {
+        term->match |= CAPTURE_M_PROTO;
+        term->ip_proto = IPPROTO_OSPF;
+    }
+    else if (strncmp(prim, "proto=", 6) == 0)
+    {
+        term->match |= CAPTURE_M_PROTO;
+        term->ip_proto = (uint8_t)atoi(arg);
+    }
+    else if (strncmp(prim, "src=", 4) == 0)
+    {
+        term->match |= CAPTURE_M_SRC;
+        return capture_parse_prefix(arg, &term->src_net, &term->src_mask);
+    }
+    else if (strncmp(prim, "dst=", 4) == 0)
+    {
+        term->match |= CAPTURE_M_DST;
+        return capture_parse_prefix(arg, &term->dst_net, &term->dst_mask);
+    }
+    else if (strncmp(prim, "net=", 4) == 0)
+    {
+        term->match |= CAPTURE_M_NET;
+        return capture_parse_prefix(arg, &term->net, &term->net_mask);
+    }
+    else if (strncmp(prim, "in=", 3) == 0 || strncmp(prim, "out=", 4) == 0)
+    {
+        if (strlen(arg) == 0 || strlen(arg) >= SR_IFACE_NAMELEN)
+        { return -1; }
+        term->match |= CAPTURE_M_IFACE;
+        term->dir = prim[0] == 'i' ? CAPTURE_IN : CAPTURE_OUT;
+        strcpy(term->iface, arg);
+    }
+    else
+    { return -1; }
+
+    /* -- an IP field implies an IP frame -- */
+    if (term->match & CAPTURE_M_IP)
+    {
+        if ((term->match & CAPTURE_M_ETHER) && term->ethertype != ETHERTYPE_IP)
+        { return -1; }
+        term->match |= CAPTURE_M_ETHER;
+        term->ethertype = ETHERTYPE_IP;
+    }
+    return 0;
+} /* -- capture_compile_prim -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_compile_filter(..)
+ * Scope: Local
+ *
+ * Compile a filter string into terms, a frame is kept if any term matches:
+ *
+ *   filter = term { ',' term }
+ *   term   = prim { '+' prim }          all primitives must match
+ *   prim   = arp | ip | ether=<type>
+ *          | icmp | tcp | udp | ospf | proto=<n>
+ *          | src=<prefix> | dst=<prefix> | net=<prefix>
+ *          | in=<iface> | out=<iface>
+ *
+ * e.g. "ospf,icmp" or "arp,icmp+net=10.0.1.0/24,in=eth0".
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_compile_filter(struct sr_capture* cap, const char* filter)
+{
+    char* copy = strdup(filter);
+    char* term_save = 0;
+    char* term_str;
+
+    assert(copy);
+    cap->num_terms = 0;
+
+    for (term_str = strtok_r(copy, ",", &term_save); term_str;
+         term_str = strtok_r(0, ",", &term_save))
+    {
+        struct capture_term* term;
+        char* prim_save = 0;
+        char* prim;
+
+        if (cap->num_terms == CAPTURE_FILTER_TERMS)
+        {
+            fprintf(stderr, "sr_capture: more than %d filter terms\n", CAPTURE_FILTER_TERMS);
+            free(copy);
+            return -1;
+        }
+        term = &cap->terms[cap->num_terms++];
+        memset(term, 0, sizeof(*term));
+
+        for (prim = strtok_r(term_str, "+", &prim_save); prim;
+             prim = strtok_r(0, "+", &prim_save))
+        {
+            if (capture_compile_prim(term, prim))
+            {
+                fprintf(stderr, "sr_capture: bad filter primitive '%s'\n", prim);
+                free(copy);
+                return -1;
+            }
+        }
+    }
+
+    free(copy);
+    return 0;
+} /* -- capture_compile_filter -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_match(..)
+ * Scope: Local
+ *
+ * Run the compiled filter over the headers of a frame.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_match(const struct sr_capture* cap, const uint8_t* buf,
+                         unsigned int len, const char* iface, int dir)
+{
+    const struct ip* ip = 0;
+    uint16_t ethertype;
+    int i;
+
+    if (len < sizeof(struct sr_ethernet_hdr))
+    { return 0; }
+
+    ethertype = ntohs(((const struct sr_ethernet_hdr*)buf)->ether_type);
+    if (ethertype == ETHERTYPE_IP &&
+        len >= sizeof(struct sr_ethernet_hdr) + sizeof(struct ip))
+    { ip = (const struct ip*)(buf + sizeof(struct sr_ethernet_hdr)); }
+
+    for (i = 0; i < cap->num_terms; i++)
+    {
+        const struct capture_term* t = &cap->terms[i];
+
+        if ((t->match & CAPTURE_M_ETHER) && t->ethertype != ethertype)
+        { continue; }
+        if (t->match & CAPTURE_M_IP)
+        {
+            if (ip == 0)
+            { continue; }
+            if ((t->match & CAPTURE_M_PROTO) && t->ip_proto != ip->ip_p)
+            { continue; }
+            if ((t->match & CAPTURE_M_SRC) &&
+                (ip->ip_src.s_addr & t->src_mask) != t->src_net)
+            { continue; }
+            if ((t->match & CAPTURE_M_DST) &&
+                (ip->ip_dst.s_addr & t->dst_mask) != t->dst_net)
+            { continue; }
+            if ((t->match & CAPTURE_M_NET) &&
+                (ip->ip_src.s_addr & t->net_mask) != t->net &&
+                (ip->ip_dst.s_addr & t->net_mask) != t->net)
+            { continue; }
+        }
+        if ((t->match & CAPTURE_M_IFACE) &&
+            (t->dir != dir || strncmp(t->iface, iface, SR_IFACE_NAMELEN)))
+        { continue; }
+
+        return 1;
+    }
+    return 0;
+} /* -- capture_match -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_get_ring(..)
+ * Scope: Local
+ *
+ * Ring of the calling thread, created on its first frame.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct capture_ring* capture_get_ring(struct sr_capture* cap)
+{
+    struct capture_ring* ring = capture_ring_tls;
+
+    if (ring && ring->owner == cap)
+    { return ring; }
+
+    pthread_mutex_lock(&cap->ring_lock);
+    if (cap->num_rings == CAPTURE_MAX_RINGS)
+    {
+        pthread_mutex_unlock(&cap->ring_lock);
+        return 0;
+    }
+
+    ring = (struct capture_ring*)calloc(1, sizeof(struct capture_ring));
+    assert(ring);
+    ring->data = (uint8_t*)malloc(CAPTURE_RING_SIZE);
+    assert(ring->data);
+    ring->owner = cap;
+
+    cap->rings[cap->num_rings] = ring;
+    __atomic_store_n(&cap->num_rings, cap->num_rings + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&cap->ring_lock);
+
+    capture_ring_tls = ring;
+    return ring;
+} /* -- capture_get_ring -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_packet(..)
+ * Scope: Global
+ *
+ * Queue a frame for the dump file, never blocks.  iface is the interface
+ * the frame came in on (CAPTURE_IN) or goes out of (CAPTURE_OUT).
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                       const char* iface, int dir)
+{
+    struct capture_ring* ring;
+    struct pcap_sf_pkthdr hdr;
+    struct timeval tv;
+    uint64_t head, tail, off, contig, need;
+    unsigned int caplen = len < (unsigned int)cap->snaplen ? len : (unsigned int)cap->snaplen;
+    unsigned int size = CAPTURE_REC_ALIGN(sizeof(uint32_t) + sizeof(hdr) + caplen);
+
+    if ((ring = capture_get_ring(cap)) == 0)
+    {
+        __atomic_add_fetch(&cap->overflow_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if ((cap->num_terms && !capture_match(cap, buf, len, iface, dir)) ||
+        (cap->config.sample > 1 && ring->passed++ % cap->config.sample))
+    {
+        __atomic_store_n(&ring->filtered, ring->filtered + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    off = head & (CAPTURE_RING_SIZE - 1);
+    contig = CAPTURE_RING_SIZE - off;
+    need = contig < size ? contig + size : size;
+
+    if (CAPTURE_RING_SIZE - (head - tail) < need)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    /* -- no room before the end of the ring, mark the rest as skipped -- */
+    if (contig < size)
+    {
+        *(uint32_t*)(ring->data + off) = 0;
+        head += contig;
+        off = 0;
+    }
+
+    gettimeofday(&tv, 0);
+    hdr.ts.tv_sec = tv.tv_sec;
+    hdr.ts.tv_usec = tv.tv_usec;
+    hdr.caplen = caplen;
+    hdr.len = len;
+
+    *(uint32_t*)(ring->data + off) = size;
+    memcpy(ring->data + off + sizeof(uint32_t), &hdr, sizeof(hdr));
+    memcpy(ring->data + off + sizeof(uint32_t) + sizeof(hdr), buf, caplen);
+
+    __atomic_store_n(&ring->captured, ring->captured + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+} /* -- sr_capture_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * segment files
+ *---------------------------------------------------------------------------*/
+
+static const char* capture_segment_path(struct sr_capture* cap, unsigned int seq)
+{
+    sprintf(cap->path, "%s.%06u", cap->fname, seq);
+    return cap->path;
+}
+
+static int capture_preallocate(int fd, uint64_t size)
+{
+#ifdef _LINUX_
+    if (fallocate(fd, 0, 0, size) == 0)
+    { return 0; }
+    if (errno != EOPNOTSUPP && errno != ENOSYS)
+    { return -1; }
+#endif /* _LINUX_ */
+    /* -- no fallocate for this file system, sparse file -- */
+    return ftruncate(fd, size);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_map_window(..)
+ * Scope: Local
+ *
+ * Map the window of the segment that holds byte cap->used.  Windows are
+ * CAPTURE_WINDOW_SIZE aligned, so records may straddle two of them.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_map_window(struct sr_capture* cap)
+{
+    int flags = MAP_SHARED;
+
+    if (cap->win)
+    { munmap(cap->win, cap->win_len); }
+
+    cap->win_off = cap->used & ~((uint64_t)CAPTURE_WINDOW_SIZE - 1);
+    cap->win_len = cap->config.segment_size - cap->win_off;
+    if (cap->win_len > CAPTURE_WINDOW_SIZE)
+    { cap->win_len = CAPTURE_WINDOW_SIZE; }
+
+#ifdef MAP_POPULATE
+    /* -- take the page faults here and not one per page while writing -- */
+    flags |= MAP_POPULATE;
+#endif
+    cap->win = (uint8_t*)mmap(0, cap->win_len, PROT_READ | PROT_WRITE, flags,
+                              cap->fd, cap->win_off);
+    if (cap->win == MAP_FAILED)
+    {
+        perror("sr_capture: mmap");
+        cap->win = 0;
+        return -1;
+    }
+    return 0;
+} /* -- capture_map_window -- */
+
+/* -- copy into the segment, the caller made sure it fits -- */
+static int capture_write(struct sr_capture* cap, const void* data, uint64_t len)
+{
+    const uint8_t* src = (const uint8_t*)data;
+
+    while (len > 0)
+    {
+        uint64_t room, n;
+
+        if (cap->win == 0 || cap->used == cap->win_off + cap->win_len)
+        {
+            if (capture_map_window(cap))
+            { return -1; }
+        }
+
+        room = cap->win_off + cap->win_len - cap->used;
+        n = len < room ? len : room;
+        memcpy(cap->win + (cap->used - cap->win_off), src, n);
+        cap->used += n;
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_write_index(..)
+ * Scope: Local
+ *
+ * Rewrite <name>.index, one line per kept segment:
+ *
+ *   <seq> <first sec.usec> <last sec.usec> <frames> <bytes> <file>
+ *
+ * Replaced through a rename so readers never see half an index.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void capture_write_index(struct sr_capture* cap)
+{
+    char* index = (char*)malloc(strlen(cap->fname) + 16);
+    char* tmp = (char*)malloc(strlen(cap->fname) + 16);
+    unsigned int keep = cap->config.segments;
+    unsigned int seq;
+    FILE* fp;
+
+    assert(index && tmp);
+    sprintf(index, "%s.index", cap->fname);
+    sprintf(tmp, "%s.index.tmp", cap->fname);
+
+    if ((fp = fopen(tmp, "w")) == 0)
+    {
+        perror("sr_capture: index");
+        free(index);
+        free(tmp);
+        return;
+    }
+
+    fprintf(fp, "# segment first last frames bytes file\n");
+    for (seq = cap->seq > keep ? cap->seq - keep : 0; seq < cap->seq; seq++)
+    {
+        struct capture_segment* seg = &cap->segments[seq % keep];
+
+        fprintf(fp, "%u %d.%06d %d.%06d %llu %llu %s\n", seg->seq,
+                seg->first.tv_sec, seg->first.tv_usec,
+                seg->last.tv_sec, seg->last.tv_usec,
+                (unsigned long long)seg->frames, (unsigned long long)seg->bytes,
+                capture_segment_path(cap, seg->seq));
+    }
+    fclose(fp);
+
+    if (rename(tmp, index))
+    { perror("sr_capture: index"); }
+    free(index);
+    free(tmp);
+} /* -- capture_write_index -- */
+
+/* -- unmap and cut the preallocated but unused end off the segment -- */
+static void capture_close_segment(struct sr_capture* cap)
+{
+    if (cap->fd < 0)
+    { return; }
+
+    if (cap->win)
+    { munmap(cap->win, cap->win_len); }
+    cap->win = 0;
+
+    if (ftruncate(cap->fd, cap->used))
+    { perror("sr_capture: ftruncate"); }
+    close(cap->fd);
+    cap->fd = -1;
+}
+
+/* -- say once that segments fail, and when to try again -- */
+static void capture_segment_failed(struct sr_capture* cap, const char* what, const char* path)
+{
+    if (!cap->failed)
+    {
+        sr_log(SR_LOG_VNS, SR_LOG_ERR, "sr_capture: can't %s %s: %s, dropping frames"
+               " and trying again every %us\n", what, path, strerror(errno),
+               CAPTURE_RETRY_SECS);
+        cap->failed = 1;
+        cap->lost_failed = cap->lost;
+    }
+    cap->retry = time(0) + CAPTURE_RETRY_SECS;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_open_segment(..)
+ * Scope: Local
+ *
+ * Start the next segment file with a tcpdump file header, removing the
+ * oldest one if that would keep more than config.segments.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 if the file could not be created, the writer then drops frames
+ *     and tries again after CAPTURE_RETRY_SECS
+ *
+ *---------------------------------------------------------------------------*/
+
+static int capture_open_segment(struct sr_capture* cap)
+{
+    struct pcap_file_header hdr;
+    struct capture_segment* seg;
+    unsigned int keep = cap->config.segments;
+    const char* path;
+
+    capture_close_segment(cap);
+
+    if (cap->seq >= keep)
+    { unlink(capture_segment_path(cap, cap->seq - keep)); }
+
+    path = capture_segment_path(cap, cap->seq);
+    if ((cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        capture_segment_failed(cap, "open", path);
+        return -1;
+    }
+
+    if (capture_preallocate(cap->fd, cap->config.segment_size))
+    {
+        capture_segment_failed(cap, "allocate", path);
+        close(cap->fd);
+        unlink(path);
+        cap->fd = -1;
+        return -1;
+    }
+
+    seg = &cap->segments[cap->seq % keep];
+    memset(seg, 0, sizeof(*seg));
+    seg->seq = cap->seq++;
+    cap->opened = time(0);
+    cap->used = 0;
+
+    hdr.magic = TCPDUMP_MAGIC;
+    hdr.version_major = PCAP_VERSION_MAJOR;
+    hdr.version_minor = PCAP_VERSION_MINOR;
+    hdr.thiszone = 0;
+    hdr.snaplen = cap->snaplen;
+    hdr.sigfigs = 0;
+    hdr.linktype = LINKTYPE_ETHERNET;
+
+    if (capture_write(cap, &hdr, sizeof(hdr)))
+    {
+        capture_segment_failed(cap, "map", path);
+        capture_close_segment(cap);
+        return -1;
+    }
+    seg->bytes = cap->used;
+
+    if (cap->failed)
+    {
+        sr_log(SR_LOG_VNS, SR_LOG_WARN, "sr_capture: writing to %s again, %llu frames lost\n",
+               path, (unsigned long long)(cap->lost - cap->lost_failed));
+        cap->failed = 0;
+    }
+
+    capture_write_index(cap);
+    return 0;
+} /* -- capture_open_segment -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_record(..)
+ * Scope: Local
+ *
+ * Append one pcap record to the current segment, moving on to the next
+ * segment first when it does not fit or the segment is too old, or
+ * trying for one again when the last try failed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void capture_record(struct sr_capture* cap, const struct pcap_sf_pkthdr* hdr)
+{
+    struct capture_segment* seg;
+    uint64_t rec_len = sizeof(*hdr) + hdr->caplen;
+
+    if (cap->fd >= 0 && cap->used > sizeof(struct pcap_file_header) &&
+        (cap->used + rec_len > cap->config.segment_size ||
+         (cap->config.segment_secs &&
+          hdr->ts.tv_sec >= cap->opened + (time_t)cap->config.segment_secs)))
+    { capture_open_segment(cap); }
+    else if (cap->fd < 0 && time(0) >= cap->retry)
+    { capture_open_segment(cap); }
+
+    if (cap->fd < 0 || capture_write(cap, hdr, rec_len))
+    {
+        __atomic_store_n(&cap->lost, cap->lost + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    seg = &cap->segments[(cap->seq - 1) % cap->config.segments];
+    if (seg->frames == 0)
+    { seg->first = hdr->ts; }
+    seg->last = hdr->ts;
+    seg->frames++;
+    seg->bytes = cap->used;
+}
+
+/*-----------------------------------------------------------------------------
+ * writer thread
+ *---------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+ * Method: capture_drain(..)
+ * Scope: Local
+ *
+ * Move everything queued in the rings to the segment.  Frames of different
+ * threads are written ring by ring, so the file is only time ordered
+ * per thread.
+ *
+ * RETURN VALUES:
+ *
+ *  number of frames written
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int capture_drain(struct sr_capture* cap)
+{
+    int num_rings = __atomic_load_n(&cap->num_rings, __ATOMIC_ACQUIRE);
+    unsigned int frames = 0;
+    int i;
+
+    for (i = 0; i < num_rings; i++)
+    {
+        struct capture_ring* ring = cap->rings[i];
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = ring->tail;
+
+        while (tail < head)
+        {
+            uint64_t off = tail & (CAPTURE_RING_SIZE - 1);
+            uint32_t size = *(uint32_t*)(ring->data + off);
+
+            if (size == 0)
+            {
+                tail += CAPTURE_RING_SIZE - off;
+                continue;
+            }
+
+            capture_record(cap, (struct pcap_sf_pkthdr*)(ring->data + off + sizeof(uint32_t)));
+            tail += size;
+            frames++;
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return frames;
+} /* -- capture_drain -- */
+
+static void* capture_writer_thread(void* arg)
+{
+    struct sr_capture* cap = (struct sr_capture*)arg;
+    struct timespec idle;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = CAPTURE_IDLE_NSEC;
+
+    while (1)
+    {
+        int stop = __atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE);
+
+        if (capture_drain(cap) == 0)
+        {
+            if (stop)
+            { break; }
+
+            /* -- a quiet link still gets its segments closed on time -- */
+            if (cap->fd >= 0 && cap->config.segment_secs &&
+                cap->used > sizeof(struct pcap_file_header) &&
+                time(0) >= cap->opened + (time_t)cap->config.segment_secs)
+            { capture_open_segment(cap); }
+
+            /* -- and a failed segment is tried again without waiting for frames -- */
+            if (cap->fd < 0 && time(0) >= cap->retry)
+            { capture_open_segment(cap); }
+
+            nanosleep(&idle, 0);
+        }
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_stats(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_stats(struct sr_capture* cap, uint64_t* captured, uint64_t* dropped)
+{
+    int num_rings = __atomic_load_n(&cap->num_rings, __ATOMIC_ACQUIRE);
+    int i;
+
+    *captured = 0;
+    *dropped = __atomic_load_n(&cap->overflow_dropped, __ATOMIC_RELAXED) +
+               __atomic_load_n(&cap->lost, __ATOMIC_RELAXED);
+
+    for (i = 0; i < num_rings; i++)
+    {
+        *captured += __atomic_load_n(&cap->rings[i]->captured, __ATOMIC_RELAXED);
+        *dropped += __atomic_load_n(&cap->rings[i]->dropped, __ATOMIC_RELAXED);
+    }
+} /* -- sr_capture_stats -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_close(..)
+ * Scope: Global
+ *
+ * Write out what is still queued, close the last segment and update the
+ * index.  No thread may log to the capture any more.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_close(struct sr_capture* cap)
+{
+    uint64_t captured, dropped, filtered = 0;
+    int i;
+
+    __atomic_store_n(&cap->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(cap->writer, 0);
+
+    sr_capture_stats(cap, &captured, &dropped);
+    for (i = 0; i < cap->num_rings; i++)
+    { filtered += cap->rings[i]->filtered; }
+    fprintf(stderr, "sr_capture: %llu frames captured, %llu dropped, %llu filtered\n",
+            (unsigned long long)captured, (unsigned long long)dropped,
+            (unsigned long long)filtered);
+
+    capture_close_segment(cap);
+    capture_write_index(cap);
+
+    for (i = 0; i < cap->num_rings; i++)
+    {
+        cap->rings[i]->owner = 0;
+        free(cap->rings[i]->data);
+        /* -- the ring itself stays, a thread may still point at it -- */
+    }
+    free(cap->segments);
+    free(cap->path);
+    free(cap->fname);
+    free(cap);
+} /* -- sr_capture_close -- */
@@ -0,0 +1,68 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ * date:  Sun Oct 18 18:05:44 PDT 2026
+ *
+ * Description:
+ *
+ * Packet capture off the forwarding path.  Every thread that logs a frame
+ * gets its own single producer / single consumer ring, a writer thread
+ * drains the rings into the tcpdump file in large writes.  A full ring
+ * drops (and counts) the frame instead of blocking the caller.
+ *
+ * The dump is a series of fixed size segment files, <name>.000000,
+ * <name>.000001, ..., each preallocated and written through a memory
+ * mapped window.  The writer moves on to a new segment when the current
+ * one is full or older than segment_secs, and only the newest 'segments'
+ * files are kept.  <name>.index lists the time range of every kept
+ * segment.  A segment that can't be created (a full disk, say) is
+ * reported once and tried again every CAPTURE_RETRY_SECS, the frames in
+ * between are counted as dropped.
+ *
+ * A filter compiled at open time (syntax in sr_capture.c) and 1 in N
+ * sampling pick the frames worth keeping before anything is copied.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define CAPTURE_RING_SIZE   (1 << 20)  /* bytes per producer thread, power of 2 */
+#define CAPTURE_MAX_RINGS   16         /* producer threads */
+#define CAPTURE_WINDOW_SIZE (4*1024*1024)  /* bytes of a segment mapped at once */
+#define CAPTURE_SEGMENT_SIZE (64*1024*1024) /* default bytes per segment file */
+#define CAPTURE_SEGMENT_MIN  (1024*1024)
+#define CAPTURE_SEGMENTS     8              /* default segment files kept */
+#define CAPTURE_FILTER_TERMS 16
+#define CAPTURE_RETRY_SECS   1              /* between tries at a segment that failed */
+
+/* -- direction of a frame, for the in= and out= filter primitives -- */
+#define CAPTURE_IN  1
+#define CAPTURE_OUT 2
+
+struct sr_capture_config
+{
+    uint64_t segment_size;       /* bytes preallocated per segment */
+    unsigned int segment_secs;   /* start a new segment after this long, 0 never */
+    unsigned int segments;       /* segment files kept on disk */
+    const char* filter;          /* 0 keeps every frame */
+    unsigned int sample;         /* keep 1 in sample frames that pass, 0 all */
+};
+
+struct sr_capture;
+
+struct sr_capture* sr_capture_open(const char* fname, int snaplen,
+                                   const struct sr_capture_config* config);
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf, unsigned int len,
+                       const char* iface, int dir);
+void sr_capture_stats(struct sr_capture* cap, uint64_t* captured, uint64_t* dropped);
+void sr_capture_close(struct sr_capture* cap);
+
+#endif /* SR_CAPTURE_H */
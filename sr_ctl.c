@@ -0,0 +1,910 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ * date:  Sun Oct 18 23:59:58 PDT 2026
+ *
+ * Description:
+ *
+ * Control socket, see sr_ctl.h.  One thread polls the listening socket,
+ * the clients and a self pipe to be stopped with.  A client's commands
+ * are read one at a time: the next is only looked at once the answer to
+ * the last one is sent.  A dump writes its next chunk only once the
+ * client took the last one.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_fib.h"
+#include "sr_pwospf.h"
+#include "sr_lsdb.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+#include "sr_ctl.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define CTL_OUT_INITIAL 4096
+
+#define CTL_NAME(name, desc) #name,
+
+static const char* ctl_stat_names[] = { SR_STATS_COUNTERS(CTL_NAME) };
+static const char* ctl_hist_names[] = { SR_STATS_HISTS(CTL_NAME) };
+static const char* ctl_dump_names[] = { "", "fib", "arp", "pending", "neighbors", "lsdb" };
+static const char* ctl_module_names[] = SR_LOG_MODULE_NAMES;
+static const char* ctl_level_names[] = SR_LOG_LEVEL_NAMES;
+
+static void* sr_ctl_thread(void* arg);
+
+/*-----------------------------------------------------------------------------
+ * output
+ *---------------------------------------------------------------------------*/
+
+static int ctl_grow(struct sr_ctl_client* c, size_t need)
+{
+    size_t max = c->out_max;
+    char* out;
+
+    if (c->out_off)
+    {
+        memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+    }
+    if (c->out_max - c->out_len >= need)
+    { return 0; }
+
+    while (max - c->out_len < need)
+    { max *= 2; }
+    if ((out = (char*)realloc(c->out, max)) == 0)
+    { return -1; }
+    c->out = out;
+    c->out_max = max;
+    return 0;
+}
+
+static void ctl_printf(struct sr_ctl_client* c, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+static void ctl_printf(struct sr_ctl_client* c, const char* fmt, ...)
+{
+    va_list ap;
+    size_t room;
+    int len;
+
+    while (1)
+    {
+        room = c->out_max - c->out_len;
+        va_start(ap, fmt);
+        len = vsnprintf(c->out + c->out_len, room, fmt, ap);
+        va_end(ap);
+        if (len < 0)
+        { return; }
+        if ((size_t)len < room)
+        {
+            c->out_len += len;
+            return;
+        }
+        /* -- out of memory truncates the answer -- */
+        if (ctl_grow(c, len + 1) != 0)
+        { return; }
+    }
+}
+
+/* -- an address in network order, in one of two buffers so two fit in a printf -- */
+static const char* ctl_ip(uint32_t ip_nbo, int which)
+{
+    static char buf[2][INET_ADDRSTRLEN];
+    struct in_addr in;
+
+    in.s_addr = ip_nbo;
+    return inet_ntop(AF_INET, &in, buf[which], INET_ADDRSTRLEN);
+}
+
+static int ctl_prefix_len(uint32_t mask_nbo)
+{ return __builtin_popcount(mask_nbo); }
+
+static const char* ctl_iface_name(struct sr_instance* sr, unsigned int index)
+{
+    struct sr_if* iface = sr_get_interface_by_index(sr, index);
+    return iface ? iface->name : "-";
+}
+
+static void ctl_lower(char* dst, const char* src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; src[i] && i < len - 1; i++)
+    { dst[i] = (src[i] >= 'A' && src[i] <= 'Z') ? src[i] - 'A' + 'a' : src[i]; }
+    dst[i] = 0;
+}
+
+static void ctl_error(struct sr_ctl_client* c, int json, const char* msg)
+{
+    if (json)
+    { ctl_printf(c, "{\"error\":\"%s\"}\n", msg); }
+    else
+    { ctl_printf(c, "error %s\n", msg); }
+}
+
+/*-----------------------------------------------------------------------------
+ * dumps, a chunk at a time.  A fill returns 1 once the table is done.
+ *---------------------------------------------------------------------------*/
+
+static void ctl_sep(struct sr_ctl_client* c)
+{
+    if (c->json && c->count)
+    { ctl_printf(c, ","); }
+    c->count++;
+}
+
+static int ctl_fill_fib(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    const struct sr_fib* fib = sr_fib_read_lock(sr);
+    unsigned long i;
+    unsigned int h;
+    int done;
+
+    if (fib == 0)
+    {
+        sr_fib_read_unlock();
+        return 1;
+    }
+    if (c->pos == 0)
+    { c->generation = fib->generation; }
+    c->generation_last = fib->generation;
+
+    /* -- a newer snapshot has the same routes mostly in the same place, go on there -- */
+    for (i = c->pos; i < fib->num_entries && i < c->pos + CTL_CHUNK; i++)
+    {
+        const struct sr_fib_entry* e = &fib->entries[i];
+        const char* proto = e->admin_dst <= 1 ? "static" : "pwospf";
+
+        ctl_sep(c);
+        if (c->json)
+        {
+            ctl_printf(c, "{\"dest\":\"%s\",\"len\":%d,\"proto\":\"%s\",\"hops\":[",
+                       ctl_ip(e->dest.s_addr, 0), ctl_prefix_len(e->mask.s_addr), proto);
+            for (h = 0; h < e->num_hops; h++)
+            { ctl_printf(c, "%s{\"gw\":\"%s\",\"iface\":\"%s\"}", h ? "," : "",
+                         ctl_ip(e->hops[h].gw.s_addr, 0),
+                         ctl_iface_name(sr, e->hops[h].if_index)); }
+            ctl_printf(c, "]}");
+        }
+        else
+        {
+            ctl_printf(c, "%s/%d %s", ctl_ip(e->dest.s_addr, 0),
+                       ctl_prefix_len(e->mask.s_addr), proto);
+            for (h = 0; h < e->num_hops; h++)
+            { ctl_printf(c, " %s %s", ctl_ip(e->hops[h].gw.s_addr, 0),
+                         ctl_iface_name(sr, e->hops[h].if_index)); }
+            ctl_printf(c, "\n");
+        }
+    }
+    c->pos = i;
+    done = i >= fib->num_entries;
+
+    sr_fib_read_unlock();
+    return done;
+}
+
+static int ctl_fill_arp(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    struct arp_cache* e = 0;
+    time_t now = time(0);
+    unsigned long i;
+    int done;
+
+    pthread_mutex_lock(&sr->arp_lock);
+    if (c->pos == 0)
+    { c->generation = sr->arp_generation; }
+    c->generation_last = sr->arp_generation;
+
+    for (e = sr->arp_cache, i = 0; e && i < c->pos; e = e->next, i++);
+    for (i = 0; e && i < CTL_CHUNK; e = e->next, i++)
+    {
+        const uint8_t* m = e->address;
+
+        ctl_sep(c);
+        ctl_printf(c, c->json ?
+                   "{\"ip\":\"%s\",\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"age\":%ld}" :
+                   "%s %02x:%02x:%02x:%02x:%02x:%02x age %ld\n",
+                   ctl_ip(e->ip.s_addr, 0), m[0], m[1], m[2], m[3], m[4], m[5],
+                   (long)(now - e->timestamp));
+    }
+    c->pos += i;
+    done = e == 0;
+
+    pthread_mutex_unlock(&sr->arp_lock);
+    return done;
+}
+
+static int ctl_fill_pending(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    struct msg_cache* e = 0;
+    time_t now = time(0);
+    unsigned long i;
+    int done;
+
+    pthread_mutex_lock(&sr->arp_lock);
+    for (e = sr->msg_cache, i = 0; e && i < c->pos; e = e->next, i++);
+    for (i = 0; e && i < CTL_CHUNK; e = e->next, i++)
+    {
+        ctl_sep(c);
+        ctl_printf(c, c->json ?
+                   "{\"ip\":\"%s\",\"out\":\"%s\",\"in\":\"%s\",\"tries\":%d,\"len\":%u,\"age\":%ld}" :
+                   "%s out %s in %s tries %d len %u age %ld\n",
+                   ctl_ip(e->ip.s_addr, 0), ctl_iface_name(sr, e->if_index),
+                   ctl_iface_name(sr, e->if_index_pre), e->counter, e->length,
+                   (long)(now - e->timestamp));
+    }
+    c->pos += i;
+    done = e == 0;
+
+    pthread_mutex_unlock(&sr->arp_lock);
+    return done;
+}
+
+/* -- pos is the interface, sub the slot of its table -- */
+static int ctl_fill_neighbors(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    struct pwospf_subsys* subsys = sr->ospf_subsys;
+    unsigned int n = 0;
+    uint64_t now;
+    int done;
+
+    if (subsys == 0)
+    { return 1; }
+
+    pwospf_lock(subsys);
+    now = subsys->clock(subsys->clock_arg);
+    while (c->pos < sr->num_ifaces && n < CTL_CHUNK)
+    {
+        struct sr_if* iface = sr_get_interface_by_index(sr, c->pos);
+        struct pwospf_neighbor* nbr;
+
+        if (iface == 0 || c->sub >= nbr_slots(&iface->neighbors))
+        {
+            c->pos++;
+            c->sub = 0;
+            continue;
+        }
+        nbr = &iface->neighbors.slots[c->sub++];
+        if (nbr->router_id == 0)
+        { continue; }
+
+        n++;
+        ctl_sep(c);
+        ctl_printf(c, c->json ?
+                   "{\"iface\":\"%s\",\"router_id\":\"%s\",\"ip\":\"%s\",\"expires_ms\":%llu,"
+                   "\"echo\":\"%s\",\"echo_missed\":%u,\"echo_replies\":%u}" :
+                   "%s rid %s ip %s expires %llums echo %s missed %u replies %u\n",
+                   iface->name, ctl_ip(nbr->router_id, 0), ctl_ip(nbr->ip, 1),
+                   (unsigned long long)(nbr->expires > now ? nbr->expires - now : 0),
+                   nbr->echo_up ? "up" : "off", nbr->echo_missed, nbr->echo_replies);
+    }
+    done = c->pos >= sr->num_ifaces;
+    pwospf_unlock(subsys);
+
+    return done;
+}
+
+static int ctl_fill_lsdb(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    struct pwospf_subsys* subsys = sr->ospf_subsys;
+    struct pwospf_lsdb* lsdb;
+    unsigned long i;
+    uint32_t l;
+    int done;
+
+    if (subsys == 0)
+    { return 1; }
+
+    pwospf_lock(subsys);
+    lsdb = &subsys->lsdb;
+    for (i = c->pos; i < lsdb->num_routers && i < c->pos + CTL_CHUNK; i++)
+    {
+        struct lsdb_router* r = lsdb->routers[i];
+
+        ctl_sep(c);
+        ctl_printf(c, c->json ?
+                   "{\"router_id\":\"%s\",\"seq\":%u,\"age\":%u,\"links\":[" :
+                   "%s seq %u age %u links",
+                   ctl_ip(r->router_id.s_addr, 0), r->sequence_num,
+                   subsys->uptime - r->time_stamp);
+        for (l = 0; l < r->num_links; l++)
+        {
+            struct ospfv2_lsu* lsu = &r->links[l];
+
+            ctl_printf(c, c->json ? "%s{\"subnet\":\"%s\",\"len\":%d,\"rid\":\"%s\"}" :
+                       "%s%s/%d %s", c->json ? (l ? "," : "") : " ",
+                       ctl_ip(lsu->subnet, 0), ctl_prefix_len(lsu->mask), ctl_ip(lsu->rid, 1));
+        }
+        ctl_printf(c, c->json ? "]}" : "\n");
+    }
+    c->pos = i;
+    done = i >= lsdb->num_routers;
+    pwospf_unlock(subsys);
+
+    return done;
+}
+
+static void ctl_dump_start(struct sr_ctl_client* c, enum sr_ctl_dump dump, int json)
+{
+    c->dump = dump;
+    c->json = json;
+    c->pos = 0;
+    c->sub = 0;
+    c->count = 0;
+    c->generation = 0;
+    c->generation_last = 0;
+    if (json)
+    { ctl_printf(c, "{\"%s\":[", ctl_dump_names[dump]); }
+}
+
+static void ctl_dump_end(struct sr_ctl_client* c)
+{
+    int versioned = c->dump == CTL_DUMP_FIB || c->dump == CTL_DUMP_ARP;
+
+    if (c->json)
+    {
+        ctl_printf(c, "],\"count\":%lu", c->count);
+        if (versioned)
+        { ctl_printf(c, ",\"generation\":%u,\"changed\":%s", c->generation,
+                     c->generation_last != c->generation ? "true" : "false"); }
+        ctl_printf(c, "}\n");
+    }
+    else
+    {
+        ctl_printf(c, "end %s %lu", ctl_dump_names[c->dump], c->count);
+        if (versioned)
+        {
+            ctl_printf(c, " generation %u", c->generation);
+            if (c->generation_last != c->generation)
+            { ctl_printf(c, " changed %u", c->generation_last); }
+        }
+        ctl_printf(c, "\n");
+    }
+    c->dump = CTL_DUMP_NONE;
+}
+
+static void ctl_fill(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    int done = 1;
+
+    switch (c->dump)
+    {
+        case CTL_DUMP_FIB:
+            done = ctl_fill_fib(sr, c);
+            break;
+        case CTL_DUMP_ARP:
+            done = ctl_fill_arp(sr, c);
+            break;
+        case CTL_DUMP_PENDING:
+            done = ctl_fill_pending(sr, c);
+            break;
+        case CTL_DUMP_NEIGHBORS:
+            done = ctl_fill_neighbors(sr, c);
+            break;
+        case CTL_DUMP_LSDB:
+            done = ctl_fill_lsdb(sr, c);
+            break;
+        case CTL_DUMP_NONE:
+            return;
+    }
+    if (done)
+    { ctl_dump_end(c); }
+}
+
+/*-----------------------------------------------------------------------------
+ * answers written in one go
+ *---------------------------------------------------------------------------*/
+
+static void ctl_counters(struct sr_instance* sr, struct sr_ctl_client* c, int json)
+{
+    struct sr_stats_snapshot snap;
+    struct sr_if* iface = 0;
+    char name[32];
+    int i;
+
+    sr_stats_snapshot(sr, &snap);
+
+    if (json)
+    { ctl_printf(c, "{\"counters\":{"); }
+    for (i = 0; i < SR_STAT_NUM; i++)
+    {
+        ctl_lower(name, ctl_stat_names[i], sizeof(name));
+        ctl_printf(c, json ? "%s\"%s\":%llu" : "%s%s %llu\n", json && i ? "," : "",
+                   name, (unsigned long long)snap.counter[i]);
+    }
+    if (json)
+    { ctl_printf(c, "},\"interfaces\":{"); }
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        uint64_t* ifc;
+
+        if (iface->index >= SR_STATS_MAX_IFACES)
+        { continue; }
+        ifc = snap.iface[iface->index];
+        ctl_printf(c, json ?
+                   "%s\"%s\":{\"rx_frames\":%llu,\"rx_bytes\":%llu,\"tx_frames\":%llu,\"tx_bytes\":%llu}" :
+                   "%siface %s rx_frames %llu rx_bytes %llu tx_frames %llu tx_bytes %llu\n",
+                   json && iface != sr->if_list ? "," : "", iface->name,
+                   (unsigned long long)ifc[SR_STAT_IF_RX_FRAMES],
+                   (unsigned long long)ifc[SR_STAT_IF_RX_BYTES],
+                   (unsigned long long)ifc[SR_STAT_IF_TX_FRAMES],
+                   (unsigned long long)ifc[SR_STAT_IF_TX_BYTES]);
+    }
+    ctl_printf(c, json ? "}}\n" : "end counters\n");
+}
+
+static void ctl_latency(struct sr_instance* sr, struct sr_ctl_client* c, int json, int reset)
+{
+    struct sr_hist* hists = 0;
+    char name[32];
+    int h;
+
+    if ((hists = (struct sr_hist*)malloc(SR_HIST_NUM * sizeof(struct sr_hist))) == 0)
+    {
+        ctl_error(c, json, "out of memory");
+        return;
+    }
+    sr_stats_hist_snapshot(sr, hists, reset);
+
+    if (json)
+    { ctl_printf(c, "{\"latency_ns\":{"); }
+    for (h = 0; h < SR_HIST_NUM; h++)
+    {
+        struct sr_hist* hist = &hists[h];
+
+        ctl_lower(name, ctl_hist_names[h], sizeof(name));
+        ctl_printf(c, json ?
+                   "%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p99\":%llu,"
+                   "\"p999\":%llu,\"max\":%llu}" :
+                   "%s%s count %llu mean %llu p50 %llu p99 %llu p999 %llu max %llu\n",
+                   json && h ? "," : "", name, (unsigned long long)hist->count,
+                   (unsigned long long)(hist->count ? hist->sum / hist->count : 0),
+                   (unsigned long long)sr_hist_percentile(hist, 50.0),
+                   (unsigned long long)sr_hist_percentile(hist, 99.0),
+                   (unsigned long long)sr_hist_percentile(hist, 99.9),
+                   (unsigned long long)sr_hist_percentile(hist, 100.0));
+    }
+    ctl_printf(c, json ? "},\"reset\":%s}\n" : "end latency ns%s\n",
+               json ? (reset ? "true" : "false") : (reset ? " reset" : ""));
+    free(hists);
+}
+
+static void ctl_log(struct sr_ctl_client* c, int json, const char* spec)
+{
+    int m;
+
+    if (spec && sr_log_set_levels(spec) != 0)
+    {
+        ctl_error(c, json, "bad log levels");
+        return;
+    }
+    ctl_printf(c, json ? "{\"log\":{" : "end log");
+    for (m = 0; m < SR_LOG_MODULES; m++)
+    { ctl_printf(c, json ? "%s\"%s\":\"%s\"" : "%s%s=%s", json ? (m ? "," : "") : " ",
+                 ctl_module_names[m], ctl_level_names[sr_log_levels[m]]); }
+    ctl_printf(c, json ? "}}\n" : "\n");
+}
+
+static void ctl_help(struct sr_ctl_client* c)
+{
+    ctl_printf(c, "fib [json]\n"
+                  "arp [json]\n"
+                  "pending [json]\n"
+                  "neighbors [json]\n"
+                  "lsdb [json]\n"
+                  "counters [json]\n"
+                  "latency [json] [reset]\n"
+                  "log [json] [[module=]level,...]\n"
+                  "end help\n");
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: ctl_command(..)
+ * Scope: Local
+ *
+ * Run one command line, its answer or the start of its dump goes to the
+ * client's output.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void ctl_command(struct sr_instance* sr, struct sr_ctl_client* c, char* line)
+{
+    char* save = 0;
+    char* cmd = strtok_r(line, " \t", &save);
+    char* arg = 0;
+    char* tok;
+    int json = 0, reset = 0;
+
+    if (cmd == 0)
+    { return; }
+    while ((tok = strtok_r(0, " \t", &save)) != 0)
+    {
+        if (strcmp(tok, "json") == 0)
+        { json = 1; }
+        else if (strcmp(tok, "reset") == 0)
+        { reset = 1; }
+        else if (arg == 0)
+        { arg = tok; }
+        else
+        {
+            ctl_error(c, json, "too many arguments");
+            return;
+        }
+    }
+    if (arg && strcmp(cmd, "log") != 0)
+    {
+        ctl_error(c, json, "unknown argument");
+        return;
+    }
+
+    if (strcmp(cmd, "fib") == 0)
+    { ctl_dump_start(c, CTL_DUMP_FIB, json); }
+    else if (strcmp(cmd, "arp") == 0)
+    { ctl_dump_start(c, CTL_DUMP_ARP, json); }
+    else if (strcmp(cmd, "pending") == 0)
+    { ctl_dump_start(c, CTL_DUMP_PENDING, json); }
+    else if (strcmp(cmd, "neighbors") == 0)
+    { ctl_dump_start(c, CTL_DUMP_NEIGHBORS, json); }
+    else if (strcmp(cmd, "lsdb") == 0)
+    { ctl_dump_start(c, CTL_DUMP_LSDB, json); }
+    else if (strcmp(cmd, "counters") == 0)
+    { ctl_counters(sr, c, json); }
+    else if (strcmp(cmd, "latency") == 0)
+    { ctl_latency(sr, c, json, reset); }
+    else if (strcmp(cmd, "log") == 0)
+    { ctl_log(c, json, arg); }
+    else if (strcmp(cmd, "help") == 0)
+    { ctl_help(c); }
+    else
+    { ctl_error(c, json, "unknown command, try help"); }
+} /* -- ctl_command -- */
+
+/*-----------------------------------------------------------------------------
+ * clients
+ *---------------------------------------------------------------------------*/
+
+static void ctl_close(struct sr_ctl_client* c)
+{
+    close(c->fd);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void ctl_accept(struct sr_ctl* ctl)
+{
+    int fd, i;
+
+    while ((fd = accept(ctl->fd, 0, 0)) >= 0)
+    {
+        struct sr_ctl_client* c = 0;
+
+        for (i = 0; i < CTL_MAX_CLIENTS; i++)
+        {
+            if (ctl->clients[i].fd < 0)
+            {
+                c = &ctl->clients[i];
+                break;
+            }
+        }
+        if (c == 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+            (c->out = (char*)malloc(CTL_OUT_INITIAL)) == 0)
+        {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->out_max = CTL_OUT_INITIAL;
+    }
+}
+
+/* -- 0, or -1 once the client is gone -- */
+static int ctl_read(struct sr_ctl_client* c)
+{
+    ssize_t n;
+
+    if (c->in_len == CTL_LINE_MAX)
+    { return 0; }
+    n = recv(c->fd, c->in + c->in_len, CTL_LINE_MAX - c->in_len, 0);
+    if (n > 0)
+    { c->in_len += n; }
+    else if (n == 0)
+    { c->eof = 1; }
+    else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    { return -1; }
+    return 0;
+}
+
+static int ctl_write(struct sr_ctl_client* c)
+{
+    while (c->out_off < c->out_len)
+    {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->out_off += n;
+    }
+    c->out_off = c->out_len = 0;
+    return 0;
+}
+
+/* -- the next command line into line, 1 if there was one -- */
+static int ctl_next_line(struct sr_ctl_client* c, char* line)
+{
+    char* nl = memchr(c->in, '\n', c->in_len);
+    unsigned int len;
+
+    if (nl == 0)
+    {
+        if (c->in_len == CTL_LINE_MAX)
+        {
+            /* -- nothing of a line that long is a command -- */
+            c->in_len = 0;
+            strcpy(line, "?");
+            return 1;
+        }
+        if (!c->eof || c->in_len == 0)
+        { return 0; }
+        nl = c->in + c->in_len;   /* last line without a newline */
+    }
+
+    len = nl - c->in;
+    memcpy(line, c->in, len);
+    line[len] = 0;
+    if (len && line[len - 1] == '\r')
+    { line[len - 1] = 0; }
+
+    len = len < c->in_len ? len + 1 : len;
+    memmove(c->in, c->in + len, c->in_len - len);
+    c->in_len -= len;
+    return 1;
+}
+
+static int ctl_busy(struct sr_ctl_client* c)
+{ return c->out_off < c->out_len || c->dump != CTL_DUMP_NONE; }
+
+/*-----------------------------------------------------------------------------
+ * Method: ctl_serve(..)
+ * Scope: Local
+ *
+ * With the last answer sent, write the next chunk of the dump, or start
+ * on the next command.  Then send what the socket takes.  Returns -1 once
+ * the client is to be closed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int ctl_serve(struct sr_instance* sr, struct sr_ctl_client* c)
+{
+    char line[CTL_LINE_MAX + 1];
+
+    if (c->out_off == c->out_len)
+    {
+        if (c->dump != CTL_DUMP_NONE)
+        { ctl_fill(sr, c); }
+        else if (ctl_next_line(c, line))
+        { ctl_command(sr, c, line); }
+    }
+    if (ctl_write(c) != 0)
+    { return -1; }
+
+    return (c->eof && !ctl_busy(c) && c->in_len == 0) ? -1 : 0;
+} /* -- ctl_serve -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_thread(..)
+ * Scope: Local
+ *
+ * Poll loop of the socket.  A client with something to send is polled
+ * for writing only, so its next command waits for it to read the answer.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_ctl_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct sr_ctl* ctl = sr->ctl;
+    struct pollfd fds[2 + CTL_MAX_CLIENTS];
+    int who[2 + CTL_MAX_CLIENTS];
+    int i, n;
+
+    while (1)
+    {
+        n = 0;
+        fds[n].fd = ctl->wake[0];
+        fds[n++].events = POLLIN;
+        fds[n].fd = ctl->fd;
+        fds[n++].events = POLLIN;
+        for (i = 0; i < CTL_MAX_CLIENTS; i++)
+        {
+            struct sr_ctl_client* c = &ctl->clients[i];
+
+            if (c->fd < 0)
+            { continue; }
+            /* -- command lines already read go without waiting for more -- */
+            while (!ctl_busy(c) && (c->eof || memchr(c->in, '\n', c->in_len)))
+            {
+                if (ctl_serve(sr, c) != 0)
+                {
+                    ctl_close(c);
+                    break;
+                }
+            }
+            if (c->fd < 0)
+            { continue; }
+            fds[n].fd = c->fd;
+            fds[n].events = ctl_busy(c) ? POLLOUT : (c->eof ? 0 : POLLIN);
+            who[n++] = i;
+        }
+
+        if (poll(fds, n, -1) < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("sr_ctl: poll");
+            break;
+        }
+        if (fds[0].revents)
+        { break; }
+        if (fds[1].revents & POLLIN)
+        { ctl_accept(ctl); }
+
+        for (i = 2; i < n; i++)
+        {
+            struct sr_ctl_client* c = &ctl->clients[who[i]];
+
+            if (fds[i].revents == 0)
+            { continue; }
+            if ((fds[i].revents & POLLIN) && ctl_read(c) != 0)
+            {
+                ctl_close(c);
+                continue;
+            }
+            if ((fds[i].revents & (POLLERR | POLLNVAL)) ||
+                ((fds[i].revents & POLLHUP) && !(fds[i].revents & POLLIN)) ||
+                ctl_serve(sr, c) != 0)
+            { ctl_close(c); }
+        }
+    }
+
+    return 0;
+} /* -- sr_ctl_thread -- */
+
+static void ctl_free(struct sr_ctl* ctl)
+{
+    int i;
+
+    for (i = 0; i < CTL_MAX_CLIENTS; i++)
+    {
+        if (ctl->clients[i].fd >= 0)
+        { ctl_close(&ctl->clients[i]); }
+    }
+    if (ctl->fd >= 0)
+    { close(ctl->fd); }
+    if (ctl->wake[0] >= 0)
+    {
+        close(ctl->wake[0]);
+        close(ctl->wake[1]);
+    }
+    if (ctl->path[0])
+    { unlink(ctl->path); }
+    free(ctl);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_start(..)
+ * Scope: Global
+ *
+ * Listen on a Unix domain socket at path and answer on it from a thread
+ * of its own until sr_ctl_stop().  A socket left at path by an earlier
+ * run is replaced, any other file is not.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_ctl_start(struct sr_instance* sr, const char* path)
+{
+    struct sr_ctl* ctl = 0;
+    struct sockaddr_un addr;
+    struct stat st;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(path);
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "sr_ctl: path too long %s\n", path);
+        return -1;
+    }
+    if ((ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl))) == 0)
+    { return -1; }
+    ctl->fd = -1;
+    ctl->wake[0] = ctl->wake[1] = -1;
+    for (i = 0; i < CTL_MAX_CLIENTS; i++)
+    { ctl->clients[i].fd = -1; }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    { unlink(path); }
+
+    if ((ctl->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(ctl->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror(path);
+        ctl_free(ctl);
+        return -1;
+    }
+    strcpy(ctl->path, path);
+
+    if (listen(ctl->fd, CTL_MAX_CLIENTS) < 0 || pipe(ctl->wake) < 0 ||
+        fcntl(ctl->fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        perror("sr_ctl");
+        ctl_free(ctl);
+        return -1;
+    }
+
+    sr->ctl = ctl;
+    if (pthread_create(&ctl->thread, 0, sr_ctl_thread, sr))
+    {
+        perror("pthread_create");
+        sr->ctl = 0;
+        ctl_free(ctl);
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_ctl_start -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_stop(..)
+ * Scope: Global
+ *
+ * Stop the thread, drop the clients and remove the socket.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ctl_stop(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+
+    if (ctl == 0)
+    { return; }
+
+    if (write(ctl->wake[1], "", 1) != 1)
+    { perror("sr_ctl: wake"); }
+    pthread_join(ctl->thread, 0);
+
+    sr->ctl = 0;
+    ctl_free(ctl);
+} /* -- sr_ctl_stop -- */
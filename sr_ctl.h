@@ -0,0 +1,99 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ * date:  Sun Oct 18 23:59:58 PDT 2026
+ *
+ * Description:
+ *
+ * Control socket of a running router (sr -c path): a Unix domain stream
+ * socket that answers one command per line, e.g.
+ *
+ *   echo fib | socat -t 5 - UNIX-CONNECT:/tmp/sr.ctl
+ *
+ *   fib [json]            forwarding table as published
+ *   arp [json]            arp cache
+ *   pending [json]        packets waiting for an arp reply
+ *   neighbors [json]      pwospf neighbors by interface
+ *   lsdb [json]           pwospf link state database
+ *   counters [json]       packet counters, by reason and interface
+ *   latency [json] [reset] latency percentiles, see sr_stats.h
+ *   log [spec]            module log levels, set as sr -L
+ *   help
+ *
+ * A line answer ends with a line starting "end" (or is one line starting
+ * "error"), a json answer is one object on one line.  Tables are written
+ * in chunks of CTL_CHUNK records, each read in a read section (the fib)
+ * or under its lock of its own and only once the client took what it
+ * had, so a big table or a slow client holds up neither forwarding nor
+ * the other clients.  A table that changes during a dump is reported in
+ * its last line.
+ *
+ * The socket has a thread of its own with a poll loop, the router has
+ * no event loop it could join: its main thread blocks on the server.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/un.h>
+
+#define CTL_MAX_CLIENTS 16
+#define CTL_LINE_MAX    256     /* bytes of a command line */
+#define CTL_CHUNK       64      /* records per chunk of a dump */
+
+struct sr_instance;
+
+enum sr_ctl_dump
+{
+    CTL_DUMP_NONE,
+    CTL_DUMP_FIB,
+    CTL_DUMP_ARP,
+    CTL_DUMP_PENDING,
+    CTL_DUMP_NEIGHBORS,
+    CTL_DUMP_LSDB
+};
+
+struct sr_ctl_client
+{
+    int fd;                     /* -1 for a free slot */
+    int eof;                    /* it sent all it will, close once answered */
+    char in[CTL_LINE_MAX];
+    unsigned int in_len;
+    char* out;                  /* answer not sent yet, from out_off */
+    size_t out_len;
+    size_t out_off;
+    size_t out_max;
+
+    /* -- table being dumped -- */
+    enum sr_ctl_dump dump;
+    int json;
+    unsigned long pos;          /* next record */
+    unsigned long sub;          /* and within it, neighbors only */
+    unsigned long count;        /* records written */
+    uint32_t generation;        /* of the fib or arp cache at the first chunk */
+    uint32_t generation_last;   /* and at the last */
+};
+
+struct sr_ctl
+{
+    int fd;
+    int wake[2];                /* self pipe, sr_ctl_stop() writes to it */
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    pthread_t thread;
+    struct sr_ctl_client clients[CTL_MAX_CLIENTS];
+};
+
+int  sr_ctl_start(struct sr_instance* sr, const char* path);
+void sr_ctl_stop(struct sr_instance* sr);
+
+#endif /* SR_CTL_H */
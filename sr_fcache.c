@@ -0,0 +1,194 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fcache.c
+ * date:  Sun Oct 18 22:14:51 PDT 2026
+ *
+ * Description:
+ *
+ * Flow cache in front of the forwarding table, see sr_fcache.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_fcache.h"
+#include "sr_fib.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+
+/* -- top bits of the product, the last octet of a network order address is on top -- */
+static uint32_t sr_fcache_slot(struct sr_fcache* fc, uint32_t addr)
+{
+    return (addr * 0x9e3779b1U) >> fc->shift;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fcache_init(..)
+ * Scope: Global
+ *
+ * Give sr a cache of 'slots' routes and adjacencies (rounded up to a
+ * power of 2).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_fcache_init(struct sr_instance* sr, unsigned int slots)
+{
+    struct sr_fcache* fc = 0;
+    unsigned int num = 2, bits = 1;
+    void* routes = 0;
+    void* adjs = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    while (num < slots)
+    {
+        num <<= 1;
+        bits++;
+    }
+
+    fc = (struct sr_fcache*)calloc(1, sizeof(struct sr_fcache));
+    if (fc == 0 ||
+        posix_memalign(&routes, FCACHE_LINE, num * sizeof(struct sr_fcache_route)) != 0 ||
+        posix_memalign(&adjs, FCACHE_LINE, num * sizeof(struct sr_fcache_adj)) != 0)
+    {
+        free(routes);
+        free(fc);
+        return -1;
+    }
+
+    memset(routes, 0, num * sizeof(struct sr_fcache_route));
+    memset(adjs, 0, num * sizeof(struct sr_fcache_adj));
+    fc->routes = (struct sr_fcache_route*)routes;
+    fc->adjs = (struct sr_fcache_adj*)adjs;
+    fc->shift = 32 - bits;
+    sr->fcache = fc;
+    return 0;
+} /* -- sr_fcache_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fcache_free(..)
+ * Scope: Global
+ *---------------------------------------------------------------------------*/
+
+void sr_fcache_free(struct sr_instance* sr)
+{
+    if (sr->fcache == 0)
+    { return; }
+
+    free(sr->fcache->routes);
+    free(sr->fcache->adjs);
+    free(sr->fcache);
+    sr->fcache = 0;
+} /* -- sr_fcache_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fcache_forward(..)
+ * Scope: Global
+ *
+ * Forward an ethernet frame by its cached decision.  The caller has made
+ * sure it is a valid transit ip packet with TTL to spare.  Returns 1 if
+ * it was sent, 0 if there is no cache or it missed.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_fcache_forward(struct sr_instance* sr, uint8_t* packet, unsigned int len)
+{
+    struct sr_fcache* fc = sr->fcache;
+    struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)packet;
+    struct ip* ip_hdr = (struct ip*)(packet + sizeof(struct sr_ethernet_hdr));
+    struct sr_fcache_route* route = 0;
+    struct sr_fcache_adj* adj = 0;
+    struct sr_if* iface = 0;
+    uint32_t gw = 0;
+
+    if (fc == 0)
+    { return 0; }
+
+    route = &fc->routes[sr_fcache_slot(fc, ip_hdr->ip_dst.s_addr)];
+    if (route->dst != ip_hdr->ip_dst.s_addr ||
+        route->fib_generation != __atomic_load_n(&sr->fib_generation, __ATOMIC_ACQUIRE))
+    {
+        fc->misses++;
+        return 0;
+    }
+
+    gw = route->gw[sr_fib_member(route->num_hops, (uint8_t*)ip_hdr,
+                                 len - sizeof(struct sr_ethernet_hdr))];
+    adj = &fc->adjs[sr_fcache_slot(fc, gw)];
+    if (gw == 0 || adj->gw != gw ||
+        adj->arp_generation != __atomic_load_n(&sr->arp_generation, __ATOMIC_ACQUIRE) ||
+        (iface = sr_get_interface_by_index(sr, adj->if_index)) == 0)
+    {
+        fc->misses++;
+        return 0;
+    }
+
+    dec_IPttl(ip_hdr);
+    memcpy(eth_hdr->ether_dhost, adj->dhost, ETHER_ADDR_LEN);
+    memcpy(eth_hdr->ether_shost, adj->shost, ETHER_ADDR_LEN);
+    fc->hits++;
+    sr_send_packet_if(sr, packet, len, iface);
+    return 1;
+} /* -- sr_fcache_forward -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fcache_insert(..)
+ * Scope: Global
+ *
+ * Remember the decision just taken for dst: member 'member' of its
+ * group of num_hops goes to gw, which is reached through interface
+ * if_index with the given ethernet addresses.  The generations are the
+ * ones read before the forwarding table and ARP cache were consulted,
+ * so a change racing with the lookup leaves an entry that is already
+ * stale rather than one that looks current.  A sparse cache (see
+ * sr_fcache.h) skips most inserts.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_fcache_insert(struct sr_instance* sr, uint32_t dst, uint32_t fib_generation,
+                      unsigned int num_hops, unsigned int member, uint32_t gw,
+                      uint32_t arp_generation, const uint8_t* dhost, const uint8_t* shost,
+                      unsigned int if_index)
+{
+    struct sr_fcache* fc = sr->fcache;
+    struct sr_fcache_route* route = 0;
+    struct sr_fcache_adj* adj = 0;
+
+    if (fc == 0 || dst == 0 || gw == 0 || num_hops > FCACHE_MAX_HOPS)
+    { return; }
+
+    /* -- judge the hit rate once a window, then thin out the inserts if it is low -- */
+    if (fc->misses - fc->window_misses >= FCACHE_WINDOW)
+    {
+        uint64_t hits = fc->hits - fc->window_hits;
+        uint64_t lookups = hits + fc->misses - fc->window_misses;
+
+        fc->sparse = (hits << FCACHE_MIN_HIT_SHIFT) < lookups;
+        fc->window_hits = fc->hits;
+        fc->window_misses = fc->misses;
+    }
+    if (fc->sparse && fc->misses % FCACHE_SPARSE_EVERY != 0)
+    { return; }
+
+    route = &fc->routes[sr_fcache_slot(fc, dst)];
+    if (route->dst != dst || route->fib_generation != fib_generation ||
+        route->num_hops != num_hops)
+    {
+        memset(route, 0, sizeof(struct sr_fcache_route));
+        route->dst = dst;
+        route->fib_generation = fib_generation;
+        route->num_hops = num_hops;
+    }
+    route->gw[member] = gw;
+
+    adj = &fc->adjs[sr_fcache_slot(fc, gw)];
+    adj->gw = gw;
+    adj->arp_generation = arp_generation;
+    memcpy(adj->dhost, dhost, ETHER_ADDR_LEN);
+    memcpy(adj->shost, shost, ETHER_ADDR_LEN);
+    adj->if_index = if_index;
+    fc->inserts++;
+} /* -- sr_fcache_insert -- */
@@ -0,0 +1,95 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fcache.h
+ * date:  Sun Oct 18 22:14:51 PDT 2026
+ *
+ * Description:
+ *
+ * Optional flow cache in front of the forwarding table.  Two small direct
+ * mapped tables, one cache line per slot, hold the forwarding decisions
+ * of recent packets: the route table, keyed by destination address, has
+ * the next hop address of every member of the route's next hop group
+ * seen so far, and the adjacency table, keyed by next hop address, has
+ * the interface index and ethernet addresses to send with.  A packet to a
+ * cached destination has its group member picked by the same flow hash
+ * as sr_fib_select(), its TTL decremented (checksum patched) and goes out
+ * without a look at the routing table or the ARP cache.
+ *
+ * Routes are stamped with the forwarding table generation and
+ * adjacencies with the ARP generation they were made under; publishing
+ * a new table or any change to the ARP cache bumps one of them and so
+ * drops every entry of that table at once.
+ *
+ * Traffic with little locality (many more destinations than slots)
+ * would have every miss evict an entry no packet comes back for.  Once
+ * fewer than 1 lookup in 2^FCACHE_MIN_HIT_SHIFT hits over a window of
+ * misses, only 1 miss in FCACHE_SPARSE_EVERY is inserted, so the cache
+ * costs little more than its miss check, and it is filled in full again
+ * once hot destinations that got in lift the hit rate.
+ *
+ * The cache belongs to the thread that calls sr_handlepacket(), it is
+ * the fast path's and is filled by it too.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FCACHE_H
+#define SR_FCACHE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_if.h"
+#include "sr_protocol.h"
+
+#define FCACHE_DEFAULT_SLOTS 256   /* routes, and as many adjacencies */
+#define FCACHE_LINE 64
+#define FCACHE_MAX_HOPS 13         /* members of a cached group, fills the line */
+#define FCACHE_WINDOW 1024         /* misses the hit rate is judged over */
+#define FCACHE_MIN_HIT_SHIFT 3     /* under 1 hit in 8 lookups the cache is sparse */
+#define FCACHE_SPARSE_EVERY 16     /* and a sparse cache takes 1 miss in 16 */
+
+struct sr_instance;
+
+struct sr_fcache_route
+{
+    uint32_t dst;                  /* network order, 0 for an empty slot */
+    uint32_t fib_generation;
+    uint32_t num_hops;
+    uint32_t gw[FCACHE_MAX_HOPS];  /* next hop of each member, 0 not seen yet */
+} __attribute__ ((aligned (FCACHE_LINE)));
+
+struct sr_fcache_adj
+{
+    uint32_t gw;                   /* network order, 0 for an empty slot */
+    uint32_t arp_generation;
+    uint8_t  dhost[ETHER_ADDR_LEN];
+    uint8_t  shost[ETHER_ADDR_LEN];
+    uint32_t if_index;
+} __attribute__ ((aligned (FCACHE_LINE)));
+
+struct sr_fcache
+{
+    struct sr_fcache_route* routes;
+    struct sr_fcache_adj* adjs;
+    uint32_t shift;                /* 32 - log2(slots) */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t window_hits;          /* hits and misses at the start of the window */
+    uint64_t window_misses;
+    int sparse;
+};
+
+int  sr_fcache_init(struct sr_instance* sr, unsigned int slots);
+void sr_fcache_free(struct sr_instance* sr);
+int  sr_fcache_forward(struct sr_instance* sr, uint8_t* packet, unsigned int len);
+void sr_fcache_insert(struct sr_instance* sr, uint32_t dst, uint32_t fib_generation,
+                      unsigned int num_hops, unsigned int member, uint32_t gw,
+                      uint32_t arp_generation, const uint8_t* dhost, const uint8_t* shost,
+                      unsigned int if_index);
+
+#endif /* SR_FCACHE_H */
@@ -0,0 +1,492 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ * date:  Sun Oct 18 21:02:37 PDT 2026
+ *
+ * Description:
+ *
+ * Published forwarding table snapshots, see sr_fib.h.
+ *
+ * Reclamation is epoch based.  A reader stores the current epoch in its
+ * slot before loading sr->fib and clears the slot when done.  Publishing
+ * swaps the pointer first and then advances the epoch, stamping the old
+ * snapshot with the new value: a reader holding an older epoch may still
+ * use it, a reader that saw the new epoch cannot.  The snapshot is freed
+ * once no slot holds an epoch older than its stamp.
+ *
+ * Publishing and reclaiming are for the control plane only, which is
+ * serialized by the caller (the pwospf lock, or running before any
+ * forwarding thread exists).
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+
+/* -- shared by every sr_instance of the process -- */
+static uint64_t fib_epoch = 1;
+static uint64_t fib_reader_epoch[FIB_MAX_READERS];  /* 0 outside a read section */
+static int fib_num_readers;
+static uint64_t fib_overflow_readers;   /* threads beyond FIB_MAX_READERS, now reading */
+static pthread_mutex_t fib_reader_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -- slot of the calling thread, -1 until its first read section -- */
+static __thread int fib_reader_tls = -1;
+static __thread int fib_reader_overflow;
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_index(..)
+ * Scope: Local
+ *
+ * Hash the prefixes of fib into its num_slots slots, for lookups by
+ * longest prefix.  The table is matched first entry first, not longest
+ * prefix first, so a slot holds the entry a packet matching it takes:
+ * the first in table order of its own entry and every shorter prefix
+ * covering it, since a packet matching a prefix matches those too.  A
+ * table with a mask that is not a run of leading ones keeps being
+ * scanned.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint32_t sr_fib_slot_hash(uint32_t dest, uint32_t mask)
+{
+    return (uint32_t)((((uint64_t)dest << 32 | mask) * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static struct sr_fib_slot* sr_fib_find_slot(struct sr_fib_slot* slots, unsigned int slot_mask,
+                                            uint32_t dest, uint32_t mask)
+{
+    unsigned int h = sr_fib_slot_hash(dest, mask) & slot_mask;
+
+    while (slots[h].dest != 0 && (slots[h].dest != dest || slots[h].mask != mask))
+    { h = (h + 1) & slot_mask; }
+    return &slots[h];
+}
+
+static void sr_fib_index(struct sr_fib* fib, struct sr_fib_slot* slots, unsigned int num_slots)
+{
+    unsigned int slot_mask = num_slots - 1;
+    uint32_t masks[33];
+    int has_len[33];
+    int len, shorter;
+    unsigned int i, j;
+
+    memset(has_len, 0, sizeof(has_len));
+    for (len = 0; len <= 32; len++)
+    { masks[len] = len ? htonl(0xffffffffU << (32 - len)) : 0; }
+
+    for (i = 0; i < fib->num_entries; i++)
+    {
+        uint32_t inverse = ~ntohl(fib->entries[i].mask.s_addr);
+        if (inverse & (inverse + 1))
+        { return; }
+    }
+
+    memset(slots, 0, num_slots * sizeof(struct sr_fib_slot));
+    for (i = 0; i < fib->num_entries; i++)
+    {
+        const struct sr_fib_entry* entry = &fib->entries[i];
+        struct sr_fib_slot* slot = 0;
+
+        /* -- the default route is taken apart, a dest outside its mask never matches -- */
+        if (entry->dest.s_addr == 0 || (entry->dest.s_addr & ~entry->mask.s_addr) != 0)
+        { continue; }
+
+        /* -- a repeated prefix is shadowed by its first entry -- */
+        slot = sr_fib_find_slot(slots, slot_mask, entry->dest.s_addr, entry->mask.s_addr);
+        if (slot->dest != 0)
+        { continue; }
+
+        slot->dest = entry->dest.s_addr;
+        slot->mask = entry->mask.s_addr;
+        slot->entry = i;
+        has_len[__builtin_popcount(entry->mask.s_addr)] = 1;
+    }
+
+    /* -- shortest first, so the covering slots already hold their answer -- */
+    for (len = 1; len <= 32; len++)
+    {
+        if (!has_len[len])
+        { continue; }
+
+        for (j = 0; j < num_slots; j++)
+        {
+            struct sr_fib_slot* slot = &slots[j];
+            if (slot->dest == 0 || slot->mask != masks[len])
+            { continue; }
+
+            for (shorter = len - 1; shorter > 0; shorter--)
+            {
+                struct sr_fib_slot* cover = 0;
+                if (!has_len[shorter])
+                { continue; }
+
+                cover = sr_fib_find_slot(slots, slot_mask, slot->dest & masks[shorter],
+                                         masks[shorter]);
+                if (cover->dest != 0)
+                {
+                    if (cover->entry < slot->entry)
+                    { slot->entry = cover->entry; }
+                    break;
+                }
+            }
+        }
+    }
+
+    for (len = 32; len > 0; len--)
+    {
+        if (has_len[len])
+        { fib->masks[fib->num_masks++] = masks[len]; }
+    }
+    fib->slot_mask = slot_mask;
+    fib->slots = slots;
+} /* -- sr_fib_index -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope: Local
+ *
+ * Snapshot of the routing table list, consecutive routes to the same
+ * prefix with the same admin distance folded into one entry.  Interface
+ * names are resolved to indices here, once per table rather than once
+ * per packet.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_fib_same_prefix(struct sr_rt* a, struct sr_rt* b)
+{
+    return a->dest.s_addr == b->dest.s_addr && a->mask.s_addr == b->mask.s_addr &&
+           a->admin_dst == b->admin_dst;
+}
+
+static struct sr_fib* sr_fib_build(struct sr_instance* sr)
+{
+    struct sr_rt* rt = sr->routing_table;
+    struct sr_rt* rt_walker = 0;
+    struct sr_rt* prev = 0;
+    struct sr_fib* fib = 0;
+    struct sr_fib_nexthop* hops = 0;
+    unsigned int num = 0, num_hops = 0, num_slots = 0;
+
+    for (rt_walker = rt; rt_walker; prev = rt_walker, rt_walker = rt_walker->next)
+    {
+        num_hops++;
+        if (prev == 0 || !sr_fib_same_prefix(prev, rt_walker))
+        { num++; }
+    }
+
+    /* -- at most half full, so a probe ends at a free slot soon -- */
+    if (num > FIB_SCAN_MAX)
+    {
+        num_slots = 1;
+        while (num_slots < 2 * num)
+        { num_slots <<= 1; }
+    }
+
+    fib = (struct sr_fib*)malloc(sizeof(struct sr_fib) + num * sizeof(struct sr_fib_entry) +
+                                 num_hops * sizeof(struct sr_fib_nexthop) +
+                                 num_slots * sizeof(struct sr_fib_slot));
+    assert(fib);
+    fib->generation = 0;
+    fib->num_entries = num;
+    fib->default_route = num;
+    fib->num_masks = 0;
+    fib->slot_mask = 0;
+    fib->slots = 0;
+    fib->retired = 0;
+    fib->next_retired = 0;
+    hops = (struct sr_fib_nexthop*)&fib->entries[num];
+
+    num = 0;
+    num_hops = 0;
+    for (rt_walker = rt, prev = 0; rt_walker; prev = rt_walker, rt_walker = rt_walker->next)
+    {
+        struct sr_fib_entry* entry = 0;
+        struct sr_fib_nexthop* hop = &hops[num_hops++];
+
+        if (prev == 0 || !sr_fib_same_prefix(prev, rt_walker))
+        {
+            entry = &fib->entries[num];
+            entry->dest = rt_walker->dest;
+            entry->mask = rt_walker->mask;
+            entry->admin_dst = rt_walker->admin_dst;
+            entry->num_hops = 0;
+            entry->hops = hop;
+
+            if (entry->dest.s_addr == 0 && fib->default_route == fib->num_entries)
+            { fib->default_route = num; }
+            num++;
+        }
+
+        fib->entries[num - 1].num_hops++;
+        hop->gw = rt_walker->gw;
+        hop->if_index = sr_get_interface_index(sr, rt_walker->interface);
+    }
+
+    if (num_slots)
+    { sr_fib_index(fib, (struct sr_fib_slot*)&hops[num_hops], num_slots); }
+
+    return fib;
+} /* -- sr_fib_build -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_publish(..)
+ * Scope: Global
+ *
+ * Replace the published snapshot by one of sr->routing_table as it is
+ * now.  Readers see either the old table or the new one, never a mix.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_fib_publish(struct sr_instance* sr)
+{
+    struct sr_fib* fib = sr_fib_build(sr);
+    struct sr_fib* old = 0;
+
+    fib->generation = sr->fib ? sr->fib->generation + 1 : 1;
+    old = __atomic_exchange_n(&sr->fib, fib, __ATOMIC_SEQ_CST);
+
+    /* -- after the swap, so a decision cached under the old number is stale -- */
+    __atomic_store_n(&sr->fib_generation, fib->generation, __ATOMIC_RELEASE);
+
+    if (old)
+    {
+        old->retired = __atomic_add_fetch(&fib_epoch, 1, __ATOMIC_SEQ_CST);
+        old->next_retired = sr->fib_retired;
+        sr->fib_retired = old;
+    }
+
+    sr_fib_reclaim(sr);
+} /* -- sr_fib_publish -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_reclaim(..)
+ * Scope: Global
+ *
+ * Free the replaced snapshots no reader can hold any more.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_fib_reclaim(struct sr_instance* sr)
+{
+    struct sr_fib** link = &sr->fib_retired;
+    uint64_t oldest = UINT64_MAX;
+    int num_readers = __atomic_load_n(&fib_num_readers, __ATOMIC_ACQUIRE);
+    int i;
+
+    if (sr->fib_retired == 0)
+    { return; }
+
+    /* -- can't tell which snapshot an overflow reader holds -- */
+    if (__atomic_load_n(&fib_overflow_readers, __ATOMIC_SEQ_CST) != 0)
+    { return; }
+
+    for (i = 0; i < num_readers; i++)
+    {
+        uint64_t epoch = __atomic_load_n(&fib_reader_epoch[i], __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest)
+        { oldest = epoch; }
+    }
+
+    while (*link)
+    {
+        struct sr_fib* fib = *link;
+        if (fib->retired <= oldest)
+        {
+            *link = fib->next_retired;
+            free(fib);
+        }
+        else
+        { link = &fib->next_retired; }
+    }
+} /* -- sr_fib_reclaim -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_free(..)
+ * Scope: Global
+ *
+ * Free every snapshot, no reader may be left.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_fib_free(struct sr_instance* sr)
+{
+    while (sr->fib_retired)
+    {
+        struct sr_fib* fib = sr->fib_retired;
+        sr->fib_retired = fib->next_retired;
+        free(fib);
+    }
+    free(sr->fib);
+    sr->fib = 0;
+} /* -- sr_fib_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_read_lock(..)
+ * Scope: Global
+ *
+ * Enter a read section and return the published snapshot (0 if none),
+ * valid until sr_fib_read_unlock().  Read sections do not nest.
+ *
+ *---------------------------------------------------------------------------*/
+
+const struct sr_fib* sr_fib_read_lock(struct sr_instance* sr)
+{
+    if (fib_reader_tls < 0 && !fib_reader_overflow)
+    {
+        pthread_mutex_lock(&fib_reader_lock);
+        if (fib_num_readers < FIB_MAX_READERS)
+        {
+            fib_reader_tls = fib_num_readers;
+            __atomic_store_n(&fib_num_readers, fib_num_readers + 1, __ATOMIC_RELEASE);
+        }
+        else
+        { fib_reader_overflow = 1; }
+        pthread_mutex_unlock(&fib_reader_lock);
+    }
+
+    if (fib_reader_tls >= 0)
+    {
+        __atomic_store_n(&fib_reader_epoch[fib_reader_tls],
+                         __atomic_load_n(&fib_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    }
+    else
+    { __atomic_add_fetch(&fib_overflow_readers, 1, __ATOMIC_SEQ_CST); }
+
+    return __atomic_load_n(&sr->fib, __ATOMIC_SEQ_CST);
+} /* -- sr_fib_read_lock -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_read_unlock(..)
+ * Scope: Global
+ *---------------------------------------------------------------------------*/
+
+void sr_fib_read_unlock(void)
+{
+    if (fib_reader_tls >= 0)
+    { __atomic_store_n(&fib_reader_epoch[fib_reader_tls], 0, __ATOMIC_RELEASE); }
+    else
+    { __atomic_sub_fetch(&fib_overflow_readers, 1, __ATOMIC_RELEASE); }
+} /* -- sr_fib_read_unlock -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ * Scope: Global
+ *
+ * Same rule the routing table list always had: the first entry in table
+ * order that matches dst, else the default route, else 0.  A hashed
+ * table is probed longest prefix first and the first slot found holds
+ * the answer (see sr_fib_index), a small one is scanned.
+ *
+ *---------------------------------------------------------------------------*/
+
+const struct sr_fib_entry* sr_fib_lookup(const struct sr_fib* fib, struct in_addr dst)
+{
+    unsigned int i;
+
+    if (fib == 0)
+    { return 0; }
+
+    if (fib->slots)
+    {
+        for (i = 0; i < fib->num_masks; i++)
+        {
+            uint32_t mask = fib->masks[i];
+            uint32_t dest = dst.s_addr & mask;
+            unsigned int h = sr_fib_slot_hash(dest, mask) & fib->slot_mask;
+            const struct sr_fib_slot* slot = &fib->slots[h];
+
+            if (dest == 0)
+            { continue; }
+
+            while (slot->dest != 0)
+            {
+                if (slot->dest == dest && slot->mask == mask)
+                { return &fib->entries[slot->entry]; }
+                h = (h + 1) & fib->slot_mask;
+                slot = &fib->slots[h];
+            }
+        }
+    }
+    else
+    {
+        for (i = 0; i < fib->num_entries; i++)
+        {
+            const struct sr_fib_entry* entry = &fib->entries[i];
+            if (entry->dest.s_addr != 0 && (dst.s_addr & entry->mask.s_addr) == entry->dest.s_addr)
+            { return entry; }
+        }
+    }
+
+    if (fib->default_route < fib->num_entries)
+    { return &fib->entries[fib->default_route]; }
+    return 0;
+} /* -- sr_fib_lookup -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_flow_hash(..)
+ * Scope: Global
+ *
+ * Hash of the addresses, protocol and, for tcp and udp, ports of the ip
+ * packet (starting at its header).  Fragments leave the ports out, so
+ * all pieces of a datagram hash alike.
+ *
+ *---------------------------------------------------------------------------*/
+
+uint32_t sr_fib_flow_hash(const uint8_t* ip_packet, unsigned int len)
+{
+    const struct ip* ip_hdr = (const struct ip*)ip_packet;
+    unsigned int hdr_len = ip_hdr->ip_hl * 4;
+    uint32_t ports = 0;
+    uint64_t h = 0;
+
+    if ((ip_hdr->ip_p == IPPROTO_TCP || ip_hdr->ip_p == IPPROTO_UDP) &&
+        (ntohs(ip_hdr->ip_off) & (IP_MF | IP_OFFMASK)) == 0 && len >= hdr_len + 4)
+    { memcpy(&ports, ip_packet + hdr_len, 4); }
+
+    /* -- murmur3 finalizer over the tuple folded into 64 bits -- */
+    h = ((uint64_t)ip_hdr->ip_src.s_addr << 32 | ip_hdr->ip_dst.s_addr) ^
+        (((uint64_t)ports << 8 | ip_hdr->ip_p) * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (uint32_t)h;
+} /* -- sr_fib_flow_hash -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_member(..)
+ * Scope: Global
+ *
+ * Index of the next hop the ip packet takes in a group of num_hops.
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_fib_member(unsigned int num_hops, const uint8_t* ip_packet, unsigned int len)
+{
+    if (num_hops == 1)
+    { return 0; }
+    return ((uint64_t)sr_fib_flow_hash(ip_packet, len) * num_hops) >> 32;
+} /* -- sr_fib_member -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_fib_select(..)
+ * Scope: Global
+ *
+ * Next hop of entry for the ip packet.
+ *
+ *---------------------------------------------------------------------------*/
+
+const struct sr_fib_nexthop* sr_fib_select(const struct sr_fib_entry* entry,
+                                           const uint8_t* ip_packet, unsigned int len)
+{
+    return &entry->hops[sr_fib_member(entry->num_hops, ip_packet, len)];
+} /* -- sr_fib_select -- */
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ * date:  Sun Oct 18 21:02:37 PDT 2026
+ *
+ * Description:
+ *
+ * Forwarding table seen by the packet path.  The control plane keeps
+ * editing sr->routing_table (static routes from sr_load_rt, pwospf routes
+ * from run_spf) and, once a batch of edits is done, publishes an
+ * immutable snapshot of it with one atomic pointer swap.  Forwarding
+ * threads read the current snapshot inside a read section and never
+ * take a lock; a replaced snapshot is freed once every read section
+ * that could still see it has ended.
+ *
+ * Routes to the same prefix that follow each other in the routing table
+ * make one entry with a group of next hops.  A packet takes the member
+ * picked by a hash of its addresses, protocol and ports, so the packets
+ * of a flow stay on one path and in order while flows spread over all.
+ *
+ * A packet takes the first entry in table order that matches it.  Past
+ * FIB_SCAN_MAX entries the snapshot carries a hash of its prefixes,
+ * probed longest first, so a lookup costs one probe per prefix length
+ * in the table rather than one compare per route.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <netinet/in.h>
+
+#include "sr_if.h"
+
+#define FIB_MAX_READERS 64   /* forwarding threads with their own read slot */
+#define FIB_SCAN_MAX    8    /* tables up to this size are scanned, not hashed */
+
+struct sr_instance;
+struct sr_rt;
+
+struct sr_fib_nexthop
+{
+    struct in_addr gw;
+    unsigned int if_index;   /* SR_IFACE_NONE if the router has no such interface */
+};
+
+struct sr_fib_entry
+{
+    struct in_addr dest;
+    struct in_addr mask;
+    uint8_t admin_dst;
+    unsigned int num_hops;             /* at least one */
+    const struct sr_fib_nexthop* hops; /* in routing table order */
+};
+
+struct sr_fib_slot
+{
+    uint32_t dest;           /* 0 for a free slot */
+    uint32_t mask;
+    unsigned int entry;      /* index of the entry a packet matching it takes */
+};
+
+struct sr_fib
+{
+    uint32_t generation;         /* 1 for the first snapshot, +1 per publish */
+    unsigned int num_entries;
+    unsigned int default_route;  /* index of the 0.0.0.0 entry, num_entries if none */
+    unsigned int num_masks;      /* 0 if the table is scanned */
+    uint32_t masks[32];          /* of the prefixes in slots, longest first */
+    unsigned int slot_mask;      /* slots - 1, a power of 2 less one */
+    const struct sr_fib_slot* slots;
+    uint64_t retired;            /* reader epoch it was replaced at */
+    struct sr_fib* next_retired;
+    struct sr_fib_entry entries[];  /* in routing table order, the next hops
+                                       and then the slots follow */
+};
+
+void sr_fib_publish(struct sr_instance* sr);
+void sr_fib_reclaim(struct sr_instance* sr);
+void sr_fib_free(struct sr_instance* sr);
+
+const struct sr_fib* sr_fib_read_lock(struct sr_instance* sr);
+void sr_fib_read_unlock(void);
+const struct sr_fib_entry* sr_fib_lookup(const struct sr_fib* fib, struct in_addr dst);
+uint32_t sr_fib_flow_hash(const uint8_t* ip_packet, unsigned int len);
+unsigned int sr_fib_member(unsigned int num_hops, const uint8_t* ip_packet, unsigned int len);
+const struct sr_fib_nexthop* sr_fib_select(const struct sr_fib_entry* entry,
+                                           const uint8_t* ip_packet, unsigned int len);
+
+#endif /* SR_FIB_H */
@@ -24,6 +24,77 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "pwospf_protocol.h"
+
+/* -- top bits of the product, the last octet of a network order address is on top -- */
+static uint32_t sr_local_slot(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    return (ip_nbo * 0x9e3779b1U) >> (32 - sr->local_bits);
+}
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_build_local_addrs(..)
+ * Scope: Local
+ *
+ * Rebuild the set of addresses that are delivered to the router itself:
+ * the address of every interface and AllSPFRouters.  Open addressing,
+ * at most a quarter full so a lookup rarely probes twice.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_build_local_addrs(struct sr_instance* sr)
+{
+    struct sr_if* if_walker = 0;
+    uint32_t mask = 0, i;
+
+    sr->local_bits = 2;
+    while((1U << sr->local_bits) < 4 * (sr->num_ifaces + 1))
+    { sr->local_bits++; }
+    mask = (1U << sr->local_bits) - 1;
+
+    free(sr->local_addrs);
+    sr->local_addrs = (uint32_t*)calloc(mask + 1, sizeof(uint32_t));
+    assert(sr->local_addrs);
+
+    for(if_walker = sr->if_list; ; if_walker = if_walker->next)
+    {
+        uint32_t ip = if_walker ? if_walker->ip : htonl(OSPF_AllSPFRouters);
+
+        if(ip != 0)
+        {
+            for(i = sr_local_slot(sr, ip); sr->local_addrs[i] && sr->local_addrs[i] != ip;
+                i = (i + 1) & mask);
+            sr->local_addrs[i] = ip;
+        }
+        if(if_walker == 0)
+        { break; }
+    }
+} /* -- sr_build_local_addrs -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_is_local_addr
+ * Scope: Global
+ *
+ * Is ip_nbo one of the router's own addresses or AllSPFRouters?
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_is_local_addr(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    uint32_t mask, i;
+
+    if(sr->local_addrs == 0 || ip_nbo == 0)
+    { return 0; }
+
+    mask = (1U << sr->local_bits) - 1;
+    for(i = sr_local_slot(sr, ip_nbo); sr->local_addrs[i]; i = (i + 1) & mask)
+    {
+        if(sr->local_addrs[i] == ip_nbo)
+        { return 1; }
+    }
+
+    return 0;
+} /* -- sr_is_local_addr -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
@@ -54,11 +125,47 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given an interface index return the interface record or 0 if there is
+ * no such interface.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int index)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(index >= sr->num_ifaces)
+    { return 0; }
+
+    return sr->if_table[index];
+} /* -- sr_get_interface_by_index -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_index
+ * Scope: Global
+ *
+ * Given an interface name return its index or SR_IFACE_NONE if it
+ * doesn't exist.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_get_interface_index(struct sr_instance* sr, const char* name)
+{
+    struct sr_if* iface = sr_get_interface(sr, name);
+
+    return iface ? iface->index : SR_IFACE_NONE;
+} /* -- sr_get_interface_index -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list, it takes the next index
  *
  *---------------------------------------------------------------------*/
 
@@ -70,12 +177,19 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     assert(name);
     assert(sr);
 
+    sr->if_table = (struct sr_if**)realloc(sr->if_table,
+            (sr->num_ifaces + 1) * sizeof(struct sr_if*));
+    assert(sr->if_table);
+
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
         sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
+        memset(sr->if_list, 0, sizeof(struct sr_if));
         sr->if_list->next = 0;
         strncpy(sr->if_list->name,name,SR_IFACE_NAMELEN);
+        sr->if_list->index = sr->num_ifaces;
+        sr->if_table[sr->num_ifaces++] = sr->if_list;
         return;
     }
 
@@ -86,7 +200,10 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
 
     if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
     if_walker = if_walker->next;
+    memset(if_walker, 0, sizeof(struct sr_if));
     strncpy(if_walker->name,name,SR_IFACE_NAMELEN);
+    if_walker->index = sr->num_ifaces;
+    sr->if_table[sr->num_ifaces++] = if_walker;
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
@@ -143,7 +260,8 @@ void sr_set_ether_mask(struct sr_instance* sr, uint32_t mask_nbo)
  * Method: sr_set_ether_ip(..)
  * Scope: Global
  *
- * set the IP address of the LAST interface in the interface list
+ * set the IP address of the LAST interface in the interface list, and
+ * with it the set of local addresses
  *
  *---------------------------------------------------------------------*/
 
@@ -160,6 +278,7 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
+    sr_build_local_addrs(sr);
 
 } /* -- sr_set_ether_ip -- */
 
@@ -204,6 +323,7 @@ void sr_print_if(struct sr_if* iface)
 {
     struct in_addr ip_addr;
     struct in_addr mask_addr;
+    uint32_t i;
 
     /* -- REQUIRES --*/
     assert(iface);
@@ -212,10 +332,31 @@ void sr_print_if(struct sr_if* iface)
     ip_addr.s_addr = iface->ip;
     mask_addr.s_addr = iface->mask;
 
-    Debug("Interface: %s\n",iface->name);
+    Debug("Interface: %s (%u)\n",iface->name,iface->index);
     Debug("  hardware address ");
     DebugMAC(iface->addr);
     Debug("\n");
     Debug("  mask %s\n",inet_ntoa(mask_addr));
     Debug("  ip address %s\n",inet_ntoa(ip_addr));
+    Debug("  neighbors %u\n", iface->neighbors.num);
+    for (i = 0; i < nbr_slots(&iface->neighbors); i++)
+    {
+        struct pwospf_neighbor* neighbor = &iface->neighbors.slots[i];
+        if (neighbor->router_id == 0)
+        { continue; }
+        ip_addr.s_addr = neighbor->router_id;
+        Debug("    %s echo %s replies %u cpu %llu ns\n", inet_ntoa(ip_addr),
+              neighbor->echo_up ? "up" : "off", neighbor->echo_replies,
+              (unsigned long long)neighbor->echo_cpu_ns);
+    }
+    if (iface->echo_lost_at)
+    {
+        ip_addr.s_addr = iface->echo_lost.router_id;
+        Debug("  lost %s to %u missed echoes, %llu ms after its last reply\n",
+              inet_ntoa(ip_addr), iface->echo_lost.echo_missed,
+              (unsigned long long)(iface->echo_lost_at - iface->echo_lost.echo_last));
+    }
+    Debug("  lsu received %u duplicate %u installed %u reflooded %u\n",
+          iface->lsu_received, iface->lsu_duplicate, iface->lsu_installed,
+          iface->lsu_reflooded);
 } /* -- sr_print_if -- */
@@ -24,7 +24,10 @@
 #include <inttypes.h>
 #endif
 
+#include "neighber.h"
+
 #define SR_IFACE_NAMELEN 32
+#define SR_IFACE_NONE    0xffffffffU  /* index of no interface */
 
 struct sr_instance;
 
@@ -38,14 +41,31 @@ struct sr_instance;
 struct sr_if
 {
     char name[SR_IFACE_NAMELEN];
+    unsigned int index;    /* dense, in the order VNSHWINFO listed the interfaces */
     unsigned char addr[6];
     uint32_t ip;
     uint32_t speed;
     volatile uint32_t mask;
+    struct pwospf_nbr_table neighbors;  /* pwospf routers heard on this link */
+    uint8_t* echo_frame;   /* echo request of this interface, built on first use */
+    uint32_t echo_seq;
+    struct pwospf_neighbor echo_lost;  /* last neighbor taken down by missed echoes */
+    uint64_t echo_lost_at; /* pwospf clock msec it was, 0 if never */
+    uint64_t hello_due;    /* pwospf clock msec the next hello goes out at, 0 for at once */
+    uint8_t* hello_frame;  /* hello of this interface, built once the router id is known */
+
+    /* -- pwospf LSU counters -- */
+    uint32_t lsu_received;   /* LSUs that arrived here */
+    uint32_t lsu_duplicate;  /* of those, dropped as not newer than the installed one */
+    uint32_t lsu_installed;  /* of those, installed in the database */
+    uint32_t lsu_reflooded;  /* LSUs of other routers forwarded out of here */
     struct sr_if* next;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int index);
+unsigned int sr_get_interface_index(struct sr_instance* sr, const char* name);
+int sr_is_local_addr(struct sr_instance* sr, uint32_t ip_nbo);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
@@ -0,0 +1,279 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ * date:  Sun Oct 18 23:58:40 PDT 2026
+ *
+ * Description:
+ *
+ * Module log levels and the per thread trace rings, see sr_log.h.
+ *
+ * Level specs for sr_log_set_levels(), comma separated:
+ *
+ *   debug                every module at debug
+ *   fwd=trace,arp=debug  the modules named
+ *   all=warn             same as warn
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_log.h"
+
+volatile uint8_t sr_log_levels[SR_LOG_MODULES] =
+    { SR_LOG_INFO, SR_LOG_INFO, SR_LOG_INFO, SR_LOG_INFO, SR_LOG_INFO };
+
+static const char* sr_log_module_names[] = SR_LOG_MODULE_NAMES;
+static const char* sr_log_level_names[] = SR_LOG_LEVEL_NAMES;
+
+struct sr_trace_ring
+{
+    struct sr_trace_record* records;
+    uint64_t head;               /* records written so far */
+    uint16_t thread;
+};
+
+static struct sr_trace_ring* trace_rings[SR_TRACE_MAX_RINGS];
+static int trace_num_rings;      /* published after the ring is set up */
+static uint64_t trace_overflow;  /* records of threads beyond SR_TRACE_MAX_RINGS */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;  /* to add a ring */
+
+/* -- ring of the calling thread -- */
+static __thread struct sr_trace_ring* trace_ring_tls;
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_printf(..)
+ * Scope: Global
+ *
+ * Print a message that passed its level check, errors and warnings to
+ * stderr, the rest to stdout.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_log_printf(int level, const char* fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(level <= SR_LOG_WARN ? stderr : stdout, fmt, ap);
+    va_end(ap);
+} /* -- sr_log_printf -- */
+
+static int sr_log_parse_level(const char* str, size_t len)
+{
+    int i;
+
+    for (i = 0; i <= SR_LOG_TRACE; i++)
+    {
+        if (strlen(sr_log_level_names[i]) == len && strncmp(str, sr_log_level_names[i], len) == 0)
+        { return i; }
+    }
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_set_levels(..)
+ * Scope: Global
+ *
+ * Set module levels from a spec (see top of file).  Levels above
+ * SR_LOG_LEVEL are accepted but print nothing.  Returns 0, or -1 and
+ * changes nothing if the spec does not parse.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_log_set_levels(const char* spec)
+{
+    uint8_t levels[SR_LOG_MODULES];
+    const char* term = spec;
+    int m;
+
+    memcpy(levels, (const uint8_t*)sr_log_levels, sizeof(levels));
+
+    while (*term)
+    {
+        const char* end = strchr(term, ',');
+        const char* eq = strchr(term, '=');
+        size_t len = end ? (size_t)(end - term) : strlen(term);
+        int level;
+
+        if (eq == 0 || eq >= term + len)
+        {
+            /* -- a bare level is for every module -- */
+            if ((level = sr_log_parse_level(term, len)) < 0)
+            { return -1; }
+            memset(levels, level, sizeof(levels));
+        }
+        else
+        {
+            size_t name_len = eq - term;
+
+            if ((level = sr_log_parse_level(eq + 1, term + len - eq - 1)) < 0)
+            { return -1; }
+
+            if (name_len == 3 && strncmp(term, "all", 3) == 0)
+            { memset(levels, level, sizeof(levels)); }
+            else
+            {
+                for (m = 0; m < SR_LOG_MODULES; m++)
+                {
+                    if (strlen(sr_log_module_names[m]) == name_len &&
+                        strncmp(term, sr_log_module_names[m], name_len) == 0)
+                    { break; }
+                }
+                if (m == SR_LOG_MODULES)
+                { return -1; }
+                levels[m] = level;
+            }
+        }
+
+        term += len;
+        if (*term == ',')
+        { term++; }
+    }
+
+    for (m = 0; m < SR_LOG_MODULES; m++)
+    { sr_log_levels[m] = levels[m]; }
+
+    return 0;
+} /* -- sr_log_set_levels -- */
+
+/*-----------------------------------------------------------------------------
+ * trace rings
+ *---------------------------------------------------------------------------*/
+
+static struct sr_trace_ring* sr_trace_get_ring(void)
+{
+    struct sr_trace_ring* ring = trace_ring_tls;
+
+    if (ring)
+    { return ring; }
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_num_rings < SR_TRACE_MAX_RINGS)
+    {
+        ring = (struct sr_trace_ring*)calloc(1, sizeof(struct sr_trace_ring));
+        if (ring)
+        { ring->records = (struct sr_trace_record*)
+                calloc(SR_TRACE_RING_RECORDS, sizeof(struct sr_trace_record)); }
+        if (ring && ring->records)
+        {
+            ring->thread = (uint16_t)trace_num_rings;
+            trace_rings[trace_num_rings] = ring;
+            __atomic_store_n(&trace_num_rings, trace_num_rings + 1, __ATOMIC_RELEASE);
+        }
+        else if (ring)
+        {
+            free(ring);
+            ring = 0;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    trace_ring_tls = ring;
+    return ring;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_trace_event(..)
+ * Scope: Global
+ *
+ * Append a record to the ring of the calling thread, overwriting its
+ * oldest once the ring is full.  Called through sr_trace().
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_trace_event(unsigned int event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    struct sr_trace_ring* ring = sr_trace_get_ring();
+    struct sr_trace_record* rec;
+    struct timespec ts;
+
+    if (ring == 0)
+    {
+        __atomic_add_fetch(&trace_overflow, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec = &ring->records[ring->head & (SR_TRACE_RING_RECORDS - 1)];
+    rec->ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->event = (uint16_t)event;
+    rec->thread = ring->thread;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+    rec->pad = 0;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+} /* -- sr_trace_event -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_trace_dump(..)
+ * Scope: Global
+ *
+ * Write what the rings hold to fname, ring by ring and oldest first.
+ * Meant for when the tracing threads are done; a thread still writing
+ * can leave a torn record at the old end of its ring.  Returns the
+ * number of records written or -1.
+ *
+ *---------------------------------------------------------------------------*/
+
+long sr_trace_dump(const char* fname)
+{
+    struct sr_trace_file_header hdr;
+    int num_rings = __atomic_load_n(&trace_num_rings, __ATOMIC_ACQUIRE);
+    uint64_t heads[SR_TRACE_MAX_RINGS];
+    FILE* fp = 0;
+    int i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SR_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.record_size = sizeof(struct sr_trace_record);
+    hdr.num_events = SR_TRACE_NUM_EVENTS;
+    hdr.lost = __atomic_load_n(&trace_overflow, __ATOMIC_RELAXED);
+
+    for (i = 0; i < num_rings; i++)
+    {
+        heads[i] = __atomic_load_n(&trace_rings[i]->head, __ATOMIC_ACQUIRE);
+        if (heads[i] > SR_TRACE_RING_RECORDS)
+        {
+            hdr.records += SR_TRACE_RING_RECORDS;
+            hdr.lost += heads[i] - SR_TRACE_RING_RECORDS;
+        }
+        else
+        { hdr.records += heads[i]; }
+    }
+
+    if ((fp = fopen(fname, "wb")) == 0)
+    {
+        perror(fname);
+        return -1;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for (i = 0; i < num_rings; i++)
+    {
+        uint64_t first = heads[i] > SR_TRACE_RING_RECORDS ? heads[i] - SR_TRACE_RING_RECORDS : 0;
+        uint64_t start = first & (SR_TRACE_RING_RECORDS - 1);
+        uint64_t count = heads[i] - first;
+        uint64_t contig = SR_TRACE_RING_RECORDS - start;
+
+        if (count <= contig)
+        { fwrite(&trace_rings[i]->records[start], sizeof(struct sr_trace_record), count, fp); }
+        else
+        {
+            fwrite(&trace_rings[i]->records[start], sizeof(struct sr_trace_record), contig, fp);
+            fwrite(trace_rings[i]->records, sizeof(struct sr_trace_record), count - contig, fp);
+        }
+    }
+
+    if (fclose(fp) != 0)
+    {
+        perror(fname);
+        return -1;
+    }
+    return (long)hdr.records;
+} /* -- sr_trace_dump -- */
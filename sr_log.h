@@ -0,0 +1,127 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ * date:  Sun Oct 18 23:58:40 PDT 2026
+ *
+ * Description:
+ *
+ * Logging by module and level.  sr_log() statements above SR_LOG_LEVEL
+ * are compiled out (make SR_LOG_LEVEL=n), the others test the runtime
+ * level of their module first, set with sr_log_set_levels() (sr -L).  The
+ * arguments are only evaluated for a message that is printed, so an
+ * inet_ntoa() in a debug message costs nothing while debug is off.
+ *
+ * Events on the packet path go through sr_trace() instead: a fixed size
+ * binary record into a ring of the calling thread, with no formatting
+ * and no lock.  A ring keeps the newest SR_TRACE_RING_RECORDS records.
+ * sr_trace_dump() writes every ring to a file (sr -X, at exit), which
+ * sr_tracedump formats offline with the event table below.
+ *
+ * This header is shared with sr_tracedump and needs nothing of the
+ * router.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_LOG_ERR   0
+#define SR_LOG_WARN  1
+#define SR_LOG_INFO  2   /* runtime default of every module */
+#define SR_LOG_DEBUG 3   /* per packet messages */
+#define SR_LOG_TRACE 4   /* per packet binary trace records */
+
+#ifndef SR_LOG_LEVEL
+#define SR_LOG_LEVEL SR_LOG_TRACE
+#endif
+
+#define SR_LOG_ARP     0
+#define SR_LOG_FWD     1
+#define SR_LOG_ICMP    2
+#define SR_LOG_OSPF    3
+#define SR_LOG_VNS     4
+#define SR_LOG_MODULES 5
+
+#define SR_LOG_MODULE_NAMES { "arp", "fwd", "icmp", "ospf", "vns" }
+#define SR_LOG_LEVEL_NAMES  { "err", "warn", "info", "debug", "trace" }
+
+/* -- module of the Debug() statements of a file, see sr_router.h -- */
+#ifndef SR_LOG_MODULE
+#define SR_LOG_MODULE SR_LOG_VNS
+#endif
+
+extern volatile uint8_t sr_log_levels[SR_LOG_MODULES];
+
+#define sr_log_enabled(mod, lvl) \
+    ((lvl) <= SR_LOG_LEVEL && (lvl) <= sr_log_levels[mod])
+
+#define sr_log(mod, lvl, fmt, args...) \
+    do { if (sr_log_enabled(mod, lvl)) sr_log_printf((lvl), fmt, ## args); } while (0)
+
+/* ----------------------------------------------------------------------------
+ * Trace events: name, module, and how sr_tracedump prints the arguments,
+ * %I an ip address in network order, %u decimal, %x hex.
+ * -------------------------------------------------------------------------- */
+
+#define SR_TRACE_EVENTS(X) \
+    X(FWD_FAST,    SR_LOG_FWD,  "fast %I -> %I via %I if %u") \
+    X(FWD_CACHE,   SR_LOG_FWD,  "cached %I -> %I if %u len %u") \
+    X(FWD_PUNT,    SR_LOG_FWD,  "punt type %x %I -> %I if %u") \
+    X(FWD_DROP,    SR_LOG_FWD,  "punt queue full, dropped type %x len %u") \
+    X(FWD_SLOW,    SR_LOG_FWD,  "slow %I -> %I via %I if %u") \
+    X(FWD_NOROUTE, SR_LOG_FWD,  "no route %I -> %I") \
+    X(ARP_WAIT,    SR_LOG_ARP,  "waiting for %I, %I -> %I") \
+    X(ARP_REPLY,   SR_LOG_ARP,  "reply %I if %u") \
+    X(ARP_REQUEST, SR_LOG_ARP,  "request for %I") \
+    X(ICMP_SEND,   SR_LOG_ICMP, "type %u code %u to %I if %u") \
+    X(OSPF_RECV,   SR_LOG_OSPF, "type %u from %I if %u len %u") \
+    X(VNS_RECV,    SR_LOG_VNS,  "frame in if %u len %u") \
+    X(VNS_SEND,    SR_LOG_VNS,  "frame out if %u len %u")
+
+#define SR_TRACE_ENUM(name, mod, fmt) SR_TRACE_##name,
+#define SR_TRACE_MOD(name, mod, fmt)  SR_TRACE_MOD_##name = mod,
+
+enum sr_trace_event { SR_TRACE_EVENTS(SR_TRACE_ENUM) SR_TRACE_NUM_EVENTS };
+enum sr_trace_module { SR_TRACE_EVENTS(SR_TRACE_MOD) SR_TRACE_MOD_NONE };
+
+#define SR_TRACE_ARGS         4
+#define SR_TRACE_RING_RECORDS (1 << 16)  /* per thread, power of 2 */
+#define SR_TRACE_MAX_RINGS    16         /* threads that trace */
+#define SR_TRACE_MAGIC        "SRTRACE1"
+
+struct sr_trace_record
+{
+    uint64_t ns;                 /* CLOCK_MONOTONIC */
+    uint16_t event;
+    uint16_t thread;             /* ring it was written to */
+    uint32_t arg[SR_TRACE_ARGS];
+    uint32_t pad;
+};
+
+struct sr_trace_file_header
+{
+    char     magic[8];
+    uint32_t record_size;
+    uint32_t num_events;         /* of the table it was written with */
+    uint64_t records;
+    uint64_t lost;               /* overwritten before the dump, all rings */
+};
+
+#define sr_trace(ev, a0, a1, a2, a3) \
+    do { if (sr_log_enabled(SR_TRACE_MOD_##ev, SR_LOG_TRACE)) \
+        sr_trace_event(SR_TRACE_##ev, (a0), (a1), (a2), (a3)); } while (0)
+
+void sr_log_printf(int level, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+int  sr_log_set_levels(const char* spec);
+void sr_trace_event(unsigned int event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+long sr_trace_dump(const char* fname);
+
+#endif /* SR_LOG_H */
@@ -0,0 +1,355 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_lsdb.c
+ * date:  Sun Oct 18 21:40:05 PDT 2026
+ *
+ * Description:
+ *
+ * PWOSPF link state database, see sr_lsdb.h.  Callers hold the pwospf
+ * subsystem lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "sr_lsdb.h"
+
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define LSDB_MIN_HASH_BITS 6
+
+static uint32_t lsdb_bucket(struct pwospf_lsdb* lsdb, uint32_t rid)
+{
+	return (rid * 0x9e3779b1U) >> (32 - lsdb->hash_bits);
+}
+
+static uint32_t lsdb_seq_slot(struct pwospf_lsdb* lsdb, uint32_t rid)
+{
+	return (rid * 0x9e3779b1U) >> (32 - lsdb->seq_bits);
+}
+
+// Slot of rid in the sequence table, or the free slot it would go to
+static uint32_t lsdb_seq_find(struct pwospf_lsdb* lsdb, uint32_t rid)
+{
+	uint32_t mask = (1U << lsdb->seq_bits) - 1;
+	uint32_t slot = lsdb_seq_slot(lsdb, rid);
+
+	while (lsdb->seqs[slot].router_id != 0 && lsdb->seqs[slot].router_id != rid)
+	{
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_init(struct pwospf_lsdb* lsdb)
+ *---------------------------------------------------------------------*/
+void lsdb_init(struct pwospf_lsdb* lsdb)
+{
+	memset(lsdb, 0, sizeof(struct pwospf_lsdb));
+	lsdb->hash_bits = LSDB_MIN_HASH_BITS;
+	lsdb->buckets = (struct lsdb_router**)calloc(1U << lsdb->hash_bits, sizeof(struct lsdb_router*));
+	lsdb->seq_bits = LSDB_MIN_HASH_BITS + 1;
+	lsdb->seqs = (struct lsdb_seq*)calloc(1U << lsdb->seq_bits, sizeof(struct lsdb_seq));
+	assert(lsdb->buckets && lsdb->seqs);
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_free(struct pwospf_lsdb* lsdb)
+ *---------------------------------------------------------------------*/
+void lsdb_free(struct pwospf_lsdb* lsdb)
+{
+	for (uint32_t i = 0; i < lsdb->num_routers; i++)
+	{
+		free(lsdb->routers[i]->links);
+		free(lsdb->routers[i]);
+	}
+	while (lsdb->partials != NULL)
+	{
+		struct lsdb_partial* partial = lsdb->partials;
+		lsdb->partials = partial->next;
+		free(partial->links);
+		free(partial);
+	}
+	free(lsdb->routers);
+	free(lsdb->buckets);
+	free(lsdb->seqs);
+	memset(lsdb, 0, sizeof(struct pwospf_lsdb));
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_rehash(struct pwospf_lsdb* lsdb, uint32_t bits)
+ *---------------------------------------------------------------------*/
+static void lsdb_rehash(struct pwospf_lsdb* lsdb, uint32_t bits)
+{
+	free(lsdb->buckets);
+	lsdb->hash_bits = bits;
+	lsdb->buckets = (struct lsdb_router**)calloc(1U << bits, sizeof(struct lsdb_router*));
+	assert(lsdb->buckets);
+
+	for (uint32_t i = 0; i < lsdb->num_routers; i++)
+	{
+		struct lsdb_router* router = lsdb->routers[i];
+		uint32_t bucket = lsdb_bucket(lsdb, router->router_id.s_addr);
+		router->hash_next = lsdb->buckets[bucket];
+		lsdb->buckets[bucket] = router;
+	}
+
+	// The sequence table stays at most half full
+	free(lsdb->seqs);
+	lsdb->seq_bits = bits + 1;
+	lsdb->seqs = (struct lsdb_seq*)calloc(1U << lsdb->seq_bits, sizeof(struct lsdb_seq));
+	assert(lsdb->seqs);
+
+	for (uint32_t i = 0; i < lsdb->num_routers; i++)
+	{
+		struct lsdb_seq* seq = &lsdb->seqs[lsdb_seq_find(lsdb, lsdb->routers[i]->router_id.s_addr)];
+		seq->router_id = lsdb->routers[i]->router_id.s_addr;
+		seq->sequence_num = lsdb->routers[i]->sequence_num;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_find(struct pwospf_lsdb* lsdb, struct in_addr router_id)
+ * Record of router_id, NULL if we hold no LSU from it.
+ *---------------------------------------------------------------------*/
+struct lsdb_router* lsdb_find(struct pwospf_lsdb* lsdb, struct in_addr router_id)
+{
+	struct lsdb_router* router = lsdb->buckets[lsdb_bucket(lsdb, router_id.s_addr)];
+	while (router != NULL && router->router_id.s_addr != router_id.s_addr)
+	{
+		router = router->hash_next;
+	}
+	return router;
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_is_newer(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num)
+ * Return 1 if an LSU of router_id with this sequence number is newer
+ * than the one installed, or none is.
+ *---------------------------------------------------------------------*/
+int lsdb_is_newer(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num)
+{
+	struct lsdb_seq* seq = &lsdb->seqs[lsdb_seq_find(lsdb, router_id.s_addr)];
+	return seq->router_id == 0 || (int16_t)(sequence_num - seq->sequence_num) > 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_same_links(struct lsdb_router* router, struct ospfv2_lsu* adv, uint32_t num_adv)
+ * The advertisements are the ones installed, in any order.
+ *---------------------------------------------------------------------*/
+static bool lsdb_same_links(struct lsdb_router* router, struct ospfv2_lsu* adv, uint32_t num_adv)
+{
+	if (router->num_links != num_adv)
+	{
+		return false;
+	}
+	if (memcmp(router->links, adv, num_adv * sizeof(struct ospfv2_lsu)) == 0)
+	{
+		return true;
+	}
+
+	for (uint32_t i = 0; i < num_adv; i++)
+	{
+		uint32_t j = 0;
+		while (j < num_adv && (router->links[j].subnet != adv[i].subnet ||
+				router->links[j].mask != adv[i].mask || router->links[j].rid != adv[i].rid))
+		{
+			j++;
+		}
+		if (j == num_adv)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_install(struct pwospf_lsdb* lsdb, struct in_addr router_id,
+ * uint16_t sequence_num, struct ospfv2_lsu* adv, uint32_t num_adv, uint32_t now)
+ *
+ * Install the LSU of router_id.  Returns 1 if its advertisements changed
+ * (or the router is new), 0 if only the sequence number and age were
+ * refreshed.
+ *---------------------------------------------------------------------*/
+int lsdb_install(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num,
+		struct ospfv2_lsu* adv, uint32_t num_adv, uint32_t now)
+{
+	struct lsdb_router* router = lsdb_find(lsdb, router_id);
+	int changed = 1;
+
+	if (router == NULL)
+	{
+		router = (struct lsdb_router*)calloc(1, sizeof(struct lsdb_router));
+		assert(router);
+		router->router_id = router_id;
+
+		if (lsdb->num_routers == lsdb->max_routers)
+		{
+			lsdb->max_routers = lsdb->max_routers ? lsdb->max_routers * 2 : 64;
+			lsdb->routers = (struct lsdb_router**)realloc(lsdb->routers, lsdb->max_routers * sizeof(struct lsdb_router*));
+			assert(lsdb->routers);
+		}
+		router->index = lsdb->num_routers;
+		lsdb->routers[lsdb->num_routers++] = router;
+
+		if (lsdb->num_routers > (1U << lsdb->hash_bits))
+		{
+			lsdb_rehash(lsdb, lsdb->hash_bits + 1);
+		}
+		else
+		{
+			uint32_t bucket = lsdb_bucket(lsdb, router_id.s_addr);
+			router->hash_next = lsdb->buckets[bucket];
+			lsdb->buckets[bucket] = router;
+		}
+	}
+	else
+	{
+		changed = !lsdb_same_links(router, adv, num_adv);
+	}
+
+	if (changed)
+	{
+		if (num_adv > router->max_links)
+		{
+			router->max_links = num_adv;
+			router->links = (struct ospfv2_lsu*)realloc(router->links, num_adv * sizeof(struct ospfv2_lsu));
+			assert(router->links);
+		}
+		if (num_adv > 0)
+		{
+			memcpy(router->links, adv, num_adv * sizeof(struct ospfv2_lsu));
+		}
+		router->num_links = num_adv;
+	}
+
+	router->sequence_num = sequence_num;
+	router->time_stamp = now;
+
+	struct lsdb_seq* seq = &lsdb->seqs[lsdb_seq_find(lsdb, router_id.s_addr)];
+	seq->router_id = router_id.s_addr;
+	seq->sequence_num = sequence_num;
+	return changed;
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_remove(struct pwospf_lsdb* lsdb, struct lsdb_router* router)
+ * Drop the record of a router.  The last record takes its place in
+ * lsdb->routers, so walk that array backwards when removing.
+ *---------------------------------------------------------------------*/
+void lsdb_remove(struct pwospf_lsdb* lsdb, struct lsdb_router* router)
+{
+	struct lsdb_router** link = &lsdb->buckets[lsdb_bucket(lsdb, router->router_id.s_addr)];
+	while (*link != router)
+	{
+		link = &(*link)->hash_next;
+	}
+	*link = router->hash_next;
+
+	// Backward shift deletion, so no probe sequence is cut short
+	uint32_t mask = (1U << lsdb->seq_bits) - 1;
+	uint32_t hole = lsdb_seq_find(lsdb, router->router_id.s_addr);
+	uint32_t slot = hole;
+	lsdb->seqs[hole].router_id = 0;
+	while (1)
+	{
+		slot = (slot + 1) & mask;
+		if (lsdb->seqs[slot].router_id == 0)
+		{
+			break;
+		}
+		uint32_t home = lsdb_seq_slot(lsdb, lsdb->seqs[slot].router_id);
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			lsdb->seqs[hole] = lsdb->seqs[slot];
+			lsdb->seqs[slot].router_id = 0;
+			hole = slot;
+		}
+	}
+
+	lsdb->routers[router->index] = lsdb->routers[--lsdb->num_routers];
+	lsdb->routers[router->index]->index = router->index;
+
+	free(router->links);
+	free(router);
+}
+
+/*---------------------------------------------------------------------
+ * Method: lsdb_add_fragment(struct pwospf_lsdb* lsdb, struct in_addr router_id,
+ * uint16_t sequence_num, uint8_t frag, struct ospfv2_lsu* adv, uint32_t num_adv,
+ * struct ospfv2_lsu** links, uint32_t* num_links)
+ *
+ * Collect a fragment of an LSU newer than the installed one, frag as in
+ * the LSU header.  Returns LSDB_FRAGMENT_COMPLETE with the advertisements
+ * of all the fragments in *links (valid until the next call) once the
+ * last one is in, LSDB_FRAGMENT_PENDING before that and
+ * LSDB_FRAGMENT_DUPLICATE for a fragment already seen.
+ *---------------------------------------------------------------------*/
+int lsdb_add_fragment(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num,
+		uint8_t frag, struct ospfv2_lsu* adv, uint32_t num_adv,
+		struct ospfv2_lsu** links, uint32_t* num_links)
+{
+	uint8_t index = frag >> 4;
+	uint8_t count = frag & 0x0f;
+	struct lsdb_partial* partial = lsdb->partials;
+
+	while (partial != NULL && partial->router_id.s_addr != router_id.s_addr)
+	{
+		partial = partial->next;
+	}
+
+	if (partial == NULL)
+	{
+		partial = (struct lsdb_partial*)calloc(1, sizeof(struct lsdb_partial));
+		assert(partial);
+		partial->router_id = router_id;
+		partial->next = lsdb->partials;
+		lsdb->partials = partial;
+	}
+	else if (partial->sequence_num == sequence_num && partial->count == count)
+	{
+		if (partial->received & (1U << index))
+		{
+			return LSDB_FRAGMENT_DUPLICATE;
+		}
+	}
+	else if ((int16_t)(sequence_num - partial->sequence_num) < 0)
+	{
+		return LSDB_FRAGMENT_DUPLICATE;
+	}
+	else
+	{
+		partial->received = 0;
+		partial->num_links = 0;
+	}
+
+	if (partial->received == 0)
+	{
+		partial->sequence_num = sequence_num;
+		partial->count = count;
+	}
+
+	if (partial->num_links + num_adv > partial->max_links)
+	{
+		partial->max_links = partial->num_links + num_adv;
+		partial->links = (struct ospfv2_lsu*)realloc(partial->links, partial->max_links * sizeof(struct ospfv2_lsu));
+		assert(partial->links);
+	}
+	if (num_adv > 0)
+	{
+		memcpy(partial->links + partial->num_links, adv, num_adv * sizeof(struct ospfv2_lsu));
+	}
+	partial->num_links += num_adv;
+	partial->received |= 1U << index;
+
+	if (partial->received != (1U << count) - 1)
+	{
+		return LSDB_FRAGMENT_PENDING;
+	}
+
+	*links = partial->links;
+	*num_links = partial->num_links;
+	return LSDB_FRAGMENT_COMPLETE;
+}
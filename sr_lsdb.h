@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_lsdb.h
+ * date:  Sun Oct 18 21:40:05 PDT 2026
+ *
+ * Description:
+ *
+ * PWOSPF link state database: one record per originating router, found
+ * through a hash on the router id, holding the advertisements of its
+ * latest LSU as one array together with its sequence number and age.
+ * Installing an LSU touches only the record of its router.
+ *
+ * The sequence numbers are also kept in a compact open addressing table,
+ * so an LSU that is not newer than the one installed is recognized with
+ * one probe before any other work is done on it.
+ *
+ * An LSU too big for one packet comes in fragments of the same sequence
+ * number; they are collected here and installed together.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LSDB_H
+#define SR_LSDB_H
+
+#include <netinet/in.h>
+
+#include "pwospf_protocol.h"
+
+struct lsdb_router
+{
+	struct in_addr router_id;
+	uint16_t sequence_num;          // of the LSU installed
+	uint32_t time_stamp;            // uptime it was last refreshed at
+	struct ospfv2_lsu* links;       // advertisements, network order as received
+	uint32_t num_links;
+	uint32_t max_links;
+	uint32_t index;                 // position in lsdb->routers
+	struct lsdb_router* hash_next;
+};
+
+struct lsdb_seq
+{
+	uint32_t router_id;             // 0 marks a free slot
+	uint16_t sequence_num;
+};
+
+// An LSU split over several packets, collected until every fragment is in
+struct lsdb_partial
+{
+	struct in_addr router_id;
+	uint16_t sequence_num;
+	uint8_t count;                  // fragments of the LSU
+	uint16_t received;              // bit i set once fragment i is in
+	struct ospfv2_lsu* links;
+	uint32_t num_links;
+	uint32_t max_links;
+	struct lsdb_partial* next;
+};
+
+#define LSDB_FRAGMENT_DUPLICATE 0
+#define LSDB_FRAGMENT_PENDING   1
+#define LSDB_FRAGMENT_COMPLETE  2
+
+struct pwospf_lsdb
+{
+	struct lsdb_router** routers;   // every record, in no particular order
+	uint32_t num_routers;
+	uint32_t max_routers;
+	struct lsdb_router** buckets;   // chained by router id
+	uint32_t hash_bits;
+	struct lsdb_seq* seqs;          // sequence number by router id, linear probing
+	uint32_t seq_bits;
+	struct lsdb_partial* partials;  // one per router that sends fragmented LSUs
+};
+
+void lsdb_init(struct pwospf_lsdb* lsdb);
+void lsdb_free(struct pwospf_lsdb* lsdb);
+struct lsdb_router* lsdb_find(struct pwospf_lsdb* lsdb, struct in_addr router_id);
+int lsdb_is_newer(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num);
+int lsdb_install(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num,
+		struct ospfv2_lsu* adv, uint32_t num_adv, uint32_t now);
+void lsdb_remove(struct pwospf_lsdb* lsdb, struct lsdb_router* router);
+int lsdb_add_fragment(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num,
+		uint8_t frag, struct ospfv2_lsu* adv, uint32_t num_adv,
+		struct ospfv2_lsu** links, uint32_t* num_links);
+
+#endif /* SR_LSDB_H */
@@ -30,9 +30,16 @@
 #include <getopt.h>
 #endif /* _LINUX_ */
 
-#include "sr_dumper.h"
+#include "sr_capture.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_pwospf.h"
+#include "sr_fib.h"
+#include "sr_fcache.h"
+#include "sr_punt.h"
+#include "sr_log.h"
+#include "sr_stats.h"
+#include "sr_ctl.h"
 
 extern char* optarg;
 
@@ -52,7 +59,6 @@ static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
-static void Arp_Cache_Timeout(struct sr_instance *sr);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -69,11 +75,27 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    struct sr_capture_config capture_config;
+    unsigned int segment_mb = CAPTURE_SEGMENT_SIZE / (1024*1024);
+    int snaplen = PACKET_DUMP_SIZE;
+    unsigned int spf_initial = OSPF_SPF_INITIAL_DELAY;
+    unsigned int spf_hold = OSPF_SPF_HOLD_TIME;
+    unsigned int spf_max = OSPF_SPF_MAX_WAIT;
+    unsigned int echo_interval = 0;
+    unsigned int echo_multiplier = OSPF_ECHO_MULTIPLIER;
+    unsigned int fcache_slots = 0;
+    char *tracefile = 0;
+    char *ctlfile = 0;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "ha:s:v:p:u:t:r:l:T:")) != EOF)
+    capture_config.segment_secs = 0;
+    capture_config.segments = CAPTURE_SEGMENTS;
+    capture_config.filter = 0;
+    capture_config.sample = 0;
+
+    while ((c = getopt(argc, argv, "ha:s:v:p:u:t:r:l:R:F:N:S:T:P:E:C:L:X:c:")) != EOF)
     {
         switch (c)
         {
@@ -102,18 +124,66 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg;
                 break;
+            case 'R':
+                /* -- segment MB[:seconds[:segments kept]] -- */
+                sscanf(optarg, "%u:%u:%u", &segment_mb,
+                       &capture_config.segment_secs, &capture_config.segments);
+                break;
+            case 'F':
+                capture_config.filter = optarg;
+                break;
+            case 'N':
+                capture_config.sample = atoi((char *) optarg);
+                break;
+            case 'S':
+                snaplen = atoi((char *) optarg);
+                break;
             case 'r':
                 rtable = optarg;
                 break;
             case 'T':
                 template = optarg;
                 break;
+            case 'P':
+                /* -- SPF initial delay[:hold time[:max wait]] in msec -- */
+                sscanf(optarg, "%u:%u:%u", &spf_initial, &spf_hold, &spf_max);
+                break;
+            case 'E':
+                /* -- fast liveness, echo interval msec[:misses] -- */
+                sscanf(optarg, "%u:%u", &echo_interval, &echo_multiplier);
+                break;
+            case 'C':
+                fcache_slots = atoi((char *) optarg);
+                break;
+            case 'L':
+                if (sr_log_set_levels(optarg) != 0)
+                {
+                    fprintf(stderr, "bad log levels %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'X':
+                tracefile = optarg;
+                break;
+            case 'c':
+                ctlfile = optarg;
+                break;
         } /* switch */
     } /* -- while -- */
 
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
 
+    /* -- counters, printed by a thread of their own on SIGUSR1, which no
+     *    thread started after this takes -- */
+    sr_stats_block_signal();
+    if(sr_stats_init(&sr) != 0 || sr_stats_start_dumper(&sr) != 0)
+    {
+        fprintf(stderr,"Error setting up the counters\n");
+        exit(1);
+    }
+
     /* -- set up routing table from file -- */
     if(template == NULL) {
         sr.template[0] = '\0';
@@ -134,8 +204,9 @@ int main(int argc, char **argv)
     /* -- set up file pointer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        capture_config.segment_size = (uint64_t)segment_mb * 1024 * 1024;
+        sr.capture = sr_capture_open(logfile,snaplen,&capture_config);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -163,14 +234,42 @@ int main(int argc, char **argv)
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
-    pthread_t thread;
-    pthread_create( &thread, NULL, Arp_Cache_Timeout, (void*)&sr);
+    pwospf_set_spf_throttle(&sr, spf_initial, spf_hold, spf_max);
+    if(echo_interval)
+    { pwospf_set_echo(&sr, echo_interval, echo_multiplier); }
+    if(fcache_slots && sr_fcache_init(&sr, fcache_slots) != 0)
+    {
+        fprintf(stderr,"Error allocating the flow cache\n");
+        exit(1);
+    }
+    if(sr_punt_init(&sr, PUNT_DEFAULT_SLOTS) != 0)
+    {
+        fprintf(stderr,"Error starting the slow path worker\n");
+        exit(1);
+    }
+    if(ctlfile && sr_ctl_start(&sr, ctlfile) != 0)
+    {
+        fprintf(stderr,"Error opening the control socket %s\n", ctlfile);
+        exit(1);
+    }
+    if(sr_arp_timeout_start(&sr) != 0)
+    {
+        fprintf(stderr,"Error starting the arp timeout thread\n");
+        exit(1);
+    }
 
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
     sr_destroy_instance(&sr);
 
+    if (tracefile)
+    {
+        long records = sr_trace_dump(tracefile);
+        if (records >= 0)
+        { fprintf(stderr, "sr: %ld trace records in %s\n", records, tracefile); }
+    }
+
     return 0;
 }/* -- main -- */
 
@@ -185,9 +284,19 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] [-a auth_key_filename]\n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
-    printf("   defaults server=%s port=%d host=%s  \n",
-            DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("           [-l log file] [-R segment MB[:seconds[:segments]]]\n");
+    printf("           [-F capture filter] [-N sample 1 in N] [-S snaplen]\n");
+    printf("           [-P SPF initial msec[:hold msec[:max wait msec]]]\n");
+    printf("           [-E neighbor echo msec[:misses]] [-C flow cache slots]\n");
+    printf("           [-L [module=]level,...] [-X trace file] [-c control socket]\n");
+    printf("   defaults server=%s port=%d host=%s -P %u:%u:%u, no -E (try -E %u:%u),\n",
+            DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST, OSPF_SPF_INITIAL_DELAY,
+            OSPF_SPF_HOLD_TIME, OSPF_SPF_MAX_WAIT, OSPF_ECHO_INTERVAL,
+            OSPF_ECHO_MULTIPLIER);
+    printf("   no -C (try -C %u), -L info\n", FCACHE_DEFAULT_SLOTS);
+    printf("   modules arp fwd icmp ospf vns, levels err warn info debug trace;\n");
+    printf("   -X writes what -L trace recorded at exit, see sr_tracedump\n");
+    printf("   kill -USR1 prints the packet counters, see sr_ctl.h for -c\n");
 } /* -- usage -- */
 
 /*-----------------------------------------------------------------------------
@@ -227,11 +336,30 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    /* -- the slow path worker forwards and logs frames, stop it first -- */
+    sr_punt_free(sr);
+
+    /* -- then every other thread that sends or counts -- */
+    sr_ctl_stop(sr);
+    pwospf_stop(sr);
+    sr_arp_timeout_stop(sr);
+
+    /* -- nothing logs any more, the capture and counters can go -- */
+    if(sr->capture)
     {
-        sr_dump_close(sr->logfile);
+        struct sr_capture* capture = sr->capture;
+        sr->capture = 0;
+        sr_capture_close(capture);
     }
 
+    sr_stats_free(sr);
+    sr_fib_free(sr);
+    sr_fcache_free(sr);
+    free(sr->if_table);
+    sr->if_table = 0;
+    free(sr->local_addrs);
+    sr->local_addrs = 0;
+
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
     */
@@ -254,8 +382,25 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->if_table = 0;
+    sr->num_ifaces = 0;
+    sr->local_addrs = 0;
+    sr->local_bits = 0;
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->fib = 0;
+    sr->fib_retired = 0;
+    sr->fib_generation = 0;
+    sr->arp_generation = 0;
+    sr->arp_running = 0;
+    sr->arp_stop = 0;
+    sr->fcache = 0;
+    sr->punt = 0;
+    sr->stats = 0;
+    sr->capture = 0;
+    sr->ctl = 0;
+    sr->hw_init = 0;
+    sr->transmit = 0;
+    sr->transmit_arg = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -125,6 +125,10 @@ struct sr_ethernet_hdr
 #define IPPROTO_ICMP            0x0001  /* ICMP protocol */
 #endif
 
+#ifndef IPPROTO_OSPF
+#define IPPROTO_OSPF            89      /* PWOSPF protocol */
+#endif
+
 #ifndef ETHERTYPE_IP
 #define ETHERTYPE_IP            0x0800  /* IP protocol */
 #endif
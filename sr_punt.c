@@ -0,0 +1,194 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_punt.c
+ * date:  Sun Oct 18 23:41:07 PDT 2026
+ *
+ * Description:
+ *
+ * Punt queue and slow path worker, see sr_punt.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_punt.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_stats.h"
+
+static void* sr_punt_worker(void* arg);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_init(..)
+ * Scope: Global
+ *
+ * Give sr a punt queue of 'slots' frames (rounded up to a power of 2) and
+ * start its worker.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_punt_init(struct sr_instance* sr, unsigned int slots)
+{
+    struct sr_punt* punt = 0;
+    unsigned int num = 2;
+
+    /* REQUIRES */
+    assert(sr);
+
+    while (num < slots)
+    { num <<= 1; }
+
+    punt = (struct sr_punt*)calloc(1, sizeof(struct sr_punt));
+    if (punt == 0 ||
+        (punt->slots = (struct sr_punt_slot*)malloc(num * sizeof(struct sr_punt_slot))) == 0)
+    {
+        free(punt);
+        return -1;
+    }
+    punt->mask = num - 1;
+    pthread_mutex_init(&punt->lock, 0);
+    pthread_cond_init(&punt->ready, 0);
+
+    sr->punt = punt;
+    if (pthread_create(&punt->worker, 0, sr_punt_worker, sr))
+    {
+        perror("pthread_create");
+        sr->punt = 0;
+        free(punt->slots);
+        free(punt);
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_punt_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_free(..)
+ * Scope: Global
+ *
+ * Let the worker finish what is queued and stop it.  Nothing may punt
+ * any more.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_punt_free(struct sr_instance* sr)
+{
+    struct sr_punt* punt = sr->punt;
+
+    if (punt == 0)
+    { return; }
+
+    pthread_mutex_lock(&punt->lock);
+    __atomic_store_n(&punt->stop, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&punt->ready);
+    pthread_mutex_unlock(&punt->lock);
+    pthread_join(punt->worker, 0);
+
+    fprintf(stderr, "sr_punt: %llu frames punted, %llu dropped\n",
+            (unsigned long long)punt->punted, (unsigned long long)punt->dropped);
+
+    sr->punt = 0;
+    pthread_cond_destroy(&punt->ready);
+    pthread_mutex_destroy(&punt->lock);
+    free(punt->slots);
+    free(punt);
+} /* -- sr_punt_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_packet(..)
+ * Scope: Global
+ *
+ * Hand a frame the fast path did not forward to the slow path.  Only the
+ * thread that calls sr_handlepacket() may punt.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_punt_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    struct sr_if* iface)
+{
+    struct sr_punt* punt = sr->punt;
+    struct sr_punt_slot* slot = 0;
+    uint64_t head, tail;
+
+    if (punt == 0)
+    {
+        sr_handlepacket_slow(sr, packet, len, iface);
+        return;
+    }
+
+    head = punt->head;
+    tail = __atomic_load_n(&punt->tail, __ATOMIC_ACQUIRE);
+    if (head - tail > punt->mask || len > PUNT_FRAME_MAX)
+    {
+        __atomic_store_n(&punt->dropped, punt->dropped + 1, __ATOMIC_RELAXED);
+        sr_stat_inc(sr, DROP_PUNT_FULL);
+        sr_trace(FWD_DROP, ntohs(((struct sr_ethernet_hdr*)packet)->ether_type), len, 0, 0);
+        return;
+    }
+
+    slot = &punt->slots[head & punt->mask];
+    slot->len = len;
+    slot->if_index = iface->index;
+    slot->ticks_in = sr_stats_packet_in;
+    memcpy(slot->frame, packet, len);
+
+    __atomic_store_n(&punt->punted, punt->punted + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&punt->head, head + 1, __ATOMIC_SEQ_CST);
+
+    /* -- pairs with the worker's store to sleeping before it looks at head -- */
+    if (__atomic_load_n(&punt->sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&punt->lock);
+        pthread_cond_signal(&punt->ready);
+        pthread_mutex_unlock(&punt->lock);
+    }
+} /* -- sr_punt_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_worker(..)
+ * Scope: Local
+ *
+ * Run the slow path on every punted frame, in the order they came.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_punt_worker(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct sr_punt* punt = sr->punt;
+    uint64_t tail = punt->tail;
+
+    while (1)
+    {
+        uint64_t head = __atomic_load_n(&punt->head, __ATOMIC_ACQUIRE);
+
+        while (tail < head)
+        {
+            struct sr_punt_slot* slot = &punt->slots[tail & punt->mask];
+            struct sr_if* iface = sr_get_interface_by_index(sr, slot->if_index);
+
+            if (iface)
+            {
+                sr_stats_packet_in = slot->ticks_in;
+                sr_handlepacket_slow(sr, slot->frame, slot->len, iface);
+            }
+            __atomic_store_n(&punt->tail, ++tail, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_lock(&punt->lock);
+        __atomic_store_n(&punt->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&punt->head, __ATOMIC_SEQ_CST) == tail &&
+               !__atomic_load_n(&punt->stop, __ATOMIC_SEQ_CST))
+        { pthread_cond_wait(&punt->ready, &punt->lock); }
+        __atomic_store_n(&punt->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&punt->lock);
+
+        if (__atomic_load_n(&punt->head, __ATOMIC_ACQUIRE) == tail &&
+            __atomic_load_n(&punt->stop, __ATOMIC_ACQUIRE))
+        { break; }
+    }
+
+    return 0;
+} /* -- sr_punt_worker -- */
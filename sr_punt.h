@@ -0,0 +1,68 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_punt.h
+ * date:  Sun Oct 18 23:41:07 PDT 2026
+ *
+ * Description:
+ *
+ * Queue between the fast path and the slow path.  The thread that reads
+ * frames off the wire forwards what it can by itself (sr_forward_fast in
+ * sr_router.c) and punts the rest: packets for the router, ARP, pwospf,
+ * expiring TTLs, IP options and next hops without an ARP entry.  A
+ * punted frame is copied into a preallocated slot of a single producer /
+ * single consumer ring and a worker thread runs the full packet handling
+ * on it, so ICMP, ARP resolution and pwospf never hold up forwarding.
+ * A full ring drops (and counts) the frame instead of blocking.
+ *
+ * Without a queue (sr_sim) punted frames are handled on the spot.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PUNT_H
+#define SR_PUNT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <pthread.h>
+
+#define PUNT_DEFAULT_SLOTS 256
+#define PUNT_FRAME_MAX     2048   /* bytes of a slot, longer frames are dropped */
+
+struct sr_instance;
+struct sr_if;
+
+struct sr_punt_slot
+{
+    uint32_t len;
+    uint32_t if_index;
+    uint64_t ticks_in;          /* sr_stats_packet_in of the frame */
+    uint8_t  frame[PUNT_FRAME_MAX];
+};
+
+struct sr_punt
+{
+    struct sr_punt_slot* slots;
+    uint32_t mask;              /* slots - 1, slots a power of 2 */
+    uint64_t head;              /* written by the fast path */
+    uint64_t tail;              /* written by the worker */
+    uint64_t punted;
+    uint64_t dropped;
+
+    int sleeping;               /* worker waits on 'ready' */
+    int stop;
+    pthread_mutex_t lock;       /* only taken to sleep and to wake the worker */
+    pthread_cond_t ready;
+    pthread_t worker;
+};
+
+int  sr_punt_init(struct sr_instance* sr, unsigned int slots);
+void sr_punt_free(struct sr_instance* sr);
+void sr_punt_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    struct sr_if* iface);
+
+#endif /* SR_PUNT_H */
@@ -7,99 +7,147 @@
  *
  *---------------------------------------------------------------------------*/
 
+#define SR_LOG_MODULE SR_LOG_OSPF
+
 #include "sr_pwospf.h"
 #include "sr_router.h"
-#include "neighbor.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "neighber.h"
+#include "sr_stats.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <netinet/in.h>
 
-bool if_unable;
-static const uint8_t OSPF_DEFAULT_HELLOINT = 5;
-
-struct sr_if_packet
-{
-	struct sr_instance* sr;
-	struct sr_if* interface;
-}__attribute__ ((packed));
+// ALLSPFRouters that is defined as "224.0.0.5" (0xe0000005)
+static const uint8_t hello_broadcast_addr[ETHER_ADDR_LEN] = { 0x01, 0x00, 0xe0, 0x00, 0x00, 0x05 };
 
 /* -- declaration of main thread function for pwospf subsystem --- */
 static void* pwospf_run_thread(void* arg);
-void add_neighbor(neighbor_list* nbr_head, neighbor_list* new_neighbor);
 void handle_hello_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length);
-void hello_messages_thread(struct sr_instance *sr);
-void* hello_message(sr_if_packet * sr_if_pk);
-void* scan_neighbor_list(void* thread);
-void dijkstra_stack_push(struct route_dijkstra_node* dijkstra_first_item, struct route_dijkstra_node* dijkstra_new_item);
-struct route_dijkstra_node* dijkstra_stack_pop(struct route_dijkstra_node* dijkstra_first_item);
-struct route_dijkstra_node* create_dikjstra_item(struct pwospf_topology_entry* new_topology_entry, uint8_t dist);
-void* run_dijkstra(struct sr_instance* sr);
-
-uint8_t hello_broadcast_addr[ETHER_ADDR_LEN];
+void handle_lsu_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length);
+static void pwospf_send_hellos(struct sr_instance* sr, uint64_t now);
+static void pwospf_send_hello(struct sr_instance* sr, struct sr_if* interface);
+static void pwospf_send_echoes(struct sr_instance* sr, uint64_t now);
+static void handle_echo_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length);
+static void pwospf_fill_headers(uint8_t* packet, struct sr_if* interface, unsigned int ospf_len);
+static int pwospf_next_deadline(struct pwospf_subsys* subsys, uint64_t* when);
+static void pwospf_expire_neighbors(struct sr_instance* sr, uint64_t now);
+void originate_lsu(struct sr_instance* sr);
+static void pwospf_request_lsu(struct sr_instance* sr);
+void* run_spf(struct sr_instance* sr);
+static void pwospf_schedule_spf(struct sr_instance* sr);
+static void pwospf_run_due_spf(struct sr_instance* sr);
 
 /*---------------------------------------------------------------------
  * Method: pwospf_init(..)
  *
- * Sets up the internal data structures for the pwospf subsystem
+ * Sets up the internal data structures for the pwospf subsystem and
+ * starts the thread that drives it once a second.
  *
- * You may assume that the interfaces have been created and initialized
- * by this point.
  *---------------------------------------------------------------------*/
 
 int pwospf_init(struct sr_instance* sr)
 {
 	assert(sr);
 
-	sr->ospf_subsys = (struct pwospf_subsys*)malloc(sizeof(struct pwospf_subsys));
-
-	assert(sr->ospf_subsys);
-	pthread_mutex_init(&(sr->ospf_subsys->lock), 0);
-	if_unable = false;
-
-	// nbr list header pointer and init header address.
-	struct in_addr header_addr;
-	header_addr.s_addr = 0;
-	nbr_head = NULL;
-	nbr_head = ((neighbor_list*)(malloc(sizeof(neighbor_list))));
-	nbr_head->neighbor_id.s_addr = header_addr.s_addr;
-	nbr_head->alive = OSPF_NEIGHBOR_TIMEOUT;
-	nbr_head->next = NULL;
-
-	// ALLSPFRouters that is defined as "224.0.0.5" (0xe0000005)
-	hello_broadcast_addr[0] = 0x01;
-	hello_broadcast_addr[1] = 0x00;
-	hello_broadcast_addr[2] = 0xe0;
-	hello_broadcast_addr[3] = 0x00;
-	hello_broadcast_addr[4] = 0x00;
-	hello_broadcast_addr[5] = 0x05;
-	/* -- handle subsystem initialization here! -- */
-
-	topology_header = create_ospfv2_topology_entry(header_addr, header_addr, header_addr, header_addr, header_addr, 0);
+	pwospf_init_subsys(sr);
 
 	/* -- start thread subsystem -- */
 	if( pthread_create(&sr->ospf_subsys->thread, 0, pwospf_run_thread, sr)) {
 		perror("pthread_create");
 		assert(0);
 	}
+	sr->ospf_subsys->running = 1;
 
-	if( pthread_create(&T_hello, NULL, hello_messages_thread, sr)) {
-		perror("pthread_create");
-		assert(0);
-	}
+	return 0; /* success */
+} /* -- pwospf_init -- */
 
-	if( pthread_create(&T_neighbor, NULL, scan_neighbor_list, NULL)) {
-		perror("pthread_create");
-		assert(0);
+/*---------------------------------------------------------------------
+ * Method: pwospf_stop(..)
+ *
+ * Wake the thread started by pwospf_init() and wait for it to end.  It
+ * sends hellos, echoes and LSUs and publishes forwarding tables, so the
+ * capture, the counters and the tables must outlive this call.
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_stop(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+
+	if (subsys == 0 || !subsys->running)
+	{
+		return;
 	}
 
+	pwospf_lock(subsys);
+	__atomic_store_n(&subsys->stop, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_signal(&subsys->timer_cond);
+	pwospf_unlock(subsys);
+	pthread_join(subsys->thread, 0);
+	subsys->running = 0;
+} /* -- pwospf_stop -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_monotonic_ms
+ *
+ * Default clock of the timers, msec since some fixed point.
+ *
+ *---------------------------------------------------------------------*/
 
+static uint64_t pwospf_monotonic_ms(void* arg)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_init_subsys(..)
+ *
+ * Allocate the per router pwospf state without starting any thread, the
+ * owner then calls pwospf_tick() once a second (the simulator uses this
+ * to run many routers in one process).
+ *
+ * The interfaces only show up once the VNSHWINFO message has been read,
+ * so the router id is picked lazily by pwospf_set_router_id().
+ *---------------------------------------------------------------------*/
+
+int pwospf_init_subsys(struct sr_instance* sr)
+{
+	assert(sr);
+
+	sr->ospf_subsys = (struct pwospf_subsys*)calloc(1, sizeof(struct pwospf_subsys));
+
+	assert(sr->ospf_subsys);
+	pthread_mutex_init(&(sr->ospf_subsys->lock), 0);
+	pthread_cond_init(&(sr->ospf_subsys->timer_cond), 0);
+
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+
+	subsys->router_id.s_addr = 0;
+
+	/* -- handle subsystem initialization here! -- */
+	lsdb_init(&subsys->lsdb);
+	subsys->lsu_sequence = 0;
+	subsys->lsu_countdown = OSPF_DEFAULT_LSUINT;
+	spf_init(&subsys->spf);
+
+	subsys->clock = pwospf_monotonic_ms;
+	subsys->spf_throttle.initial_delay = OSPF_SPF_INITIAL_DELAY;
+	subsys->spf_throttle.hold_time = OSPF_SPF_HOLD_TIME;
+	subsys->spf_throttle.max_wait = OSPF_SPF_MAX_WAIT;
+	subsys->spf_throttle.wait = OSPF_SPF_HOLD_TIME;
 
 	return 0; /* success */
-} /* -- pwospf_init -- */
+} /* -- pwospf_init_subsys -- */
 
 
 /*---------------------------------------------------------------------
@@ -128,10 +176,29 @@ void pwospf_unlock(struct pwospf_subsys* subsys)
 	{ assert(0); }
 } /* -- pwospf_subsys -- */
 
+/*---------------------------------------------------------------------
+ * Method: pwospf_set_router_id
+ *
+ * Use the address of the first interface as the router id once the
+ * hardware information has arrived. Caller holds the subsystem lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_set_router_id(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	if (subsys->router_id.s_addr == 0 && sr->if_list != NULL)
+	{
+		subsys->router_id.s_addr = sr->if_list->ip;
+		Debug("-> PWOSPF: Router ID set to %s\n", inet_ntoa(subsys->router_id));
+	}
+}
+
 /*---------------------------------------------------------------------
  * Method: pwospf_run_thread
  *
- * Main thread of pwospf subsystem.
+ * Main thread of pwospf subsystem, one tick a second and the hellos and
+ * scheduled SPF runs in between.
  *
  *---------------------------------------------------------------------*/
 
@@ -139,19 +206,369 @@ static
 void* pwospf_run_thread(void* arg)
 {
 	struct sr_instance* sr = (struct sr_instance*)arg;
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	uint64_t next_tick = subsys->clock(subsys->clock_arg) + 1000;
 
-	while(1)
+	while(!__atomic_load_n(&subsys->stop, __ATOMIC_SEQ_CST))
 	{
-		/* -- PWOSPF subsystem functionality should start  here! -- */
+		/* -- sleep until the next tick or timer, whichever is first -- */
+		pwospf_lock(subsys);
+		uint64_t now = subsys->clock(subsys->clock_arg);
+		uint64_t wake = next_tick;
+		uint64_t due;
+		if (pwospf_next_deadline(subsys, &due) && due < wake)
+		{
+			wake = due;
+		}
+		if (wake > now)
+		{
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += (wake - now) / 1000;
+			deadline.tv_nsec += ((wake - now) % 1000) * 1000000;
+			if (deadline.tv_nsec >= 1000000000)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&subsys->timer_cond, &subsys->lock, &deadline);
+		}
+		pwospf_unlock(subsys);
+
+		if (!sr->hw_init || __atomic_load_n(&subsys->stop, __ATOMIC_SEQ_CST))
+		{
+			continue;
+		}
 
-		pwospf_lock(sr->ospf_subsys);
-		printf(" pwospf subsystem sleeping \n");
-		pwospf_unlock(sr->ospf_subsys);
-		sleep(2);
-		printf(" pwospf subsystem awake \n");
+		pwospf_timers(sr);
+		now = subsys->clock(subsys->clock_arg);
+		if (now >= next_tick)
+		{
+			/* -- PWOSPF subsystem functionality should start  here! -- */
+			pwospf_tick(sr);
+			next_tick = (now - next_tick < 1000) ? next_tick + 1000 : now + 1000;
+		}
 	};
+
+	return NULL;
 } /* -- run_ospf_thread -- */
 
+/*---------------------------------------------------------------------
+ * Method: pwospf_tick
+ *
+ * One second of pwospf time: send the hellos that are due (the first
+ * ones, once the router id is known, the rest normally go out from
+ * pwospf_timers() at their own deadline), age out the topology entries
+ * (scheduling an SPF if any were removed), flood our own LSU every
+ * OSPF_DEFAULT_LSUINT seconds, run the SPF if it is due and free the
+ * forwarding tables no longer in use.
+ *
+ *---------------------------------------------------------------------*/
+
+static int age_topology_entries(struct pwospf_subsys* subsys);
+
+void pwospf_tick(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+
+	pwospf_lock(subsys);
+	subsys->uptime++;
+	pwospf_set_router_id(sr);
+
+	pwospf_send_hellos(sr, subsys->clock(subsys->clock_arg));
+
+	// Drop the links of routers that stopped advertising them.
+	if (age_topology_entries(subsys) > 0)
+	{
+		pwospf_schedule_spf(sr);
+	}
+
+	if (subsys->lsu_countdown > 0)
+	{
+		subsys->lsu_countdown--;
+	}
+	else
+	{
+		originate_lsu(sr);
+	}
+
+	pwospf_run_due_spf(sr);
+	sr_fib_reclaim(sr);
+	pwospf_unlock(subsys);
+} /* -- pwospf_tick -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_timers
+ *
+ * Send the hellos, echoes and collected LSU, expire the neighbors and
+ * run the SPF that are due, the owner calls this at the time returned by
+ * pwospf_next_timer().
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_timers(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+
+	pwospf_lock(subsys);
+	uint64_t now = subsys->clock(subsys->clock_arg);
+	if (subsys->hello_next != 0 && subsys->hello_next <= now)
+	{
+		pwospf_send_hellos(sr, now);
+	}
+	if (subsys->echo_next != 0 && subsys->echo_next <= now)
+	{
+		pwospf_send_echoes(sr, now);
+	}
+	if (subsys->nbr_next != 0 && subsys->nbr_next <= now)
+	{
+		pwospf_expire_neighbors(sr, now);
+	}
+	if (subsys->lsu_due != 0 && subsys->lsu_due <= now)
+	{
+		subsys->lsu_originated++;
+		originate_lsu(sr);
+	}
+	pwospf_run_due_spf(sr);
+	pwospf_unlock(subsys);
+} /* -- pwospf_timers -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_next_deadline
+ *
+ * Earliest of the next hello, echo, neighbor expiry, collected LSU and
+ * scheduled SPF, caller holds the subsystem lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int pwospf_next_deadline(struct pwospf_subsys* subsys, uint64_t* when)
+{
+	int scheduled = 0;
+
+	if (subsys->hello_next != 0)
+	{
+		*when = subsys->hello_next;
+		scheduled = 1;
+	}
+	if (subsys->nbr_next != 0 && (!scheduled || subsys->nbr_next < *when))
+	{
+		*when = subsys->nbr_next;
+		scheduled = 1;
+	}
+	if (subsys->echo_next != 0 && (!scheduled || subsys->echo_next < *when))
+	{
+		*when = subsys->echo_next;
+		scheduled = 1;
+	}
+	if (subsys->lsu_due != 0 && (!scheduled || subsys->lsu_due < *when))
+	{
+		*when = subsys->lsu_due;
+		scheduled = 1;
+	}
+	if (subsys->spf_throttle.scheduled && (!scheduled || subsys->spf_throttle.due < *when))
+	{
+		*when = subsys->spf_throttle.due;
+		scheduled = 1;
+	}
+
+	return scheduled;
+}
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_next_timer
+ *
+ * Return 1 and the pwospf clock time the next hello, echo, neighbor
+ * expiry, collected LSU or scheduled SPF is due at, 0 if there is none.
+ *
+ *---------------------------------------------------------------------*/
+
+int pwospf_next_timer(struct sr_instance* sr, uint64_t* when)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	int scheduled;
+
+	pwospf_lock(subsys);
+	scheduled = pwospf_next_deadline(subsys, when);
+	pwospf_unlock(subsys);
+
+	return scheduled;
+} /* -- pwospf_next_timer -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_set_spf_throttle
+ *
+ * Set the SPF initial delay, hold time and maximum wait, in msec.
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_set_spf_throttle(struct sr_instance* sr, uint32_t initial_delay,
+		uint32_t hold_time, uint32_t max_wait)
+{
+	struct pwospf_spf_throttle* throttle = &sr->ospf_subsys->spf_throttle;
+
+	pwospf_lock(sr->ospf_subsys);
+	throttle->initial_delay = initial_delay;
+	throttle->hold_time = hold_time;
+	throttle->max_wait = max_wait < hold_time ? hold_time : max_wait;
+	throttle->wait = throttle->hold_time;
+	pwospf_unlock(sr->ospf_subsys);
+} /* -- pwospf_set_spf_throttle -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_set_echo
+ *
+ * Turn fast liveness on with an echo to the neighbors every interval
+ * msec, a neighbor that misses multiplier of them in a row is down.  An
+ * interval of 0 turns it off, the hellos alone keep the neighbors then.
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_set_echo(struct sr_instance* sr, uint32_t interval, uint32_t multiplier)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+
+	pwospf_lock(subsys);
+	subsys->echo_interval = interval;
+	subsys->echo_multiplier = multiplier ? multiplier : 1;
+	subsys->echo_next = interval ? subsys->clock(subsys->clock_arg) + interval : 0;
+	pwospf_unlock(subsys);
+	pthread_cond_signal(&subsys->timer_cond);
+} /* -- pwospf_set_echo -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_schedule_spf
+ *
+ * Ask for an SPF after a topology change.  The first one after a quiet
+ * period runs initial_delay later, the next ones at least the hold time
+ * after the previous run, the hold time doubling up to max_wait while
+ * changes keep coming.  A request while one is scheduled is folded into
+ * it.  Caller holds the subsystem lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_schedule_spf(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	struct pwospf_spf_throttle* throttle = &subsys->spf_throttle;
+	uint64_t now = subsys->clock(subsys->clock_arg);
+
+	subsys->spf_requested++;
+	if (throttle->scheduled)
+	{
+		return;
+	}
+
+	throttle->due = now + throttle->initial_delay;
+	if (!throttle->has_run || now - throttle->last_run > 2 * (uint64_t)throttle->wait)
+	{
+		// Quiet long enough, start over from the initial delay
+		throttle->wait = throttle->hold_time;
+	}
+	else
+	{
+		if (throttle->last_run + throttle->wait > throttle->due)
+		{
+			throttle->due = throttle->last_run + throttle->wait;
+		}
+		throttle->wait = (throttle->wait * 2 > throttle->max_wait) ? throttle->max_wait : throttle->wait * 2;
+	}
+
+	throttle->scheduled = 1;
+	pthread_cond_signal(&subsys->timer_cond);
+} /* -- pwospf_schedule_spf -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_run_due_spf
+ *
+ * Run the scheduled SPF once its time has come.  Caller holds the
+ * subsystem lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_run_due_spf(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	struct pwospf_spf_throttle* throttle = &subsys->spf_throttle;
+	uint64_t now = subsys->clock(subsys->clock_arg);
+
+	if (!throttle->scheduled || now < throttle->due)
+	{
+		return;
+	}
+
+	throttle->scheduled = 0;
+	throttle->has_run = 1;
+	throttle->last_run = now;
+	run_spf(sr);
+} /* -- pwospf_run_due_spf -- */
+
+/*------------------------------------------------------------------------------------
+ * Method: pwospf_verify_checksum(struct ospfv2_hdr* ospf_hdr, unsigned int length)
+ * Check the checksum of a received PWOSPF packet, computed with the csum field zeroed.
+ *-----------------------------------------------------------------------------------*/
+static bool pwospf_verify_checksum(struct ospfv2_hdr* ospf_hdr, unsigned int length)
+{
+	uint16_t rx_checksum = ospf_hdr->csum;
+	ospf_hdr->csum = 0;
+	uint16_t checksum = cal_ICMPcksum((uint8_t*)ospf_hdr, length);
+	ospf_hdr->csum = rx_checksum;
+
+	return checksum == rx_checksum;
+}
+
+/*------------------------------------------------------------------------------------
+ * Method: handle_pwospf_packet(struct sr_instance* sr,
+ * uint8_t* packet,
+ * unsigned int length,
+ * struct sr_if* iface)
+ * Entry point from sr_handleIPpacket for IP protocol 89.
+ *-----------------------------------------------------------------------------------*/
+void handle_pwospf_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_if* iface)
+{
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+
+	if (iface == NULL || length < hdr_len + sizeof(struct ospfv2_hdr))
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Packet dropped, too short\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
+
+	struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(packet + hdr_len);
+	if (ospf_hdr->version != OSPF_V2 || ntohs(ospf_hdr->len) > length - hdr_len)
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Packet dropped, invalid header\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
+	sr_trace(OSPF_RECV, ospf_hdr->type, ospf_hdr->rid, iface->index, length);
+
+	pwospf_lock(sr->ospf_subsys);
+	pwospf_set_router_id(sr);
+
+	// Packets that come back to us from a neighbor are ignored
+	if (ospf_hdr->rid != sr->ospf_subsys->router_id.s_addr)
+	{
+		if (ospf_hdr->type == OSPF_TYPE_HELLO)
+		{
+			sr_stat_inc(sr, OSPF_HELLO_RECV);
+			handle_hello_packets(sr, iface, packet, length);
+		}
+		else if (ospf_hdr->type == OSPF_TYPE_LSU)
+		{
+			sr_stat_inc(sr, OSPF_LSU_RECV);
+			handle_lsu_packets(sr, iface, packet, length);
+		}
+		else if (ospf_hdr->type == OSPF_TYPE_ECHO)
+		{
+			sr_stat_inc(sr, OSPF_ECHO_RECV);
+			handle_echo_packets(sr, iface, packet, length);
+		}
+	}
+
+	pwospf_unlock(sr->ospf_subsys);
+}
+
 /*------------------------------------------------------------------------------------
  * Method: handle_hello_packets(struct sr_instance* sr,
  * struct sr_if* interface,
@@ -161,497 +578,905 @@ void* pwospf_run_thread(void* arg)
  *-----------------------------------------------------------------------------------*/
 void handle_hello_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length)
 {
-	bool exit_neighbor = true;
-	uint16_t checksum = 0;
 	struct in_addr neighbor_id;
 	// Contruct the header.
 
+	if (length < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_hello_hdr))
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: HELLO Packet dropped, too short\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
+
 	struct ip * iP_Hdr = NULL;
-	iP_Hdr = (ip *)(packet + sizeof(sr_ethernet_hdr));
-	struct ospfv2_hdr* ospfv2_Hdr = (struct ospfv2_hdr *)(packet + sizeof(sr_ethernet_hdr) + sizeof(ip));
-	struct ospfv2_hello_hdr* ospfv2_Hello_Hdr = (struct ospfv2_hello_hdr *)(packet + sizeof(sr_ethernet_hdr) + sizeof(ip) + sizeof(ospfv2_hdr));
+	iP_Hdr = (struct ip *)(packet + sizeof(struct sr_ethernet_hdr));
+	struct ospfv2_hdr* ospfv2_Hdr = (struct ospfv2_hdr *)(packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
+	struct ospfv2_hello_hdr* ospfv2_Hello_Hdr = (struct ospfv2_hello_hdr *)(packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr));
 
 	neighbor_id.s_addr = ospfv2_Hdr->rid;
 	struct in_addr net_mask;
 	net_mask.s_addr = ospfv2_Hello_Hdr->nmask;
-	Debug("-> PWOSPF: Detecting PWOSPF HELLO Packet from:\n");
-	Debug("      [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-	Debug("      [Neighbor IP = %s]\n", inet_ntoa(iP_Hdr->ip_src));
-	Debug("      [Network Mask = %s]\n", inet_ntoa(net_mask));
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Detecting PWOSPF HELLO Packet from:\n");
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "      [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "      [Neighbor IP = %s]\n", inet_ntoa(iP_Hdr->ip_src));
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "      [Network Mask = %s]\n", inet_ntoa(net_mask));
 
 	// Examine the checksum
-	uint16_t rx_checksum = ospfv2_Hdr->csum;
-	uint8_t * hdr_checksum = (uint8_t *)(packet + sizeof(sr_ethernet_hdr) + sizeof(ip));
-	checksum = cal_ICMPcksum(hdr_checksum, sizeof(ospfv2_hello_hdr) + sizeof(ospfv2_hdr));
-	if (checksum != rx_checksum)
+	if (!pwospf_verify_checksum(ospfv2_Hdr, sizeof(struct ospfv2_hello_hdr) + sizeof(struct ospfv2_hdr)))
 	{
-		Debug("-> PWOSPF: HELLO Packet dropped, invalid checksum\n");
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: HELLO Packet dropped, invalid checksum\n");
+		sr_stat_inc(sr, OSPF_DROP);
 		return;
 	}
 
 	// Examine the validation of the hello interval
-	if (ospfv2_Hello_Hdr->helloint != 5)
+	if (ntohs(ospfv2_Hello_Hdr->helloint) != OSPF_DEFAULT_HELLOINT)
 	{
-		Debug("-> PWOSPF: HELLO Packet dropped, invalid hello interval\n");
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: HELLO Packet dropped, invalid hello interval\n");
+		sr_stat_inc(sr, OSPF_DROP);
 		return;
 	}
 
 	// Examine the interface mask
 	if (ospfv2_Hello_Hdr->nmask != interface->mask)
 	{
-		Debug("-> PWOSPF: HELLO Packet dropped, invalid hello network mask\n");
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: HELLO Packet dropped, invalid hello network mask\n");
+		sr_stat_inc(sr, OSPF_DROP);
 		return;
 	}
 
-	// If it is already the neighbor of the interface
-	// TODO add neighbor_id to the list
-	if (interface->neighbor_id != ospfv2_Hdr->rid)
+	if (neighbor_id.s_addr == 0)
 	{
-		exit_neighbor = false;
-		interface->neighbor_id = ospfv2_Hdr->rid;
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: HELLO Packet dropped, no router id\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
 	}
-	interface->neighbor_ip = iP_Hdr->ip_src.s_addr;
 
-	// give the header of the neighbor list and the neighbor id, and renew the neighbors' timestamp
-	struct neighbor_list* ptr = nbr_head;
-	while(ptr != NULL)
-	{
-		if (ptr->neighbor_id.s_addr == neighbor_id.s_addr)
-		{
-			Debug("-> PWOSPF: Refreshing the neighbor, [ID = %s] in the alive neighbors table\n", inet_ntoa(neighbor_id));
-			ptr->alive = OSPF_NEIGHBOR_TIMEOUT;
-			return;
-		}
+	// Refresh the neighbor, or add it to the table of the interface
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	uint64_t expires = subsys->clock(subsys->clock_arg) + OSPF_NEIGHBOR_TIMEOUT * 1000;
+	struct pwospf_neighbor* neighbor = nbr_find(&interface->neighbors, neighbor_id.s_addr);
+	bool changed = false;
 
-		ptr = ptr->next;
+	if (neighbor == NULL)
+	{
+		Debug("-> PWOSPF: Adding the neighbor, [ID = %s] to the alive neighbors table of %s\n", inet_ntoa(neighbor_id), interface->name);
+		neighbor = nbr_add(&interface->neighbors, neighbor_id.s_addr);
+		changed = true;
+	}
+	else
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Refreshing the neighbor, [ID = %s] in the alive neighbors table of %s\n", inet_ntoa(neighbor_id), interface->name);
 	}
 
-	Debug("-> PWOSPF: Adding the neighbor, [ID = %s] to the alive neighbors table\n", inet_ntoa(neighbor_id));
+	if (neighbor->ip != iP_Hdr->ip_src.s_addr)
+	{
+		neighbor->ip = iP_Hdr->ip_src.s_addr;
+		changed = true;
+	}
+	neighbor->expires = expires;
 
-	// Create a new neighbor and malloc memory for it, and add it to the list
-	struct neighbor_list* new_neighbor = (neighbor_list*)(malloc(sizeof(neighbor_list)));
-	new_neighbor->neighbor_id.s_addr = neighbor_id.s_addr;
-	new_neighbor->alive = OSPF_NEIGHBOR_TIMEOUT;
-	new_neighbor->next = NULL;
-	// sub function of creat a new neib, memory for new neighbor is allocated
-	add_neighbor(nbr_head, new_neighbor);
+	// Refreshing only moves a deadline later, the earliest one stays a safe bound
+	if (subsys->nbr_next == 0 || expires < subsys->nbr_next)
+	{
+		subsys->nbr_next = expires;
+	}
 
 	// send the lsu announcement to the internet of adding a new neighbor
-	if (exit_neighbor == false)
+	if (changed)
 	{
-		struct sr_if_packet* lsu_param = (sr_if_packet*)(malloc(sizeof(sr_if_packet)));
-		lsu_param->sr = sr;
-		lsu_param->interface = interface;
-		pthread_create(&lsu_thread, NULL, send_lsu, lsu_param);
+		pwospf_request_lsu(sr);
 	}
 }
 
 /*------------------------------------------------------------------------------------
- * Method: hello_messages_thread(struct sr_instance *sr)
- * Periodically check the interface list of the router to decide whether to send hello
+ * Method: pwospf_csum_patch(uint16_t csum, uint16_t old_word, uint16_t new_word)
+ * Return an internet checksum updated for one 16 bit word that changed (RFC 1624).
  *-----------------------------------------------------------------------------------*/
-void hello_messages_thread(struct sr_instance *sr)
+static uint16_t pwospf_csum_patch(uint16_t csum, uint16_t old_word, uint16_t new_word)
 {
-	//struct sr_instance* sr = (struct sr_instance*)arg;
+	uint32_t sum = (uint16_t)~csum + (uint16_t)~old_word + new_word;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
 
-	while(1)
+static uint16_t pwospf_csum_patch32(uint16_t csum, uint32_t old_value, uint32_t new_value)
+{
+	csum = pwospf_csum_patch(csum, (uint16_t)old_value, (uint16_t)new_value);
+	return pwospf_csum_patch(csum, (uint16_t)(old_value >> 16), (uint16_t)(new_value >> 16));
+}
+
+/*------------------------------------------------------------------------------------
+ * Method: pwospf_send_hellos(struct sr_instance* sr, uint64_t now)
+ * Send the hello of every interface whose deadline has passed and set its next one
+ * OSPF_DEFAULT_HELLOINT seconds on, without drifting.  Caller holds the subsystem lock.
+ *-----------------------------------------------------------------------------------*/
+static void pwospf_send_hellos(struct sr_instance* sr, uint64_t now)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	uint64_t interval = OSPF_DEFAULT_HELLOINT * 1000;
+	uint64_t next = 0;
+
+	pwospf_set_router_id(sr);
+	if (subsys->router_id.s_addr == 0)
 	{
-		sleep(OSPF_DEFAULT_HELLOINT);
-		pwospf_lock(sr->ospf_subsys);
+		return;
+	}
 
-		// Interate all the interface
-		struct sr_if* if_walker = sr->if_list;
-		while(if_walker != NULL)
+	for (struct sr_if* if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		if (if_walker->hello_due <= now)
 		{
-			// Check if this interface is down
-			if (if_unable == true)
-			{
-				// Skip this down interface
-				if (strcmp(if_walker->name, sr->f_interface) == 0)
-				{
-					if_walker = if_walker->next;
-					continue;
-				}
-			}
-
-			// Reduce the helloint of the unreceived interface
-			if (if_walker->helloint > 0)
+			pwospf_send_hello(sr, if_walker);
+			if (if_walker->hello_due != 0 && now - if_walker->hello_due < interval)
 			{
-				if_walker->helloint--;
+				if_walker->hello_due += interval;
 			}
 			else
 			{
-				// send hello packet.
-				struct sr_if_packet* sr_if_pk = (sr_if_packet*)(malloc(sizeof(sr_if_packet)));
-				sr_if_pk->sr = sr;
-				sr_if_pk->interface = if_walker;
-				pthread_create(&T_hello, NULL, hello_message, sr_if_pk); // void sr_if_pk
-				//pthread_create( &thread, NULL, Arp_Cache_Timeout, (void*)&sr_if_pk);
-
-				if_walker->helloint = OSPF_DEFAULT_HELLOINT;
+				if_walker->hello_due = now + interval;
 			}
-
-			if_walker = if_walker->next;
 		}
 
-		pwospf_unlock(sr->ospf_subsys);
-	};
+		if (next == 0 || if_walker->hello_due < next)
+		{
+			next = if_walker->hello_due;
+		}
+	}
 
+	subsys->hello_next = next;
 }
 
 /*------------------------------------------------------------------------------------
- * Method: hello_message(sr_if_packet * sr_if_pk)
- * Detail to build the packet and send it by calling sr_send_packet.
+ * Method: pwospf_send_hello(struct sr_instance* sr, struct sr_if* interface)
+ * Send the hello of an interface.  The frame is built the first time and kept;
+ * after that only the router id and mask are checked, patching the checksum for
+ * whichever changed.
  *-----------------------------------------------------------------------------------*/
-void* hello_message(sr_if_packet * sr_if_pk)
+static void pwospf_send_hello(struct sr_instance* sr, struct sr_if* interface)
 {
-	uint8_t* hello_packet = NULL;
-	hello_packet = ((uint8_t*)(malloc(packet_len)));
-
-	int packet_len = sizeof(sr_ethernet_hdr) + sizeof(ip) + sizeof(ospfv2_hdr) + sizeof(ospfv2_hello_hdr);
-	Debug("\n\nPWOSPF: Constructing HELLO packet for interface %s: \n", sr_if_pk->interface->name);
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+	unsigned int ospf_len = sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_hello_hdr);
 
-	struct sr_ethernet_hdr* eth_hdr = (sr_ethernet_hdr*)(malloc(sizeof(sr_ethernet_hdr)));
-	struct ip* ip_hdr = (ip*)(malloc(sizeof(ip)));
-	struct ospfv2_hdr* ospf_hdr = (ospfv2_hdr*)(malloc(sizeof(ospfv2_hdr)));
-	struct ospfv2_hello_hdr* hello_hdr = (ospfv2_hello_hdr*)(malloc(sizeof(ospfv2_hello_hdr)));
-
-	// Copy the destination and source mac address from the target.
-	for (int i = 0; i < ETHER_ADDR_LEN; i++)
+	if (interface->hello_frame == NULL)
 	{
-		eth_hdr->ether_dhost[i] = hello_broadcast_addr[i];
-		eth_hdr->ether_shost[i] = (uint8_t)(sr_if_pk->interface->addr[i]);
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "\n\nPWOSPF: Constructing HELLO packet for interface %s: \n", interface->name);
+
+		interface->hello_frame = (uint8_t*)calloc(1, hdr_len + ospf_len);
+		assert(interface->hello_frame);
+		pwospf_fill_headers(interface->hello_frame, interface, ospf_len);
+
+		struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(interface->hello_frame + hdr_len);
+		struct ospfv2_hello_hdr* hello_hdr = (struct ospfv2_hello_hdr*)(interface->hello_frame + hdr_len + sizeof(struct ospfv2_hdr));
+		ospf_hdr->version = OSPF_V2;
+		ospf_hdr->type = OSPF_TYPE_HELLO;
+		ospf_hdr->len = htons(ospf_len);
+		ospf_hdr->rid = sr->ospf_subsys->router_id.s_addr;    //It is the highest IP address on a router [according to Cisco]
+		ospf_hdr->aid = htonl(171); //TODO now the area id dynamically
+		hello_hdr->nmask = interface->mask;
+		hello_hdr->helloint = htons(OSPF_DEFAULT_HELLOINT);
+		ospf_hdr->csum = cal_ICMPcksum((uint8_t*)ospf_hdr, ospf_len);
 	}
 
-	eth_hdr->ether_type = htons(ETHERTYPE_IP);
-	ip_hdr->ip_v = (sizeof(struct ip))/4;
-	ip_hdr->ip_hl = 5;
-	ip_hdr->ip_tos = 0;
-	ip_hdr->ip_len = htons((sizeof(ip)) + sizeof(ospfv2_hdr) + sizeof(ospfv2_hello_hdr));
-
-	ip_hdr->ip_id = 0; /* 0 */
-	ip_hdr->ip_sum = 0;
-	ip_hdr->ip_off = 0;
-	ip_hdr->ip_ttl = 64;
-	ip_hdr->ip_p = 89; // OSPFv2
-
-	ip_hdr->ip_src.s_addr = sr_if_pk->interface->ip;
-	ip_hdr->ip_dst.s_addr = htonl(OSPF_AllSPFRouters);
+	struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(interface->hello_frame + hdr_len);
+	struct ospfv2_hello_hdr* hello_hdr = (struct ospfv2_hello_hdr*)(interface->hello_frame + hdr_len + sizeof(struct ospfv2_hdr));
+	uint32_t mask = interface->mask;
+	if (ospf_hdr->rid != sr->ospf_subsys->router_id.s_addr)
+	{
+		ospf_hdr->csum = pwospf_csum_patch32(ospf_hdr->csum, ospf_hdr->rid, sr->ospf_subsys->router_id.s_addr);
+		ospf_hdr->rid = sr->ospf_subsys->router_id.s_addr;
+	}
+	if (hello_hdr->nmask != mask)
+	{
+		ospf_hdr->csum = pwospf_csum_patch32(ospf_hdr->csum, hello_hdr->nmask, mask);
+		hello_hdr->nmask = mask;
+	}
 
-	/* Re-Calculate checksum of the IP header */
-	ip_hdr->ip_sum = cal_ICMPcksum((uint8_t*)(ip_hdr), sizeof(ip));
-	ospf_hdr->version = OSPF_V2;
-	ospf_hdr->type = OSPF_TYPE_HELLO;
-	ospf_hdr->len = htons(sizeof(ospfv2_hdr) + sizeof(ospfv2_hello_hdr));
-	ospf_hdr->rid = router_id.s_addr;    //It is the highest IP address on a router [according to Cisco]
-	ospf_hdr->aid = htonl(171); //TODO now the area id dynamically
-	ospf_hdr->csum = 0;
-	ospf_hdr->autype = 0;
-	ospf_hdr->audata = 0;
-	hello_hdr->nmask = htonl(0xfffffffe);
-	hello_hdr->helloint = htons(OSPF_DEFAULT_HELLOINT);
-	hello_hdr->padding = 0;
-
-	// Create the packet
-	// Copy the content to the packet.
-	memcpy(hello_packet, eth_hdr, sizeof(sr_ethernet_hdr));
-	memcpy(hello_packet + sizeof(sr_ethernet_hdr), ip_hdr, sizeof(ip));
-	memcpy(hello_packet + sizeof(sr_ethernet_hdr) + sizeof(ip), ospf_hdr, sizeof(ospfv2_hdr));
-	memcpy(hello_packet + sizeof(sr_ethernet_hdr) + sizeof(ip) + sizeof(ospfv2_hdr), hello_hdr, sizeof(ospfv2_hello_hdr));
-
-	// Update the ospf2 header checksum.
-	uint8_t * temp_packet = hello_packet + sizeof(sr_ethernet_hdr) + sizeof(ip);
-	ospf_hdr->csum = calc_chsum(temp_packet, sizeof(ospfv2_hdr) + sizeof(ospfv2_hello_hdr));
-	ospf_hdr->csum = htons(ospf_hdr->csum);
-	//(ospfv2_hdr*)(hello_packet + sizeof(sr_ethernet_hdr) + sizeof(ip))->csum =
-	//    calc_cksum(hello_packet + sizeof(sr_ethernet_hdr) + sizeof(ip), sizeof(ospfv2_hdr) + sizeof(ospfv2_hello_hdr));
-
-	Debug("-> PWOSPF: Sending HELLO Packet of length = %d, out of the interface: %s\n", packet_len, sr_if_pk->interface->name);
-	sr_send_packet(sr_if_pk->sr, (uint8_t*)(hello_packet), packet_len, sr_if_pk->interface->name);
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Sending HELLO Packet of length = %d, out of the interface: %s\n", hdr_len + ospf_len, interface->name);
+	sr_send_packet_if(sr, interface->hello_frame, hdr_len + ospf_len, interface);
+	sr_stat_inc(sr, OSPF_HELLO_SENT);
+	sr->ospf_subsys->hello_sent++;
+}
 
+static uint64_t pwospf_cpu_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
 /*------------------------------------------------------------------------------------
- * Method: scan_neighbor_list(void* thread)
- * Scan the neighbor list, check if neighbors are alive or deleted them for the list.
+ * Method: pwospf_send_echoes(struct sr_instance* sr, uint64_t now)
+ * Fast liveness: count a miss for every neighbor that did not answer the last echo,
+ * take down the ones that missed echo_multiplier in a row, then send the next echo
+ * out of every interface with neighbors.  Only neighbors that answered an echo once
+ * are judged by them, a router without fast liveness keeps the hello timeout.
+ * Caller holds the subsystem lock.
  *-----------------------------------------------------------------------------------*/
-void* scan_neighbor_list(void* thread)
+static void pwospf_send_echoes(struct sr_instance* sr, uint64_t now)
 {
-	while(1)
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+	unsigned int ospf_len = sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_echo_hdr);
+	bool lost_neighbor = false;
+
+	subsys->echo_next = (now - subsys->echo_next < subsys->echo_interval) ?
+			subsys->echo_next + subsys->echo_interval : now + subsys->echo_interval;
+	if (subsys->router_id.s_addr == 0)
 	{
-		usleep(1000000);
+		return;
+	}
 
-		struct ospfv2_neighbor* tmp_walker = nbr_head;
+	for (struct sr_if* if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		struct pwospf_nbr_table* table = &if_walker->neighbors;
+		uint64_t cpu_start = pwospf_cpu_ns();
+		uint32_t num_up = 0;
+		uint32_t i = 0;
 
-		while(tmp_walker != NULL)
+		while (i < nbr_slots(table))
 		{
-			// If there is no neighbor in this interface, break from the scan.
-			if (tmp_walker->next == NULL)
+			struct pwospf_neighbor* neighbor = &table->slots[i];
+			if (neighbor->router_id == 0 || !neighbor->echo_up)
 			{
-				break;
+				i++;
+				continue;
 			}
 
-			// if the alive is zero then delete the neighbor from the list.
-			if (tmp_walker->next->alive == 0)
+			if (neighbor->echo_pending && ++neighbor->echo_missed >= subsys->echo_multiplier)
 			{
-				Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table\n\n", inet_ntoa(ptr->next->neighbor_id));
+				struct in_addr neighbor_id;
+				neighbor_id.s_addr = neighbor->router_id;
+				Debug("\n\n**** PWOSPF: Neighbor [ID = %s] on %s missed %u echoes, down %llu ms after its last reply\n\n",
+						inet_ntoa(neighbor_id), if_walker->name, neighbor->echo_missed,
+						(unsigned long long)(now - neighbor->echo_last));
+
+				if_walker->echo_lost = *neighbor;
+				if_walker->echo_lost_at = now;
+				subsys->echo_down++;
+
+				// Another neighbor may move into this slot, look at it again
+				nbr_remove(table, neighbor);
+				lost_neighbor = true;
+				continue;
+			}
 
-				neighbor_list* delete_neighbor = tmp_walker->next;
+			neighbor->echo_pending = 1;
+			num_up++;
+			i++;
+		}
 
-				if (tmp_walker->next->next != NULL)
-				{
-					tmp_walker->next = tmp_walker->next->next;
-				}
-				else
-				{
-					tmp_walker->next = NULL;
-				}
+		if (table->num == 0)
+		{
+			continue;
+		}
 
-				free(delete_neighbor);
-			}
-			else
+		if (if_walker->echo_frame == NULL)
+		{
+			if_walker->echo_frame = (uint8_t*)calloc(1, hdr_len + ospf_len);
+			assert(if_walker->echo_frame);
+			pwospf_fill_headers(if_walker->echo_frame, if_walker, ospf_len);
+
+			struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(if_walker->echo_frame + hdr_len);
+			struct ospfv2_echo_hdr* echo_hdr = (struct ospfv2_echo_hdr*)(if_walker->echo_frame + hdr_len + sizeof(struct ospfv2_hdr));
+			ospf_hdr->version = OSPF_V2;
+			ospf_hdr->type = OSPF_TYPE_ECHO;
+			ospf_hdr->len = htons(ospf_len);
+			ospf_hdr->rid = subsys->router_id.s_addr;
+			ospf_hdr->aid = htonl(171);
+			echo_hdr->origin = subsys->router_id.s_addr;
+			echo_hdr->seq = htonl(if_walker->echo_seq);
+			ospf_hdr->csum = cal_ICMPcksum((uint8_t*)ospf_hdr, ospf_len);
+		}
+
+		// Only the sequence number changes
+		struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(if_walker->echo_frame + hdr_len);
+		struct ospfv2_echo_hdr* echo_hdr = (struct ospfv2_echo_hdr*)(if_walker->echo_frame + hdr_len + sizeof(struct ospfv2_hdr));
+		uint32_t seq = htonl(++if_walker->echo_seq);
+		ospf_hdr->csum = pwospf_csum_patch32(ospf_hdr->csum, echo_hdr->seq, seq);
+		echo_hdr->seq = seq;
+
+		sr_send_packet_if(sr, if_walker->echo_frame, hdr_len + ospf_len, if_walker);
+		sr_stat_inc(sr, OSPF_ECHO_SENT);
+		subsys->echo_sent++;
+
+		// The send is shared by the neighbors it checks
+		if (num_up > 0)
+		{
+			uint64_t cpu_ns = (pwospf_cpu_ns() - cpu_start) / num_up;
+			for (i = 0; i < nbr_slots(table); i++)
 			{
-				// else deduce the alive for one.
-				tmp_walker->next->alive--;
+				if (table->slots[i].router_id != 0 && table->slots[i].echo_up)
+				{
+					table->slots[i].echo_cpu_ns += cpu_ns;
+				}
 			}
-
-			tmp_walker = tmp_walker->next;
 		}
-	};
+	}
 
+	// Tear the adjacency down now rather than at the hello timeout.
+	if (lost_neighbor)
+	{
+		pwospf_request_lsu(sr);
+	}
 }
 
 /*------------------------------------------------------------------------------------
- * Method: dijkstra_stack_push(struct route_dijkstra_node* dijkstra_first_item, struct route_dijkstra_node* dijkstra_new_item)
- * Push a visited node into the stack structure to calculate the dijkstra
+ * Method: handle_echo_packets(struct sr_instance* sr, struct sr_if* interface,
+ * uint8_t* packet, unsigned int length)
+ * Answer the echo requests of other routers out of the interface they came in on,
+ * and mark the neighbor that answered one of ours as alive.
  *-----------------------------------------------------------------------------------*/
-void dijkstra_stack_push(struct route_dijkstra_node* dijkstra_first_item, struct route_dijkstra_node* dijkstra_new_item)
+static void handle_echo_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length)
 {
-	if (dijkstra_first_item->next != NULL)
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+	unsigned int ospf_len = sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_echo_hdr);
+	uint64_t cpu_start = pwospf_cpu_ns();
+
+	if (length < hdr_len + ospf_len)
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: ECHO Packet dropped, too short\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
+
+	struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(packet + hdr_len);
+	struct ospfv2_echo_hdr* echo_hdr = (struct ospfv2_echo_hdr*)(packet + hdr_len + sizeof(struct ospfv2_hdr));
+	if (!pwospf_verify_checksum(ospf_hdr, ospf_len))
 	{
-		dijkstra_new_item->next = dijkstra_first_item->next;
-		dijkstra_first_item->next = dijkstra_new_item;
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: ECHO Packet dropped, invalid checksum\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
+
+	if (!echo_hdr->reply)
+	{
+		uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_echo_hdr)];
+		struct ospfv2_hdr* reply_ospf_hdr = (struct ospfv2_hdr*)(reply + hdr_len);
+		struct ospfv2_echo_hdr* reply_echo_hdr = (struct ospfv2_echo_hdr*)(reply + hdr_len + sizeof(struct ospfv2_hdr));
+
+		memcpy(reply + hdr_len, ospf_hdr, ospf_len);
+		pwospf_fill_headers(reply, interface, ospf_len);
+		reply_ospf_hdr->rid = subsys->router_id.s_addr;
+		reply_echo_hdr->reply = 1;
+		reply_ospf_hdr->csum = 0;
+		reply_ospf_hdr->csum = cal_ICMPcksum((uint8_t*)reply_ospf_hdr, ospf_len);
+		sr_send_packet_if(sr, reply, hdr_len + ospf_len, interface);
+		sr_stat_inc(sr, OSPF_ECHO_SENT);
+		return;
+	}
+
+	struct pwospf_neighbor* neighbor = nbr_find(&interface->neighbors, ospf_hdr->rid);
+	if (echo_hdr->origin != subsys->router_id.s_addr || neighbor == NULL ||
+			ntohl(echo_hdr->seq) != interface->echo_seq)
+	{
+		// Late, or from a router we have no adjacency with
+		return;
 	}
 
-	dijkstra_first_item->next = dijkstra_new_item;
+	neighbor->echo_up = 1;
+	neighbor->echo_pending = 0;
+	neighbor->echo_missed = 0;
+	neighbor->echo_last = subsys->clock(subsys->clock_arg);
+	neighbor->echo_replies++;
+	subsys->echo_replies++;
+	neighbor->echo_cpu_ns += pwospf_cpu_ns() - cpu_start;
 }
 
 /*------------------------------------------------------------------------------------
- * Method: dijkstra_stack_pop(struct route_dijkstra_node* dijkstra_first_item)
- * Pop a visited node into the stack structure to calculate the dijkstra
+ * Method: pwospf_expire_neighbors(struct sr_instance* sr, uint64_t now)
+ * Drop the neighbors whose hellos stopped OSPF_NEIGHBOR_TIMEOUT seconds ago and set
+ * the next deadline to the earliest expiry left.  Runs only when that deadline has
+ * passed, not once a second.  Caller holds the subsystem lock.
  *-----------------------------------------------------------------------------------*/
-struct route_dijkstra_node* dijkstra_stack_pop(struct route_dijkstra_node* dijkstra_first_item)
+static void pwospf_expire_neighbors(struct sr_instance* sr, uint64_t now)
 {
-	if (dijkstra_first_item->next == NULL)
+	bool lost_neighbor = false;
+	uint64_t next = 0;
+
+	for (struct sr_if* if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
 	{
-		return NULL;
+		struct pwospf_nbr_table* table = &if_walker->neighbors;
+		uint32_t i = 0;
+
+		while (i < nbr_slots(table))
+		{
+			struct pwospf_neighbor* neighbor = &table->slots[i];
+			if (neighbor->router_id != 0 && neighbor->expires <= now)
+			{
+				struct in_addr neighbor_id;
+				neighbor_id.s_addr = neighbor->router_id;
+				Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table of %s\n\n", inet_ntoa(neighbor_id), if_walker->name);
+
+				// Another neighbor may move into this slot, look at it again
+				nbr_remove(table, neighbor);
+				lost_neighbor = true;
+				continue;
+			}
+			if (neighbor->router_id != 0 && (next == 0 || neighbor->expires < next))
+			{
+				next = neighbor->expires;
+			}
+			i++;
+		}
 	}
-	else
+
+	sr->ospf_subsys->nbr_next = next;
+
+	// Tell the rest of the network that the link is gone, which also schedules the SPF.
+	if (lost_neighbor)
 	{
-		struct route_dijkstra_node* pResult = dijkstra_first_item->next;
+		pwospf_request_lsu(sr);
+	}
+}
 
-		dijkstra_first_item->next = dijkstra_first_item->next->next;
+/*------------------------------------------------------------------------------------
+ * Method: age_topology_entries(struct pwospf_subsys* subsys)
+ * Remove the routers whose LSU was not refreshed for OSPF_TOPO_ENTRY_TIMEOUT seconds.
+ *-----------------------------------------------------------------------------------*/
+static int age_topology_entries(struct pwospf_subsys* subsys)
+{
+	int removed = 0;
+	uint32_t now = subsys->uptime;
 
-		return pResult;
+	for (uint32_t i = subsys->lsdb.num_routers; i-- > 0; )
+	{
+		struct lsdb_router* router = subsys->lsdb.routers[i];
+		if (router->router_id.s_addr != subsys->router_id.s_addr &&
+				now - router->time_stamp > OSPF_TOPO_ENTRY_TIMEOUT)
+		{
+			Debug("-> PWOSPF: Topology entry of router %s timed out\n", inet_ntoa(router->router_id));
+			spf_update_router(&subsys->spf, router->router_id, NULL, 0);
+			lsdb_remove(&subsys->lsdb, router);
+			removed++;
+		}
 	}
+
+	return removed;
 }
 
 /*------------------------------------------------------------------------------------
- * Method: create_dikjstra_item(struct pwospf_topology_entry* new_topology_entry, uint8_t dist)
- * Create a new dijkstra list to save the router's node.
+ * Method: pwospf_fill_headers(uint8_t* packet, struct sr_if* interface, unsigned int ospf_len)
+ * Fill the ethernet and IP headers of a PWOSPF packet sent out of interface.
  *-----------------------------------------------------------------------------------*/
-struct route_dijkstra_node* create_dikjstra_item(struct pwospf_topology_entry* new_topology_entry, uint8_t dist)
-{
-	struct route_dijkstra_node* dijkstra_new_item = ((route_dijkstra_node*)(malloc(sizeof(route_dijkstra_node))));
-	dijkstra_new_item->topology_entry = new_topology_entry;
-	dijkstra_new_item->dist = dist;
-	dijkstra_new_item->prev = NULL;
-	dijkstra_new_item->next = NULL;
-	return dijkstra_new_item;
+static void pwospf_fill_headers(uint8_t* packet, struct sr_if* interface, unsigned int ospf_len)
+{
+	struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)packet;
+	struct ip* ip_hdr = (struct ip*)(packet + sizeof(struct sr_ethernet_hdr));
+
+	memcpy(eth_hdr->ether_dhost, hello_broadcast_addr, ETHER_ADDR_LEN);
+	memcpy(eth_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
+	eth_hdr->ether_type = htons(ETHERTYPE_IP);
+
+	ip_hdr->ip_v = 4;
+	ip_hdr->ip_hl = 5;
+	ip_hdr->ip_tos = 0;
+	ip_hdr->ip_len = htons(sizeof(struct ip) + ospf_len);
+	ip_hdr->ip_id = 0;
+	ip_hdr->ip_off = 0;
+	ip_hdr->ip_ttl = 64;
+	ip_hdr->ip_p = IPPROTO_OSPF;
+	ip_hdr->ip_src.s_addr = interface->ip;
+	ip_hdr->ip_dst.s_addr = htonl(OSPF_AllSPFRouters);
+	ip_hdr->ip_sum = 0;
+	ip_hdr->ip_sum = cal_IPchecksum(ip_hdr);
 }
 
-/*---------------------------------------------------------------------
- * Method: run_dijkstra(struct sr_instance* sr)
- *
- * Run Dijkstra algorithm, Let the node at which we are starting be
- * called the initial node. Let the distance of node Y be the distance from the initial node to Y.
- *---------------------------------------------------------------------*/
+/*------------------------------------------------------------------------------------
+ * Method: pwospf_request_lsu(struct sr_instance* sr)
+ * Our links changed.  The first change after a quiet period is advertised at once,
+ * the ones within OSPF_LSU_MIN_INTERVAL of the last LSU are collected and go out
+ * together in one LSU at the end of it.  Caller holds the subsystem lock.
+ *-----------------------------------------------------------------------------------*/
+static void pwospf_request_lsu(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	uint64_t now = subsys->clock(subsys->clock_arg);
+
+	subsys->lsu_events++;
+	if (subsys->lsu_due != 0)
+	{
+		return;
+	}
+
+	if (subsys->lsu_sequence == 0 || now - subsys->lsu_last >= OSPF_LSU_MIN_INTERVAL)
+	{
+		subsys->lsu_originated++;
+		originate_lsu(sr);
+	}
+	else
+	{
+		subsys->lsu_due = subsys->lsu_last + OSPF_LSU_MIN_INTERVAL;
+	}
+}
 
-void* run_dijkstra(struct sr_instance* sr)
+/*------------------------------------------------------------------------------------
+ * Method: originate_lsu(struct sr_instance* sr)
+ * Advertise the links of this router to all the neighbors, and install them in
+ * our own topology database. Caller holds the subsystem lock.
+ *
+ * All the links go in one LSU.  Only when that would exceed OSPF_MAX_LSU_SIZE is it
+ * split in fragments of the same sequence number, which the receivers collect before
+ * installing (lsdb_add_fragment); each interface gets all of them in one batch.
+ *-----------------------------------------------------------------------------------*/
+void originate_lsu(struct sr_instance* sr)
 {
-	// Mutex lock for the dijkstra calculation look}
-	pthread_mutex_lock(&mutex_lock_dijkstra);
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	struct sr_if* if_walker = NULL;
+	uint32_t num_adv = 0;
 
-	struct in_addr zero;
-	zero.s_addr = 0;
-	dijkstra_stack = create_dikjstra_item(create_pwospf_topology_entry(zero, zero, zero, zero, zero, 0), 0);
-	dijkstra_heap = create_dikjstra_item(create_pwospf_topology_entry(zero, zero, zero, zero, zero, 0), 0);
-	/* Cleaing the routing table */
-	// TODO
-	clear_routes(sr);
+	subsys->lsu_due = 0;
+	pwospf_set_router_id(sr);
+	if (subsys->router_id.s_addr == 0)
+	{
+		return;
+	}
 
-	struct sr_rt* entry = sr->routing_table;
-	while(entry/*->next*/ != NULL)
+	// One link per neighbor, an interface without any still advertises its subnet
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
 	{
-		//printf("entry: %s\t", inet_ntoa(entry->dest));
-		if (entry->next == NULL)
+		num_adv += if_walker->neighbors.num ? if_walker->neighbors.num : 1;
+	}
+
+	struct ospfv2_lsu* adv = (struct ospfv2_lsu*)malloc(num_adv * sizeof(struct ospfv2_lsu));
+	assert(adv);
+
+	uint32_t i = 0;
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		struct pwospf_nbr_table* table = &if_walker->neighbors;
+		uint32_t first = i;
+
+		for (uint32_t j = 0; j < nbr_slots(table); j++)
 		{
-			break;
+			if (table->slots[j].router_id != 0)
+			{
+				adv[i++].rid = table->slots[j].router_id;
+			}
 		}
-		//printf("entry->next: %s\n", inet_ntoa(entry->next->dest));
-		if (entry->next->admin_dst > 1)
+		if (i == first)
 		{
-			sr_del_rt_entry(entry);
+			adv[i++].rid = 0;
 		}
-		else
+		for (uint32_t j = first; j < i; j++)
 		{
-			entry = entry->next;
+			adv[j].subnet = if_walker->ip & if_walker->mask;
+			adv[j].mask = if_walker->mask;
 		}
 	}
 
+	// Split only if it does not fit in one packet
+	uint32_t per_packet = (OSPF_MAX_LSU_SIZE - sizeof(struct ospfv2_hdr) - sizeof(struct ospfv2_lsu_hdr)) / sizeof(struct ospfv2_lsu);
+	uint32_t num_packets = (num_adv + per_packet - 1) / per_packet;
+	if (num_packets > OSPF_MAX_LSU_FRAGMENTS)
+	{
+		Debug("-> PWOSPF: %u links do not fit in an LSU, advertising the first %u\n", num_adv, OSPF_MAX_LSU_FRAGMENTS * per_packet);
+		num_packets = OSPF_MAX_LSU_FRAGMENTS;
+		num_adv = num_packets * per_packet;
+	}
+
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+	uint8_t* packets[OSPF_MAX_LSU_FRAGMENTS];
+	unsigned int lens[OSPF_MAX_LSU_FRAGMENTS];
+	unsigned int ospf_lens[OSPF_MAX_LSU_FRAGMENTS];
+
+	subsys->lsu_sequence++;
+	subsys->lsu_last = subsys->clock(subsys->clock_arg);
+	subsys->lsu_countdown = OSPF_DEFAULT_LSUINT;
+
+	for (uint32_t p = 0; p < num_packets; p++)
+	{
+		uint32_t first = p * per_packet;
+		uint32_t num = (num_adv - first < per_packet) ? num_adv - first : per_packet;
+
+		ospf_lens[p] = sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr) + num * sizeof(struct ospfv2_lsu);
+		lens[p] = hdr_len + ospf_lens[p];
+		packets[p] = (uint8_t*)calloc(1, lens[p]);
+		assert(packets[p]);
+
+		struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(packets[p] + hdr_len);
+		struct ospfv2_lsu_hdr* lsu_hdr = (struct ospfv2_lsu_hdr*)(packets[p] + hdr_len + sizeof(struct ospfv2_hdr));
+
+		ospf_hdr->version = OSPF_V2;
+		ospf_hdr->type = OSPF_TYPE_LSU;
+		ospf_hdr->len = htons(ospf_lens[p]);
+		ospf_hdr->rid = subsys->router_id.s_addr;
+		ospf_hdr->aid = htonl(171);
+		lsu_hdr->seq = htons(subsys->lsu_sequence);
+		lsu_hdr->frag = num_packets > 1 ? (uint8_t)(p << 4 | num_packets) : 0;
+		lsu_hdr->ttl = OSPF_MAX_LSU_TTL;
+		lsu_hdr->num_adv = htonl(num);
+		memcpy(packets[p] + hdr_len + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr), adv + first, num * sizeof(struct ospfv2_lsu));
+		ospf_hdr->csum = cal_ICMPcksum((uint8_t*)ospf_hdr, ospf_lens[p]);
+	}
 
-	/* Run Dijkstra algorithm */
-	struct pwospf_topology_entry* topo_entry = topology_header->next;
-	while(topo_entry != NULL)
+	Debug("-> PWOSPF: Flooding LSU, sequence = %d, %d links in %u packets\n", subsys->lsu_sequence, num_adv, num_packets);
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
 	{
-		if (check_route(sr, topo_entry->net_num) == 0)
+		if (if_walker->neighbors.num == 0)
 		{
-			struct sr_if* temp_int = sr->if_list;
-			while (temp_int != NULL)
-			{
+			continue;
+		}
+		for (uint32_t p = 0; p < num_packets; p++)
+		{
+			pwospf_fill_headers(packets[p], if_walker, ospf_lens[p]);
+		}
+		sr_send_packet_batch(sr, packets, lens, num_packets, if_walker);
+		subsys->lsu_sent += num_packets;
+		sr_stat_add(sr, OSPF_LSU_SENT, num_packets);
+	}
 
-				if (search_topolgy_table(topology_header, (temp_int->ip & htonl(0xfffffffe))) == 0)
-				{
-					temp_int = temp_int->next;
-					continue;
-				}
+	// Our links in the tree come from the interfaces, not from the LSU
+	lsdb_install(&subsys->lsdb, subsys->router_id, subsys->lsu_sequence, adv, num_adv, subsys->uptime);
+	spf_set_root(&subsys->spf, subsys->router_id);
+	spf_update_interfaces(&subsys->spf, sr);
+	if (spf_pending(&subsys->spf))
+	{
+		pwospf_schedule_spf(sr);
+	}
 
-				if (temp_int->neighbor_id != 0)
-				{
-					struct in_addr mask;	    mask.s_addr = htonl(0xfffffffe);
-					struct in_addr subnet;	    subnet.s_addr = temp_int->ip & mask.s_addr;
-					struct in_addr neighbor_id;	    neighbor_id.s_addr = temp_int->neighbor_id;
-					struct in_addr next_hop;	    next_hop.s_addr = temp_int->neighbor_ip;
+	for (uint32_t p = 0; p < num_packets; p++)
+	{
+		free(packets[p]);
+	}
+	free(adv);
+}
 
-					dijkstra_stack_push(dijkstra_heap, create_dikjstra_item(create_pwospf_topology_entry(router_id, subnet, mask, neighbor_id,
-							next_hop, 0), 1));
-				}
+/*------------------------------------------------------------------------------------
+ * Method: handle_lsu_packets(struct sr_instance* sr,
+ * struct sr_if* interface,
+ * uint8_t* packet,
+ * unsigned int length)
+ * Install a new LSU in the topology database and forward it to the other neighbors.
+ *-----------------------------------------------------------------------------------*/
+void handle_lsu_packets(struct sr_instance* sr, struct sr_if* interface, uint8_t* packet, unsigned int length)
+{
+	unsigned int hdr_len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip);
+	struct ospfv2_hdr* ospf_hdr = (struct ospfv2_hdr*)(packet + hdr_len);
+	unsigned int ospf_len = ntohs(ospf_hdr->len);
 
-				temp_int = temp_int->next;
-			}
+	if (ospf_len < sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr))
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: LSU Packet dropped, too short\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
 
-			struct route_dijkstra_node* dijkstra_popped_item;
-			uint8_t stop = 0;
-			while(1)
-			{
-				while(1)
-				{
-					/* Pop from the heap */
-					dijkstra_popped_item = dijkstra_stack_pop(dijkstra_heap);
-
-					if (dijkstra_popped_item == NULL)
-					{
-						stop = 1;
-						break;
-					}
-
-					if (dijkstra_popped_item->topology_entry->net_num.s_addr == topo_entry->net_num.s_addr)
-					{
-						stop = 1;
-						break;
-					}
-
-					if (dijkstra_popped_item->topology_entry->neighbor_id.s_addr != 0)
-					{
-						break;
-					}
-				}
+	struct ospfv2_lsu_hdr* lsu_hdr = (struct ospfv2_lsu_hdr*)(packet + hdr_len + sizeof(struct ospfv2_hdr));
+	struct ospfv2_lsu* adv = (struct ospfv2_lsu*)(packet + hdr_len + sizeof(struct ospfv2_hdr) + sizeof(struct ospfv2_lsu_hdr));
+	uint32_t num_adv = ntohl(lsu_hdr->num_adv);
 
-				/* Push popped item in stack */
-				if (dijkstra_popped_item != NULL)
-				{
-					dijkstra_stack_push(dijkstra_stack, dijkstra_popped_item);
-				}
+	if (num_adv > (ospf_len - sizeof(struct ospfv2_hdr) - sizeof(struct ospfv2_lsu_hdr)) / sizeof(struct ospfv2_lsu))
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: LSU Packet dropped, invalid number of advertisements\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
 
+	struct in_addr rid;
+	rid.s_addr = ospf_hdr->rid;
+	uint16_t sequence_num = ntohs(lsu_hdr->seq);
 
-				/* stopping criteria here */
-				if (stop == 1)
-				{
-					break;
-				}
+	// Drop the LSU if we already have this one or a newer one, before
+	// spending anything on it: in a mesh most LSUs are such copies.
+	sr->ospf_subsys->lsu_received++;
+	interface->lsu_received++;
+	if (!lsdb_is_newer(&sr->ospf_subsys->lsdb, rid, sequence_num))
+	{
+		sr->ospf_subsys->lsu_duplicate++;
+		interface->lsu_duplicate++;
+		return;
+	}
 
+	if (!pwospf_verify_checksum(ospf_hdr, ospf_len))
+	{
+		sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: LSU Packet dropped, invalid checksum\n");
+		sr_stat_inc(sr, OSPF_DROP);
+		return;
+	}
 
-				/* Relaxing the popped item */
-				struct pwospf_topology_entry* ptr = topology_header->next;
-				while(ptr != NULL)
-				{
-					if ((ptr->router_id.s_addr == dijkstra_popped_item->topology_entry->neighbor_id.s_addr) &&
-							(ptr->net_num.s_addr != dijkstra_popped_item->topology_entry->net_num.s_addr) &&
-							(ptr->neighbor_id.s_addr != dijkstra_popped_item->topology_entry->neighbor_id.s_addr))
-					{
-						struct pwospf_topology_entry* clone = clone_pwospf_topology_entry(ptr);
-
-						struct route_dijkstra_node* to_be_pushed = create_dikjstra_item(clone, dijkstra_popped_item->cost + 1);
-						to_be_pushed->parent = dijkstra_popped_item;
-
-						// Push a visited node into the stack structure to calculate the dijkstra
-						dijkstra_stack_push(dijkstra_heap, to_be_pushed);
-
-						// Change the order of the best node
-						struct route_dijkstra_node* node_walker = dijkstra_heap;
-						while (node_walker->next != NULL)
-						{
-							if (node_walker->next->next == NULL)
-							{
-								break;
-							}
-
-							if (node_walker->next->cost > node_walker->next->next->cost)
-							{
-								struct route_dijkstra_node* temp_walker_1 = node_walker->next->next->next;
-								struct route_dijkstra_node* temp_walker_2 = node_walker->next->next;
-								node_walker->next->next->next = node_walker->next;
-								node_walker->next->next = temp_walker_1;
-								node_walker->next = temp_walker_2;
-							}
-							node_walker = node_walker->next;
-						}
-					}
-					ptr = ptr->next;
-				}
-			}
+	sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: Received LSU from %s, sequence = %d\n", inet_ntoa(rid), sequence_num);
 
-			struct route_dijkstra_node* final_item = dijkstra_stack_pop(dijkstra_stack);
+	// A fragment is only flooded on until the whole LSU is in, then installed
+	int complete = 1;
+	if (lsu_hdr->frag != 0)
+	{
+		if ((lsu_hdr->frag >> 4) >= (lsu_hdr->frag & 0x0f))
+		{
+			sr_log(SR_LOG_OSPF, SR_LOG_DEBUG, "-> PWOSPF: LSU Packet dropped, invalid fragment\n");
+			sr_stat_inc(sr, OSPF_DROP);
+			return;
+		}
 
-			if (final_item != NULL)
+		int state = lsdb_add_fragment(&sr->ospf_subsys->lsdb, rid, sequence_num, lsu_hdr->frag,
+				adv, num_adv, &adv, &num_adv);
+		if (state == LSDB_FRAGMENT_DUPLICATE)
+		{
+			sr->ospf_subsys->lsu_duplicate++;
+			interface->lsu_duplicate++;
+			return;
+		}
+		complete = (state == LSDB_FRAGMENT_COMPLETE);
+	}
+
+	if (complete)
+	{
+		interface->lsu_installed++;
+		if (lsdb_install(&sr->ospf_subsys->lsdb, rid, sequence_num, adv, num_adv, sr->ospf_subsys->uptime))
+		{
+			spf_update_router(&sr->ospf_subsys->spf, rid, adv, num_adv);
+			if (sr->ospf_subsys->lsu_pending == 0)
 			{
-				while (final_item->parent != NULL)
-				{
-					final_item = final_item->parent;
+				sr->ospf_subsys->lsu_pending = sr_stat_ticks(sr);
+			}
+			pwospf_schedule_spf(sr);
+		}
+	}
+
+	// Forward the LSU to all the other neighbors
+	if (lsu_hdr->ttl <= 1)
+	{
+		return;
+	}
 
-					struct sr_if* next_hop_int = sr->if_list;
-					while (next_hop_int != NULL)
-					{
-						if ((next_hop_int->ip & htonl(0xfffffffe)) == (final_item->topology_entry->next_hop.s_addr & htonl(0xfffffffe)))
-						{
-							break;
-						}
+	uint8_t* flood_packet = (uint8_t*)malloc(hdr_len + ospf_len);
+	memcpy(flood_packet, packet, hdr_len + ospf_len);
+	struct ospfv2_hdr* flood_ospf_hdr = (struct ospfv2_hdr*)(flood_packet + hdr_len);
+	struct ospfv2_lsu_hdr* flood_lsu_hdr = (struct ospfv2_lsu_hdr*)(flood_packet + hdr_len + sizeof(struct ospfv2_hdr));
 
-						next_hop_int = next_hop_int->next;
-					}
+	// Only the TTL changes, patch the checksum for its 16 bit word
+	uint16_t* ttl_word = (uint16_t*)&flood_lsu_hdr->frag;
+	uint16_t old_word = *ttl_word;
+	flood_lsu_hdr->ttl--;
+	flood_ospf_hdr->csum = pwospf_csum_patch(flood_ospf_hdr->csum, old_word, *ttl_word);
 
-					sr_add_rt_entry(sr, topo_entry->net_num, final_item->topology_entry->next_hop, topo_entry->net_mask, next_hop_int->name, 110);
-				}
-			}
+	struct sr_if* if_walker = sr->if_list;
+	while (if_walker != NULL)
+	{
+		if (if_walker != interface && if_walker->neighbors.num != 0)
+		{
+			pwospf_fill_headers(flood_packet, if_walker, ospf_len);
+			sr_send_packet_if(sr, flood_packet, hdr_len + ospf_len, if_walker);
+			sr->ospf_subsys->lsu_sent++;
+			sr_stat_inc(sr, OSPF_LSU_SENT);
+			if_walker->lsu_reflooded++;
+		}
+		if_walker = if_walker->next;
+	}
 
-			topo_entry = topo_entry->next;
+	free(flood_packet);
+}
+
+/*------------------------------------------------------------------------------------
+ * Method: check_static_route(struct sr_instance* sr, struct spf_subnet* subnet, struct sr_rt** last)
+ * Return 1 if a static route for the subnet exists, these take precedence.
+ * Leaves the last static route in *last, pwospf routes go after it.
+ *-----------------------------------------------------------------------------------*/
+static int check_static_route(struct sr_instance* sr, struct spf_subnet* subnet, struct sr_rt** last)
+{
+	struct sr_rt* rt_walker = sr->routing_table;
+	*last = NULL;
+	while (rt_walker != NULL && rt_walker->admin_dst == 1)
+	{
+		if (rt_walker->dest.s_addr == subnet->net_num.s_addr && rt_walker->mask.s_addr == subnet->net_mask.s_addr)
+		{
+			return 1;
+		}
+		*last = rt_walker;
+		rt_walker = rt_walker->next;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: install_routes(struct sr_instance* sr, struct spf_subnet* subnet, uint64_t hops,
+ * struct sr_rt* after)
+ *
+ * Make the routing table hold one entry per first hop in hops for the
+ * subnet, one after the other so the forwarding table takes them as one
+ * next hop group.  Entries it already has are rewritten in place, new
+ * ones go after 'after' when it has none.  No hops removes them all.
+ *---------------------------------------------------------------------*/
+static void install_routes(struct sr_instance* sr, struct spf_subnet* subnet, uint64_t hops,
+		struct sr_rt* after)
+{
+	struct pwospf_spf* spf = &sr->ospf_subsys->spf;
+	struct sr_rt* last = NULL;
+	uint32_t num = 0;
+
+	for (; hops != 0; hops &= hops - 1, num++)
+	{
+		uint32_t slot = __builtin_ctzll(hops);
+		struct in_addr gw;
+		gw.s_addr = spf->hop_ips[slot];
+
+		if (num < subnet->num_rt)
+		{
+			last = (num == 0) ? subnet->rt : last->next;
+			last->gw = gw;
+			strncpy(last->interface, spf->hop_interfaces[slot]->name, SR_IFACE_NAMELEN);
 		}
+		else
+		{
+			last = sr_add_rt_entry_after(sr, (num == 0) ? after : last, subnet->net_num, gw,
+					subnet->net_mask, spf->hop_interfaces[slot]->name, 110);
+			if (num == 0)
+			{
+				subnet->rt = last;
+			}
+		}
+	}
+
+	// Drop the entries left over, with no hops the first one last
+	for (uint32_t i = (num > 0) ? num : 1; i < subnet->num_rt; i++)
+	{
+		sr_del_rt_entry_after(sr, (num > 0) ? last : subnet->rt);
+	}
+	if (num == 0 && subnet->rt != NULL)
+	{
+		sr_del_rt_entry(sr, subnet->rt);
+		subnet->rt = NULL;
+	}
+	subnet->num_rt = num;
+}
 
-		Debug("\n-> PWOSPF: Dijkstra algorithm completed\n\n");
-		Debug("\n-> PWOSPF: Printing the forwarding table\n");
-		print_routing_table(sr);
+/*---------------------------------------------------------------------
+ * Method: run_spf(struct sr_instance* sr)
+ *
+ * Bring the pwospf routes up to date: apply the topology changes queued
+ * since the last run to the shortest path tree (sr_spf.c), rewrite only
+ * the routing table entries (one per equal cost first hop) of the
+ * subnets whose route changed and publish the result to the forwarding
+ * path in one swap (sr_fib.c).
+ * Caller holds the subsystem lock.
+ *---------------------------------------------------------------------*/
 
-		pthread_mutex_unlock(&mutex_lock_dijkstra);
+void* run_spf(struct sr_instance* sr)
+{
+	struct pwospf_subsys* subsys = sr->ospf_subsys;
+	struct timespec spf_start, spf_end;
+	uint64_t ticks_start = sr_stat_ticks(sr);
 
-		return NULL;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &spf_start);
+
+	uint32_t num_changes = spf_run(&subsys->spf, sr);
+	for (uint32_t i = 0; i < num_changes; i++)
+	{
+		struct spf_subnet* subnet = &subsys->spf.subnets[subsys->spf.changes[i]];
+		struct spf_route* route = &subnet->route;
+		struct sr_rt* last_static = NULL;
+
+		if (route->cost == SPF_INFINITY || check_static_route(sr, subnet, &last_static))
+		{
+			install_routes(sr, subnet, 0, NULL);
+		}
+		else
+		{
+			install_routes(sr, subnet, route->hops, last_static);
+		}
 	}
+
+	// Forwarding keeps using the old table until the new one is complete
+	if (num_changes > 0)
+	{
+		sr_fib_publish(sr);
+		sr_stat_since(sr, LSU_TO_FIB, subsys->lsu_pending);
+	}
+	subsys->lsu_pending = 0;
+	sr_stat_since(sr, SPF, ticks_start);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &spf_end);
+	subsys->spf_runs++;
+	subsys->spf_usec += (spf_end.tv_sec - spf_start.tv_sec) * 1000000LL +
+			(spf_end.tv_nsec - spf_start.tv_nsec) / 1000;
+
+	Debug("\n-> PWOSPF: SPF completed, %u routes changed\n\n", num_changes);
+	Debug("\n-> PWOSPF: Printing the forwarding table\n");
+#ifdef _DEBUG_
+	sr_print_routing_table(sr);
+#endif
+
+	return NULL;
+}
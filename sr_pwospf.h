@@ -1,6 +1,6 @@
 /*-----------------------------------------------------------------------------
  * file:  sr_pwospf.h
- * date:  Tue Nov 23 23:21:22 PST 2004 
+ * date:  Tue Nov 23 23:21:22 PST 2004
  * Author: Martin Casado
  *
  * Description:
@@ -12,68 +12,87 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <netinet/in.h>
 
 #include "sr_if.h"
 #include "sr_router.h"
 #include "sr_protocol.h"
+#include "pwospf_protocol.h"
+#include "sr_spf.h"
+#include "sr_lsdb.h"
 
 /* forward declare */
 struct sr_instance;
-in_addr router_id;
 
-pthread_t T_hello;
-pthread_t T_neighbor;
-pthread_t T_dijkstra;
-
-// Mutex lock for the dijkstra calculation look
-pthread_mutex_t mutex_lock_dijkstra = PTHREAD_MUTEX_INITIALIZER;
-
-// A list of all the neighbors.
-struct neighbor_list
-{
-    uint8_t alive; // in seconds
-    struct in_addr neighbor_id;
-    struct neighbor_list* next;
-}__attribute__ ((packed));
-
-struct neighbor_list* nbr_head;
-
-struct route_dijkstra_node
+/* -- SPF throttle: initial delay, then a hold time doubling up to max_wait -- */
+struct pwospf_spf_throttle
 {
-    // TODO struct ospfv2_topology_entry* topology_entry;
-    struct route_dijkstra_node* next;
-    struct route_dijkstra_node* prev;
-    uint8_t dist;
-} __attribute__ ((packed)) ;
-
-struct route_dijkstra_node* dijkstra_stack;
-struct route_dijkstra_node* dijkstra_heap;
+    uint32_t initial_delay; /* msec */
+    uint32_t hold_time;     /* msec */
+    uint32_t max_wait;      /* msec */
+    uint32_t wait;          /* current hold time */
+    uint64_t last_run;      /* msec, pwospf clock */
+    uint64_t due;           /* msec, when scheduled */
+    uint8_t scheduled;
+    uint8_t has_run;
+};
 
 struct pwospf_subsys
 {
     /* -- pwospf subsystem state variables here -- */
-
+    struct in_addr router_id;
+    struct pwospf_lsdb lsdb;                        /* topology database, see sr_lsdb.h */
+    struct pwospf_spf spf;                          /* SPF scratch, see sr_spf.h */
+    uint16_t lsu_sequence;  /* sequence number of the last LSU we originated */
+    uint8_t lsu_countdown;  /* seconds until the periodic LSU flood */
+    uint64_t lsu_last;      /* pwospf clock msec our last LSU went out at */
+    uint64_t lsu_due;       /* when the changes collected since go out, 0 if none */
+    uint32_t uptime;        /* seconds of pwospf time, see pwospf_tick() */
+    struct pwospf_spf_throttle spf_throttle;
+    uint64_t hello_next;    /* earliest hello deadline of the interfaces, 0 if none */
+    uint64_t nbr_next;      /* no neighbor expires before this, 0 if there are none */
+    uint32_t echo_interval; /* msec between echoes, 0 when fast liveness is off */
+    uint32_t echo_multiplier; /* missed echoes that take a neighbor down */
+    uint64_t echo_next;     /* pwospf clock msec of the next echoes, 0 when off */
+
+    /* -- msec clock of the timers, monotonic unless the owner sets it -- */
+    uint64_t (*clock)(void* arg);
+    void* clock_arg;
+
+    /* -- counters -- */
+    uint32_t hello_sent;
+    uint32_t lsu_sent;
+    uint32_t lsu_events;    /* changes of our links that asked for an LSU */
+    uint32_t lsu_originated; /* LSUs of our own sent for them, refreshes not counted */
+    uint32_t lsu_received;
+    uint32_t lsu_duplicate;  /* received ones not newer than the installed LSU */
+    uint32_t echo_sent;
+    uint32_t echo_replies;  /* answers to our echoes */
+    uint32_t echo_down;     /* neighbors taken down by missed echoes */
+    uint32_t spf_requested; /* topology changes that asked for an SPF */
+    uint32_t spf_runs;      /* SPFs run, the rest were coalesced */
+    uint64_t spf_usec;      /* cpu time spent in run_spf */
+    uint64_t lsu_pending;   /* sr_stats_ticks of the oldest LSU the next SPF is for, 0 none */
 
     /* -- thread and single lock for pwospf subsystem -- */
     pthread_t thread;
+    int running;                /* thread started by pwospf_init() */
+    int stop;                   /* set by pwospf_stop() */
     pthread_mutex_t lock;
+    pthread_cond_t timer_cond;  /* wakes the thread when an SPF is scheduled */
 };
 
-struct pwospf_topology_entry
-{
-    struct in_addr router_id;       /* router id */
-    struct in_addr subnet_ip;       /* subnetwork prefix */
-    struct in_addr subnet_mask;      /* subnetwork mask */
-    struct in_addr neighbor_id;     /* neighbour router id */
-   // struct in_addr next_hop;        /* next hop */
-    uint16_t sequence_num;         /* sequence number of the related LSU */
-    int time_stamp;                       /* the timestamp of this advertised link */
-    struct pwospf_topology_entry* next;
-}__attribute__ ((packed));
-
-struct pwospf_topology_entry* topology_header;
-
 int pwospf_init(struct sr_instance* sr);
-
+int pwospf_init_subsys(struct sr_instance* sr);
+void pwospf_stop(struct sr_instance* sr);
+void pwospf_tick(struct sr_instance* sr);
+void pwospf_timers(struct sr_instance* sr);
+int pwospf_next_timer(struct sr_instance* sr, uint64_t* when);
+void pwospf_set_spf_throttle(struct sr_instance* sr, uint32_t initial_delay,
+		uint32_t hold_time, uint32_t max_wait);
+void pwospf_set_echo(struct sr_instance* sr, uint32_t interval, uint32_t multiplier);
+void pwospf_lock(struct pwospf_subsys* subsys);
+void pwospf_unlock(struct pwospf_subsys* subsys);
+void handle_pwospf_packet(struct sr_instance* sr, uint8_t* packet, unsigned int length, struct sr_if* iface);
 
 #endif /* SR_PWOSPF_H */
@@ -13,6 +13,10 @@
  **********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <pthread.h>
@@ -23,6 +27,10 @@
 #include "sr_router.h"
 #include "sr_protocol.h"
 #include "sr_pwospf.h"
+#include "sr_fib.h"
+#include "sr_fcache.h"
+#include "sr_punt.h"
+#include "sr_stats.h"
 
 #define NO_ARP_REC -2
 #define UNKOWN_TYPE -1
@@ -46,6 +54,8 @@ void sr_init(struct sr_instance* sr)
     assert(sr);
 	sr->arp_cache = NULL;
 	sr->msg_cache = NULL;
+	pthread_mutex_init(&(sr->arp_lock), 0);
+	sr_fib_publish(sr);
 	pwospf_init(sr);
 	
     /* Add initialization code here! */
@@ -55,15 +65,16 @@ void sr_init(struct sr_instance* sr)
 
 
 /*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
+ * Method: sr_handlepacket(uint8_t* p,struct sr_if* iface)
  * Scope:  Global
  *
  * This method is called each time the router receives a packet on the
  * interface.  The packet buffer, the packet length and the receiving
  * interface are passed in as parameters. The packet is complete with
- * ethernet headers.
+ * ethernet headers.  The interface was looked up by name once when the
+ * frame came in, everything after that uses the record or its index.
  *
- * Note: Both the packet buffer and the character's memory are handled
+ * Note: Both the packet buffer and the interface record are handled
  * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
  * packet instead if you intend to keep it around beyond the scope of
  * the method call.
@@ -74,22 +85,24 @@ void sr_init(struct sr_instance* sr)
 void sr_handleARPpacket(struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface);
+        struct sr_if* sr_in);
 void sr_handleICMPpacket(struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface,
+        struct sr_if* sr_in,
         unsigned int ICMP_type,
         unsigned int ICMP_code); 
 void sr_handleIPpacket(struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface);  
+        struct sr_if* sr_in);  
 void sr_IPforward(struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface);
+        struct sr_if* sr_in);
 void Arp_Request(struct sr_instance * sr, struct in_addr dest);
+void Search_Message_Entry(struct sr_instance *sr, uint32_t ipadr, uint8_t *eth_addr);
+void Req_Timeout(struct sr_instance *sr);
 
 /*------------------------------------------
  * Calculate the checksum of the IP header
@@ -110,6 +123,26 @@ uint32_t cal_IPchecksum(struct ip* ip_hdr)
 }
 
 
+/*------------------------------------------
+ * Decrement the TTL, patching the checksum
+ * instead of recomputing it (RFC 1624)
+ *------------------------------------------*/
+void dec_IPttl(struct ip* ip_hdr)
+{
+	// TTL shares a 16 bit word with the protocol
+	uint16_t old_word, new_word;
+	uint32_t sum;
+
+	memcpy(&old_word, &ip_hdr->ip_ttl, 2);
+	ip_hdr->ip_ttl--;
+	memcpy(&new_word, &ip_hdr->ip_ttl, 2);
+	sum = (uint16_t)~ip_hdr->ip_sum + (uint16_t)~old_word + new_word;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	ip_hdr->ip_sum = ~sum;
+}
+
+
 /*------------------------------------------
  * Calculate the checksum of the ICMP header
  *------------------------------------------*/
@@ -132,51 +165,168 @@ uint16_t cal_ICMPcksum(uint8_t * packet, int len)
 }/* cal_ICMPcksum() */
 
 
+/*---------------------------------------------------------------------
+ * Method: sr_forward_fast(struct sr_instance* sr, uint8_t* packet,
+ * unsigned int len, struct sr_if* sr_in)
+ * Forward a valid transit IPv4 packet without options whose next hop is
+ * in the ARP cache.  Nothing is logged or allocated and no lock is waited
+ * for.  Returns 1 if the packet was sent, 0 if it is left untouched for
+ * the slow path.
+ *---------------------------------------------------------------------*/
+static int sr_forward_fast(struct sr_instance* sr, uint8_t* packet, unsigned int len, struct sr_if* sr_in)
+{
+	struct sr_ethernet_hdr *eth_hdr = (struct sr_ethernet_hdr *)packet;
+	struct ip *ip_hdr = (struct ip *)(packet + sizeof(struct sr_ethernet_hdr));
+	unsigned int ip_len = len - sizeof(struct sr_ethernet_hdr);
+
+	if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) ||
+			eth_hdr->ether_type != htons(ETHERTYPE_IP) ||
+			ip_hdr->ip_v != 4 || ip_hdr->ip_hl != 5 ||
+			ntohs(ip_hdr->ip_len) < sizeof(struct ip) || ntohs(ip_hdr->ip_len) > ip_len ||
+			ip_hdr->ip_ttl <= 1 || (uint16_t)cal_IPchecksum(ip_hdr) != 0 ||
+			sr_is_local_addr(sr, ip_hdr->ip_dst.s_addr))
+		return 0;
+
+	// a decision cached for the destination needs no lookups at all
+	if (sr_fcache_forward(sr, packet, len))
+	{
+		sr_stat_since(sr, FORWARD, sr_stats_packet_in);
+		sr_stat_inc(sr, FWD_CACHE);
+		sr_trace(FWD_CACHE, ip_hdr->ip_src.s_addr, ip_hdr->ip_dst.s_addr, sr_in->index, len);
+		return 1;
+	}
+
+	// generation first, a change during the lookup leaves a stale cache entry
+	uint32_t fib_generation = __atomic_load_n(&sr->fib_generation, __ATOMIC_ACQUIRE);
+	struct sr_if *forward_if = NULL;
+	struct in_addr ip_nexthop;
+	unsigned int num_hops = 0, member = 0;
+
+	const struct sr_fib *fib = sr_fib_read_lock(sr);
+	const struct sr_fib_entry *route = sr_fib_lookup(fib, ip_hdr->ip_dst);
+	if (route != NULL)
+	{
+		num_hops = route->num_hops;
+		member = sr_fib_member(num_hops, (uint8_t *)ip_hdr, ip_len);
+		ip_nexthop = route->hops[member].gw.s_addr != 0 ? route->hops[member].gw : ip_hdr->ip_dst;
+		forward_if = sr_get_interface_by_index(sr, route->hops[member].if_index);
+	}
+	sr_fib_read_unlock();
+
+	if (forward_if == NULL)
+		return 0;
+
+	// the slow path may hold the ARP lock for a while, never wait for it
+	if (pthread_mutex_trylock(&(sr->arp_lock)) != 0)
+		return 0;
+
+	struct arp_cache *en = sr->arp_cache;
+	while (en != NULL && en->ip.s_addr != ip_nexthop.s_addr)
+		en = en->next;
+	if (en == NULL)
+	{
+		pthread_mutex_unlock(&(sr->arp_lock));
+		sr_stat_inc(sr, ARP_MISS);
+		return 0;
+	}
+	memcpy(eth_hdr->ether_dhost, en->address, ETHER_ADDR_LEN);
+	uint32_t arp_generation = sr->arp_generation;
+	pthread_mutex_unlock(&(sr->arp_lock));
+	sr_stat_inc(sr, ARP_HIT);
+
+	memcpy(eth_hdr->ether_shost, forward_if->addr, ETHER_ADDR_LEN);
+	dec_IPttl(ip_hdr);
+	sr_fcache_insert(sr, ip_hdr->ip_dst.s_addr, fib_generation, num_hops, member,
+			ip_nexthop.s_addr, arp_generation, eth_hdr->ether_dhost,
+			eth_hdr->ether_shost, forward_if->index);
+	sr_stat_inc(sr, FWD_FAST);
+	sr_trace(FWD_FAST, ip_hdr->ip_src.s_addr, ip_hdr->ip_dst.s_addr, ip_nexthop.s_addr, forward_if->index);
+	sr_send_packet_if(sr, packet, len, forward_if);
+	sr_stat_since(sr, FORWARD, sr_stats_packet_in);
+	return 1;
+} /* sr_forward_fast() */
+
+
 /* ------------------------------------------------------- */
 /*               packet handle function                    */
-/* set packet to process based on their types, ARP or IP   */
+/* transit packets that can go out at once are forwarded   */
+/* here, everything else is punted to the slow path        */
 /* ------------------------------------------------------- */
 
 void sr_handlepacket(struct sr_instance* sr, 
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */)
+        struct sr_if* iface/* lent */)
 {
     /* REQUIRES */
     assert(sr);
     assert(packet);
-    assert(interface);
+    assert(iface);
+
+    sr_stats_packet_in = sr_stat_sample(sr);
+
+    if (sr_forward_fast(sr, packet, len, iface))
+        return;
+
+    if (sr_log_enabled(SR_LOG_FWD, SR_LOG_TRACE))
+    {
+        // addresses only of IP packets long enough to have them
+        struct ip *ip_hdr = (struct ip *)(packet + sizeof(struct sr_ethernet_hdr));
+        int has_ip = len >= sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) &&
+            get_EtherType(packet) == ETHERTYPE_IP;
+
+        sr_trace(FWD_PUNT, ntohs(((struct sr_ethernet_hdr *)packet)->ether_type),
+                has_ip ? ip_hdr->ip_src.s_addr : 0, has_ip ? ip_hdr->ip_dst.s_addr : 0,
+                iface->index);
+    }
+    sr_stat_inc(sr, PUNTED);
+    sr_punt_packet(sr, packet, len, iface);
+
+} /* sr_handlepacket() */
+
 
-    printf("*** -> Received packet of length %d \n",len);
+
+/* ------------------------------------------------------- */
+/*                 slow path, punted packets               */
+/* set packet to process based on their types, ARP or IP   */
+/* ------------------------------------------------------- */
+
+void sr_handlepacket_slow(struct sr_instance* sr, 
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        struct sr_if* iface/* lent */)
+{
+    sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "*** -> Received packet of length %d \n",len);
 
     // Recognize the Ethernet type
     short type = get_EtherType(packet);
     if(type == UNKOWN_TYPE)
     {
-        printf("Can't Recognize the Ethernet type \n");
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "Can't Recognize the Ethernet type \n");
+        sr_stat_inc(sr, DROP_ETHERTYPE);
         return;
     }
 
     // Request and respond function for ARP.
     if(type == ETHERTYPE_ARP)
     {
-        printf("received ARP packet\n");
-        sr_handleARPpacket(sr, packet, len, interface);
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "received ARP packet\n");
+        sr_handleARPpacket(sr, packet, len, iface);
     }
 
     // Handle the IP packet.
     else if(type == ETHERTYPE_IP)
     {
-        printf("received IP packet\n");
-        sr_handleIPpacket(sr, packet, len, interface);    
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "received IP packet\n");
+        sr_handleIPpacket(sr, packet, len, iface);    
     }   
 
 	else
 	{
-        printf("Unknown Ethernet type\n");
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "Unknown Ethernet type\n");
     }
 
-} /* sr_handlepacket() */
+} /* sr_handlepacket_slow() */
 
 
 
@@ -185,21 +335,22 @@ void sr_handlepacket(struct sr_instance* sr,
 /* ----------------- */
 void sr_handleARPpacket(struct sr_instance* sr, 
         uint8_t * packet, unsigned int len,
-        char* interface)
+        struct sr_if* sr_in)
 {
-    // Get the router interfaces from the packet and initiate the apr header.
-    struct sr_if *sr_in = sr_get_interface(sr, interface);
+    // Initiate the apr header.
     struct sr_arphdr *arphdr = (struct sr_arphdr *)(packet + sizeof(struct sr_ethernet_hdr));
 
     if(sr_in == 0) {
-        printf("Bad interface \n");
+        sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "Bad interface \n");
+        sr_stat_inc(sr, DROP_BAD_IFACE);
         return;
     }
 
     // Use ntohs function converts the unsigned short integer netshort from network byte order to host byte order.
     if(ntohs(arphdr->ar_op) == ARP_REQUEST) {
 
-		printf("get ARP_Request\n");
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "get ARP_Request\n");
+		sr_stat_inc(sr, ARP_REQUEST_RECV);
         // If it's the destination
         if(arphdr->ar_tip == sr_in->ip){
 
@@ -234,25 +385,29 @@ void sr_handleARPpacket(struct sr_instance* sr,
             // Send the packet to designated interface.
             // Have to cast the packet to uint8_t * to align with the sr_send_packet.
             int status;
-            status = sr_send_packet(sr, (uint8_t *)send_packet, packet_len, interface);
+            status = sr_send_packet_if(sr, (uint8_t *)send_packet, packet_len, sr_in);
             if(status == ERROR) {
                 // printf("The host are unavaliable to response \n");
             }
             // Success to send the packet back.
             else {
-                printf("Reply Packet sent for ARP request!\n");
+                sr_stat_inc(sr, ARP_REPLY_SENT);
+                sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "Reply Packet sent for ARP request!\n");
             }
 
             free(send_packet);
         }
         // If this is not the destination, just inform the user.
         else
-            printf("Packet Received\n");
+            sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "Packet Received\n");
     }
 
     else if(ntohs(arphdr->ar_op) == ARP_REPLY) {
 
-			printf("get ARP_Reply\n");
+			sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "get ARP_Reply\n");
+			sr_trace(ARP_REPLY, arphdr->ar_sip, sr_in->index, 0, 0);
+			sr_stat_inc(sr, ARP_REPLY_RECV);
+			pthread_mutex_lock(&(sr->arp_lock));
             // Init and add a new arp entry.
             struct arp_cache * cache_entry = NULL;
 
@@ -275,8 +430,10 @@ void sr_handleARPpacket(struct sr_instance* sr,
             cache_entry->next = NULL;
             cache_entry->ip.s_addr = arphdr->ar_sip;
             cache_entry->timestamp = time(NULL);
+            __atomic_add_fetch(&sr->arp_generation, 1, __ATOMIC_RELEASE);
 
 			Search_Message_Entry(sr, arphdr->ar_sip, arphdr->ar_sha);
+			pthread_mutex_unlock(&(sr->arp_lock));
 
     }
 } /*  sr_handleARPpacket  */
@@ -305,37 +462,48 @@ short get_EtherType(uint8_t *packet){
  * Add message request to cache
  *--------------------------------*/
 void Add_Message_Entry(struct sr_instance *sr, uint8_t *packet, 
-		unsigned int len, char *interface_pre, char *interface, 
+		unsigned int len, unsigned int if_index_pre, unsigned int if_index, 
 		struct in_addr ip)
 {
 	struct in_addr dest_ip = ip;
 	uint8_t *packet_entry = malloc(len);
 	memcpy(packet_entry, packet, len);
 	struct msg_cache *msg_cache_index = sr->msg_cache;
+	struct msg_cache *msg_cache_tail = NULL;
 
 	while(msg_cache_index != NULL)
 	{
+		msg_cache_tail = msg_cache_index;
 		msg_cache_index = msg_cache_index->next;
 	}
 
 	msg_cache_index = malloc(sizeof(struct msg_cache));
-	if (sr->msg_cache == NULL)
+	if (msg_cache_tail == NULL)
 	{
 		sr->msg_cache = msg_cache_index;
 	}
+	else
+	{
+		msg_cache_tail->next = msg_cache_index;
+	}
 
 	msg_cache_index->packet = packet_entry;
 	msg_cache_index->ip = ip;
-	msg_cache_index->interface = interface;
-	msg_cache_index->interface_pre = interface_pre;
+	msg_cache_index->if_index = if_index;
+	msg_cache_index->if_index_pre = if_index_pre;
 	msg_cache_index->counter = 0;
+	msg_cache_index->timestamp = time(NULL);
+	msg_cache_index->ticks_in = sr_stats_packet_in;
+	msg_cache_index->ticks_queued = sr_stat_ticks(sr);
 	msg_cache_index->length = len;
 	msg_cache_index->next = NULL;
 
-	printf("add the msg entry\n");
+	sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "add the msg entry\n");
+	sr_trace(ARP_WAIT, ip.s_addr, ((struct ip *)(packet + sizeof(struct sr_ethernet_hdr)))->ip_src.s_addr,
+			((struct ip *)(packet + sizeof(struct sr_ethernet_hdr)))->ip_dst.s_addr, 0);
 
 	Arp_Request(sr, dest_ip);
-	printf("send arp request\n");
+	sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "send arp request\n");
 
 } /* Add_Message_Entry() */
 
@@ -347,82 +515,122 @@ void Add_Message_Entry(struct sr_instance *sr, uint8_t *packet,
  *-----------------------------------*/
 void Search_Message_Entry(struct sr_instance *sr, uint32_t ipadr, uint8_t *eth_addr)
 {
-	struct arp_cache *arp_entry_index = sr->arp_cache;
 	struct msg_cache *msg_cache_index = sr->msg_cache;
 	struct msg_cache *pre_msg = NULL;
+	int sent = 0;
 
-	while (msg_cache_index != NULL && (msg_cache_index->ip.s_addr != ipadr))
-	{
-		pre_msg = msg_cache_index;
-		msg_cache_index = msg_cache_index->next;
-	}
-	printf("search msg cache\n");
+	sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "search msg cache\n");
 
-	if (msg_cache_index != NULL)
+	// Every packet queued for this address goes out now
+	while (msg_cache_index != NULL)
 	{
-		printf("find a message entry\n");
+		if (msg_cache_index->ip.s_addr != ipadr)
+		{
+			pre_msg = msg_cache_index;
+			msg_cache_index = msg_cache_index->next;
+			continue;
+		}
+
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "find a message entry\n");
 		struct sr_ethernet_hdr *eth_hdr = (struct sr_ethernet_hdr *)(msg_cache_index->packet);
 		memcpy(eth_hdr->ether_dhost, eth_addr, ETHER_ADDR_LEN);
-		sr_send_packet(sr, msg_cache_index->packet, msg_cache_index->length, msg_cache_index->interface);
-		printf("a waiting message been sent\n");
-
+		sr_send_packet_if(sr, msg_cache_index->packet, msg_cache_index->length,
+				sr_get_interface_by_index(sr, msg_cache_index->if_index));
+		sr_stat_since(sr, FORWARD, msg_cache_index->ticks_in);
+		sr_stat_since(sr, ARP_RESOLVE, msg_cache_index->ticks_queued);
+		sr_stat_inc(sr, FWD_SLOW);
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "a waiting message been sent\n");
+
+		struct msg_cache *sent_msg = msg_cache_index;
+		msg_cache_index = msg_cache_index->next;
 		if (pre_msg != NULL)
-			pre_msg->next = msg_cache_index->next;
+			pre_msg->next = msg_cache_index;
 		else
-			sr->msg_cache = msg_cache_index->next;
-		
-		free(msg_cache_index->packet);
-		free(msg_cache_index);
-		printf("delete sent message\n");
+			sr->msg_cache = msg_cache_index;
+
+		free(sent_msg->packet);
+		free(sent_msg);
+		sent++;
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "delete sent message\n");
 	}
-	else
-		printf("no IP matched message entry \n");
+
+	if (sent == 0)
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "no IP matched message entry \n");
 } /* Search_Message_Entry() */
 
 
 /*-----------------------------------------------------------
- * Method: void Arp_Cache_Timeout(struct sr_instance *sr)
- * Calculate the timeout for arp table in every minute.
+ * Method: void* Arp_Cache_Timeout(void *arg)
+ * Calculate the timeout for arp table in every second.
  * Remove the timeout Entry.
  *----------------------------------------------------------*/
-void Arp_Cache_Timeout(struct sr_instance *sr){
+void* Arp_Cache_Timeout(void *arg){
+	struct sr_instance *sr = (struct sr_instance *)arg;
 
-	while(1){
+	while(!__atomic_load_n(&sr->arp_stop, __ATOMIC_ACQUIRE)){
 		sleep(1);
-		
+
+		pthread_mutex_lock(&(sr->arp_lock));
+
 		// every time calling this function, init the scan.
-		struct arp_cache *curCache = NULL;
-		
-		if(sr->arp_cache != NULL)
-			curCache = sr->arp_cache;
-
-		if(curCache != NULL){// protect
-			while(curCache != NULL){
-				time_t curtime = time(NULL);
-				if(difftime(curtime, curCache->timestamp) > ARP_TIMEOUT){
-					struct arp_cache *freeCache = curCache;
-
-					if(curCache->next != NULL){
-						curCache = curCache->next;
-						free(freeCache);
-						sr->arp_cache = curCache;
-					}
-					else
-						curCache = NULL;
-
-				// Iterator moves forward
-				}else{
-					//prevCache = curCache;
-					if(curCache-> next != NULL)
-						curCache = curCache->next;
-				}
+		struct arp_cache *curCache = sr->arp_cache;
+		struct arp_cache *prevCache = NULL;
+
+		while(curCache != NULL){
+			time_t curtime = time(NULL);
+			if(difftime(curtime, curCache->timestamp) > ARP_TIMEOUT){
+				struct arp_cache *freeCache = curCache;
+
+				curCache = curCache->next;
+				if(prevCache != NULL)
+					prevCache->next = curCache;
+				else
+					sr->arp_cache = curCache;
+				free(freeCache);
+				__atomic_add_fetch(&sr->arp_generation, 1, __ATOMIC_RELEASE);
+
+			// Iterator moves forward
+			}else{
+				prevCache = curCache;
+				curCache = curCache->next;
 			}
 		}
 
 		// Calculate the timeout for the outstanding request packets.
 		Req_Timeout(sr);
-		
+
+		pthread_mutex_unlock(&(sr->arp_lock));
 	}
+
+	return NULL;
+}
+
+/*-----------------------------------------------------------
+ * Method: int sr_arp_timeout_start(struct sr_instance *sr)
+ * Start the thread that runs Arp_Cache_Timeout, 0 on success.
+ *----------------------------------------------------------*/
+int sr_arp_timeout_start(struct sr_instance *sr){
+	sr->arp_stop = 0;
+	if(pthread_create(&sr->arp_thread, NULL, Arp_Cache_Timeout, (void*)sr)){
+		perror("pthread_create");
+		return -1;
+	}
+	sr->arp_running = 1;
+	return 0;
+}
+
+/*-----------------------------------------------------------
+ * Method: void sr_arp_timeout_stop(struct sr_instance *sr)
+ * Stop that thread once its current round is done, which
+ * takes up to a second.  It sends ARP requests and ICMP
+ * errors, so nothing they use may go before it has stopped.
+ *----------------------------------------------------------*/
+void sr_arp_timeout_stop(struct sr_instance *sr){
+	if(!sr->arp_running)
+		return;
+	__atomic_store_n(&sr->arp_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(sr->arp_thread, NULL);
+	sr->arp_running = 0;
 }
 
 
@@ -437,34 +645,30 @@ void Req_Timeout(struct sr_instance *sr){
 	struct msg_cache *prevReq = NULL;
 
 	curReq = sr->msg_cache;
-	if(curReq != NULL){
-		nextReq = curReq->next;
-	}
 	while(curReq != NULL)
 	{
+		nextReq = curReq->next;
 
 		time_t dif = difftime(time(0),curReq->timestamp);
 		if(dif > PACKET_RESEND_TIME){
 			if(curReq->counter >= MAX_TIME_SENT){
-				// if doesn't have prevReq, free this node.
-	            if (prevReq == NULL) {
-	                sr->msg_cache = curReq->next;
-		            // Send ICMP unreachable.
-	                sr_handleICMPpacket(sr, curReq->packet , curReq->length, curReq->interface_pre, 3 , 1);
-	                free(curReq);
-	                curReq = curReq->next;
-	            // otherwise skip  this node.
-	            } else {
-	                prevReq->next = curReq->next;
-		            // Send ICMP unreachable.
-	                sr_handleICMPpacket(sr, curReq->packet , curReq->length, curReq->interface_pre, 3 , 1);
-	                free(curReq);
-	                curReq = prevReq->next;
-	            }
-	            //sr_handleICMPpacket(sr, curReq->packet , curReq->length, curReq->interface,3 , 1);
+				// unlink this node and answer the sender.
+	            if (prevReq == NULL)
+	                sr->msg_cache = nextReq;
+	            else
+	                prevReq->next = nextReq;
+
+	            // Send ICMP unreachable.
+	            sr_stat_inc(sr, DROP_ARP_TIMEOUT);
+	            sr_handleICMPpacket(sr, curReq->packet , curReq->length,
+	                    sr_get_interface_by_index(sr, curReq->if_index_pre), 3 , 1);
+	            free(curReq->packet);
+	            free(curReq);
+	            curReq = nextReq;
+	            continue;
 
 			}else{
-	        	printf("Resend arp request %d times ! \n", curReq->counter);
+	        	sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "Resend arp request %d times ! \n", curReq->counter);
 		        Arp_Request(sr, curReq->ip);
 		        curReq->counter++;
 		        curReq->timestamp = time(NULL);
@@ -473,8 +677,6 @@ void Req_Timeout(struct sr_instance *sr){
 
 		prevReq = curReq;
 		curReq = nextReq;
-		if(curReq != NULL)
-			nextReq = curReq->next;
 	}
 }
 
@@ -489,7 +691,7 @@ struct arp_cache *Look_up_ARPCache(struct sr_instance * sr, struct in_addr ip) {
 
 	cache_entry = sr->arp_cache;
 	uint8_t addr = 0;
-	printf("get into ARPCache look up\n");
+	sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "get into ARPCache look up\n");
 	while(cache_entry != NULL) {
 		if(cache_entry->ip.s_addr == ip.s_addr)
 			break;
@@ -501,7 +703,7 @@ struct arp_cache *Look_up_ARPCache(struct sr_instance * sr, struct in_addr ip) {
 		addr = 0;
 	else
 	{
-		printf("find matched IP entry %s \n",inet_ntoa(cache_entry->ip));
+		sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "find matched IP entry %s \n",inet_ntoa(cache_entry->ip));
 		addr = cache_entry->address;
 	}
 	
@@ -534,6 +736,8 @@ void Arp_Request(struct sr_instance * sr, struct in_addr dest){
 
 	struct sr_if *interface = sr->if_list;
 
+	sr_trace(ARP_REQUEST, dest.s_addr, 0, 0, 0);
+
 	// Broadcast to all the interface on router
 	while(interface != NULL)
 	{
@@ -541,9 +745,11 @@ void Arp_Request(struct sr_instance * sr, struct in_addr dest){
 		memcpy(eth_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
 		arp_hdr->ar_sip = interface->ip;
 		int status;
-		status = sr_send_packet(sr, packet, sizeof (struct sr_ethernet_hdr) + sizeof (struct sr_arphdr), interface->name);
+		status = sr_send_packet_if(sr, packet, sizeof (struct sr_ethernet_hdr) + sizeof (struct sr_arphdr), interface);
 		if(status == ERROR)
-			printf("Send arp request error ! \n");
+			sr_log(SR_LOG_ARP, SR_LOG_DEBUG, "Send arp request error ! \n");
+		else
+			sr_stat_inc(sr, ARP_REQUEST_SENT);
 		interface = interface->next;
 	}
 
@@ -561,26 +767,27 @@ void sr_handleICMPpacket(
         struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface,
+        struct sr_if* sr_in,
         unsigned int ICMP_type,
         unsigned int ICMP_code)
 {
-    // acquire interface name
-    struct sr_if *sr_in = sr_get_interface(sr, interface);
-	struct sr_if *temp_interface = sr_in;
 
     // ICMP message information
     if (ICMP_type == 11 && ICMP_code == 0){
-        printf("TTL time out\n");}
+        sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "TTL time out\n");
+        sr_stat_inc(sr, ICMP_TIME_EXCEEDED);}
 
     if (ICMP_type == 3 && ICMP_code == 1){
-        printf("Host Unreachable\n");}
+        sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "Host Unreachable\n");
+        sr_stat_inc(sr, ICMP_HOST_UNREACH);}
 
     if (ICMP_type == 3 && ICMP_code == 3){
-        printf("Port Unreachable\n");}
+        sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "Port Unreachable\n");
+        sr_stat_inc(sr, ICMP_PORT_UNREACH);}
 
     if (ICMP_type == 0 && ICMP_code == 0){
-        printf("ICMP echo reply\n");}
+        sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "ICMP echo reply\n");
+        sr_stat_inc(sr, ICMP_ECHO_REPLY);}
         
 
     //     build ICMP packet       //           
@@ -589,7 +796,7 @@ void sr_handleICMPpacket(
 	uint8_t *icmp_packet = malloc(sizeof(uint8_t) * len);
     memcpy(icmp_packet, packet, len);
 	
-    printf("build ICMP\n");
+    sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "build ICMP\n");
 	
     // initiate ICMP packet header
     struct sr_ICMPhdr *icmp_hdr = (struct sr_ICMPhdr *)(icmp_packet + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip));
@@ -626,13 +833,14 @@ void sr_handleICMPpacket(
 	icmp_hdr->checksum = cal_ICMPcksum(icmp_hdr, len - sizeof(struct sr_ethernet_hdr) - sizeof(struct ip));
 	
 	// send final ICMP packet
+	sr_trace(ICMP_SEND, ICMP_type, ICMP_code, icmp_ip->ip_dst.s_addr, sr_in->index);
 	if (ICMP_type != 20)
-		sr_send_packet(sr, icmp_packet, len, interface);
+		sr_send_packet_if(sr, icmp_packet, len, sr_in);
 	else
-		sr_send_packet(sr, icmp_packet, sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ICMPhdr) + sizeof(struct ip)*2 + 8, interface);
+		sr_send_packet_if(sr, icmp_packet, sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ICMPhdr) + sizeof(struct ip)*2 + 8, sr_in);
 	
-	printf("ICMP message sent from %s to ", inet_ntoa(icmp_ip->ip_src));
-	printf("%s\n  ", inet_ntoa(icmp_ip->ip_dst));
+	sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "ICMP message sent from %s to ", inet_ntoa(icmp_ip->ip_src));
+	sr_log(SR_LOG_ICMP, SR_LOG_DEBUG, "%s\n  ", inet_ntoa(icmp_ip->ip_dst));
 
     free(icmp_packet);
 	free(ethernet_temp);
@@ -647,64 +855,53 @@ void sr_handleICMPpacket(
 void sr_IPforward(struct sr_instance* sr, 
         uint8_t * packet,
         unsigned int len,
-        char* interface)
+        struct sr_if* sr_in)
 {
-	char* interface_temp = (char *)malloc(sizeof(char) * SR_IFACE_NAMELEN);
-	strncpy(interface_temp, interface, SR_IFACE_NAMELEN);   // copy of the input interface;
-	
     // use dest_IP address search routing table for next hop
     struct ip *ip_hdr = NULL;
     ip_hdr = (struct ip *)(sizeof(struct sr_ethernet_hdr) + packet);
     struct in_addr ip_dst_temp = ip_hdr->ip_dst;
     struct in_addr ip_nexthop;
 
-    // searching routing table for next hop IP address
-    struct sr_rt * rt_temp = sr->routing_table;
+    // searching the published forwarding table for next hop IP address,
+    // copying what we need out of it before leaving the read section
 	struct sr_if *forward_if = NULL;
 
-    while (rt_temp != NULL)
-    {
-
-        if ((rt_temp->dest.s_addr != 0) && ((ip_dst_temp.s_addr & rt_temp->mask.s_addr) == rt_temp->dest.s_addr))
-        {
-            printf("found next hop Ip\n");
-            if (rt_temp->gw.s_addr != 0)
-            {
-                ip_nexthop = rt_temp->gw;
-            }
-            else
-            {
-                ip_nexthop = ip_dst_temp;
-			}
-
-			interface = (char *)(rt_temp->interface);
-			forward_if = sr_get_interface(sr, interface);
-			printf("next hop address %s \n", inet_ntoa(ip_nexthop));
-            break;   
-        }
-               
-        else
-            rt_temp = rt_temp->next;
-    }
+	const struct sr_fib *fib = sr_fib_read_lock(sr);
+	const struct sr_fib_entry *route = sr_fib_lookup(fib, ip_dst_temp);
+	if (route != NULL)
+	{
+		// the flow hash picks one member of a multipath route
+		const struct sr_fib_nexthop *hop = sr_fib_select(route, (uint8_t *)ip_hdr, len - sizeof(struct sr_ethernet_hdr));
 
-    // not found destination IP in routing table
-    // use default gateway
-    if (rt_temp == NULL) 
-    {
-        rt_temp = sr->routing_table;
-		while (rt_temp != NULL)
-			if (rt_temp->dest.s_addr == 0)
-			{
-				ip_nexthop = rt_temp->gw;
-				interface = (char *)(rt_temp->interface);
-				forward_if = sr_get_interface(sr, interface);
-				printf("next hop address %s \n", inet_ntoa(ip_nexthop));
-				break;
-			}
+		sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "found next hop Ip\n");
+		if (hop->gw.s_addr != 0)
+		{
+			ip_nexthop = hop->gw;
+		}
 		else
-            rt_temp = rt_temp->next;
-    }
+		{
+			ip_nexthop = ip_dst_temp;
+		}
+
+		forward_if = sr_get_interface_by_index(sr, hop->if_index);
+		sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "next hop address %s \n", inet_ntoa(ip_nexthop));
+	}
+	sr_fib_read_unlock();
 	
+	// no route and no default gateway, drop the packet
+	if (forward_if == NULL)
+	{
+		sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "no route to %s\n", inet_ntoa(ip_dst_temp));
+		sr_trace(FWD_NOROUTE, ip_hdr->ip_src.s_addr, ip_dst_temp.s_addr, 0, 0);
+		sr_stat_inc(sr, DROP_NO_ROUTE);
+		return;
+	}
+
+	sr_trace(FWD_SLOW, ip_hdr->ip_src.s_addr, ip_dst_temp.s_addr, ip_nexthop.s_addr, forward_if->index);
+
+	pthread_mutex_lock(&(sr->arp_lock));
+
 	// search ARP cache table find next hop mac address
     struct arp_cache *en = Look_up_ARPCache(sr, ip_nexthop);
 
@@ -713,22 +910,28 @@ void sr_IPforward(struct sr_instance* sr,
 
     if (en != NULL)
     {
-        printf("found Mac address for the destination %d, ethAddr_nexthop\n");
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "found Mac address for the next hop\n");
 
 		memcpy(forward_ethernet->ether_dhost, en->address, ETHER_ADDR_LEN);
-		sr_send_packet(sr, packet, len, interface);
-		printf("send forward IP packet\n");
+		sr_send_packet_if(sr, packet, len, forward_if);
+		sr_stat_since(sr, FORWARD, sr_stats_packet_in);
+		sr_stat_inc(sr, ARP_HIT);
+		sr_stat_inc(sr, FWD_SLOW);
+		sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "send forward IP packet\n");
 	}
 	else 
 	{
-		printf("add to message cache\n");
+		sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "add to message cache\n");
+		sr_stat_inc(sr, ARP_MISS);
 
 		uint8_t * waiting_packet = malloc(len);
 		memcpy(waiting_packet, packet, len);
-		Add_Message_Entry(sr, waiting_packet, len, interface_temp, interface, ip_nexthop);
+		Add_Message_Entry(sr, waiting_packet, len, sr_in->index, forward_if->index, ip_nexthop);
 		free(waiting_packet);
 	}
 
+	pthread_mutex_unlock(&(sr->arp_lock));
+
 }/* sr_IPforward() */
 
 
@@ -737,72 +940,68 @@ void sr_IPforward(struct sr_instance* sr,
  *-----------------------*/
 void sr_handleIPpacket(struct sr_instance* sr, 
         uint8_t * packet, unsigned int len,
-        char* interface)
+        struct sr_if* sr_in)
 {
     struct ip *ip_hdr = NULL;
     ip_hdr = (struct ip *)(sizeof(struct sr_ethernet_hdr) + packet);
 
-    printf("source IP address %s to ", inet_ntoa(ip_hdr->ip_src));
-    printf("dest IP address %s \n", inet_ntoa(ip_hdr->ip_dst));
-
-	// compare ip address and then get interface IP address
-    struct sr_if *sr_in = sr_get_interface(sr, interface);
+    sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "source IP address %s to ", inet_ntoa(ip_hdr->ip_src));
+    sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "dest IP address %s \n", inet_ntoa(ip_hdr->ip_dst));
 
     if (sr_in == 0)     
     {
-        printf("Bad interface \n");
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "Bad interface \n");
+        sr_stat_inc(sr, DROP_BAD_IFACE);
         return;
     }
-    else 
+    // destination IP address is not the router, any interface of it or AllSPFRouters
+    else if (!sr_is_local_addr(sr, ip_hdr->ip_dst.s_addr))
     {
-        struct sr_if *temp_interface = sr_in;
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "destination is not the router\n");
 
-        // check if destination IP address is the router
-        while (temp_interface)
-        {
-            if (temp_interface->ip == ip_hdr->ip_dst.s_addr) 
-            {
-                printf("destination is the router\n");
-
-                // ICMP Type
-                if (ip_hdr->ip_p == IPPROTO_ICMP)
-                {
-                    sr_handleICMPpacket(sr, packet, len, interface, 0, 0);
-					printf("finish ICMP echo\n");
-                    break;
-                }
-                // TCP/UDP type, drop the packet, send port unreachable packets
-                else if (ip_hdr->ip_p == IPPROTO_TCP || ip_hdr->ip_p == IPPROTO_UDP)
-                {             
-                    sr_handleICMPpacket(sr, packet, len, interface, 3, 3);
-                    break;
-                }
-                else 
-                {
-                    printf("IP type not recognized\n");
-                    break;
-                }
-            }
+        // decrease TTL, if = 0, ICMP error message
+        ip_hdr->ip_ttl = ip_hdr->ip_ttl - 1;
+		ip_hdr->ip_sum = 0;
+		ip_hdr->ip_sum = cal_IPchecksum(ip_hdr);
 
-            temp_interface = temp_interface->next;
+        if (ip_hdr->ip_ttl < 1)
+        {
+            sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "time limit reached\n");
+            sr_stat_inc(sr, DROP_TTL);
+            sr_handleICMPpacket(sr, packet, len, sr_in, 11, 0);
         }
+        else sr_IPforward(sr, packet, len, sr_in);
+    }
+    // PWOSPF hellos and LSUs belong to the pwospf subsystem
+    else if (ip_hdr->ip_p == IPPROTO_OSPF)
+    {
+        handle_pwospf_packet(sr, packet, len, sr_in);
+    }
+    // nothing else is taken on the multicast address
+    else if (ip_hdr->ip_dst.s_addr == htonl(OSPF_AllSPFRouters))
+    {
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "IP type not recognized\n");
+        sr_stat_inc(sr, DROP_IP_PROTO);
+    }
+    else
+    {
+        sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "destination is the router\n");
 
-        // destination IP address is not the router
-        if (temp_interface == NULL)
+        // ICMP Type
+        if (ip_hdr->ip_p == IPPROTO_ICMP)
         {
-            printf("destination is not the router\n");
-
-            // decrease TTL, if = 0, ICMP error message
-            ip_hdr->ip_ttl = ip_hdr->ip_ttl - 1;
-			ip_hdr->ip_sum = 0;
-			ip_hdr->ip_sum = cal_IPchecksum(ip_hdr);
-
-            if (ip_hdr->ip_ttl < 1)
-            {
-                printf("time limit reached");
-                sr_handleICMPpacket(sr, packet, len, interface, 11, 0);
-            }
-            else sr_IPforward(sr, packet, len, interface);
+            sr_handleICMPpacket(sr, packet, len, sr_in, 0, 0);
+			sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "finish ICMP echo\n");
+        }
+        // TCP/UDP type, drop the packet, send port unreachable packets
+        else if (ip_hdr->ip_p == IPPROTO_TCP || ip_hdr->ip_p == IPPROTO_UDP)
+        {             
+            sr_handleICMPpacket(sr, packet, len, sr_in, 3, 3);
+        }
+        else 
+        {
+            sr_log(SR_LOG_FWD, SR_LOG_DEBUG, "IP type not recognized\n");
+            sr_stat_inc(sr, DROP_IP_PROTO);
         }
     }
    
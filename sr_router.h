@@ -12,17 +12,21 @@
 #include <netinet/in.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "sr_protocol.h"
+#include "sr_log.h"
 #ifdef VNL
 #include "vnlconn.h"
 #endif
 
-/* we dont like this debug , but what to do for varargs ? */
+/* we dont like this debug , but what to do for varargs ?
+ * Debug() is info of the module a file sets in SR_LOG_MODULE (sr_log.h) */
 #ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
+#define Debug(x, args...) sr_log(SR_LOG_MODULE, SR_LOG_INFO, x, ## args)
 #define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
+  do { int ivyl; if (!sr_log_enabled(SR_LOG_MODULE, SR_LOG_INFO)) break; \
+  for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
   (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
 #else
 #define Debug(x, args...) do{}while(0)
@@ -35,6 +39,11 @@
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_capture;
+struct sr_fcache;
+struct sr_punt;
+struct sr_stats;
+struct sr_ctl;
 
 /* struct of ICMP header */
 /*                       */
@@ -68,10 +77,12 @@ struct arp_cache{
 struct msg_cache{
 	uint8_t *packet;
 	struct in_addr ip; // ip
-	char *interface;   // forward interface
-	char *interface_pre;  // input interface
+	unsigned int if_index;     // forward interface
+	unsigned int if_index_pre; // input interface
 	int counter; // req counter
 	time_t timestamp; // time arrive
+	uint64_t ticks_in; // sr_stats_ticks when the packet came in, 0 untimed
+	uint64_t ticks_queued; // and when it started waiting here
 	unsigned int length;
 	struct msg_cache *next;
 };
@@ -95,14 +106,34 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
-    struct sr_rt* routing_table; /* routing table */
+    struct sr_if** if_table; /* the same interfaces by index */
+    unsigned int num_ifaces;
+    uint32_t* local_addrs; /* interface addresses and AllSPFRouters, see sr_is_local_addr */
+    unsigned int local_bits; /* log2 of the slots in local_addrs */
+    struct sr_rt* routing_table; /* routing table, control plane only */
+    struct sr_fib* fib; /* published snapshot for forwarding, see sr_fib.h */
+    struct sr_fib* fib_retired; /* replaced snapshots not freed yet */
+    uint32_t fib_generation; /* of sr->fib, set once it is published */
     struct arp_cache *arp_cache;
     struct arp_req_cache *arp_req;
 	struct msg_cache *msg_cache;
-    FILE* logfile;
+	pthread_mutex_t arp_lock; /* guards arp_cache and msg_cache */
+    uint32_t arp_generation; /* bumped on any change to arp_cache */
+    pthread_t arp_thread; /* Arp_Cache_Timeout, see sr_arp_timeout_start */
+    int arp_running;
+    int arp_stop;
+    struct sr_fcache* fcache; /* optional flow cache, see sr_fcache.h */
+    struct sr_punt* punt; /* slow path queue and worker, see sr_punt.h */
+    struct sr_stats* stats; /* packet counters, see sr_stats.h */
+    struct sr_capture* capture; /* packet log, see sr_capture.h */
+    struct sr_ctl* ctl; /* control socket, see sr_ctl.h */
 	
 	volatile uint8_t  hw_init; /* bool : hardware has been initialized */
 
+    /* -- if set, sr_send_packet hands frames here instead of the server -- */
+    int (*transmit)(struct sr_instance* , uint8_t* , unsigned int , struct sr_if* );
+    void* transmit_arg;
+
     /* -- pwospf subsystem -- */
     struct pwospf_subsys* ospf_subsys;
 };
@@ -112,12 +143,22 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_if(struct sr_instance* , uint8_t* , unsigned int , struct sr_if* );
+int sr_send_packet_batch(struct sr_instance* , uint8_t** , unsigned int* , unsigned int ,
+                         struct sr_if* );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , struct sr_if* );
+void sr_handlepacket_slow(struct sr_instance* , uint8_t * , unsigned int , struct sr_if* );
+uint32_t cal_IPchecksum(struct ip* );
+void dec_IPttl(struct ip* );
+uint16_t cal_ICMPcksum(uint8_t* , int );
+void* Arp_Cache_Timeout(void* );
+int sr_arp_timeout_start(struct sr_instance* );
+void sr_arp_timeout_stop(struct sr_instance* );
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
@@ -73,7 +73,7 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
                     mask);
             return -1; 
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
+        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface,1);
     } /* -- while -- */
 
     return 0; /* -- success -- */
@@ -85,7 +85,8 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
  *---------------------------------------------------------------------*/
 
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
-        struct in_addr gw, struct in_addr mask,char* if_name)
+        struct in_addr gw, struct in_addr mask,char* if_name,
+        uint8_t admin_dst)
 {
     struct sr_rt* rt_walker = 0;
 
@@ -102,6 +103,7 @@ void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
         sr->routing_table->dest = dest;
         sr->routing_table->gw   = gw;
         sr->routing_table->mask = mask;
+        sr->routing_table->admin_dst = admin_dst;
         strncpy(sr->routing_table->interface,if_name,SR_IFACE_NAMELEN);
 
         return;
@@ -120,10 +122,109 @@ void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
     rt_walker->dest = dest;
     rt_walker->gw   = gw;
     rt_walker->mask = mask;
+    rt_walker->admin_dst = admin_dst;
     strncpy(rt_walker->interface,if_name,SR_IFACE_NAMELEN);
 
 } /* -- sr_add_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_add_rt_entry_after(..)
+ *
+ * Link a new entry in after 'after' (0 for the front of the table) and
+ * return it, so a batch of routes is added without walking the table
+ * once per route.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_add_rt_entry_after(struct sr_instance* sr, struct sr_rt* after,
+        struct in_addr dest, struct in_addr gw, struct in_addr mask,
+        char* if_name, uint8_t admin_dst)
+{
+    struct sr_rt* entry = 0;
+
+    /* -- REQUIRES -- */
+    assert(if_name);
+    assert(sr);
+
+    entry = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+    assert(entry);
+    entry->dest = dest;
+    entry->gw   = gw;
+    entry->mask = mask;
+    entry->admin_dst = admin_dst;
+    strncpy(entry->interface,if_name,SR_IFACE_NAMELEN);
+
+    if(after == 0)
+    {
+        entry->next = sr->routing_table;
+        sr->routing_table = entry;
+    }
+    else
+    {
+        entry->next = after->next;
+        after->next = entry;
+    }
+
+    return entry;
+} /* -- sr_add_rt_entry_after -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_del_rt_entry(..)
+ *
+ * Unlink entry from the routing table and free it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_del_rt_entry(struct sr_instance* sr, struct sr_rt* entry)
+{
+    struct sr_rt* rt_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(entry);
+
+    if(sr->routing_table == entry)
+    {
+        sr->routing_table = entry->next;
+        free(entry);
+        return;
+    }
+
+    rt_walker = sr->routing_table;
+    while(rt_walker && rt_walker->next != entry)
+    {rt_walker = rt_walker->next; }
+
+    if(rt_walker)
+    {
+        rt_walker->next = entry->next;
+        free(entry);
+    }
+} /* -- sr_del_rt_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_del_rt_entry_after(..)
+ *
+ * Unlink and free the entry following 'after', without walking the
+ * table.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_del_rt_entry_after(struct sr_instance* sr, struct sr_rt* after)
+{
+    struct sr_rt* entry = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(after);
+
+    entry = after->next;
+    if(entry)
+    {
+        after->next = entry->next;
+        free(entry);
+    }
+} /* -- sr_del_rt_entry_after -- */
+
 /*--------------------------------------------------------------------- 
  * Method:
  *
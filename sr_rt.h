@@ -33,13 +33,18 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[SR_IFACE_NAMELEN];
+    uint8_t admin_dst; /* 1 for static routes, 110 for pwospf routes */
     struct sr_rt* next;
 };
 
 
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
-                  struct in_addr,char*);
+                  struct in_addr,char*,uint8_t);
+struct sr_rt* sr_add_rt_entry_after(struct sr_instance*, struct sr_rt*,
+                  struct in_addr,struct in_addr,struct in_addr,char*,uint8_t);
+void sr_del_rt_entry(struct sr_instance*, struct sr_rt*);
+void sr_del_rt_entry_after(struct sr_instance*, struct sr_rt*);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
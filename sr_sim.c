@@ -0,0 +1,1343 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_sim.c
+ * date:  Sun Oct 18 15:40:12 PDT 2026
+ *
+ * Description:
+ *
+ * In-process PWOSPF simulator.  Builds N struct sr_instance routers on a
+ * generated graph (ring, grid, random, fat-tree), wires the sr_send_packet
+ * of each one to the sr_handlepacket of its neighbors through in-memory
+ * links, and runs them all on a virtual clock from a single event queue.
+ * Every router gets one pwospf_tick() per virtual second and a timer
+ * event whenever a hello, echo or its throttled SPF is due, frames take
+ * the configured link delay.
+ *
+ * Reported per phase (initial convergence, then each link failure and
+ * repair): convergence time in virtual seconds, hellos sent, link
+ * changes asking for an LSU against LSUs originated, LSU packets sent,
+ * received and dropped as duplicates, SPF runs requested and executed
+ * and the cpu time spent in SPF.  With -E the neighbors also run fast
+ * liveness and each failure reports how long both ends took to notice.
+ * After the initial convergence the forwarding tables are checked for
+ * equal cost routes and how evenly flows hash over their next hops.
+ *
+ * With -B the graph is not simulated but fed directly to SPF as router 0
+ * would see it, to time incremental against full SPF over link flaps.
+ *
+ * With -F, once the phases are done, a stream of udp packets with Zipf
+ * distributed destinations is replayed through router 0, once without
+ * and once with the flow cache, reporting ns per packet, the cache hit
+ * rate and the frames sent on each interface.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pwospf.h"
+#include "sr_fib.h"
+#include "sr_fcache.h"
+#include "sr_stats.h"
+
+#define SIM_TICK_US      1000000ULL
+#define DEFAULT_DELAY_US 1000
+#define DEFAULT_QUIET    3
+#define DEFAULT_MAX_TIME 600
+#define DEFAULT_DEGREE   3
+#define DEFAULT_FATTREE_K 4
+#define DEFAULT_BENCH_FLAPS 100
+#define SIM_PATH_FLOWS    4096   /* flows hashed over each multipath route */
+#define SIM_FRAME_LEN     64     /* bytes of a replayed udp frame */
+#define SIM_ZIPF_S        1.0    /* skew of the replayed destinations */
+
+enum sim_event_type
+{
+    SIM_FRAME,  /* frame arrives at the far end of a link */
+    SIM_TICK,   /* one second of pwospf time on a router */
+    SIM_TIMER   /* a hello or the scheduled SPF of a router is due */
+};
+
+struct sim_event
+{
+    uint64_t time;   /* virtual usec */
+    uint64_t seq;    /* keeps events of the same time in fifo order */
+    int type;
+    int router;
+    int port;
+    uint8_t* frame;
+    unsigned int len;
+};
+
+struct sim_link
+{
+    int router[2];
+    int port[2];
+    uint8_t up;
+};
+
+struct sim_router
+{
+    struct sr_instance sr;
+    int num_ports;
+    int* port_link;   /* link of each interface, ethN is port N */
+    int* port_side;   /* which end of the link the interface is */
+    uint32_t spf_runs;
+    uint64_t timer_at; /* virtual usec of the queued SIM_TIMER, 0 if none */
+};
+
+struct sim_state
+{
+    struct sim_router* routers;
+    int num_routers;
+    struct sim_link* links;
+    int num_links;
+    int max_links;
+
+    struct sim_event* heap;
+    int heap_len;
+    int heap_max;
+    uint64_t seq;
+
+    uint64_t now;        /* virtual usec */
+    uint64_t last_spf;   /* virtual usec of the last SPF run anywhere */
+    uint64_t delay;      /* link delay in usec */
+    uint64_t frames;
+    uint64_t frames_lost; /* sent into a link that is down */
+};
+
+static void usage(char* );
+
+/* -- sr_vns_comm.c needs this from the main program -- */
+int sr_verify_routing_table(struct sr_instance* sr)
+{
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * event queue, a binary min-heap on (time, seq)
+ *---------------------------------------------------------------------------*/
+
+static int sim_event_before(struct sim_event* a, struct sim_event* b)
+{
+    if (a->time != b->time)
+    { return a->time < b->time; }
+    return a->seq < b->seq;
+}
+
+static void sim_push(struct sim_state* sim, struct sim_event* ev)
+{
+    int i, parent;
+
+    if (sim->heap_len == sim->heap_max)
+    {
+        sim->heap_max = sim->heap_max ? sim->heap_max * 2 : 1024;
+        sim->heap = (struct sim_event*)realloc(sim->heap,
+                sim->heap_max * sizeof(struct sim_event));
+        assert(sim->heap);
+    }
+
+    ev->seq = sim->seq++;
+    i = sim->heap_len++;
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        if (!sim_event_before(ev, &sim->heap[parent]))
+        { break; }
+        sim->heap[i] = sim->heap[parent];
+        i = parent;
+    }
+    sim->heap[i] = *ev;
+}
+
+static void sim_pop(struct sim_state* sim, struct sim_event* ev)
+{
+    struct sim_event last;
+    int i = 0, child;
+
+    assert(sim->heap_len > 0);
+    *ev = sim->heap[0];
+    last = sim->heap[--sim->heap_len];
+
+    while ((child = 2*i + 1) < sim->heap_len)
+    {
+        if (child + 1 < sim->heap_len &&
+            sim_event_before(&sim->heap[child+1], &sim->heap[child]))
+        { child++; }
+        if (!sim_event_before(&sim->heap[child], &last))
+        { break; }
+        sim->heap[i] = sim->heap[child];
+        i = child;
+    }
+    sim->heap[i] = last;
+}
+
+/* -- pwospf clock of every router, in virtual msec -- */
+static uint64_t sim_clock(void* arg)
+{
+    return ((struct sim_state*)arg)->now / 1000;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_transmit(..)
+ * Scope: Local
+ *
+ * sr_send_packet hook of every simulated router: put the frame on the
+ * link behind the interface, it arrives at the other end after the link
+ * delay.  Delivery is never direct, that would re-enter the pwospf lock
+ * of the sender when an LSU floods back.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_transmit(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                        struct sr_if* iface)
+{
+    struct sim_state* sim = (struct sim_state*)sr->transmit_arg;
+    struct sim_router* r = (struct sim_router*)sr;
+    struct sim_link* link;
+    struct sim_event ev;
+    int port = (int)iface->index;
+    int side;
+
+    assert(port >= 0 && port < r->num_ports);
+    link = &sim->links[r->port_link[port]];
+    side = r->port_side[port];
+
+    if (!link->up)
+    {
+        sim->frames_lost++;
+        return 0;
+    }
+
+    ev.time = sim->now + sim->delay;
+    ev.type = SIM_FRAME;
+    ev.router = link->router[!side];
+    ev.port = link->port[!side];
+    ev.frame = (uint8_t*)malloc(len);
+    assert(ev.frame);
+    memcpy(ev.frame, buf, len);
+    ev.len = len;
+    sim_push(sim, &ev);
+
+    return 0;
+} /* -- sim_transmit -- */
+
+/*-----------------------------------------------------------------------------
+ * topology generation
+ *---------------------------------------------------------------------------*/
+
+static void sim_add_link(struct sim_state* sim, int a, int b)
+{
+    struct sim_link* link;
+
+    if (sim->num_links == sim->max_links)
+    {
+        sim->max_links = sim->max_links ? sim->max_links * 2 : 1024;
+        sim->links = (struct sim_link*)realloc(sim->links,
+                sim->max_links * sizeof(struct sim_link));
+        assert(sim->links);
+    }
+
+    link = &sim->links[sim->num_links++];
+    link->router[0] = a;
+    link->router[1] = b;
+    link->up = 1;
+}
+
+/* -- set of router pairs, so the random graph has no parallel links -- */
+static int sim_pair_insert(uint64_t* set, uint64_t size, int a, int b)
+{
+    uint64_t key, h;
+
+    if (a > b)
+    { int t = a; a = b; b = t; }
+    key = ((uint64_t)(a + 1) << 32) | (uint64_t)(b + 1);
+    h = (key * 0x9e3779b97f4a7c15ULL) & (size - 1);
+
+    while (set[h] != 0)
+    {
+        if (set[h] == key)
+        { return 0; }
+        h = (h + 1) & (size - 1);
+    }
+    set[h] = key;
+    return 1;
+}
+
+static int sim_gen_ring(struct sim_state* sim, int n)
+{
+    int i;
+
+    if (n < 3)
+    { return -1; }
+    for (i = 0; i < n; i++)
+    { sim_add_link(sim, i, (i + 1) % n); }
+    return n;
+}
+
+static int sim_gen_grid(struct sim_state* sim, int n)
+{
+    int rows = (int)sqrt((double)n);
+    int cols, r, c;
+
+    if (rows < 2)
+    { return -1; }
+    cols = n / rows;
+
+    for (r = 0; r < rows; r++)
+    {
+        for (c = 0; c < cols; c++)
+        {
+            if (c + 1 < cols)
+            { sim_add_link(sim, r*cols + c, r*cols + c + 1); }
+            if (r + 1 < rows)
+            { sim_add_link(sim, r*cols + c, (r+1)*cols + c); }
+        }
+    }
+    return rows * cols;
+}
+
+static int sim_gen_random(struct sim_state* sim, int n, int degree)
+{
+    uint64_t want = (uint64_t)n * degree / 2;
+    uint64_t size = 1024;
+    uint64_t* set;
+    uint64_t tries = 0;
+    int i, a, b;
+
+    if (n < 2 || degree < 2)
+    { return -1; }
+
+    while (size < 2 * want)
+    { size *= 2; }
+    set = (uint64_t*)calloc(size, sizeof(uint64_t));
+    assert(set);
+
+    /* -- a random spanning tree keeps the graph connected -- */
+    for (i = 1; i < n; i++)
+    {
+        a = i;
+        b = random() % i;
+        sim_pair_insert(set, size, a, b);
+        sim_add_link(sim, a, b);
+    }
+
+    while ((uint64_t)sim->num_links < want && tries++ < 100 * want)
+    {
+        a = random() % n;
+        b = random() % n;
+        if (a != b && sim_pair_insert(set, size, a, b))
+        { sim_add_link(sim, a, b); }
+    }
+
+    free(set);
+    return n;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_gen_fattree(..)
+ * Scope: Local
+ *
+ * k-ary fat-tree: (k/2)^2 core switches, k pods of k/2 aggregation and k/2
+ * edge switches.  Routers 0.. are the cores, then pod by pod the
+ * aggregation and edge switches.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_gen_fattree(struct sim_state* sim, int k)
+{
+    int half = k / 2;
+    int cores = half * half;
+    int p, a, e, c;
+
+    if (k < 2 || (k % 2) != 0)
+    { return -1; }
+
+    for (p = 0; p < k; p++)
+    {
+        int pod = cores + p * k;
+        for (a = 0; a < half; a++)
+        {
+            for (c = 0; c < half; c++)
+            { sim_add_link(sim, pod + a, a * half + c); }
+            for (e = 0; e < half; e++)
+            { sim_add_link(sim, pod + a, pod + half + e); }
+        }
+    }
+    return cores + k * k;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_build_routers(..)
+ * Scope: Local
+ *
+ * Create the routers and their interfaces, link i gets 10.0.0.0/8 + 4*i
+ * as its /30.  The interfaces are configured the way sr_handle_hwinfo
+ * would do it.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sim_build_routers(struct sim_state* sim)
+{
+    int i, side;
+    char name[SR_IFACE_NAMELEN];
+    unsigned char addr[ETHER_ADDR_LEN];
+
+    sim->routers = (struct sim_router*)calloc(sim->num_routers, sizeof(struct sim_router));
+    assert(sim->routers);
+
+    for (i = 0; i < sim->num_links; i++)
+    {
+        for (side = 0; side < 2; side++)
+        { sim->routers[sim->links[i].router[side]].num_ports++; }
+    }
+
+    for (i = 0; i < sim->num_routers; i++)
+    {
+        struct sim_router* r = &sim->routers[i];
+        struct sr_instance* sr = &r->sr;
+
+        sr->sockfd = -1;
+        snprintf(sr->host, sizeof(sr->host), "r%d", i);
+        sr->transmit = sim_transmit;
+        sr->transmit_arg = sim;
+        pthread_mutex_init(&(sr->arp_lock), 0);
+        pwospf_init_subsys(sr);
+        sr->ospf_subsys->clock = sim_clock;
+        sr->ospf_subsys->clock_arg = sim;
+
+        r->port_link = (int*)malloc(r->num_ports * sizeof(int));
+        r->port_side = (int*)malloc(r->num_ports * sizeof(int));
+        assert(r->port_link && r->port_side);
+        r->num_ports = 0;
+    }
+
+    for (i = 0; i < sim->num_links; i++)
+    {
+        struct sim_link* link = &sim->links[i];
+        uint32_t net = 0x0a000000 + 4 * (uint32_t)i;
+
+        for (side = 0; side < 2; side++)
+        {
+            struct sim_router* r = &sim->routers[link->router[side]];
+            int port = r->num_ports++;
+
+            r->port_link[port] = i;
+            r->port_side[port] = side;
+            link->port[side] = port;
+
+            snprintf(name, sizeof(name), "eth%d", port);
+            addr[0] = 0x02;
+            addr[1] = (uint8_t)(link->router[side] >> 16);
+            addr[2] = (uint8_t)(link->router[side] >> 8);
+            addr[3] = (uint8_t)(link->router[side]);
+            addr[4] = (uint8_t)(port >> 8);
+            addr[5] = (uint8_t)(port);
+
+            sr_add_interface(&r->sr, name);
+            sr_set_ether_addr(&r->sr, addr);
+            sr_set_ether_ip(&r->sr, htonl(net + 1 + side));
+            sr_set_ether_mask(&r->sr, htonl(0xfffffffc));
+        }
+    }
+
+    for (i = 0; i < sim->num_routers; i++)
+    { sim->routers[i].sr.hw_init = 1; }
+} /* -- sim_build_routers -- */
+
+/*-----------------------------------------------------------------------------
+ * convergence
+ *---------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_router_complete(..)
+ * Scope: Local
+ *
+ * A router has converged when every link subnet of the graph is either
+ * directly connected or has a pwospf route (run_spf never installs
+ * a route to a connected subnet, and the entries of one subnet follow
+ * each other, one per equal cost next hop), and no SPF is still
+ * scheduled.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_router_complete(struct sim_state* sim, struct sim_router* r)
+{
+    struct sr_rt* rt;
+    struct sr_rt* prev = 0;
+    int known = r->num_ports;
+
+    if (r->sr.ospf_subsys->spf_throttle.scheduled)
+    { return 0; }
+
+    for (rt = r->sr.routing_table; rt; prev = rt, rt = rt->next)
+    {
+        if (rt->admin_dst > 1 && (prev == 0 || prev->dest.s_addr != rt->dest.s_addr))
+        { known++; }
+    }
+    return known == sim->num_links;
+}
+
+static int sim_all_complete(struct sim_state* sim)
+{
+    int i;
+    for (i = 0; i < sim->num_routers; i++)
+    {
+        if (!sim_router_complete(sim, &sim->routers[i]))
+        { return 0; }
+    }
+    return 1;
+}
+
+/* -- both ends of the link agree on the adjacency being up or down -- */
+static int sim_link_settled(struct sim_state* sim, struct sim_link* link)
+{
+    int side;
+    for (side = 0; side < 2; side++)
+    {
+        struct sr_instance* sr = &sim->routers[link->router[side]].sr;
+        struct sr_if* iface = sr->if_list;
+        int port = link->port[side];
+
+        while (port-- > 0)
+        { iface = iface->next; }
+        if ((iface->neighbors.num != 0) != (link->up != 0))
+        { return 0; }
+    }
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * statistics
+ *---------------------------------------------------------------------------*/
+
+struct sim_totals
+{
+    uint64_t hello_sent;
+    uint64_t lsu_sent;
+    uint64_t lsu_events;
+    uint64_t lsu_originated;
+    uint64_t lsu_received;
+    uint64_t lsu_duplicate;
+    uint64_t spf_requested;
+    uint64_t spf_runs;
+    uint64_t spf_usec;
+    uint64_t spf_usec_max;  /* largest per router share */
+    uint64_t frames;
+};
+
+static void sim_totals(struct sim_state* sim, struct sim_totals* t)
+{
+    int i;
+
+    memset(t, 0, sizeof(*t));
+    for (i = 0; i < sim->num_routers; i++)
+    {
+        struct pwospf_subsys* subsys = sim->routers[i].sr.ospf_subsys;
+        t->hello_sent += subsys->hello_sent;
+        t->lsu_sent += subsys->lsu_sent;
+        t->lsu_events += subsys->lsu_events;
+        t->lsu_originated += subsys->lsu_originated;
+        t->lsu_received += subsys->lsu_received;
+        t->lsu_duplicate += subsys->lsu_duplicate;
+        t->spf_requested += subsys->spf_requested;
+        t->spf_runs += subsys->spf_runs;
+        t->spf_usec += subsys->spf_usec;
+        if (subsys->spf_usec > t->spf_usec_max)
+        { t->spf_usec_max = subsys->spf_usec; }
+    }
+    t->frames = sim->frames;
+}
+
+static void sim_report(FILE* out, const char* phase, struct sim_state* sim,
+                       struct sim_totals* before, uint64_t start, int converged,
+                       double wall)
+{
+    struct sim_totals after;
+
+    sim_totals(sim, &after);
+    fprintf(out, "%-12s %10s %9.3f %10llu %8llu %8llu %10llu %10llu %10llu %9llu %9llu %11.3f %9.3f %8.2f\n",
+            phase, converged ? "yes" : "NO",
+            sim->last_spf > start ? (sim->last_spf - start) / 1e6 : 0.0,
+            (unsigned long long)(after.hello_sent - before->hello_sent),
+            (unsigned long long)(after.lsu_events - before->lsu_events),
+            (unsigned long long)(after.lsu_originated - before->lsu_originated),
+            (unsigned long long)(after.lsu_sent - before->lsu_sent),
+            (unsigned long long)(after.lsu_received - before->lsu_received),
+            (unsigned long long)(after.lsu_duplicate - before->lsu_duplicate),
+            (unsigned long long)(after.spf_requested - before->spf_requested),
+            (unsigned long long)(after.spf_runs - before->spf_runs),
+            (after.spf_usec - before->spf_usec) / 1e3,
+            after.spf_usec_max / 1e3,
+            wall);
+}
+
+/* -- how each end of a failed link noticed, with fast liveness on -- */
+static void sim_report_echo(FILE* out, struct sim_state* sim, struct sim_link* link,
+                            uint64_t start)
+{
+    int side;
+    for (side = 0; side < 2; side++)
+    {
+        struct sim_router* r = &sim->routers[link->router[side]];
+        struct sr_if* iface = r->sr.if_list;
+        int port = link->port[side];
+
+        while (port-- > 0)
+        { iface = iface->next; }
+
+        if (iface->echo_lost_at * 1000 < start)
+        {
+            fprintf(out, "  r%d %s: not noticed by echo\n", link->router[side], iface->name);
+            continue;
+        }
+        fprintf(out, "  r%d %s: r%d down %llu ms after the failure, %u echoes missed, "
+                "%u answered before, echo cpu %.1f us\n",
+                link->router[side], iface->name, link->router[1 - side],
+                (unsigned long long)(iface->echo_lost_at - start / 1000),
+                iface->echo_lost.echo_missed, iface->echo_lost.echo_replies,
+                iface->echo_lost.echo_cpu_ns / 1e3);
+    }
+}
+
+/* -- equal cost routes in the forwarding tables and how flows spread over them -- */
+static void sim_report_paths(FILE* out, struct sim_state* sim)
+{
+    uint64_t routes = 0, multipath = 0, hops = 0;
+    double worst = 0.0;
+    uint8_t packet[sizeof(struct ip) + 4];
+    struct ip* ip_hdr = (struct ip*)packet;
+    int i;
+
+    memset(packet, 0, sizeof(packet));
+    ip_hdr->ip_hl = 5;
+    ip_hdr->ip_p = IPPROTO_UDP;
+
+    for (i = 0; i < sim->num_routers; i++)
+    {
+        const struct sr_fib* fib = sim->routers[i].sr.fib;
+        unsigned int e, f, h;
+
+        for (e = 0; fib && e < fib->num_entries; e++)
+        {
+            const struct sr_fib_entry* entry = &fib->entries[e];
+            unsigned int count[SPF_MAX_HOPS];
+
+            routes++;
+            hops += entry->num_hops;
+            if (entry->num_hops < 2)
+            { continue; }
+            multipath++;
+
+            /* -- member share against an even split, over flows from random ports -- */
+            memset(count, 0, sizeof(count));
+            for (f = 0; f < SIM_PATH_FLOWS; f++)
+            {
+                uint32_t ports = random();
+                ip_hdr->ip_src.s_addr = htonl(0x0a000000 | (random() & 0xffffff));
+                ip_hdr->ip_dst.s_addr = entry->dest.s_addr | htonl(1);
+                memcpy(packet + sizeof(struct ip), &ports, 4);
+                count[sr_fib_select(entry, packet, sizeof(packet)) - entry->hops]++;
+            }
+            for (h = 0; h < entry->num_hops && h < SPF_MAX_HOPS; h++)
+            {
+                double share = count[h] * (double)entry->num_hops / SIM_PATH_FLOWS;
+                if (fabs(share - 1.0) > worst)
+                { worst = fabs(share - 1.0); }
+            }
+        }
+    }
+
+    fprintf(out, "%llu routes, %llu next hops, %llu routes multipath, "
+            "flows within %.1f%% of an even split\n",
+            (unsigned long long)routes, (unsigned long long)hops,
+            (unsigned long long)multipath, worst * 100);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_run_until(..)
+ * Scope: Local
+ *
+ * Process events until the phase is done: every router is complete,
+ * the given link (if any) is settled at both ends and no SPF ran for
+ * 'quiet' seconds.  Returns 1 when converged, 0 when max_time hit.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_run_until(struct sim_state* sim, struct sim_link* link,
+                         uint64_t quiet, uint64_t max_time)
+{
+    struct sim_event ev;
+    uint64_t next_check = sim->now + SIM_TICK_US;
+
+    while (sim->heap_len > 0 && sim->now < max_time)
+    {
+        struct sim_router* r;
+        uint64_t due;
+
+        sim_pop(sim, &ev);
+        sim->now = ev.time;
+        r = &sim->routers[ev.router];
+
+        if (ev.type == SIM_FRAME)
+        {
+            sim->frames++;
+            sr_handlepacket(&r->sr, ev.frame, ev.len, sr_get_interface_by_index(&r->sr, ev.port));
+            free(ev.frame);
+        }
+        else if (ev.type == SIM_TICK)
+        {
+            pwospf_tick(&r->sr);
+            ev.time += SIM_TICK_US;
+            sim_push(sim, &ev);
+        }
+        else
+        {
+            if (ev.time == r->timer_at)
+            { r->timer_at = 0; }
+            pwospf_timers(&r->sr);
+        }
+
+        if (r->sr.ospf_subsys->spf_runs != r->spf_runs)
+        {
+            r->spf_runs = r->sr.ospf_subsys->spf_runs;
+            sim->last_spf = sim->now;
+        }
+
+        /* -- wake the router at its next hello or SPF, unless already queued -- */
+        if (pwospf_next_timer(&r->sr, &due))
+        {
+            due = due * 1000 > sim->now ? due * 1000 : sim->now;
+            if (r->timer_at == 0 || due < r->timer_at)
+            {
+                memset(&ev, 0, sizeof(ev));
+                ev.type = SIM_TIMER;
+                ev.router = (int)(r - sim->routers);
+                ev.time = due;
+                sim_push(sim, &ev);
+                r->timer_at = due;
+            }
+        }
+
+        if (sim->now >= next_check)
+        {
+            next_check = sim->now + SIM_TICK_US;
+            if (sim->now - sim->last_spf >= quiet &&
+                (link == 0 || sim_link_settled(sim, link)) &&
+                sim_all_complete(sim))
+            { return 1; }
+        }
+    }
+
+    return 0;
+} /* -- sim_run_until -- */
+
+static double sim_wall(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*-----------------------------------------------------------------------------
+ * SPF benchmark, router 0's view of the graph fed straight into two SPF
+ * states, one run incrementally and one recomputed in full every time
+ *---------------------------------------------------------------------------*/
+
+static uint32_t sim_rid(struct sim_state* sim, int r)
+{
+    struct sr_if* iface = sim->routers[r].sr.if_list;
+    return iface ? iface->ip : htonl(0xc0a80000 + (uint32_t)r);
+}
+
+/* -- the LSU router r would send, a down link advertises no neighbor -- */
+static uint32_t sim_spf_adv(struct sim_state* sim, int r, struct ospfv2_lsu* adv)
+{
+    struct sim_router* router = &sim->routers[r];
+    int p;
+
+    for (p = 0; p < router->num_ports; p++)
+    {
+        struct sim_link* link = &sim->links[router->port_link[p]];
+        adv[p].subnet = htonl(0x0a000000 + 4 * (uint32_t)router->port_link[p]);
+        adv[p].mask = htonl(0xfffffffc);
+        adv[p].rid = link->up ? sim_rid(sim, link->router[1 - router->port_side[p]]) : 0;
+    }
+    return router->num_ports;
+}
+
+/* -- neighbor state of router 0, as the hellos would leave it -- */
+static void sim_spf_root(struct sim_state* sim)
+{
+    struct sim_router* router = &sim->routers[0];
+    int p;
+
+    for (p = 0; p < router->num_ports; p++)
+    {
+        struct sim_link* link = &sim->links[router->port_link[p]];
+        int side = router->port_side[p];
+        struct sr_if* iface = sr_get_interface_by_index(&router->sr, p);
+
+        nbr_clear(&iface->neighbors);
+        if (link->up)
+        {
+            struct pwospf_neighbor* neighbor = nbr_add(&iface->neighbors, sim_rid(sim, link->router[1 - side]));
+            neighbor->ip = htonl(0x0a000000 + 4 * (uint32_t)router->port_link[p] + 2 - side);
+        }
+    }
+}
+
+static void sim_spf_update(struct sim_state* sim, struct pwospf_spf* spf, int r,
+                           struct ospfv2_lsu* adv)
+{
+    struct in_addr rid;
+
+    if (r == 0)
+    {
+        spf_update_interfaces(spf, &sim->routers[0].sr);
+        return;
+    }
+    rid.s_addr = sim_rid(sim, r);
+    spf_update_router(spf, rid, adv, sim_spf_adv(sim, r, adv));
+}
+
+static int sim_cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_spf_bench(..)
+ * Scope: Local
+ *
+ * Take 'flaps' random links down and up again, timing spf_run() against
+ * spf_run_full() on every change and checking they agree on the cost and
+ * first hops of every route.  Returns the number of disagreements.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_spf_bench(FILE* out, struct sim_state* sim, int flaps)
+{
+    struct pwospf_spf inc, full;
+    struct ospfv2_lsu* adv;
+    struct in_addr root;
+    double *t_inc, *t_full, sum_inc = 0, sum_full = 0;
+    uint64_t changes = 0;
+    int max_ports = 0, runs = 0, mismatches = 0;
+    int i, r, up;
+    uint32_t s;
+
+    for (r = 0; r < sim->num_routers; r++)
+    {
+        if (sim->routers[r].num_ports > max_ports)
+        { max_ports = sim->routers[r].num_ports; }
+    }
+    adv = (struct ospfv2_lsu*)malloc((max_ports + 1) * sizeof(struct ospfv2_lsu));
+    t_inc = (double*)malloc((2 * flaps + 1) * sizeof(double));
+    t_full = (double*)malloc((2 * flaps + 1) * sizeof(double));
+    assert(adv && t_inc && t_full);
+
+    spf_init(&inc);
+    spf_init(&full);
+    root.s_addr = sim_rid(sim, 0);
+    spf_set_root(&inc, root);
+    spf_set_root(&full, root);
+    sim_spf_root(sim);
+    for (r = 0; r < sim->num_routers; r++)
+    {
+        sim_spf_update(sim, &inc, r, adv);
+        sim_spf_update(sim, &full, r, adv);
+    }
+    spf_run_full(&inc, &sim->routers[0].sr);
+    spf_run_full(&full, &sim->routers[0].sr);
+
+    for (i = 0; i < flaps; i++)
+    {
+        struct sim_link* link = &sim->links[random() % sim->num_links];
+
+        for (up = 0; up < 2; up++)
+        {
+            double t0, t1, t2;
+            int side;
+
+            link->up = up;
+            sim_spf_root(sim);
+            for (side = 0; side < 2; side++)
+            {
+                sim_spf_update(sim, &inc, link->router[side], adv);
+                sim_spf_update(sim, &full, link->router[side], adv);
+            }
+
+            t0 = sim_wall();
+            changes += spf_run(&inc, &sim->routers[0].sr);
+            t1 = sim_wall();
+            spf_run_full(&full, &sim->routers[0].sr);
+            t2 = sim_wall();
+
+            t_inc[runs] = (t1 - t0) * 1e6;
+            t_full[runs] = (t2 - t1) * 1e6;
+            sum_inc += t_inc[runs];
+            sum_full += t_full[runs];
+            runs++;
+
+            /* -- both states saw the same updates, so the subnets line up -- */
+            for (s = 0; s < inc.num_subnets; s++)
+            {
+                if (inc.subnets[s].route.cost != full.subnets[s].route.cost ||
+                    inc.subnets[s].route.hops != full.subnets[s].route.hops)
+                { mismatches++; }
+            }
+        }
+    }
+
+    if (runs > 0)
+    {
+        qsort(t_inc, runs, sizeof(double), sim_cmp_double);
+        qsort(t_full, runs, sizeof(double), sim_cmp_double);
+        fprintf(out, "%-12s %10s %10s %10s\n", "spf", "mean us", "p50 us", "max us");
+        fprintf(out, "%-12s %10.1f %10.1f %10.1f\n", "full",
+                sum_full / runs, t_full[runs / 2], t_full[runs - 1]);
+        fprintf(out, "%-12s %10.1f %10.1f %10.1f\n", "incremental",
+                sum_inc / runs, t_inc[runs / 2], t_inc[runs - 1]);
+        fprintf(out, "%d runs, %.1fx faster, %.1f routes changed per run, %d route mismatches\n",
+                runs, sum_inc > 0 ? sum_full / sum_inc : 0.0,
+                (double)changes / runs, mismatches);
+    }
+
+    spf_free(&inc);
+    spf_free(&full);
+    free(adv);
+    free(t_inc);
+    free(t_full);
+    return mismatches;
+} /* -- sim_spf_bench -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sim_forward_bench(..)
+ * Scope: Local
+ *
+ * Replay 'packets' udp frames through sr_handlepacket() of router 0, once
+ * without and once with a flow cache of 'slots' entries.  Destinations
+ * are the far end addresses of every link router 0 is not on, drawn by
+ * a Zipf law so a few of them take most of the traffic.  The ARP cache
+ * is filled from replies of the neighbors first, and frames sent are
+ * counted per interface instead of being delivered.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sim_count_transmit(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                              struct sr_if* iface)
+{
+    uint64_t* tx = (uint64_t*)sr->transmit_arg;
+    tx[iface->index]++;
+    return 0;
+}
+
+static void sim_forward_frames(uint8_t* frames, uint32_t* dsts, int packets)
+{
+    int i;
+    for (i = 0; i < packets; i++)
+    {
+        uint8_t* frame = frames + (size_t)i * SIM_FRAME_LEN;
+        struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)frame;
+        struct ip* ip_hdr = (struct ip*)(frame + sizeof(struct sr_ethernet_hdr));
+        uint32_t ports = random();
+
+        memset(frame, 0, SIM_FRAME_LEN);
+        eth_hdr->ether_type = htons(ETHERTYPE_IP);
+        ip_hdr->ip_v = 4;
+        ip_hdr->ip_hl = 5;
+        ip_hdr->ip_len = htons(SIM_FRAME_LEN - sizeof(struct sr_ethernet_hdr));
+        ip_hdr->ip_ttl = 64;
+        ip_hdr->ip_p = IPPROTO_UDP;
+        ip_hdr->ip_src.s_addr = htonl(0xc0a80000 | (random() & 0xffff));
+        ip_hdr->ip_dst.s_addr = dsts[i];
+        memcpy(frame + sizeof(struct sr_ethernet_hdr) + sizeof(struct ip), &ports, 4);
+        ip_hdr->ip_sum = 0;
+        ip_hdr->ip_sum = cal_IPchecksum(ip_hdr);
+    }
+}
+
+static void sim_forward_bench(FILE* out, struct sim_state* sim, int packets, unsigned int slots)
+{
+    struct sim_router* r0 = &sim->routers[0];
+    struct sr_instance* sr = &r0->sr;
+    int num_dsts = 0, run, i, p;
+    uint32_t* dst_pool = (uint32_t*)malloc(sim->num_links * sizeof(uint32_t));
+    double* cdf = (double*)malloc(sim->num_links * sizeof(double));
+    uint32_t* dsts = (uint32_t*)malloc(packets * sizeof(uint32_t));
+    uint8_t* frames = (uint8_t*)malloc((size_t)packets * SIM_FRAME_LEN);
+    uint64_t* tx = (uint64_t*)calloc(r0->num_ports, sizeof(uint64_t));
+    struct sr_stats_snapshot snap;
+    struct sr_hist* hists = 0;
+    double sum = 0.0;
+
+    assert(dst_pool && cdf && dsts && frames && tx);
+
+    for (i = 0; i < sim->num_links; i++)
+    {
+        struct sim_link* link = &sim->links[i];
+        if (link->router[0] != 0 && link->router[1] != 0)
+        {
+            dst_pool[num_dsts] = htonl(0x0a000000 + 4 * (uint32_t)i + 2);
+            sum += 1.0 / pow(num_dsts + 1, SIM_ZIPF_S);
+            cdf[num_dsts++] = sum;
+        }
+    }
+    if (num_dsts == 0)
+    { goto done; }
+
+    for (i = 0; i < packets; i++)
+    {
+        double u = (random() / (double)RAND_MAX) * sum;
+        int lo = 0, hi = num_dsts - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+            { lo = mid + 1; }
+            else
+            { hi = mid; }
+        }
+        dsts[i] = dst_pool[lo];
+    }
+
+    /* -- every neighbor answers for its address -- */
+    for (p = 0; p < r0->num_ports; p++)
+    {
+        struct sim_link* link = &sim->links[r0->port_link[p]];
+        int side = r0->port_side[p];
+        struct sr_if* far = sr_get_interface_by_index(&sim->routers[link->router[!side]].sr,
+                                                      link->port[!side]);
+        struct sr_if* near = sr_get_interface_by_index(sr, p);
+        uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arphdr)];
+        struct sr_ethernet_hdr* eth_hdr = (struct sr_ethernet_hdr*)reply;
+        struct sr_arphdr* arp_hdr = (struct sr_arphdr*)(reply + sizeof(struct sr_ethernet_hdr));
+
+        memset(reply, 0, sizeof(reply));
+        memcpy(eth_hdr->ether_dhost, near->addr, ETHER_ADDR_LEN);
+        memcpy(eth_hdr->ether_shost, far->addr, ETHER_ADDR_LEN);
+        eth_hdr->ether_type = htons(ETHERTYPE_ARP);
+        arp_hdr->ar_hrd = htons(ARPHDR_ETHER);
+        arp_hdr->ar_pro = htons(ETHERTYPE_IP);
+        arp_hdr->ar_hln = ETHER_ADDR_LEN;
+        arp_hdr->ar_pln = 4;
+        arp_hdr->ar_op = htons(ARP_REPLY);
+        memcpy(arp_hdr->ar_sha, far->addr, ETHER_ADDR_LEN);
+        arp_hdr->ar_sip = far->ip;
+        memcpy(arp_hdr->ar_tha, near->addr, ETHER_ADDR_LEN);
+        arp_hdr->ar_tip = near->ip;
+        sr_handlepacket(sr, reply, sizeof(reply), near);
+    }
+
+    sr->transmit = sim_count_transmit;
+    sr->transmit_arg = tx;
+
+    fprintf(out, "forwarding replay through r0, %d packets to %d destinations (zipf %.1f)\n",
+            packets, num_dsts, SIM_ZIPF_S);
+    fprintf(out, "%-12s %10s %10s %10s %10s %10s\n", "flow cache", "ns/pkt", "hit rate",
+            "p50", "p99", "p99.9");
+
+    /* -- r0 counts like a real router does, so the cost is in the numbers -- */
+    if (sr_stats_init(sr) != 0 ||
+        (hists = (struct sr_hist*)malloc(SR_HIST_NUM * sizeof(struct sr_hist))) == 0)
+    { goto done; }
+
+    for (run = 0; run < 2; run++)
+    {
+        double t0, t1;
+
+        if (run == 1 && sr_fcache_init(sr, slots) != 0)
+        { break; }
+        memset(tx, 0, r0->num_ports * sizeof(uint64_t));
+        sim_forward_frames(frames, dsts, packets);
+
+        t0 = sim_wall();
+        for (i = 0; i < packets; i++)
+        { sr_handlepacket(sr, frames + (size_t)i * SIM_FRAME_LEN, SIM_FRAME_LEN, sr->if_list); }
+        t1 = sim_wall();
+
+        if (run == 0)
+        { fprintf(out, "%-12s %10.1f %10s", "off", (t1 - t0) * 1e9 / packets, "-"); }
+        else
+        {
+            struct sr_fcache* fc = sr->fcache;
+            fprintf(out, "%-12s %10.1f %9.1f%%", "on",
+                    (t1 - t0) * 1e9 / packets,
+                    100.0 * fc->hits / (fc->hits + fc->misses ? fc->hits + fc->misses : 1));
+        }
+
+        /* -- each run's latencies on their own -- */
+        sr_stats_hist_snapshot(sr, hists, 1);
+        fprintf(out, " %10llu %10llu %10llu\n",
+                (unsigned long long)sr_hist_percentile(&hists[SR_HIST_FORWARD], 50.0),
+                (unsigned long long)sr_hist_percentile(&hists[SR_HIST_FORWARD], 99.0),
+                (unsigned long long)sr_hist_percentile(&hists[SR_HIST_FORWARD], 99.9));
+    }
+
+    fprintf(out, "frames out per interface:");
+    for (p = 0; p < r0->num_ports; p++)
+    { fprintf(out, " eth%d %llu", p, (unsigned long long)tx[p]); }
+    fprintf(out, "\n");
+
+    sr_stats_snapshot(sr, &snap);
+    fprintf(out, "counted: %llu from the flow cache, %llu fast path, %llu slow path, %llu sent\n",
+            (unsigned long long)snap.counter[SR_STAT_FWD_CACHE],
+            (unsigned long long)snap.counter[SR_STAT_FWD_FAST],
+            (unsigned long long)snap.counter[SR_STAT_FWD_SLOW],
+            (unsigned long long)snap.counter[SR_STAT_TX]);
+
+    sr_stats_free(sr);
+    sr_fcache_free(sr);
+    sr->transmit = sim_transmit;
+    sr->transmit_arg = sim;
+
+done:
+    free(hists);
+    free(dst_pool);
+    free(cdf);
+    free(dsts);
+    free(frames);
+    free(tx);
+} /* -- sim_forward_bench -- */
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+    struct sim_state sim;
+    struct sim_totals before;
+    struct sim_event ev;
+    char* topo = "ring";
+    int n = 16;
+    int k = DEFAULT_FATTREE_K;
+    int degree = DEFAULT_DEGREE;
+    int flaps = -1;
+    int bench = 0;
+    int forward_packets = 0;
+    unsigned int fcache_slots = FCACHE_DEFAULT_SLOTS;
+    int verbose = 0;
+    unsigned int spf_initial = OSPF_SPF_INITIAL_DELAY;
+    unsigned int spf_hold = OSPF_SPF_HOLD_TIME;
+    unsigned int spf_max = OSPF_SPF_MAX_WAIT;
+    unsigned int echo_interval = 0;
+    unsigned int echo_multiplier = OSPF_ECHO_MULTIPLIER;
+    unsigned int seed = 1;
+    uint64_t quiet = DEFAULT_QUIET * SIM_TICK_US;
+    uint64_t max_time = DEFAULT_MAX_TIME * SIM_TICK_US;
+    uint64_t start;
+    double wall;
+    FILE* out = stdout;
+    int c, i;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.delay = DEFAULT_DELAY_US;
+
+    while ((c = getopt(argc, argv, "ht:n:k:D:s:l:f:q:T:P:E:F:C:vB")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 't':
+                topo = optarg;
+                break;
+            case 'n':
+                n = atoi((char *) optarg);
+                break;
+            case 'k':
+                k = atoi((char *) optarg);
+                break;
+            case 'D':
+                degree = atoi((char *) optarg);
+                break;
+            case 's':
+                seed = atoi((char *) optarg);
+                break;
+            case 'l':
+                sim.delay = atoi((char *) optarg);
+                break;
+            case 'f':
+                flaps = atoi((char *) optarg);
+                break;
+            case 'q':
+                quiet = atoi((char *) optarg) * SIM_TICK_US;
+                break;
+            case 'T':
+                max_time = atoi((char *) optarg) * SIM_TICK_US;
+                break;
+            case 'P':
+                sscanf(optarg, "%u:%u:%u", &spf_initial, &spf_hold, &spf_max);
+                break;
+            case 'E':
+                sscanf(optarg, "%u:%u", &echo_interval, &echo_multiplier);
+                break;
+            case 'F':
+                forward_packets = atoi((char *) optarg);
+                break;
+            case 'C':
+                fcache_slots = atoi((char *) optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'B':
+                bench = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        } /* switch */
+    } /* -- while -- */
+
+    srandom(seed);
+
+    if (strcmp(topo, "ring") == 0)
+    { sim.num_routers = sim_gen_ring(&sim, n); }
+    else if (strcmp(topo, "grid") == 0)
+    { sim.num_routers = sim_gen_grid(&sim, n); }
+    else if (strcmp(topo, "random") == 0)
+    { sim.num_routers = sim_gen_random(&sim, n, degree); }
+    else if (strcmp(topo, "fattree") == 0)
+    { sim.num_routers = sim_gen_fattree(&sim, k); }
+    else
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if (sim.num_routers <= 0)
+    {
+        fprintf(stderr, "sr_sim: bad size for a %s topology\n", topo);
+        exit(1);
+    }
+
+    /* -- the routers are chatty on stdout, keep it for the report only -- */
+    if (!verbose)
+    {
+        out = fdopen(dup(fileno(stdout)), "w");
+        if (out == 0 || freopen("/dev/null", "w", stdout) == 0)
+        {
+            perror("sr_sim: stdout");
+            exit(1);
+        }
+        setvbuf(out, 0, _IOLBF, 0);
+    }
+
+    sim_build_routers(&sim);
+
+    if (bench)
+    {
+        fprintf(out, "sr_sim: spf benchmark, %s, %d routers, %d links, seed %u\n",
+                topo, sim.num_routers, sim.num_links, seed);
+        return sim_spf_bench(out, &sim, flaps < 0 ? DEFAULT_BENCH_FLAPS : flaps) ? 1 : 0;
+    }
+    if (flaps < 0)
+    { flaps = 0; }
+
+    for (i = 0; i < sim.num_routers; i++)
+    {
+        pwospf_set_spf_throttle(&sim.routers[i].sr, spf_initial, spf_hold, spf_max);
+        if (echo_interval)
+        { pwospf_set_echo(&sim.routers[i].sr, echo_interval, echo_multiplier); }
+    }
+
+    fprintf(out, "sr_sim: %s, %d routers, %d links, link delay %lluus, seed %u, spf throttle %u:%u:%u ms\n",
+            topo, sim.num_routers, sim.num_links,
+            (unsigned long long)sim.delay, seed, spf_initial, spf_hold, spf_max);
+    fprintf(out, "%-12s %10s %9s %10s %8s %8s %10s %10s %10s %9s %9s %11s %9s %8s\n",
+            "phase", "converged", "time s", "hellos", "lsu evt", "lsu orig", "lsu tx", "lsu rx",
+            "lsu dup", "spf req", "spf runs", "spf cpu ms", "max ms", "wall s");
+
+    /* -- routers come up within the first second, in random order -- */
+    for (i = 0; i < sim.num_routers; i++)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.type = SIM_TICK;
+        ev.router = i;
+        ev.time = random() % SIM_TICK_US;
+        sim_push(&sim, &ev);
+    }
+
+    sim_totals(&sim, &before);
+    start = sim.now;
+    wall = sim_wall();
+    c = sim_run_until(&sim, 0, quiet, start + max_time);
+    sim_report(out, "initial", &sim, &before, start, c, sim_wall() - wall);
+    sim_report_paths(out, &sim);
+
+    for (i = 0; i < flaps && c; i++)
+    {
+        struct sim_link* link = &sim.links[random() % sim.num_links];
+        char phase[32];
+
+        link->up = 0;
+        snprintf(phase, sizeof(phase), "fail r%d-r%d", link->router[0], link->router[1]);
+        sim_totals(&sim, &before);
+        start = sim.last_spf = sim.now;
+        wall = sim_wall();
+        c = sim_run_until(&sim, link, quiet, start + max_time);
+        sim_report(out, phase, &sim, &before, start, c, sim_wall() - wall);
+        if (echo_interval)
+        { sim_report_echo(out, &sim, link, start); }
+        if (!c)
+        { break; }
+
+        link->up = 1;
+        snprintf(phase, sizeof(phase), "repair");
+        sim_totals(&sim, &before);
+        start = sim.last_spf = sim.now;
+        wall = sim_wall();
+        c = sim_run_until(&sim, link, quiet, start + max_time);
+        sim_report(out, phase, &sim, &before, start, c, sim_wall() - wall);
+    }
+
+    fprintf(out, "%llu frames delivered, %llu lost on failed links, %.1f virtual seconds\n",
+            (unsigned long long)sim.frames, (unsigned long long)sim.frames_lost,
+            sim.now / 1e6);
+    if (c && forward_packets > 0)
+    { sim_forward_bench(out, &sim, forward_packets, fcache_slots); }
+    fflush(out);
+
+    return c ? 0 : 1;
+}/* -- main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: usage(..)
+ * Scope: local
+ *---------------------------------------------------------------------------*/
+
+static void usage(char* argv0)
+{
+    printf("PWOSPF convergence simulator\n");
+    printf("Format: %s [-h] [-t ring|grid|random|fattree] [-n routers] [-k fattree k]\n", argv0);
+    printf("           [-D random degree] [-s seed] [-l link delay us] [-f link failures]\n");
+    printf("           [-q quiet seconds] [-T max seconds per phase] [-v] [-B]\n");
+    printf("           [-F forwarding replay packets] [-C flow cache slots]\n");
+    printf("           [-P SPF initial msec[:hold msec[:max wait msec]]]\n");
+    printf("           [-E neighbor echo msec[:misses]]\n");
+    printf("   -B benchmarks incremental against full SPF over -f link flaps instead\n");
+    printf("   defaults -t ring -n 16 -k %d -D %d -l %d -q %d -T %d -C %d, -f %d with -B\n",
+           DEFAULT_FATTREE_K, DEFAULT_DEGREE, DEFAULT_DELAY_US,
+           DEFAULT_QUIET, DEFAULT_MAX_TIME, FCACHE_DEFAULT_SLOTS, DEFAULT_BENCH_FLAPS);
+} /* -- usage -- */
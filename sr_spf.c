@@ -0,0 +1,1108 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_spf.c
+ * date:  Sun Oct 18 20:10:12 PDT 2026
+ *
+ * Description:
+ *
+ * Incremental shortest path first for PWOSPF, see sr_spf.h.
+ *
+ * All links cost 1.  Our own links are taken from the interfaces (the
+ * live neighbor state) rather than from our LSU, and we never route to
+ * our own subnets.  Routers and subnets are numbered through hash tables
+ * the first time they are seen and are never forgotten, a router that
+ * stops advertising simply has no links and no subnets left.
+ *
+ * Removing links only makes paths longer, so the routers outside the
+ * subtrees hanging off the removed tree links keep their distance.  An
+ * incremental run resets those subtrees, seeds them from their neighbors
+ * outside, relaxes the routers that gained links and runs Dijkstra on
+ * what was queued.
+ *
+ * The tree only gives distances.  The first hops of a router are the
+ * union of those of its neighbors one hop closer to us, kept as a bit
+ * set over hop slots and recomputed after Dijkstra, closest first, for
+ * the routers that moved or whose incoming links changed; a router whose
+ * set changed passes the work on to the routers it links to.
+ *
+ * There are SPF_MAX_HOPS slots.  Past that, neighbor routers we have no
+ * slot for yet come before second links to routers that have one, so
+ * paths are only lost once there are more neighbor routers than slots.
+ * A neighbor left without a slot is counted and logged once.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_LOG_MODULE SR_LOG_OSPF
+
+#include "sr_spf.h"
+#include "sr_pwospf.h"
+#include "sr_router.h"
+#include "sr_log.h"
+#include "sr_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*---------------------------------------------------------------------
+ * small arrays of indices
+ *---------------------------------------------------------------------*/
+
+static void spf_array_add(uint32_t** array, uint32_t* num, uint32_t* max, uint32_t value)
+{
+	if (*num == *max)
+	{
+		*max = *max ? *max * 2 : 4;
+		*array = (uint32_t*)realloc(*array, *max * sizeof(uint32_t));
+		assert(*array);
+	}
+	(*array)[(*num)++] = value;
+}
+
+static bool spf_array_contains(uint32_t* array, uint32_t num, uint32_t value)
+{
+	for (uint32_t i = 0; i < num; i++)
+	{
+		if (array[i] == value)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Order is not kept, the last element takes the place of the removed one
+static void spf_array_remove(uint32_t* array, uint32_t* num, uint32_t value)
+{
+	for (uint32_t i = 0; i < *num; i++)
+	{
+		if (array[i] == value)
+		{
+			array[i] = array[--(*num)];
+			return;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_init(struct pwospf_spf* spf)
+ *---------------------------------------------------------------------*/
+void spf_init(struct pwospf_spf* spf)
+{
+	memset(spf, 0, sizeof(struct pwospf_spf));
+	spf->root = SPF_NONE;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_free(struct pwospf_spf* spf)
+ *---------------------------------------------------------------------*/
+void spf_free(struct pwospf_spf* spf)
+{
+	for (uint32_t i = 0; i < spf->num_nodes; i++)
+	{
+		free(spf->nodes[i].links);
+		free(spf->nodes[i].in_links);
+		free(spf->nodes[i].subnets);
+	}
+	for (uint32_t i = 0; i < spf->num_subnets; i++)
+	{
+		free(spf->subnets[i].advertisers);
+	}
+	free(spf->nodes);
+	free(spf->node_hash);
+	free(spf->root_hops);
+	free(spf->subnets);
+	free(spf->subnet_hash);
+	free(spf->invalid);
+	free(spf->seeds);
+	free(spf->dirty);
+	free(spf->recheck);
+	free(spf->heap);
+	free(spf->stack);
+	free(spf->changed);
+	free(spf->changes);
+	spf_init(spf);
+}
+
+/*---------------------------------------------------------------------
+ * routers and subnets by hash, open addressing kept at most half full
+ *---------------------------------------------------------------------*/
+
+static uint32_t spf_node_slot(struct pwospf_spf* spf, uint32_t rid)
+{
+	return (rid * 0x9e3779b1U) >> (32 - spf->node_hash_bits);
+}
+
+static uint32_t spf_subnet_slot(struct pwospf_spf* spf, uint32_t net, uint32_t mask)
+{
+	return ((net ^ (mask * 0x85ebca6bU)) * 0x9e3779b1U) >> (32 - spf->subnet_hash_bits);
+}
+
+static void spf_node_rehash(struct pwospf_spf* spf, uint32_t bits)
+{
+	uint32_t mask = (1U << bits) - 1;
+
+	free(spf->node_hash);
+	spf->node_hash = (uint32_t*)calloc(1U << bits, sizeof(uint32_t));
+	assert(spf->node_hash);
+	spf->node_hash_bits = bits;
+
+	for (uint32_t i = 0; i < spf->num_nodes; i++)
+	{
+		uint32_t slot = spf_node_slot(spf, spf->nodes[i].router_id.s_addr);
+		while (spf->node_hash[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		spf->node_hash[slot] = i + 1;
+	}
+}
+
+static void spf_subnet_rehash(struct pwospf_spf* spf, uint32_t bits)
+{
+	uint32_t mask = (1U << bits) - 1;
+
+	free(spf->subnet_hash);
+	spf->subnet_hash = (uint32_t*)calloc(1U << bits, sizeof(uint32_t));
+	assert(spf->subnet_hash);
+	spf->subnet_hash_bits = bits;
+
+	for (uint32_t i = 0; i < spf->num_subnets; i++)
+	{
+		uint32_t slot = spf_subnet_slot(spf, spf->subnets[i].net_num.s_addr, spf->subnets[i].net_mask.s_addr);
+		while (spf->subnet_hash[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		spf->subnet_hash[slot] = i + 1;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_node_lookup(struct pwospf_spf* spf, uint32_t rid)
+ * Index of router rid, SPF_NONE if it was never seen.
+ *---------------------------------------------------------------------*/
+static uint32_t spf_node_lookup(struct pwospf_spf* spf, uint32_t rid)
+{
+	uint32_t mask = (1U << spf->node_hash_bits) - 1;
+	uint32_t slot;
+
+	if (spf->node_hash == NULL)
+	{
+		return SPF_NONE;
+	}
+
+	for (slot = spf_node_slot(spf, rid); spf->node_hash[slot] != 0; slot = (slot + 1) & mask)
+	{
+		if (spf->nodes[spf->node_hash[slot] - 1].router_id.s_addr == rid)
+		{
+			return spf->node_hash[slot] - 1;
+		}
+	}
+	return SPF_NONE;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_node_intern(struct pwospf_spf* spf, uint32_t rid)
+ * Index of router rid, numbering it if it is new.  May move spf->nodes.
+ *---------------------------------------------------------------------*/
+static uint32_t spf_node_intern(struct pwospf_spf* spf, uint32_t rid)
+{
+	uint32_t index = spf_node_lookup(spf, rid);
+	if (index != SPF_NONE)
+	{
+		return index;
+	}
+
+	if (spf->num_nodes == spf->max_nodes)
+	{
+		spf->max_nodes = spf->max_nodes ? spf->max_nodes * 2 : 64;
+		spf->nodes = (struct spf_node*)realloc(spf->nodes, spf->max_nodes * sizeof(struct spf_node));
+		assert(spf->nodes);
+	}
+
+	index = spf->num_nodes++;
+	struct spf_node* node = &spf->nodes[index];
+	memset(node, 0, sizeof(struct spf_node));
+	node->router_id.s_addr = rid;
+	node->dist = SPF_INFINITY;
+	node->parent = SPF_NONE;
+
+	if (spf->num_nodes * 2 > (1U << spf->node_hash_bits))
+	{
+		spf_node_rehash(spf, spf->node_hash_bits ? spf->node_hash_bits + 1 : 7);
+	}
+	else
+	{
+		uint32_t mask = (1U << spf->node_hash_bits) - 1;
+		uint32_t slot = spf_node_slot(spf, rid);
+		while (spf->node_hash[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		spf->node_hash[slot] = index + 1;
+	}
+	return index;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_subnet_lookup(struct pwospf_spf* spf, uint32_t net, uint32_t mask)
+ *---------------------------------------------------------------------*/
+static uint32_t spf_subnet_lookup(struct pwospf_spf* spf, uint32_t net, uint32_t mask)
+{
+	uint32_t hash_mask = (1U << spf->subnet_hash_bits) - 1;
+	uint32_t slot;
+
+	if (spf->subnet_hash == NULL)
+	{
+		return SPF_NONE;
+	}
+
+	for (slot = spf_subnet_slot(spf, net, mask); spf->subnet_hash[slot] != 0; slot = (slot + 1) & hash_mask)
+	{
+		struct spf_subnet* subnet = &spf->subnets[spf->subnet_hash[slot] - 1];
+		if (subnet->net_num.s_addr == net && subnet->net_mask.s_addr == mask)
+		{
+			return spf->subnet_hash[slot] - 1;
+		}
+	}
+	return SPF_NONE;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_subnet_intern(struct pwospf_spf* spf, uint32_t net, uint32_t mask)
+ *---------------------------------------------------------------------*/
+static uint32_t spf_subnet_intern(struct pwospf_spf* spf, uint32_t net, uint32_t mask)
+{
+	uint32_t index = spf_subnet_lookup(spf, net, mask);
+	if (index != SPF_NONE)
+	{
+		return index;
+	}
+
+	if (spf->num_subnets == spf->max_subnets)
+	{
+		spf->max_subnets = spf->max_subnets ? spf->max_subnets * 2 : 64;
+		spf->subnets = (struct spf_subnet*)realloc(spf->subnets, spf->max_subnets * sizeof(struct spf_subnet));
+		assert(spf->subnets);
+	}
+
+	index = spf->num_subnets++;
+	struct spf_subnet* subnet = &spf->subnets[index];
+	memset(subnet, 0, sizeof(struct spf_subnet));
+	subnet->net_num.s_addr = net;
+	subnet->net_mask.s_addr = mask;
+	subnet->route.cost = SPF_INFINITY;
+
+	if (spf->num_subnets * 2 > (1U << spf->subnet_hash_bits))
+	{
+		spf_subnet_rehash(spf, spf->subnet_hash_bits ? spf->subnet_hash_bits + 1 : 7);
+	}
+	else
+	{
+		uint32_t hash_mask = (1U << spf->subnet_hash_bits) - 1;
+		uint32_t slot = spf_subnet_slot(spf, net, mask);
+		while (spf->subnet_hash[slot] != 0)
+		{
+			slot = (slot + 1) & hash_mask;
+		}
+		spf->subnet_hash[slot] = index + 1;
+	}
+	return index;
+}
+
+/*---------------------------------------------------------------------
+ * queued work
+ *---------------------------------------------------------------------*/
+
+static void spf_mark_dirty(struct pwospf_spf* spf, uint32_t subnet)
+{
+	if (!spf->subnets[subnet].dirty)
+	{
+		spf->subnets[subnet].dirty = 1;
+		spf_array_add(&spf->dirty, &spf->num_dirty, &spf->max_dirty, subnet);
+	}
+}
+
+// Router y lost the link its shortest path came in on
+static void spf_unlink(struct pwospf_spf* spf, uint32_t x, uint32_t y)
+{
+	spf_array_remove(spf->nodes[y].in_links, &spf->nodes[y].num_in_links, x);
+	if (spf->nodes[y].parent == x)
+	{
+		spf_array_add(&spf->invalid, &spf->num_invalid, &spf->max_invalid, y);
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_set_links(struct pwospf_spf* spf, uint32_t x, uint32_t* links, uint32_t num_links)
+ * Replace the links of router x, queueing the work the difference needs.
+ *---------------------------------------------------------------------*/
+static void spf_set_links(struct pwospf_spf* spf, uint32_t x, uint32_t* links, uint32_t num_links)
+{
+	struct spf_node* node = &spf->nodes[x];
+	bool added = false;
+
+	for (uint32_t i = node->num_links; i-- > 0; )
+	{
+		uint32_t y = node->links[i];
+		if (!spf_array_contains(links, num_links, y))
+		{
+			node->links[i] = node->links[--node->num_links];
+			spf_unlink(spf, x, y);
+			spf_array_add(&spf->recheck, &spf->num_recheck, &spf->max_recheck, y);
+		}
+	}
+
+	for (uint32_t i = 0; i < num_links; i++)
+	{
+		uint32_t y = links[i];
+		if (!spf_array_contains(node->links, node->num_links, y))
+		{
+			spf_array_add(&node->links, &node->num_links, &node->max_links, y);
+			spf_array_add(&spf->nodes[y].in_links, &spf->nodes[y].num_in_links, &spf->nodes[y].max_in_links, x);
+			spf_array_add(&spf->recheck, &spf->num_recheck, &spf->max_recheck, y);
+			added = true;
+		}
+	}
+
+	if (added)
+	{
+		spf_array_add(&spf->seeds, &spf->num_seeds, &spf->max_seeds, x);
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_set_subnets(struct pwospf_spf* spf, uint32_t x, uint32_t* subnets, uint32_t num_subnets)
+ * Replace the subnets advertised by router x.
+ *---------------------------------------------------------------------*/
+static void spf_set_subnets(struct pwospf_spf* spf, uint32_t x, uint32_t* subnets, uint32_t num_subnets)
+{
+	struct spf_node* node = &spf->nodes[x];
+
+	for (uint32_t i = node->num_subnets; i-- > 0; )
+	{
+		uint32_t s = node->subnets[i];
+		if (!spf_array_contains(subnets, num_subnets, s))
+		{
+			node->subnets[i] = node->subnets[--node->num_subnets];
+			spf_array_remove(spf->subnets[s].advertisers, &spf->subnets[s].num_advertisers, x);
+			spf_mark_dirty(spf, s);
+		}
+	}
+
+	for (uint32_t i = 0; i < num_subnets; i++)
+	{
+		uint32_t s = subnets[i];
+		if (!spf_array_contains(node->subnets, node->num_subnets, s))
+		{
+			spf_array_add(&node->subnets, &node->num_subnets, &node->max_subnets, s);
+			spf_array_add(&spf->subnets[s].advertisers, &spf->subnets[s].num_advertisers,
+					&spf->subnets[s].max_advertisers, x);
+			spf_mark_dirty(spf, s);
+		}
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_set_root(struct pwospf_spf* spf, struct in_addr router_id)
+ * Root the tree at our router id, the next run is a full one.
+ *---------------------------------------------------------------------*/
+void spf_set_root(struct pwospf_spf* spf, struct in_addr router_id)
+{
+	if (spf->root != SPF_NONE && spf->nodes[spf->root].router_id.s_addr == router_id.s_addr)
+	{
+		return;
+	}
+
+	if (spf->root != SPF_NONE)
+	{
+		spf_set_links(spf, spf->root, NULL, 0);
+	}
+
+	// Whatever was heard in our name before is replaced by the interfaces
+	uint32_t root = spf_node_intern(spf, router_id.s_addr);
+	spf_set_links(spf, root, NULL, 0);
+	spf_set_subnets(spf, root, NULL, 0);
+
+	spf->root = root;
+	spf->full_pending = 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_update_router(struct pwospf_spf* spf, struct in_addr router_id,
+ * struct ospfv2_lsu* adv, uint32_t num_adv)
+ *
+ * Install the advertisements of the latest LSU of a router, 0 of them
+ * when its LSU timed out.
+ *---------------------------------------------------------------------*/
+void spf_update_router(struct pwospf_spf* spf, struct in_addr router_id,
+		struct ospfv2_lsu* adv, uint32_t num_adv)
+{
+	uint32_t* links = (uint32_t*)malloc((num_adv + 1) * sizeof(uint32_t));
+	uint32_t* subnets = (uint32_t*)malloc((num_adv + 1) * sizeof(uint32_t));
+	uint32_t num_links = 0, num_subnets = 0;
+	uint32_t x = spf_node_intern(spf, router_id.s_addr);
+
+	assert(links && subnets);
+
+	// Our own links and subnets come from the interfaces
+	if (x == spf->root)
+	{
+		free(links);
+		free(subnets);
+		return;
+	}
+
+	for (uint32_t i = 0; i < num_adv; i++)
+	{
+		if (adv[i].rid != 0 && adv[i].rid != router_id.s_addr)
+		{
+			uint32_t y = spf_node_intern(spf, adv[i].rid);
+			if (!spf_array_contains(links, num_links, y))
+			{
+				links[num_links++] = y;
+			}
+		}
+
+		uint32_t s = spf_subnet_intern(spf, adv[i].subnet, adv[i].mask);
+		if (!spf_array_contains(subnets, num_subnets, s))
+		{
+			subnets[num_subnets++] = s;
+		}
+	}
+
+	spf_set_links(spf, x, links, num_links);
+	spf_set_subnets(spf, x, subnets, num_subnets);
+
+	free(links);
+	free(subnets);
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_hop_slot(struct pwospf_spf* spf, struct sr_if* iface, uint32_t ip, uint64_t* used, bool take_new)
+ *
+ * Hop slot of a neighbor, the one it had if it had one.  A new one, if
+ * take_new, comes from the slots neither in use nor released since the
+ * last run, so no hop set computed before can mistake it for the old
+ * owner.  SPF_NONE when there is none.
+ *---------------------------------------------------------------------*/
+static uint32_t spf_hop_slot(struct pwospf_spf* spf, struct sr_if* iface, uint32_t ip, uint64_t* used, bool take_new)
+{
+	uint64_t free_slots;
+
+	for (uint64_t old = spf->hops_used; old != 0; old &= old - 1)
+	{
+		uint32_t slot = __builtin_ctzll(old);
+		if (spf->hop_interfaces[slot] == iface && spf->hop_ips[slot] == ip)
+		{
+			*used |= 1ULL << slot;
+			return slot;
+		}
+	}
+
+	free_slots = ~(spf->hops_used | spf->hops_released | *used);
+	if (!take_new || free_slots == 0)
+	{
+		return SPF_NONE;
+	}
+
+	uint32_t slot = __builtin_ctzll(free_slots);
+	spf->hop_interfaces[slot] = iface;
+	spf->hop_ips[slot] = ip;
+	*used |= 1ULL << slot;
+	return slot;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_update_interfaces(struct pwospf_spf* spf, struct sr_instance* sr)
+ *
+ * Take our links from the neighbors currently up on the interfaces.
+ *---------------------------------------------------------------------*/
+void spf_update_interfaces(struct pwospf_spf* spf, struct sr_instance* sr)
+{
+	struct sr_if* if_walker = NULL;
+	uint32_t num_neighbors = 0, num_links = 0;
+	uint64_t used = 0;
+
+	if (spf->root == SPF_NONE)
+	{
+		return;
+	}
+
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		num_neighbors += if_walker->neighbors.num;
+	}
+
+	uint32_t* links = (uint32_t*)malloc((num_neighbors + 1) * sizeof(uint32_t));
+	uint64_t* hops = (uint64_t*)malloc((num_neighbors + 1) * sizeof(uint64_t));
+	assert(links && hops);
+
+	// Neighbors keep their slot, so new slots are only handed out from
+	// the second pass on: first to routers with no slot yet, then to the
+	// parallel links of the others
+	uint32_t missing = 0;
+	struct sr_if* missing_if = NULL;
+	uint32_t missing_ip = 0;
+	for (int pass = 0; pass < 3; pass++)
+	{
+		for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+		{
+			struct pwospf_nbr_table* table = &if_walker->neighbors;
+			for (uint32_t i = 0; i < nbr_slots(table); i++)
+			{
+				if (table->slots[i].router_id == 0)
+				{
+					continue;
+				}
+
+				uint32_t y = spf_node_intern(spf, table->slots[i].router_id);
+				if (y == spf->root)
+				{
+					continue;
+				}
+
+				uint32_t j = 0;
+				while (j < num_links && links[j] != y)
+				{
+					j++;
+				}
+				if (j == num_links)
+				{
+					links[num_links] = y;
+					hops[num_links++] = 0;
+				}
+
+				bool take_new = pass == 2 || (pass == 1 && hops[j] == 0);
+				uint32_t slot = spf_hop_slot(spf, if_walker, table->slots[i].ip, &used, take_new);
+				if (slot != SPF_NONE)
+				{
+					hops[j] |= 1ULL << slot;
+				}
+				else if (pass == 2)
+				{
+					missing++;
+					missing_if = if_walker;
+					missing_ip = table->slots[i].ip;
+				}
+			}
+		}
+	}
+
+	if (missing > spf->hops_missing)
+	{
+		sr_stat_add(sr, OSPF_NO_HOP_SLOT, missing - spf->hops_missing);
+	}
+	if (missing && !spf->hops_warned)
+	{
+		struct in_addr ip;
+		ip.s_addr = missing_ip;
+		sr_log(SR_LOG_OSPF, SR_LOG_WARN, "-> PWOSPF: more than %d neighbors, %u left without"
+				" a first hop, e.g. %s on %s\n", SPF_MAX_HOPS, missing, inet_ntoa(ip),
+				missing_if->name);
+		spf->hops_warned = 1;
+	}
+	spf->hops_missing = missing;
+
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		// Directly connected subnets get no route, that may have just changed
+		uint32_t s = spf_subnet_lookup(spf, if_walker->ip & if_walker->mask, if_walker->mask);
+		if (s != SPF_NONE)
+		{
+			spf_mark_dirty(spf, s);
+		}
+	}
+
+	spf->hops_released |= spf->hops_used & ~used;
+	spf->hops_used = used;
+
+	// A neighbor we keep a link to but now reach over other hops needs its
+	// hops recomputed, spf_set_links queues the ones that come and go
+	struct spf_node* root = &spf->nodes[spf->root];
+	for (uint32_t i = 0; i < root->num_links; i++)
+	{
+		for (uint32_t j = 0; j < num_links; j++)
+		{
+			if (links[j] == root->links[i] && hops[j] != spf->root_hops[i])
+			{
+				spf_array_add(&spf->recheck, &spf->num_recheck, &spf->max_recheck, links[j]);
+			}
+		}
+	}
+
+	spf_set_links(spf, spf->root, links, num_links);
+
+	// Line the hop sets up with the root links again, spf_set_links reorders them
+	root = &spf->nodes[spf->root];
+	if (root->num_links > spf->max_root_hops)
+	{
+		spf->max_root_hops = root->max_links;
+		spf->root_hops = (uint64_t*)realloc(spf->root_hops, spf->max_root_hops * sizeof(uint64_t));
+		assert(spf->root_hops);
+	}
+	for (uint32_t i = 0; i < root->num_links; i++)
+	{
+		for (uint32_t j = 0; j < num_links; j++)
+		{
+			if (links[j] == root->links[i])
+			{
+				spf->root_hops[i] = hops[j];
+				break;
+			}
+		}
+	}
+
+	free(links);
+	free(hops);
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_pending(struct pwospf_spf* spf)
+ * Return 1 if updates are waiting for a run.
+ *---------------------------------------------------------------------*/
+int spf_pending(struct pwospf_spf* spf)
+{
+	return spf->full_pending || spf->num_invalid > 0 || spf->num_seeds > 0 || spf->num_dirty > 0 ||
+			spf->num_recheck > 0;
+}
+
+/*---------------------------------------------------------------------
+ * binary min heap of routers by dist
+ *---------------------------------------------------------------------*/
+
+static void spf_heap_up(struct pwospf_spf* spf, uint32_t pos)
+{
+	uint32_t x = spf->heap[pos];
+
+	while (pos > 0)
+	{
+		uint32_t parent = (pos - 1) / 2;
+		if (spf->nodes[spf->heap[parent]].dist <= spf->nodes[x].dist)
+		{
+			break;
+		}
+		spf->heap[pos] = spf->heap[parent];
+		spf->nodes[spf->heap[pos]].heap_pos = pos + 1;
+		pos = parent;
+	}
+
+	spf->heap[pos] = x;
+	spf->nodes[x].heap_pos = pos + 1;
+}
+
+static uint32_t spf_heap_pop(struct pwospf_spf* spf)
+{
+	uint32_t top = spf->heap[0];
+	uint32_t x = spf->heap[--spf->heap_len];
+	uint32_t pos = 0;
+
+	spf->nodes[top].heap_pos = 0;
+	if (spf->heap_len == 0)
+	{
+		return top;
+	}
+
+	while (1)
+	{
+		uint32_t child = 2 * pos + 1;
+		if (child >= spf->heap_len)
+		{
+			break;
+		}
+		if (child + 1 < spf->heap_len && spf->nodes[spf->heap[child + 1]].dist < spf->nodes[spf->heap[child]].dist)
+		{
+			child++;
+		}
+		if (spf->nodes[spf->heap[child]].dist >= spf->nodes[x].dist)
+		{
+			break;
+		}
+		spf->heap[pos] = spf->heap[child];
+		spf->nodes[spf->heap[pos]].heap_pos = pos + 1;
+		pos = child;
+	}
+
+	spf->heap[pos] = x;
+	spf->nodes[x].heap_pos = pos + 1;
+	return top;
+}
+
+/*---------------------------------------------------------------------
+ * relaxation
+ *---------------------------------------------------------------------*/
+
+static void spf_node_changed(struct pwospf_spf* spf, uint32_t x)
+{
+	if (spf->nodes[x].changed_epoch != spf->epoch)
+	{
+		spf->nodes[x].changed_epoch = spf->epoch;
+		spf->changed[spf->num_changed++] = x;
+	}
+}
+
+// Link k of router x
+static void spf_relax(struct pwospf_spf* spf, uint32_t x, uint32_t k)
+{
+	struct spf_node* from = &spf->nodes[x];
+	struct spf_node* to = &spf->nodes[from->links[k]];
+	uint32_t y = from->links[k];
+
+	if (from->dist == SPF_INFINITY || from->dist + 1 >= to->dist)
+	{
+		return;
+	}
+
+	to->dist = from->dist + 1;
+	to->parent = x;
+	spf_node_changed(spf, y);
+
+	if (to->heap_pos == 0)
+	{
+		spf->heap[spf->heap_len++] = y;
+		spf_heap_up(spf, spf->heap_len - 1);
+	}
+	else
+	{
+		spf_heap_up(spf, to->heap_pos - 1);
+	}
+}
+
+static void spf_relax_links(struct pwospf_spf* spf, uint32_t x)
+{
+	for (uint32_t k = 0; k < spf->nodes[x].num_links; k++)
+	{
+		spf_relax(spf, x, k);
+	}
+}
+
+static void spf_relax_link_to(struct pwospf_spf* spf, uint32_t x, uint32_t y)
+{
+	for (uint32_t k = 0; k < spf->nodes[x].num_links; k++)
+	{
+		if (spf->nodes[x].links[k] == y)
+		{
+			spf_relax(spf, x, k);
+			return;
+		}
+	}
+}
+
+static void spf_dijkstra(struct pwospf_spf* spf)
+{
+	while (spf->heap_len > 0)
+	{
+		spf_relax_links(spf, spf_heap_pop(spf));
+	}
+}
+
+/*---------------------------------------------------------------------
+ * first hop sets
+ *---------------------------------------------------------------------*/
+
+static void spf_hops_queue(struct pwospf_spf* spf, uint32_t x)
+{
+	if (spf->nodes[x].heap_pos == 0)
+	{
+		spf->heap[spf->heap_len++] = x;
+		spf_heap_up(spf, spf->heap_len - 1);
+	}
+}
+
+// Union of the first hops of the routers one hop closer that link to x
+static uint64_t spf_node_hops(struct pwospf_spf* spf, uint32_t x)
+{
+	struct spf_node* node = &spf->nodes[x];
+	uint64_t hops = 0;
+
+	if (node->dist == SPF_INFINITY || x == spf->root)
+	{
+		return 0;
+	}
+
+	for (uint32_t j = 0; j < node->num_in_links; j++)
+	{
+		uint32_t p = node->in_links[j];
+		if (p == spf->root)
+		{
+			if (node->dist == 1)
+			{
+				struct spf_node* root = &spf->nodes[p];
+				for (uint32_t k = 0; k < root->num_links; k++)
+				{
+					if (root->links[k] == x)
+					{
+						hops |= spf->root_hops[k];
+					}
+				}
+			}
+		}
+		else if (spf->nodes[p].dist + 1 == node->dist)
+		{
+			hops |= spf->nodes[p].hops;
+		}
+	}
+	return hops;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_update_hops(struct pwospf_spf* spf)
+ *
+ * Recompute the first hops of the routers Dijkstra moved and of those
+ * whose incoming links changed, in order of distance.  A router that
+ * moved queues the routers it links to once, after that only a change
+ * of its set does.  Runs on the heap, which Dijkstra left empty.
+ *---------------------------------------------------------------------*/
+static void spf_update_hops(struct pwospf_spf* spf)
+{
+	uint32_t num_moved = spf->num_changed;
+
+	for (uint32_t i = 0; i < num_moved; i++)
+	{
+		spf_hops_queue(spf, spf->changed[i]);
+	}
+	for (uint32_t i = 0; i < spf->num_recheck; i++)
+	{
+		spf_hops_queue(spf, spf->recheck[i]);
+	}
+	spf->num_recheck = 0;
+
+	while (spf->heap_len > 0)
+	{
+		uint32_t x = spf_heap_pop(spf);
+		struct spf_node* node = &spf->nodes[x];
+		uint64_t hops = spf_node_hops(spf, x);
+		bool moved = node->hops_epoch != spf->epoch && node->changed_epoch == spf->epoch;
+
+		node->hops_epoch = spf->epoch;
+		if (hops == node->hops && !moved)
+		{
+			continue;
+		}
+		if (hops != node->hops)
+		{
+			node->hops = hops;
+			spf_node_changed(spf, x);
+		}
+
+		for (uint32_t k = 0; k < node->num_links; k++)
+		{
+			spf_hops_queue(spf, node->links[k]);
+		}
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_begin_run(struct pwospf_spf* spf)
+ *---------------------------------------------------------------------*/
+static void spf_begin_run(struct pwospf_spf* spf)
+{
+	if (spf->num_nodes > spf->max_scratch)
+	{
+		spf->max_scratch = spf->max_nodes;
+		spf->heap = (uint32_t*)realloc(spf->heap, spf->max_scratch * sizeof(uint32_t));
+		spf->stack = (uint32_t*)realloc(spf->stack, spf->max_scratch * sizeof(uint32_t));
+		spf->changed = (uint32_t*)realloc(spf->changed, spf->max_scratch * sizeof(uint32_t));
+		assert(spf->heap && spf->stack && spf->changed);
+	}
+
+	spf->epoch++;
+	spf->heap_len = 0;
+	spf->num_changed = 0;
+	spf->num_changes = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_best_route(struct pwospf_spf* spf, struct sr_instance* sr, struct spf_subnet* subnet)
+ * Cheapest way to a subnet, with the first hops of every advertiser at
+ * that cost.
+ *---------------------------------------------------------------------*/
+static struct spf_route spf_best_route(struct pwospf_spf* spf, struct sr_instance* sr, struct spf_subnet* subnet)
+{
+	struct spf_route best;
+	struct sr_if* if_walker = NULL;
+
+	best.hops = 0;
+	best.cost = SPF_INFINITY;
+
+	for (if_walker = sr->if_list; if_walker != NULL; if_walker = if_walker->next)
+	{
+		if ((if_walker->ip & if_walker->mask) == subnet->net_num.s_addr && if_walker->mask == subnet->net_mask.s_addr)
+		{
+			return best;
+		}
+	}
+
+	for (uint32_t i = 0; i < subnet->num_advertisers; i++)
+	{
+		struct spf_node* node = &spf->nodes[subnet->advertisers[i]];
+		if (node->dist == SPF_INFINITY || node->hops == 0 || subnet->advertisers[i] == spf->root)
+		{
+			continue;
+		}
+
+		if (node->dist + 1 < best.cost)
+		{
+			best.hops = node->hops;
+			best.cost = node->dist + 1;
+		}
+		else if (node->dist + 1 == best.cost)
+		{
+			best.hops |= node->hops;
+		}
+	}
+	return best;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_finish_run(struct pwospf_spf* spf, struct sr_instance* sr)
+ * Recompute the routes of the dirty subnets and of the subnets of the
+ * routers that moved, leaving the ones that changed in spf->changes.
+ *---------------------------------------------------------------------*/
+static uint32_t spf_finish_run(struct pwospf_spf* spf, struct sr_instance* sr)
+{
+	for (uint32_t i = 0; i < spf->num_changed; i++)
+	{
+		struct spf_node* node = &spf->nodes[spf->changed[i]];
+		for (uint32_t j = 0; j < node->num_subnets; j++)
+		{
+			spf_mark_dirty(spf, node->subnets[j]);
+		}
+	}
+
+	for (uint32_t i = 0; i < spf->num_dirty; i++)
+	{
+		struct spf_subnet* subnet = &spf->subnets[spf->dirty[i]];
+		struct spf_route best = spf_best_route(spf, sr, subnet);
+
+		subnet->dirty = 0;
+		if (best.cost != subnet->route.cost || best.hops != subnet->route.hops)
+		{
+			subnet->route = best;
+			spf_array_add(&spf->changes, &spf->num_changes, &spf->max_changes, spf->dirty[i]);
+		}
+	}
+
+	spf->num_dirty = 0;
+	spf->num_invalid = 0;
+	spf->num_seeds = 0;
+	spf->hops_released = 0;
+	return spf->num_changes;
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_run(struct pwospf_spf* spf, struct sr_instance* sr)
+ *
+ * Apply the queued updates to the shortest path tree and the routes.
+ * Returns the number of subnets whose route changed, listed in
+ * spf->changes.
+ *---------------------------------------------------------------------*/
+uint32_t spf_run(struct pwospf_spf* spf, struct sr_instance* sr)
+{
+	if (spf->root == SPF_NONE)
+	{
+		return 0;
+	}
+	if (spf->full_pending)
+	{
+		return spf_run_full(spf, sr);
+	}
+
+	spf_begin_run(spf);
+
+	// Reset the subtrees under the removed tree links
+	for (uint32_t i = 0; i < spf->num_invalid; i++)
+	{
+		uint32_t y = spf->invalid[i];
+		uint32_t num_stack = 0;
+
+		if (spf->nodes[y].invalid_epoch == spf->epoch)
+		{
+			continue;
+		}
+		spf->nodes[y].invalid_epoch = spf->epoch;
+		spf->stack[num_stack++] = y;
+
+		while (num_stack > 0)
+		{
+			uint32_t x = spf->stack[--num_stack];
+			struct spf_node* node = &spf->nodes[x];
+
+			for (uint32_t k = 0; k < node->num_links; k++)
+			{
+				struct spf_node* child = &spf->nodes[node->links[k]];
+				if (child->parent == x && child->invalid_epoch != spf->epoch)
+				{
+					child->invalid_epoch = spf->epoch;
+					spf->stack[num_stack++] = node->links[k];
+				}
+			}
+
+			node->dist = SPF_INFINITY;
+			node->parent = SPF_NONE;
+			spf_node_changed(spf, x);
+		}
+	}
+
+	// Reach them again from their neighbors outside the subtrees
+	uint32_t num_reset = spf->num_changed;
+	for (uint32_t i = 0; i < num_reset; i++)
+	{
+		uint32_t y = spf->changed[i];
+		struct spf_node* node = &spf->nodes[y];
+		for (uint32_t j = 0; j < node->num_in_links; j++)
+		{
+			uint32_t x = node->in_links[j];
+			if (spf->nodes[x].invalid_epoch != spf->epoch)
+			{
+				spf_relax_link_to(spf, x, y);
+			}
+		}
+	}
+
+	// New links may give shorter paths
+	for (uint32_t i = 0; i < spf->num_seeds; i++)
+	{
+		spf_relax_links(spf, spf->seeds[i]);
+	}
+
+	spf_dijkstra(spf);
+	spf_update_hops(spf);
+	return spf_finish_run(spf, sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: spf_run_full(struct pwospf_spf* spf, struct sr_instance* sr)
+ * Recompute the whole tree and every route, same result as spf_run().
+ *---------------------------------------------------------------------*/
+uint32_t spf_run_full(struct pwospf_spf* spf, struct sr_instance* sr)
+{
+	if (spf->root == SPF_NONE)
+	{
+		return 0;
+	}
+
+	spf_begin_run(spf);
+
+	for (uint32_t i = 0; i < spf->num_nodes; i++)
+	{
+		struct spf_node* node = &spf->nodes[i];
+		node->dist = SPF_INFINITY;
+		node->parent = SPF_NONE;
+		spf_node_changed(spf, i);
+	}
+	spf->nodes[spf->root].dist = 0;
+
+	spf_relax_links(spf, spf->root);
+	spf_dijkstra(spf);
+	spf_update_hops(spf);
+
+	for (uint32_t i = 0; i < spf->num_subnets; i++)
+	{
+		spf_mark_dirty(spf, i);
+	}
+	spf->full_pending = 0;
+	return spf_finish_run(spf, sr);
+}
@@ -0,0 +1,145 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_spf.h
+ * date:  Sun Oct 18 20:10:12 PDT 2026
+ *
+ * Description:
+ *
+ * Incremental shortest path first over the PWOSPF topology database.
+ *
+ * The database is kept as a graph indexed by router, with the links and
+ * the subnets each router advertises, together with the shortest path
+ * tree from our router id and the best route to every subnet.  Updates
+ * only queue work: a removed tree link invalidates the subtree under it,
+ * an added link seeds a relaxation from its router and a changed subnet
+ * is marked dirty.  spf_run() then recomputes just that part of the tree
+ * and reports the subnets whose route changed; spf_run_full() recomputes
+ * everything from scratch.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SPF_H
+#define SR_SPF_H
+
+#include <netinet/in.h>
+
+#include "sr_if.h"
+
+/* forward declare */
+struct sr_instance;
+struct sr_rt;
+struct ospfv2_lsu;
+
+#define SPF_INFINITY 0xffffffff
+#define SPF_NONE     0xffffffff
+#define SPF_MAX_HOPS 64             // first hops in use at once, one bit each in a hop set
+
+struct spf_route
+{
+	uint64_t hops;                  // first hops of the shortest paths, by hop slot
+	uint32_t cost;                  // SPF_INFINITY when there is no route
+};
+
+struct spf_node
+{
+	struct in_addr router_id;
+	uint32_t* links;                // routers this one advertises a link to
+	uint32_t num_links;
+	uint32_t max_links;
+	uint32_t* in_links;             // routers advertising a link to this one
+	uint32_t num_in_links;
+	uint32_t max_in_links;
+	uint32_t* subnets;              // subnets this one advertises
+	uint32_t num_subnets;
+	uint32_t max_subnets;
+
+	// Shortest path tree
+	uint32_t dist;
+	uint32_t parent;
+	uint64_t hops;                  // first hops of all shortest paths here, by hop slot
+	uint32_t hops_epoch;            // run that last recomputed hops
+	uint32_t heap_pos;              // position in the heap + 1, 0 if not queued
+	uint32_t invalid_epoch;         // run that invalidated it
+	uint32_t changed_epoch;         // run that changed its distance or first hop
+};
+
+struct spf_subnet
+{
+	struct in_addr net_num;
+	struct in_addr net_mask;
+	uint32_t* advertisers;          // routers advertising the subnet
+	uint32_t num_advertisers;
+	uint32_t max_advertisers;
+	uint8_t dirty;
+	struct spf_route route;         // best route
+	struct sr_rt* rt;               // first routing table entry installed for it, see run_spf()
+	uint32_t num_rt;                // entries from rt on, one per first hop
+};
+
+struct pwospf_spf
+{
+	struct spf_node* nodes;
+	uint32_t num_nodes;
+	uint32_t max_nodes;
+	uint32_t* node_hash;            // node index + 1 by hashed router id, 0 is free
+	uint32_t node_hash_bits;
+	uint32_t root;                  // our node, SPF_NONE until the router id is known
+
+	// Our own links come from the neighbor tables.  Every interface and
+	// neighbor address pair gets a hop slot, link i of the root can leave
+	// on any of the slots in root_hops[i] (parallel links to one router)
+	uint64_t* root_hops;
+	uint32_t max_root_hops;
+	struct sr_if* hop_interfaces[SPF_MAX_HOPS];
+	uint32_t hop_ips[SPF_MAX_HOPS];
+	uint64_t hops_used;             // slots of the current neighbors
+	uint64_t hops_released;         // slots given up since the last run, not reused before it
+	uint32_t hops_missing;          // neighbors without a slot at the last update
+	uint8_t hops_warned;            // running out of slots was logged
+	uint8_t full_pending;           // root just set, the next run recomputes everything
+
+	struct spf_subnet* subnets;
+	uint32_t num_subnets;
+	uint32_t max_subnets;
+	uint32_t* subnet_hash;          // subnet index + 1 by hashed subnet and mask
+	uint32_t subnet_hash_bits;
+
+	// Queued work
+	uint32_t* invalid;              // routers whose tree link was removed
+	uint32_t num_invalid;
+	uint32_t max_invalid;
+	uint32_t* seeds;                // routers that gained links
+	uint32_t num_seeds;
+	uint32_t max_seeds;
+	uint32_t* dirty;                // subnets to recompute the route of
+	uint32_t num_dirty;
+	uint32_t max_dirty;
+	uint32_t* recheck;              // routers whose incoming links changed, for their hops
+	uint32_t num_recheck;
+	uint32_t max_recheck;
+
+	// Scratch of a run
+	uint32_t epoch;
+	uint32_t* heap;                 // binary min heap of routers by dist
+	uint32_t heap_len;
+	uint32_t* stack;
+	uint32_t* changed;              // routers whose dist or first hops changed
+	uint32_t num_changed;
+	uint32_t max_scratch;
+
+	// Result of the last run, subnets whose route changed
+	uint32_t* changes;
+	uint32_t num_changes;
+	uint32_t max_changes;
+};
+
+void spf_init(struct pwospf_spf* spf);
+void spf_free(struct pwospf_spf* spf);
+void spf_set_root(struct pwospf_spf* spf, struct in_addr router_id);
+void spf_update_router(struct pwospf_spf* spf, struct in_addr router_id,
+		struct ospfv2_lsu* adv, uint32_t num_adv);
+void spf_update_interfaces(struct pwospf_spf* spf, struct sr_instance* sr);
+int spf_pending(struct pwospf_spf* spf);
+uint32_t spf_run(struct pwospf_spf* spf, struct sr_instance* sr);
+uint32_t spf_run_full(struct pwospf_spf* spf, struct sr_instance* sr);
+
+#endif /* SR_SPF_H */
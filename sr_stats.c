@@ -0,0 +1,432 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.c
+ * date:  Sun Oct 18 23:59:47 PDT 2026
+ *
+ * Description:
+ *
+ * Per thread counter blocks, their sum, the latency histograms and the
+ * SIGUSR1/SIGUSR2 dumps, see sr_stats.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "sr_stats.h"
+#include "sr_if.h"
+#include "sr_router.h"
+
+__thread int sr_stats_thread = -1;
+__thread uint64_t sr_stats_packet_in;
+__thread unsigned int sr_stats_sample_count;
+
+double sr_stats_ns_per_tick = 1.0;
+
+static int stats_num_threads;       /* slots handed out so far */
+static pthread_once_t stats_calibrated = PTHREAD_ONCE_INIT;
+
+static const char* stats_names[] =
+{
+#define SR_STATS_DESC(name, desc) desc,
+    SR_STATS_COUNTERS(SR_STATS_DESC)
+};
+
+static const char* hist_names[] =
+{
+    SR_STATS_HISTS(SR_STATS_DESC)
+#undef SR_STATS_DESC
+};
+
+static void* sr_stats_dumper(void* arg);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_register_thread(..)
+ * Scope: Global
+ *
+ * Slot of the calling thread in every router's blocks, the same for all
+ * routers of the process.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_stats_register_thread(void)
+{
+    int slot = __atomic_fetch_add(&stats_num_threads, 1, __ATOMIC_RELAXED);
+
+    return slot < SR_STATS_MAX_THREADS - 1 ? slot : SR_STATS_MAX_THREADS - 1;
+} /* -- sr_stats_register_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_add_block(..)
+ * Scope: Global
+ *
+ * First count of a thread for a router: give it its block.  Returns 0 if
+ * there is no memory, the count is lost then.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_stats_block* sr_stats_add_block(struct sr_stats* stats, int thread)
+{
+    struct sr_stats_block* blk = 0;
+
+    pthread_mutex_lock(&stats->lock);
+    if ((blk = stats->blocks[thread]) == 0 &&
+        posix_memalign((void**)&blk, SR_STATS_LINE, sizeof(struct sr_stats_block)) == 0)
+    {
+        memset(blk, 0, sizeof(struct sr_stats_block));
+        __atomic_store_n(&stats->blocks[thread], blk, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&stats->lock);
+
+    return blk;
+} /* -- sr_stats_add_block -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_calibrate(..)
+ * Scope: Local
+ *
+ * Measure the TSC against CLOCK_MONOTONIC over 20 ms, once per process.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_stats_calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec ts0, ts1;
+    uint64_t t0, t1;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts0);
+    t0 = sr_stats_ticks();
+    usleep(20000);
+    clock_gettime(CLOCK_MONOTONIC, &ts1);
+    t1 = sr_stats_ticks();
+
+    ns = (ts1.tv_sec - ts0.tv_sec) * 1e9 + (ts1.tv_nsec - ts0.tv_nsec);
+    if (t1 > t0)
+    { sr_stats_ns_per_tick = ns / (double)(t1 - t0); }
+#endif
+} /* -- sr_stats_calibrate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_init(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_stats_init(struct sr_instance* sr)
+{
+    struct sr_stats* stats = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    pthread_once(&stats_calibrated, sr_stats_calibrate);
+
+    if ((stats = (struct sr_stats*)calloc(1, sizeof(struct sr_stats))) == 0)
+    { return -1; }
+    pthread_mutex_init(&stats->lock, 0);
+    sr->stats = stats;
+
+    return 0;
+} /* -- sr_stats_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_free(..)
+ * Scope: Global
+ *
+ * Stop the dump thread and drop the counters.  Nothing may count any
+ * more.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_free(struct sr_instance* sr)
+{
+    struct sr_stats* stats = sr->stats;
+    int i;
+
+    if (stats == 0)
+    { return; }
+
+    if (stats->dumping)
+    {
+        pthread_cancel(stats->dumper);
+        pthread_join(stats->dumper, 0);
+    }
+
+    sr->stats = 0;
+    for (i = 0; i < SR_STATS_MAX_THREADS; i++)
+    { free(stats->blocks[i]); }
+    pthread_mutex_destroy(&stats->lock);
+    free(stats);
+} /* -- sr_stats_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_snapshot(..)
+ * Scope: Global
+ *
+ * Add up the blocks of every thread.  The threads keep counting while
+ * this runs, so counters are each exact but not all of the same instant.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_snapshot(struct sr_instance* sr, struct sr_stats_snapshot* snap)
+{
+    int i, c, k;
+
+    memset(snap, 0, sizeof(struct sr_stats_snapshot));
+    if (sr->stats == 0)
+    { return; }
+
+    for (i = 0; i < SR_STATS_MAX_THREADS; i++)
+    {
+        struct sr_stats_block* blk = __atomic_load_n(&sr->stats->blocks[i], __ATOMIC_ACQUIRE);
+
+        if (blk == 0)
+        { continue; }
+        for (c = 0; c < SR_STAT_NUM; c++)
+        { snap->counter[c] += __atomic_load_n(&blk->counter[c], __ATOMIC_RELAXED); }
+        for (c = 0; c < SR_STATS_MAX_IFACES; c++)
+        {
+            for (k = 0; k < SR_STAT_IF_NUM; k++)
+            { snap->iface[c][k] += __atomic_load_n(&blk->iface[c][k], __ATOMIC_RELAXED); }
+        }
+    }
+} /* -- sr_stats_snapshot -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_hist_snapshot(..)
+ * Scope: Global
+ *
+ * Sum of every thread's histograms (SR_HIST_NUM of them) since the last
+ * read with reset, or since the start if there was none.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_hist_snapshot(struct sr_instance* sr, struct sr_hist* hists, int reset)
+{
+    struct sr_stats* stats = sr->stats;
+    int i, h, b;
+
+    memset(hists, 0, SR_HIST_NUM * sizeof(struct sr_hist));
+    if (stats == 0)
+    { return; }
+
+    /* -- one reader at a time, or a reset could land between a sum and
+     *    the subtraction of the last one -- */
+    pthread_mutex_lock(&stats->lock);
+
+    for (i = 0; i < SR_STATS_MAX_THREADS; i++)
+    {
+        struct sr_stats_block* blk = __atomic_load_n(&stats->blocks[i], __ATOMIC_ACQUIRE);
+
+        if (blk == 0)
+        { continue; }
+        for (h = 0; h < SR_HIST_NUM; h++)
+        {
+            hists[h].count += __atomic_load_n(&blk->hist[h].count, __ATOMIC_RELAXED);
+            hists[h].sum += __atomic_load_n(&blk->hist[h].sum, __ATOMIC_RELAXED);
+            for (b = 0; b < SR_HIST_BUCKETS; b++)
+            { hists[h].bucket[b] += __atomic_load_n(&blk->hist[h].bucket[b], __ATOMIC_RELAXED); }
+        }
+    }
+
+    for (h = 0; h < SR_HIST_NUM; h++)
+    {
+        struct sr_hist* base = &stats->hist_read[h];
+        struct sr_hist now = hists[h];
+
+        hists[h].count -= base->count;
+        hists[h].sum -= base->sum;
+        for (b = 0; b < SR_HIST_BUCKETS; b++)
+        { hists[h].bucket[b] -= base->bucket[b]; }
+        if (reset)
+        { *base = now; }
+    }
+    pthread_mutex_unlock(&stats->lock);
+} /* -- sr_stats_hist_snapshot -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_hist_percentile(..)
+ * Scope: Global
+ *
+ * Highest value of the bucket the p-th percentile (0 < p <= 100) falls
+ * in, in ns.  0 for an empty histogram.
+ *
+ *---------------------------------------------------------------------------*/
+
+uint64_t sr_hist_percentile(const struct sr_hist* h, double p)
+{
+    uint64_t rank, seen = 0;
+    unsigned int b;
+
+    if (h->count == 0)
+    { return 0; }
+
+    /* -- the buckets were read one by one, they may add up to a bit more -- */
+    rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank == 0)
+    { rank = 1; }
+
+    for (b = 0; b < SR_HIST_BUCKETS; b++)
+    {
+        seen += h->bucket[b];
+        if (seen >= rank)
+        { break; }
+    }
+    if (b == SR_HIST_BUCKETS)
+    { b--; }
+
+    if (b < SR_HIST_SUB)
+    { return b; }
+    return ((uint64_t)(SR_HIST_SUB + (b & (SR_HIST_SUB - 1)) + 1) << (b / SR_HIST_SUB - 1)) - 1;
+} /* -- sr_hist_percentile -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_print_latency(..)
+ * Scope: Global
+ *
+ * p50, p99, p99.9 and max of every histogram that has anything, since the
+ * last read with reset.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_print_latency(struct sr_instance* sr, FILE* out, int reset)
+{
+    struct sr_hist* hists = 0;
+    int h;
+
+    if ((hists = (struct sr_hist*)malloc(SR_HIST_NUM * sizeof(struct sr_hist))) == 0)
+    { return; }
+    sr_stats_hist_snapshot(sr, hists, reset);
+
+    fprintf(out, "  %-26s %10s %10s %10s %10s %10s %10s\n", "latency ns", "count", "mean",
+            "p50", "p99", "p99.9", "max");
+    for (h = 0; h < SR_HIST_NUM; h++)
+    {
+        struct sr_hist* hist = &hists[h];
+
+        if (hist->count == 0)
+        { continue; }
+        fprintf(out, "  %-26s %10llu %10llu %10llu %10llu %10llu %10llu\n", hist_names[h],
+                (unsigned long long)hist->count,
+                (unsigned long long)(hist->sum / hist->count),
+                (unsigned long long)sr_hist_percentile(hist, 50.0),
+                (unsigned long long)sr_hist_percentile(hist, 99.0),
+                (unsigned long long)sr_hist_percentile(hist, 99.9),
+                (unsigned long long)sr_hist_percentile(hist, 100.0));
+    }
+    fflush(out);
+    free(hists);
+} /* -- sr_stats_print_latency -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_print(..)
+ * Scope: Global
+ *
+ * Every counter that is not 0, the interfaces, then the latencies since
+ * the last read with reset.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_print(struct sr_instance* sr, FILE* out)
+{
+    struct sr_stats_snapshot snap;
+    struct sr_if* iface = 0;
+    int c;
+
+    sr_stats_snapshot(sr, &snap);
+
+    fprintf(out, "counters of %s\n", sr->host);
+    for (c = 0; c < SR_STAT_NUM; c++)
+    {
+        if (snap.counter[c])
+        { fprintf(out, "  %12llu %s\n", (unsigned long long)snap.counter[c], stats_names[c]); }
+    }
+
+    fprintf(out, "  %-10s %12s %14s %12s %14s\n", "interface", "rx frames", "rx bytes",
+            "tx frames", "tx bytes");
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        uint64_t* ifc;
+
+        if (iface->index >= SR_STATS_MAX_IFACES)
+        { continue; }
+        ifc = snap.iface[iface->index];
+        fprintf(out, "  %-10s %12llu %14llu %12llu %14llu\n", iface->name,
+                (unsigned long long)ifc[SR_STAT_IF_RX_FRAMES],
+                (unsigned long long)ifc[SR_STAT_IF_RX_BYTES],
+                (unsigned long long)ifc[SR_STAT_IF_TX_FRAMES],
+                (unsigned long long)ifc[SR_STAT_IF_TX_BYTES]);
+    }
+    sr_stats_print_latency(sr, out, 0);
+} /* -- sr_stats_print -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_block_signal(..)
+ * Scope: Global
+ *
+ * Block SIGUSR1 and SIGUSR2 in the calling thread and every thread it
+ * starts after, so only the dump thread takes them.  Call before starting
+ * any thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_block_signal(void)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, 0);
+} /* -- sr_stats_block_signal -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_start_dumper(..)
+ * Scope: Global
+ *
+ * Start a thread that prints the counters to stdout on every SIGUSR1, and
+ * only the latencies, with reset, on every SIGUSR2.  Call after
+ * sr_stats_block_signal().
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_stats_start_dumper(struct sr_instance* sr)
+{
+    if (sr->stats == 0 || sr->stats->dumping)
+    { return -1; }
+
+    if (pthread_create(&sr->stats->dumper, 0, sr_stats_dumper, sr))
+    {
+        perror("pthread_create");
+        return -1;
+    }
+    sr->stats->dumping = 1;
+
+    return 0;
+} /* -- sr_stats_start_dumper -- */
+
+static void* sr_stats_dumper(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    sigset_t set;
+    int sig;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+
+    while (sigwait(&set, &sig) == 0)
+    {
+        if (sig == SIGUSR1)
+        { sr_stats_print(sr, stdout); }
+        else
+        { sr_stats_print_latency(sr, stdout, 1); }
+    }
+
+    return 0;
+} /* -- sr_stats_dumper -- */
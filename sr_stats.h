@@ -0,0 +1,265 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.h
+ * date:  Sun Oct 18 23:59:47 PDT 2026
+ *
+ * Description:
+ *
+ * Packet counters of a router, by reason and by interface.  Every thread
+ * that counts gets a block of its own, cache line aligned, that only it
+ * writes, so a count is a plain load, add and store with no lock, no
+ * atomic read-modify-write and no cache line shared with another thread.
+ * Readers add the blocks up (sr_stats_snapshot) and may run at any time,
+ * e.g. on SIGUSR1 (sr_stats_start_dumper) or from a control interface.
+ *
+ * The blocks hold latency histograms too, log-linear like HDR histograms:
+ * SR_HIST_SUB buckets for every power of 2 of nanoseconds, so a
+ * percentile is within about 3% whatever its size.  Times are taken from
+ * the TSC where there is one (sr_stats_ticks) and converted with a rate
+ * measured against CLOCK_MONOTONIC once.  Forwarding latency is taken of
+ * one frame in SR_HIST_SAMPLE per thread (sr_stat_sample), which leaves
+ * the percentiles as they are and the clock off the other frames.  A
+ * reader that wants each period on its own reads with reset: the threads
+ * never clear their blocks, the reader keeps what it saw last and
+ * subtracts it next time.
+ *
+ * A router without counters (sr->stats 0) counts nothing; sr_sim only
+ * gives them to the router of its forwarding replay.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STATS_H
+#define SR_STATS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#define SR_STATS_LINE        64
+#define SR_STATS_MAX_THREADS 16   /* the last block is shared by any more */
+#define SR_STATS_MAX_IFACES  64   /* interfaces counted one by one */
+
+/* -- name and what sr_stats_print() calls it -- */
+#define SR_STATS_COUNTERS(X) \
+    X(RX,               "frames received") \
+    X(TX,               "frames sent") \
+    X(TX_ERROR,         "frames failed to send") \
+    X(FWD_CACHE,        "forwarded from the flow cache") \
+    X(FWD_FAST,         "forwarded by the fast path") \
+    X(FWD_SLOW,         "forwarded by the slow path") \
+    X(PUNTED,           "punted to the slow path") \
+    X(DROP_PUNT_FULL,   "dropped, punt queue full") \
+    X(DROP_BAD_IFACE,   "dropped, unknown interface") \
+    X(DROP_NOT_FOR_US,  "dropped, arp request for another router") \
+    X(DROP_ETHERTYPE,   "dropped, unknown ethertype") \
+    X(DROP_TTL,         "dropped, ttl expired") \
+    X(DROP_NO_ROUTE,    "dropped, no route") \
+    X(DROP_ARP_TIMEOUT, "dropped, next hop did not answer arp") \
+    X(DROP_IP_PROTO,    "dropped, ip protocol not handled") \
+    X(ICMP_ECHO_REPLY,  "icmp echo replies sent") \
+    X(ICMP_TIME_EXCEEDED, "icmp time exceeded sent") \
+    X(ICMP_HOST_UNREACH, "icmp host unreachable sent") \
+    X(ICMP_PORT_UNREACH, "icmp port unreachable sent") \
+    X(ARP_HIT,          "arp cache hits") \
+    X(ARP_MISS,         "arp cache misses") \
+    X(ARP_REQUEST_RECV, "arp requests received") \
+    X(ARP_REPLY_RECV,   "arp replies received") \
+    X(ARP_REQUEST_SENT, "arp requests sent") \
+    X(ARP_REPLY_SENT,   "arp replies sent") \
+    X(OSPF_HELLO_RECV,  "pwospf hellos received") \
+    X(OSPF_LSU_RECV,    "pwospf lsus received") \
+    X(OSPF_ECHO_RECV,   "pwospf echoes received") \
+    X(OSPF_DROP,        "pwospf packets dropped") \
+    X(OSPF_HELLO_SENT,  "pwospf hellos sent") \
+    X(OSPF_LSU_SENT,    "pwospf lsus sent") \
+    X(OSPF_ECHO_SENT,   "pwospf echoes sent") \
+    X(OSPF_NO_HOP_SLOT, "pwospf neighbors left without a hop slot")
+
+#define SR_STATS_ENUM(name, desc) SR_STAT_##name,
+
+enum sr_stat { SR_STATS_COUNTERS(SR_STATS_ENUM) SR_STAT_NUM };
+
+/* -- latencies, name and what sr_stats_print() calls it -- */
+#define SR_STATS_HISTS(X) \
+    X(FORWARD,     "forwarded, in to sent") \
+    X(ARP_RESOLVE, "arp wait, queued to sent") \
+    X(SPF,         "spf run") \
+    X(LSU_TO_FIB,  "lsu in to table installed")
+
+#define SR_STATS_HIST_ENUM(name, desc) SR_HIST_##name,
+
+enum sr_hist_id { SR_STATS_HISTS(SR_STATS_HIST_ENUM) SR_HIST_NUM };
+
+#define SR_HIST_SUB_BITS 5
+#define SR_HIST_SUB      (1 << SR_HIST_SUB_BITS)
+#define SR_HIST_MAX_BITS 36      /* longer than 2^36 ns (69 s) counts as that */
+#define SR_HIST_BUCKETS  ((SR_HIST_MAX_BITS - SR_HIST_SUB_BITS + 1) * SR_HIST_SUB)
+#define SR_HIST_SAMPLE   16      /* frames per timed one, power of 2 */
+
+struct sr_hist
+{
+    uint64_t count;
+    uint64_t sum;                /* ns */
+    uint64_t bucket[SR_HIST_BUCKETS];
+};
+
+enum sr_stat_if
+{
+    SR_STAT_IF_RX_FRAMES,
+    SR_STAT_IF_RX_BYTES,
+    SR_STAT_IF_TX_FRAMES,
+    SR_STAT_IF_TX_BYTES,
+    SR_STAT_IF_NUM
+};
+
+struct sr_stats_block
+{
+    uint64_t counter[SR_STAT_NUM];
+    uint64_t iface[SR_STATS_MAX_IFACES][SR_STAT_IF_NUM];
+    struct sr_hist hist[SR_HIST_NUM];
+} __attribute__ ((aligned (SR_STATS_LINE)));
+
+struct sr_stats
+{
+    struct sr_stats_block* blocks[SR_STATS_MAX_THREADS];
+    struct sr_hist hist_read[SR_HIST_NUM]; /* sum at the last read with reset */
+    pthread_mutex_t lock;          /* to add a block, and for hist_read */
+    int dumping;                   /* SIGUSR1 thread started */
+    pthread_t dumper;
+};
+
+/* -- sum of the blocks -- */
+struct sr_stats_snapshot
+{
+    uint64_t counter[SR_STAT_NUM];
+    uint64_t iface[SR_STATS_MAX_IFACES][SR_STAT_IF_NUM];
+};
+
+struct sr_instance;
+
+/* -- block of the calling thread, -1 before it counts for the first time -- */
+extern __thread int sr_stats_thread;
+
+/* -- ticks when the frame the calling thread handles came in, 0 untimed -- */
+extern __thread uint64_t sr_stats_packet_in;
+extern __thread unsigned int sr_stats_sample_count;
+
+extern double sr_stats_ns_per_tick;
+
+int  sr_stats_register_thread(void);
+struct sr_stats_block* sr_stats_add_block(struct sr_stats* stats, int thread);
+
+static inline struct sr_stats_block* sr_stats_block(struct sr_stats* stats)
+{
+    struct sr_stats_block* blk;
+
+    if (sr_stats_thread < 0)
+    { sr_stats_thread = sr_stats_register_thread(); }
+    blk = stats->blocks[sr_stats_thread];
+    return blk ? blk : sr_stats_add_block(stats, sr_stats_thread);
+}
+
+/* -- the only writer of a block needs no read-modify-write -- */
+static inline void sr_stats_bump(uint64_t* c, uint64_t n)
+{
+    if (sr_stats_thread == SR_STATS_MAX_THREADS - 1)
+    { __atomic_add_fetch(c, n, __ATOMIC_RELAXED); }
+    else
+    { __atomic_store_n(c, *c + n, __ATOMIC_RELAXED); }
+}
+
+static inline void sr_stats_count(struct sr_stats* stats, unsigned int ctr, uint64_t n)
+{
+    struct sr_stats_block* blk;
+
+    if (stats == 0 || (blk = sr_stats_block(stats)) == 0)
+    { return; }
+    sr_stats_bump(&blk->counter[ctr], n);
+}
+
+/* -- a frame and its bytes in (SR_STAT_IF_RX_FRAMES) or out (TX) of an interface -- */
+static inline void sr_stats_count_if(struct sr_stats* stats, unsigned int index,
+                                     unsigned int dir, unsigned int len)
+{
+    struct sr_stats_block* blk;
+
+    if (stats == 0 || index >= SR_STATS_MAX_IFACES || (blk = sr_stats_block(stats)) == 0)
+    { return; }
+    sr_stats_bump(&blk->iface[index][dir], 1);
+    sr_stats_bump(&blk->iface[index][dir + 1], len);
+}
+
+static inline uint64_t sr_stats_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline unsigned int sr_hist_index(uint64_t ns)
+{
+    int msb;
+
+    if (ns < SR_HIST_SUB)
+    { return (unsigned int)ns; }
+    if (ns >= (1ULL << SR_HIST_MAX_BITS))
+    { ns = (1ULL << SR_HIST_MAX_BITS) - 1; }
+    msb = 63 - __builtin_clzll(ns);
+    return (msb - SR_HIST_SUB_BITS + 1) * SR_HIST_SUB +
+        ((ns >> (msb - SR_HIST_SUB_BITS)) & (SR_HIST_SUB - 1));
+}
+
+static inline void sr_stats_record(struct sr_stats* stats, unsigned int hist, uint64_t ns)
+{
+    struct sr_stats_block* blk;
+    struct sr_hist* h;
+
+    if (stats == 0 || (blk = sr_stats_block(stats)) == 0)
+    { return; }
+    h = &blk->hist[hist];
+    sr_stats_bump(&h->bucket[sr_hist_index(ns)], 1);
+    sr_stats_bump(&h->sum, ns);
+    sr_stats_bump(&h->count, 1);
+}
+
+/* -- time since t0 (sr_stats_ticks) into a histogram, nothing if t0 is 0 -- */
+static inline void sr_stats_record_since(struct sr_stats* stats, unsigned int hist, uint64_t t0)
+{
+    uint64_t now;
+
+    if (stats == 0 || t0 == 0)
+    { return; }
+    now = sr_stats_ticks();
+    sr_stats_record(stats, hist, now > t0 ? (uint64_t)((now - t0) * sr_stats_ns_per_tick) : 0);
+}
+
+#define sr_stat_add(sr, name, n) sr_stats_count((sr)->stats, SR_STAT_##name, (n))
+#define sr_stat_inc(sr, name)    sr_stats_count((sr)->stats, SR_STAT_##name, 1)
+#define sr_stat_since(sr, name, t0) \
+    do { if (t0) sr_stats_record_since((sr)->stats, SR_HIST_##name, (t0)); } while (0)
+#define sr_stat_ticks(sr)        ((sr)->stats ? sr_stats_ticks() : 0)
+#define sr_stat_sample(sr) \
+    ((sr)->stats && (++sr_stats_sample_count & (SR_HIST_SAMPLE - 1)) == 0 ? sr_stats_ticks() : 0)
+
+int  sr_stats_init(struct sr_instance* sr);
+void sr_stats_free(struct sr_instance* sr);
+void sr_stats_snapshot(struct sr_instance* sr, struct sr_stats_snapshot* snap);
+void sr_stats_hist_snapshot(struct sr_instance* sr, struct sr_hist* hists, int reset);
+uint64_t sr_hist_percentile(const struct sr_hist* h, double p);
+void sr_stats_print(struct sr_instance* sr, FILE* out);
+void sr_stats_print_latency(struct sr_instance* sr, FILE* out, int reset);
+void sr_stats_block_signal(void);
+int  sr_stats_start_dumper(struct sr_instance* sr);
+
+#endif /* SR_STATS_H */
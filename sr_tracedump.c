@@ -0,0 +1,158 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tracedump.c
+ * date:  Sun Oct 18 23:58:40 PDT 2026
+ *
+ * Description:
+ *
+ * Prints a trace file written by sr -X, all threads merged in time order:
+ *
+ *   sr_tracedump [-n max] trace.bin
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_log.h"
+
+#define SR_TRACE_NAME(name, mod, fmt) #name,
+#define SR_TRACE_MODULE(name, mod, fmt) mod,
+#define SR_TRACE_FORMAT(name, mod, fmt) fmt,
+
+static const char* event_names[] = { SR_TRACE_EVENTS(SR_TRACE_NAME) };
+static const int event_modules[] = { SR_TRACE_EVENTS(SR_TRACE_MODULE) };
+static const char* event_formats[] = { SR_TRACE_EVENTS(SR_TRACE_FORMAT) };
+static const char* module_names[] = SR_LOG_MODULE_NAMES;
+
+static int cmp_record(const void* a, const void* b)
+{
+    const struct sr_trace_record* ra = (const struct sr_trace_record*)a;
+    const struct sr_trace_record* rb = (const struct sr_trace_record*)b;
+
+    if (ra->ns != rb->ns)
+    { return ra->ns < rb->ns ? -1 : 1; }
+    return (int)ra->thread - (int)rb->thread;
+}
+
+/* -- the event's format with its %I, %u and %x filled in -- */
+static void print_args(const char* fmt, const uint32_t* arg)
+{
+    int i = 0;
+
+    for (; *fmt; fmt++)
+    {
+        if (*fmt != '%' || fmt[1] == 0 || i == SR_TRACE_ARGS)
+        {
+            putchar(*fmt);
+            continue;
+        }
+        switch (*++fmt)
+        {
+            case 'I':
+            {
+                struct in_addr in;
+                in.s_addr = arg[i++];
+                fputs(inet_ntoa(in), stdout);
+                break;
+            }
+            case 'x':
+                printf("0x%04x", arg[i++]);
+                break;
+            case 'u':
+                printf("%u", arg[i++]);
+                break;
+            default:
+                putchar(*fmt);
+        }
+    }
+}
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-n max] trace.bin\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_trace_file_header hdr;
+    struct sr_trace_record* recs = 0;
+    unsigned long max = 0;
+    size_t num, i;
+    FILE* fp = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                max = strtoul(optarg, 0, 10);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "rb")) == 0)
+    {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, SR_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.record_size != sizeof(struct sr_trace_record))
+    {
+        fprintf(stderr, "%s: not a trace file of this version\n", argv[optind]);
+        exit(1);
+    }
+    if (hdr.num_events != SR_TRACE_NUM_EVENTS)
+    { fprintf(stderr, "warning: written with %u events, this table has %u\n",
+              hdr.num_events, SR_TRACE_NUM_EVENTS); }
+
+    if ((recs = (struct sr_trace_record*)malloc((hdr.records + 1) * sizeof(*recs))) == 0)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    num = fread(recs, sizeof(*recs), hdr.records, fp);
+    fclose(fp);
+    if (num != hdr.records)
+    { fprintf(stderr, "warning: file truncated, %lu of %llu records\n",
+              (unsigned long)num, (unsigned long long)hdr.records); }
+
+    qsort(recs, num, sizeof(*recs), cmp_record);
+
+    printf("%lu records, %llu lost\n", (unsigned long)num, (unsigned long long)hdr.lost);
+    if (max && num > max)
+    { num = max; }
+
+    for (i = 0; i < num; i++)
+    {
+        struct sr_trace_record* rec = &recs[i];
+        uint64_t rel = rec->ns - recs[0].ns;
+
+        printf("%6llu.%06llu %2u ", (unsigned long long)(rel / 1000000000ULL),
+               (unsigned long long)(rel % 1000000000ULL / 1000), rec->thread);
+        if (rec->event >= SR_TRACE_NUM_EVENTS)
+        {
+            printf("?    event %u\n", rec->event);
+            continue;
+        }
+        printf("%-4s %-11s ", module_names[event_modules[rec->event]], event_names[rec->event]);
+        print_args(event_formats[rec->event], rec->arg);
+        putchar('\n');
+    }
+
+    free(recs);
+    return 0;
+}
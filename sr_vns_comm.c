@@ -32,23 +32,30 @@
 #include <errno.h>
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
 
-#include "sr_dumper.h"
+#include "sr_capture.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_stats.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+/* -- a server gone while threads still send is an error, not SIGPIPE -- */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static void sr_log_packet(struct sr_instance* , uint8_t* , int , const char* , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
 /*-----------------------------------------------------------------------------
@@ -69,6 +76,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
 {
 #ifndef VNL
     struct hostent *hp;
+    struct sockaddr_un sun;
 #endif
     c_open command;
     c_open_template ot;
@@ -85,36 +93,59 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
 #ifdef VNL
 	sr->vc = vnl_open(sr->topo_id,sr->host);
 #else
-    /* zero out server address struct */
-    memset(&(sr->sr_addr),0,sizeof(struct sockaddr_in));
+    /* a server given as a path is a local unix socket (e.g. vns_emu -u) */
+    if (server[0] == '/')
+    {
+        memset(&sun,0,sizeof(struct sockaddr_un));
+        sun.sun_family = AF_UNIX;
+        strncpy(sun.sun_path,server,sizeof(sun.sun_path) - 1);
 
-    sr->sr_addr.sin_family = AF_INET;
-    sr->sr_addr.sin_port = htons(port);
+        if ((sr->sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+            perror("socket(..):sr_client.c::sr_connect_to_server(..)");
+            return -1;
+        }
 
-    /* grab hosts address from domain name */
-    if ((hp = gethostbyname(server))==0)
-    {
-        perror("gethostbyname:sr_client.c::sr_connect_to_server(..)");
-        return -1;
+        if (connect(sr->sockfd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+        {
+            perror("connect(..):sr_client.c::sr_connect_to_server(..)");
+            close(sr->sockfd);
+            return -1;
+        }
     }
+    else
+    {
+        /* zero out server address struct */
+        memset(&(sr->sr_addr),0,sizeof(struct sockaddr_in));
 
-    /* set server address */
-    memcpy(&(sr->sr_addr.sin_addr),hp->h_addr,hp->h_length);
+        sr->sr_addr.sin_family = AF_INET;
+        sr->sr_addr.sin_port = htons(port);
 
-    /* create socket */
-    if ((sr->sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-    {
-        perror("socket(..):sr_client.c::sr_connect_to_server(..)");
-        return -1;
-    }
+        /* grab hosts address from domain name */
+        if ((hp = gethostbyname(server))==0)
+        {
+            perror("gethostbyname:sr_client.c::sr_connect_to_server(..)");
+            return -1;
+        }
 
-    /* attempt to connect to the server */
-    if (connect(sr->sockfd, (struct sockaddr *)&(sr->sr_addr),
-                sizeof(sr->sr_addr)) < 0)
-    {
-        perror("connect(..):sr_client.c::sr_connect_to_server(..)");
-        close(sr->sockfd);
-        return -1;
+        /* set server address */
+        memcpy(&(sr->sr_addr.sin_addr),hp->h_addr,hp->h_length);
+
+        /* create socket */
+        if ((sr->sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        {
+            perror("socket(..):sr_client.c::sr_connect_to_server(..)");
+            return -1;
+        }
+
+        /* attempt to connect to the server */
+        if (connect(sr->sockfd, (struct sockaddr *)&(sr->sr_addr),
+                    sizeof(sr->sr_addr)) < 0)
+        {
+            perror("connect(..):sr_client.c::sr_connect_to_server(..)");
+            close(sr->sockfd);
+            return -1;
+        }
     }
 #endif
 
@@ -340,6 +371,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     int command, len;
     unsigned char *buf = 0;
     c_packet_ethernet_header* sr_pkt = 0;
+    struct sr_if* iface = 0;
     int ret = 0, bytes_read = 0;
 
     /* REQUIRES */
@@ -440,24 +472,44 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
 
+            /* -- the only lookup by name this frame gets -- */
+            iface = sr_get_interface(sr, (char*)(buf + sizeof(c_base)));
+            if ( iface == 0 )
+            {
+                fprintf(stderr, "** Error, packet on unknown interface %s\n",
+                        (char*)(buf + sizeof(c_base)));
+                sr_stat_inc(sr, DROP_BAD_IFACE);
+                break;
+            }
+
+            sr_stat_inc(sr, RX);
+            sr_stats_count_if(sr->stats, iface->index, SR_STAT_IF_RX_FRAMES,
+                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
+
             /* -- check if it is an ARP to another router if so drop   -- */
             if ( sr_arp_req_not_for_us(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
+                    iface) )
+            {
+                sr_stat_inc(sr, DROP_NOT_FOR_US);
+                break;
+            }
+
+            sr_trace(VNS_RECV, iface->index, ntohl(sr_pkt->mLen) - sizeof(c_packet_header), 0, 0);
 
             /* -- log packet -- */
             sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
+                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header),
+                    iface->name, CAPTURE_IN);
 
             /* -- pass to router, student's code should take over here -- */
             sr_handlepacket(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+                    iface);
 
             break;
 
@@ -487,6 +539,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 fprintf(stderr,"Routing table not consistent with hardware\n");
                 return -1;
             }
+            sr->hw_init = 1;
             printf(" <-- Ready to process packets --> \n");
             break;
 
@@ -531,24 +584,16 @@ static
 int
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+                                struct sr_if* iface /* borrowed */ )
 {
     struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(sr);
     assert(buf);
-    assert(name);
+    assert(iface);
 
     ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 )
-    {
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 )
     {
@@ -578,7 +623,57 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
-                         const char* iface /* borrowed */)
+                         const char* name /* borrowed */)
+{
+    struct sr_if* iface = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(name);
+
+    iface = sr_get_interface(sr, name);
+    if ( iface == 0 )
+    {
+        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        return -1;
+    }
+
+    return sr_send_packet_if(sr, buf, len, iface);
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_count_sent(..)
+ * Scope: Local
+ *
+ * Count a frame sr_send_packet_if() is done with, ret is what it returns.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_count_sent(struct sr_instance* sr, struct sr_if* iface,
+                         unsigned int len, int ret)
+{
+    if ( ret == 0 )
+    {
+        sr_stat_inc(sr, TX);
+        sr_stats_count_if(sr->stats, iface->index, SR_STAT_IF_TX_FRAMES, len);
+    }
+    else
+    { sr_stat_inc(sr, TX_ERROR); }
+    return ret;
+} /* -- sr_count_sent -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_if(..)
+ * Scope: Global
+ *
+ * sr_send_packet(..) for callers that hold the interface record already.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_if(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         struct sr_if* iface /* borrowed */)
 {
     c_packet_header *sr_pkt;
     unsigned int total_len =  len + (sizeof(c_packet_header));
@@ -592,7 +687,20 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     if ( len < sizeof(struct sr_ethernet_hdr) )
     {
         fprintf(stderr , "** Error: packet is wayy to short \n");
-        return -1;
+        return sr_count_sent(sr, iface, len, -1);
+    }
+
+    sr_trace(VNS_SEND, iface->index, len, 0, 0);
+
+    /* -- in-process transports (sr_sim) take the frame as is -- */
+    if ( sr->transmit )
+    {
+        if ( ! sr_ether_addrs_match_interface( sr, buf, iface) )
+        {
+            fprintf( stderr, "*** Error: problem with ethernet header\n");
+            return sr_count_sent(sr, iface, len, -1);
+        }
+        return sr_count_sent(sr, iface, len, sr->transmit(sr, buf, len, iface));
     }
 
     /* Create packet */
@@ -601,61 +709,136 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     assert(sr_pkt);
     sr_pkt->mLen  = htonl(total_len);
     sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
+    strncpy(sr_pkt->mInterfaceName,iface->name,16);
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
     /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
+    sr_log_packet(sr,buf,len,iface->name,CAPTURE_OUT);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) )
     {
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
         free ( sr_pkt );
-        return -1;
+        return sr_count_sent(sr, iface, len, -1);
     }
 
 #ifdef VNL
     if( vnl_write(sr->vc, sr_pkt, total_len) < total_len )
 #else
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len )
+    if( send(sr->sockfd, sr_pkt, total_len, MSG_NOSIGNAL) < total_len )
 #endif
     {
         fprintf(stderr, "Error writing packet\n");
         free(sr_pkt);
-        return -1;
+        return sr_count_sent(sr, iface, len, -1);
     }
 
     free(sr_pkt);
 
-    return 0;
-} /* -- sr_send_packet -- */
+    return sr_count_sent(sr, iface, len, 0);
+} /* -- sr_send_packet_if -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_log_packet()
- * Scope: Local
+ * Method: sr_send_packet_batch(..)
+ * Scope: Global
+ *
+ * Send 'num' packets out of the same interface, packed into a single
+ * write to the server.  Returns 0 if all of them were sent.
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+int sr_send_packet_batch(struct sr_instance* sr /* borrowed */,
+                         uint8_t** bufs /* borrowed */,
+                         unsigned int* lens,
+                         unsigned int num,
+                         struct sr_if* iface /* borrowed */)
 {
-    struct pcap_pkthdr h;
-    int size;
+    uint8_t* batch = 0;
+    unsigned int total_len = 0;
+    unsigned int offset = 0;
+    unsigned int i;
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
+    assert(bufs);
+    assert(lens);
+    assert(iface);
 
-    if(!sr->logfile)
-    {return; }
+    /* -- in-process transports and single packets need no packing -- */
+    if ( sr->transmit || num == 1 )
+    {
+        for ( i = 0; i < num; i++ )
+        {
+            if ( sr_send_packet_if(sr, bufs[i], lens[i], iface) != 0 )
+            { ret = -1; }
+        }
+        return ret;
+    }
+
+    for ( i = 0; i < num; i++ )
+    {
+        if ( lens[i] < sizeof(struct sr_ethernet_hdr) ||
+             ! sr_ether_addrs_match_interface( sr, bufs[i], iface) )
+        {
+            fprintf( stderr, "*** Error: problem with ethernet header\n");
+            sr_stat_add(sr, TX_ERROR, num);
+            return -1;
+        }
+        total_len += lens[i] + sizeof(c_packet_header);
+    }
 
-    size = min(PACKET_DUMP_SIZE, len);
+    batch = (uint8_t*)malloc(total_len);
+    assert(batch);
 
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
+    for ( i = 0; i < num; i++ )
+    {
+        c_packet_header* sr_pkt = (c_packet_header*)(batch + offset);
+
+        sr_pkt->mLen  = htonl(lens[i] + sizeof(c_packet_header));
+        sr_pkt->mType = htonl(VNSPACKET);
+        strncpy(sr_pkt->mInterfaceName,iface->name,16);
+        memcpy(batch + offset + sizeof(c_packet_header), bufs[i], lens[i]);
+        offset += lens[i] + sizeof(c_packet_header);
+
+        sr_log_packet(sr,bufs[i],lens[i],iface->name,CAPTURE_OUT);
+    }
+
+#ifdef VNL
+    if( vnl_write(sr->vc, batch, total_len) < total_len )
+#else
+    if( send(sr->sockfd, batch, total_len, MSG_NOSIGNAL) < total_len )
+#endif
+    {
+        fprintf(stderr, "Error writing packet batch\n");
+        ret = -1;
+    }
+
+    for ( i = 0; i < num; i++ )
+    { sr_count_sent(sr, iface, lens[i], ret); }
+
+    free(batch);
+
+    return ret;
+} /* -- sr_send_packet_batch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_packet()
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   const char* iface, int dir)
+{
+    /* REQUIRES */
+    assert(sr);
+
+    if(!sr->capture)
+    {return; }
 
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    sr_capture_packet(sr->capture, buf, len, iface, dir);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -667,9 +850,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arphdr*       a_hdr = 0;
 
@@ -0,0 +1,1542 @@
+/*-----------------------------------------------------------------------------
+ * file:  vns_emu.c
+ * date:  Sun Oct 18 11:02:37 PDT 2026
+ *
+ * Description:
+ *
+ * A local stand-in for the VNS server, for load testing routers without
+ * any outside service.  sr clients (built with VNL=0) connect over TCP
+ * loopback or a unix socket, go through the usual VNS_AUTH_REQUEST /
+ * VNS_AUTH_STATUS handshake, open a virtual host and receive its VNSHWINFO.
+ * From then on the emulator switches VNSPACKET frames between routers and
+ * plays the hosts of the topology, which answer ARP and act as traffic
+ * generators.  Every generated datagram carries a sequence number and a
+ * timestamp so the receiving host can account loss and latency.
+ *
+ * Topology file, one statement per line ('#' starts a comment):
+ *
+ *   router <vhost>
+ *   iface  <vhost> <ifname> <ip> <mask> [mac]
+ *   link   <vhost> <ifname> <vhost> <ifname>
+ *   host   <name> <ip> <vhost> <ifname> [mac]
+ *   flow   <src host> <dst host> [pps <n>] [size <bytes>] [window <n>]
+ *
+ * A flow with pps 0 runs closed loop, keeping at most 'window' datagrams
+ * in flight, which measures the highest rate the routers sustain.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifdef _SOLARIS_
+#define __EXTENSIONS__
+#endif /* _SOLARIS_ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_protocol.h"
+#include "sha1.h"
+#include "vnscommand.h"
+
+#define DEFAULT_PORT 3250
+#define DEFAULT_WARMUP 3
+#define DEFAULT_DURATION 10
+#define DEFAULT_SIZE 128
+#define DEFAULT_WINDOW 32
+
+#define EMU_MAX_ROUTERS 64
+#define EMU_MAX_IFACES  16
+#define EMU_MAX_HOSTS   256
+#define EMU_MAX_FLOWS   64
+#define EMU_MAX_CLIENTS 64
+
+#define EMU_INBUF_SIZE  (64*1024)
+#define EMU_OUTBUF_MAX  (4*1024*1024)
+#define EMU_MAX_SAMPLES (1024*1024)
+#define EMU_SALT_LEN    32
+#define EMU_AUTH_KEY_LEN 64
+#define EMU_TX_BURST    64
+
+#define EMU_PROBE_MAGIC 0x56454d55 /* "VEMU" */
+#define EMU_PROBE_PORT  9999
+#define EMU_PROBE_PRIME 0x80000000 /* seq flag of warmup datagrams */
+
+/* ----------------------------------------------------------------------------
+ * topology
+ * -------------------------------------------------------------------------- */
+
+struct emu_client;
+struct emu_host;
+
+struct emu_iface
+{
+    char name[16];
+    uint32_t ip;   /* nbo */
+    uint32_t mask; /* nbo */
+    uint8_t addr[ETHER_ADDR_LEN];
+    struct emu_router* router;
+    struct emu_iface* peer;  /* other end of a router to router link */
+    struct emu_host* hosts;  /* hosts on this segment */
+};
+
+struct emu_router
+{
+    char name[IDSIZE];
+    struct emu_iface ifaces[EMU_MAX_IFACES];
+    int num_ifaces;
+    struct emu_client* client; /* connection once the host is opened */
+};
+
+struct emu_host
+{
+    char name[IDSIZE];
+    uint32_t ip; /* nbo */
+    uint8_t addr[ETHER_ADDR_LEN];
+    struct emu_iface* iface;
+    struct emu_host* next; /* next host on the segment */
+};
+
+struct emu_flow
+{
+    struct emu_host* src;
+    struct emu_host* dst;
+    unsigned int pps;
+    unsigned int size;
+    unsigned int window;
+
+    uint64_t next_tx;      /* ns */
+    uint64_t last_rx;      /* ns */
+    uint32_t next_seq;
+
+    uint64_t tx;
+    uint64_t rx;
+    uint64_t rx_bytes;
+    uint64_t dropped;      /* never left the emulator, client queue full */
+    uint64_t reordered;
+    uint32_t highest_seq;
+
+    uint32_t* samples;     /* latency in ns of received datagrams */
+    uint32_t num_samples;
+};
+
+/* -- datagram payload of the traffic generators -- */
+struct emu_probe
+{
+    uint32_t magic;
+    uint16_t flow;
+    uint16_t pad;
+    uint32_t seq;
+    uint64_t tx_ns;
+} __attribute__ ((packed));
+
+struct udp_hdr
+{
+    uint16_t uh_sport;
+    uint16_t uh_dport;
+    uint16_t uh_ulen;
+    uint16_t uh_sum;
+} __attribute__ ((packed));
+
+/* ----------------------------------------------------------------------------
+ * connections
+ * -------------------------------------------------------------------------- */
+
+enum emu_client_state
+{
+    EMU_AUTH,    /* auth request sent, waiting for the reply */
+    EMU_OPEN,    /* authenticated, waiting for VNSOPEN */
+    EMU_RUNNING, /* hardware info sent, exchanging packets */
+    EMU_CLOSED
+};
+
+struct emu_client
+{
+    int fd;
+    enum emu_client_state state;
+    struct emu_router* router;
+    uint8_t salt[EMU_SALT_LEN];
+
+    uint8_t* inbuf;
+    unsigned int inlen;
+
+    uint8_t* outbuf;
+    unsigned int outlen;
+    unsigned int outcap;
+};
+
+enum emu_phase
+{
+    EMU_WAIT,    /* waiting for every router to connect */
+    EMU_WARMUP,  /* priming ARP caches and routing */
+    EMU_RUN,     /* measuring */
+    EMU_DRAIN,   /* collecting datagrams still in flight */
+    EMU_DONE
+};
+
+struct emu_state
+{
+    struct emu_router routers[EMU_MAX_ROUTERS];
+    int num_routers;
+    struct emu_host hosts[EMU_MAX_HOSTS];
+    int num_hosts;
+    struct emu_flow flows[EMU_MAX_FLOWS];
+    int num_flows;
+    struct emu_client clients[EMU_MAX_CLIENTS];
+    int num_clients;
+
+    char* auth_key; /* 0 accepts any user */
+
+    enum emu_phase phase;
+    uint64_t phase_end;  /* ns */
+    uint64_t run_start;  /* ns */
+    uint64_t run_end;    /* ns */
+    unsigned int warmup;
+    unsigned int duration;
+
+    uint64_t frames_switched;
+    uint64_t frames_dropped;
+};
+
+static volatile sig_atomic_t emu_stop = 0;
+
+static void usage(char* );
+static int  emu_load_topology(struct emu_state* , const char* );
+static void emu_report(struct emu_state* );
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_now()
+ * Scope: Local
+ *
+ * monotonic clock in nanoseconds
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint64_t emu_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} /* -- emu_now -- */
+
+static void emu_sigint(int sig)
+{
+    emu_stop = 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_cksum(..)
+ * Scope: Local
+ *
+ * internet checksum over len bytes
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint16_t emu_cksum(const void* buf, int len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i + 1 < len; i += 2)
+    { sum += (p[i] << 8) | p[i+1]; }
+    if (i < len)
+    { sum += p[i] << 8; }
+
+    while (sum >> 16)
+    { sum = (sum & 0xffff) + (sum >> 16); }
+
+    return htons(~sum & 0xffff);
+} /* -- emu_cksum -- */
+
+/*-----------------------------------------------------------------------------
+ * topology loading
+ *---------------------------------------------------------------------------*/
+
+static struct emu_router* emu_find_router(struct emu_state* emu, const char* name)
+{
+    int i;
+    for (i = 0; i < emu->num_routers; i++)
+    {
+        if (strncmp(emu->routers[i].name, name, IDSIZE) == 0)
+        { return &emu->routers[i]; }
+    }
+    return 0;
+}
+
+static struct emu_iface* emu_find_iface(struct emu_state* emu,
+                                        const char* router, const char* name)
+{
+    struct emu_router* r = emu_find_router(emu, router);
+    int i;
+
+    if (r == 0)
+    { return 0; }
+
+    for (i = 0; i < r->num_ifaces; i++)
+    {
+        if (strncmp(r->ifaces[i].name, name, sizeof(r->ifaces[i].name)) == 0)
+        { return &r->ifaces[i]; }
+    }
+    return 0;
+}
+
+static struct emu_host* emu_find_host(struct emu_state* emu, const char* name)
+{
+    int i;
+    for (i = 0; i < emu->num_hosts; i++)
+    {
+        if (strncmp(emu->hosts[i].name, name, IDSIZE) == 0)
+        { return &emu->hosts[i]; }
+    }
+    return 0;
+}
+
+static int emu_copy_name(char* dst, size_t size, const char* src)
+{
+    size_t len = strlen(src);
+    if (len >= size)
+    { return -1; }
+    memcpy(dst, src, len + 1);
+    return 0;
+}
+
+static int emu_parse_mac(const char* str, uint8_t* addr)
+{
+    unsigned int b[ETHER_ADDR_LEN];
+    int i;
+
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x",
+               &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETHER_ADDR_LEN)
+    { return -1; }
+
+    for (i = 0; i < ETHER_ADDR_LEN; i++)
+    { addr[i] = (uint8_t)b[i]; }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_load_topology(..)
+ * Scope: Local
+ *
+ * Read the topology file, see the description at the top of the file.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 on error
+ *
+ *---------------------------------------------------------------------------*/
+
+static int emu_load_topology(struct emu_state* emu, const char* filename)
+{
+    FILE* fp;
+    char line[BUFSIZ];
+    char tok[10][64];
+    int lineno = 0;
+    int n, i;
+    struct in_addr addr;
+
+    if ((fp = fopen(filename, "r")) == 0)
+    {
+        perror("fopen(topology)");
+        return -1;
+    }
+
+    while (fgets(line, BUFSIZ, fp) != 0)
+    {
+        char* hash = strchr(line, '#');
+        lineno++;
+        if (hash)
+        { *hash = 0; }
+
+        n = sscanf(line, "%63s %63s %63s %63s %63s %63s %63s %63s %63s %63s",
+                   tok[0], tok[1], tok[2], tok[3], tok[4],
+                   tok[5], tok[6], tok[7], tok[8], tok[9]);
+        if (n <= 0)
+        { continue; }
+
+        if (strcmp(tok[0], "router") == 0 && n == 2)
+        {
+            struct emu_router* r;
+            if (emu->num_routers == EMU_MAX_ROUTERS || emu_find_router(emu, tok[1]))
+            { goto bad_line; }
+            r = &emu->routers[emu->num_routers++];
+            if (emu_copy_name(r->name, IDSIZE, tok[1]) != 0)
+            { goto bad_line; }
+        }
+        else if (strcmp(tok[0], "iface") == 0 && (n == 5 || n == 6))
+        {
+            struct emu_router* r = emu_find_router(emu, tok[1]);
+            struct emu_iface* iface;
+            if (r == 0 || r->num_ifaces == EMU_MAX_IFACES || emu_find_iface(emu, tok[1], tok[2]))
+            { goto bad_line; }
+            iface = &r->ifaces[r->num_ifaces++];
+            if (emu_copy_name(iface->name, sizeof(iface->name), tok[2]) != 0)
+            { goto bad_line; }
+            iface->router = r;
+            if (inet_aton(tok[3], &addr) == 0)
+            { goto bad_line; }
+            iface->ip = addr.s_addr;
+            if (inet_aton(tok[4], &addr) == 0)
+            { goto bad_line; }
+            iface->mask = addr.s_addr;
+            if (n == 6)
+            {
+                if (emu_parse_mac(tok[5], iface->addr) != 0)
+                { goto bad_line; }
+            }
+            else
+            {
+                /* -- locally administered, router index / interface index -- */
+                iface->addr[0] = 0x02;
+                iface->addr[2] = (uint8_t)(r - emu->routers);
+                iface->addr[3] = (uint8_t)(r->num_ifaces - 1);
+            }
+        }
+        else if (strcmp(tok[0], "link") == 0 && n == 5)
+        {
+            struct emu_iface* a = emu_find_iface(emu, tok[1], tok[2]);
+            struct emu_iface* b = emu_find_iface(emu, tok[3], tok[4]);
+            if (a == 0 || b == 0 || a == b || a->peer || b->peer || a->hosts || b->hosts)
+            { goto bad_line; }
+            a->peer = b;
+            b->peer = a;
+        }
+        else if (strcmp(tok[0], "host") == 0 && (n == 5 || n == 6))
+        {
+            struct emu_iface* iface = emu_find_iface(emu, tok[3], tok[4]);
+            struct emu_host* h;
+            if (iface == 0 || iface->peer || emu->num_hosts == EMU_MAX_HOSTS ||
+                emu_find_host(emu, tok[1]))
+            { goto bad_line; }
+            h = &emu->hosts[emu->num_hosts++];
+            if (emu_copy_name(h->name, IDSIZE, tok[1]) != 0)
+            { goto bad_line; }
+            if (inet_aton(tok[2], &addr) == 0)
+            { goto bad_line; }
+            h->ip = addr.s_addr;
+            if (n == 6)
+            {
+                if (emu_parse_mac(tok[5], h->addr) != 0)
+                { goto bad_line; }
+            }
+            else
+            {
+                h->addr[0] = 0x02;
+                h->addr[1] = 0x01;
+                h->addr[4] = (uint8_t)((emu->num_hosts - 1) >> 8);
+                h->addr[5] = (uint8_t)(emu->num_hosts - 1);
+            }
+            h->iface = iface;
+            h->next = iface->hosts;
+            iface->hosts = h;
+        }
+        else if (strcmp(tok[0], "flow") == 0 && n >= 3 && (n % 2) == 1)
+        {
+            struct emu_flow* f;
+            if (emu->num_flows == EMU_MAX_FLOWS)
+            { goto bad_line; }
+            f = &emu->flows[emu->num_flows];
+            f->src = emu_find_host(emu, tok[1]);
+            f->dst = emu_find_host(emu, tok[2]);
+            f->pps = 0;
+            f->size = DEFAULT_SIZE;
+            f->window = DEFAULT_WINDOW;
+            if (f->src == 0 || f->dst == 0 || f->src == f->dst)
+            { goto bad_line; }
+            for (i = 3; i < n; i += 2)
+            {
+                if (strcmp(tok[i], "pps") == 0)
+                { f->pps = atoi(tok[i+1]); }
+                else if (strcmp(tok[i], "size") == 0)
+                { f->size = atoi(tok[i+1]); }
+                else if (strcmp(tok[i], "window") == 0)
+                { f->window = atoi(tok[i+1]); }
+                else
+                { goto bad_line; }
+            }
+            if (f->size < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) +
+                    sizeof(struct udp_hdr) + sizeof(struct emu_probe) ||
+                f->size > 1514 || f->window == 0)
+            { goto bad_line; }
+            f->samples = (uint32_t*)malloc(EMU_MAX_SAMPLES * sizeof(uint32_t));
+            assert(f->samples);
+            emu->num_flows++;
+        }
+        else
+        { goto bad_line; }
+    } /* -- while -- */
+
+    fclose(fp);
+
+    if (emu->num_routers == 0)
+    {
+        fprintf(stderr, "%s: no routers in topology\n", filename);
+        return -1;
+    }
+    return 0;
+
+bad_line:
+    fprintf(stderr, "%s:%d: bad topology statement\n", filename, lineno);
+    fclose(fp);
+    return -1;
+} /* -- emu_load_topology -- */
+
+/*-----------------------------------------------------------------------------
+ * client output
+ *---------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_flush(..)
+ * Scope: Local
+ *
+ * Write out as much of the pending output as the socket takes.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_flush(struct emu_client* c)
+{
+    ssize_t ret;
+    unsigned int done = 0;
+
+    while (done < c->outlen)
+    {
+        ret = write(c->fd, c->outbuf + done, c->outlen - done);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            { c->state = EMU_CLOSED; }
+            break;
+        }
+        done += ret;
+    }
+
+    memmove(c->outbuf, c->outbuf + done, c->outlen - done);
+    c->outlen -= done;
+} /* -- emu_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_queue(..)
+ * Scope: Local
+ *
+ * Queue a VNS message for the client.  A client that does not keep up
+ * loses frames instead of stalling the emulator, as a full NIC queue would.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 if the message was dropped
+ *
+ *---------------------------------------------------------------------------*/
+
+static int emu_queue(struct emu_client* c, const void* msg, unsigned int len)
+{
+    if (c->state == EMU_CLOSED)
+    { return -1; }
+
+    if (c->outlen + len > c->outcap)
+    {
+        unsigned int cap = c->outcap ? c->outcap : 64*1024;
+        while (cap < c->outlen + len)
+        { cap *= 2; }
+        if (cap > EMU_OUTBUF_MAX)
+        { return -1; }
+        c->outbuf = (uint8_t*)realloc(c->outbuf, cap);
+        assert(c->outbuf);
+        c->outcap = cap;
+    }
+
+    memcpy(c->outbuf + c->outlen, msg, len);
+    c->outlen += len;
+    return 0;
+} /* -- emu_queue -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_send_frame(..)
+ * Scope: Local
+ *
+ * Hand an ethernet frame to the router owning iface.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int emu_send_frame(struct emu_state* emu, struct emu_iface* iface,
+                          const uint8_t* frame, unsigned int len)
+{
+    uint8_t buf[sizeof(c_packet_header) + 2048];
+    c_packet_header* hdr = (c_packet_header*)buf;
+    struct emu_client* c = iface->router->client;
+
+    if (c == 0 || c->state != EMU_RUNNING || len > 2048)
+    {
+        emu->frames_dropped++;
+        return -1;
+    }
+
+    hdr->mLen = htonl(sizeof(c_packet_header) + len);
+    hdr->mType = htonl(VNSPACKET);
+    memset(hdr->mInterfaceName, 0, sizeof(hdr->mInterfaceName));
+    strncpy(hdr->mInterfaceName, iface->name, sizeof(hdr->mInterfaceName));
+    memcpy(buf + sizeof(c_packet_header), frame, len);
+
+    if (emu_queue(c, buf, sizeof(c_packet_header) + len) != 0)
+    {
+        emu->frames_dropped++;
+        return -1;
+    }
+    return 0;
+} /* -- emu_send_frame -- */
+
+static void emu_send_close(struct emu_client* c, const char* reason)
+{
+    c_close msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.mLen = htonl(sizeof(msg));
+    msg.mType = htonl(VNSCLOSE);
+    strncpy(msg.mErrorMessage, reason, sizeof(msg.mErrorMessage) - 1);
+    emu_queue(c, &msg, sizeof(msg));
+    emu_flush(c);
+    c->state = EMU_CLOSED;
+}
+
+/*-----------------------------------------------------------------------------
+ * VNS handshake
+ *---------------------------------------------------------------------------*/
+
+static void emu_send_auth_request(struct emu_client* c)
+{
+    uint8_t buf[sizeof(c_auth_request) + EMU_SALT_LEN];
+    c_auth_request* req = (c_auth_request*)buf;
+    int i;
+
+    for (i = 0; i < EMU_SALT_LEN; i++)
+    { c->salt[i] = (uint8_t)random(); }
+
+    req->mLen = htonl(sizeof(buf));
+    req->mType = htonl(VNS_AUTH_REQUEST);
+    memcpy(req->salt, c->salt, EMU_SALT_LEN);
+    emu_queue(c, buf, sizeof(buf));
+}
+
+static void emu_send_auth_status(struct emu_client* c, int ok, const char* msg)
+{
+    uint8_t buf[sizeof(c_auth_status) + 128];
+    c_auth_status* st = (c_auth_status*)buf;
+    unsigned int len = sizeof(c_auth_status) + strlen(msg) + 1;
+
+    assert(len <= sizeof(buf));
+    st->mLen = htonl(len);
+    st->mType = htonl(VNS_AUTH_STATUS);
+    st->auth_ok = ok ? 1 : 0;
+    strcpy(st->msg, msg);
+    emu_queue(c, buf, len);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_handle_auth_reply(..)
+ * Scope: Local
+ *
+ * Check the salted SHA1 of the shared key against the reply when the
+ * emulator was given a key file, accept anyone otherwise.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_handle_auth_reply(struct emu_state* emu, struct emu_client* c,
+                                  uint8_t* msg, unsigned int len)
+{
+    c_auth_reply* ar = (c_auth_reply*)msg;
+    unsigned int ulen;
+    SHA1Context sha1;
+    int i;
+
+    if (len < sizeof(c_auth_reply) || ntohl(ar->mType) != VNS_AUTH_REPLY)
+    {
+        emu_send_close(c, "expected VNS_AUTH_REPLY");
+        return;
+    }
+
+    ulen = ntohl(ar->usernameLen);
+    if (ulen > len - sizeof(c_auth_reply) || len - sizeof(c_auth_reply) - ulen != 20)
+    {
+        emu_send_close(c, "malformed VNS_AUTH_REPLY");
+        return;
+    }
+
+    if (emu->auth_key)
+    {
+        SHA1Reset(&sha1);
+        SHA1Input(&sha1, c->salt, EMU_SALT_LEN);
+        SHA1Input(&sha1, (unsigned char*)emu->auth_key, EMU_AUTH_KEY_LEN);
+        SHA1Result(&sha1);
+        for (i = 0; i < 5; i++)
+        { sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]); }
+
+        if (memcmp(ar->username + ulen, sha1.Message_Digest, 20) != 0)
+        {
+            emu_send_auth_status(c, 0, "bad credentials");
+            emu_flush(c);
+            c->state = EMU_CLOSED;
+            return;
+        }
+    }
+
+    emu_send_auth_status(c, 1, "vns_emu");
+    c->state = EMU_OPEN;
+} /* -- emu_handle_auth_reply -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_handle_open(..)
+ * Scope: Local
+ *
+ * Bind the client to the virtual host it asks for and send its hardware
+ * information, in the order sr_handle_hwinfo expects (the interface name
+ * first, then the attributes of that last interface).
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_handle_open(struct emu_state* emu, struct emu_client* c,
+                            uint8_t* msg, unsigned int len)
+{
+    c_open* op = (c_open*)msg;
+    c_hwinfo hw;
+    char host[IDSIZE+1];
+    struct emu_router* r;
+    int i, n = 0;
+
+    if (ntohl(op->mType) == VNS_OPEN_TEMPLATE)
+    {
+        emu_send_close(c, "vns_emu does not instantiate templates");
+        return;
+    }
+
+    if (ntohl(op->mType) != VNSOPEN || len < sizeof(c_open))
+    {
+        emu_send_close(c, "expected VNSOPEN");
+        return;
+    }
+
+    memcpy(host, op->mVirtualHostID, IDSIZE);
+    host[IDSIZE] = 0;
+
+    if ((r = emu_find_router(emu, host)) == 0)
+    {
+        emu_send_close(c, "unknown virtual host");
+        return;
+    }
+    if (r->client)
+    {
+        emu_send_close(c, "virtual host already in use");
+        return;
+    }
+
+    memset(&hw, 0, sizeof(hw));
+    for (i = 0; i < r->num_ifaces; i++)
+    {
+        struct emu_iface* iface = &r->ifaces[i];
+
+        hw.mHWInfo[n].mKey = htonl(HWINTERFACE);
+        strncpy(hw.mHWInfo[n++].value, iface->name, 32);
+        hw.mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(hw.mHWInfo[n++].value, iface->addr, ETHER_ADDR_LEN);
+        hw.mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(hw.mHWInfo[n++].value, &iface->ip, 4);
+        hw.mHWInfo[n].mKey = htonl(HWMASK);
+        memcpy(hw.mHWInfo[n++].value, &iface->mask, 4);
+    }
+    hw.mLen = htonl(2*sizeof(uint32_t) + n*sizeof(c_hw_entry));
+    hw.mType = htonl(VNSHWINFO);
+    emu_queue(c, &hw, 2*sizeof(uint32_t) + n*sizeof(c_hw_entry));
+
+    r->client = c;
+    c->router = r;
+    c->state = EMU_RUNNING;
+    fprintf(stderr, "vns_emu: %s connected\n", r->name);
+} /* -- emu_handle_open -- */
+
+/*-----------------------------------------------------------------------------
+ * hosts
+ *---------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_host_arp(..)
+ * Scope: Local
+ *
+ * Answer an ARP request from a router for one of the hosts on the segment.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_host_arp(struct emu_state* emu, struct emu_iface* iface,
+                         uint8_t* frame, unsigned int len)
+{
+    uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arphdr)];
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct sr_arphdr* arp = (struct sr_arphdr*)(frame + sizeof(struct sr_ethernet_hdr));
+    struct sr_ethernet_hdr* reth = (struct sr_ethernet_hdr*)reply;
+    struct sr_arphdr* rarp = (struct sr_arphdr*)(reply + sizeof(struct sr_ethernet_hdr));
+    struct emu_host* h;
+
+    if (len < sizeof(reply) || ntohs(arp->ar_op) != ARP_REQUEST)
+    { return; }
+
+    for (h = iface->hosts; h; h = h->next)
+    {
+        if (h->ip == arp->ar_tip)
+        { break; }
+    }
+    if (h == 0)
+    { return; }
+
+    memcpy(reth->ether_dhost, eth->ether_shost, ETHER_ADDR_LEN);
+    memcpy(reth->ether_shost, h->addr, ETHER_ADDR_LEN);
+    reth->ether_type = htons(ETHERTYPE_ARP);
+
+    rarp->ar_hrd = htons(ARPHDR_ETHER);
+    rarp->ar_pro = htons(ETHERTYPE_IP);
+    rarp->ar_hln = ETHER_ADDR_LEN;
+    rarp->ar_pln = 4;
+    rarp->ar_op = htons(ARP_REPLY);
+    memcpy(rarp->ar_sha, h->addr, ETHER_ADDR_LEN);
+    rarp->ar_sip = h->ip;
+    memcpy(rarp->ar_tha, arp->ar_sha, ETHER_ADDR_LEN);
+    rarp->ar_tip = arp->ar_sip;
+
+    emu_send_frame(emu, iface, reply, sizeof(reply));
+} /* -- emu_host_arp -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_host_receive(..)
+ * Scope: Local
+ *
+ * A datagram routed to one of the hosts; account it to its flow.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_host_receive(struct emu_state* emu, struct emu_iface* iface,
+                             uint8_t* frame, unsigned int len)
+{
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct ip* ip_hdr = (struct ip*)(frame + sizeof(struct sr_ethernet_hdr));
+    struct udp_hdr* udp;
+    struct emu_probe* probe;
+    struct emu_flow* f;
+    struct emu_host* h;
+    uint64_t now;
+    uint32_t seq;
+
+    /* -- multicast (pwospf hellos and LSUs) is not for the hosts -- */
+    if (eth->ether_dhost[0] & 0x01)
+    { return; }
+
+    for (h = iface->hosts; h; h = h->next)
+    {
+        if (memcmp(h->addr, eth->ether_dhost, ETHER_ADDR_LEN) == 0)
+        { break; }
+    }
+    if (h == 0)
+    { return; }
+
+    if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) +
+            sizeof(struct udp_hdr) + sizeof(struct emu_probe) ||
+        ip_hdr->ip_p != IPPROTO_UDP || ip_hdr->ip_dst.s_addr != h->ip)
+    { return; }
+
+    udp = (struct udp_hdr*)((uint8_t*)ip_hdr + ip_hdr->ip_hl*4);
+    probe = (struct emu_probe*)(udp + 1);
+    if ((uint8_t*)(probe + 1) > frame + len ||
+        ntohs(udp->uh_dport) != EMU_PROBE_PORT ||
+        ntohl(probe->magic) != EMU_PROBE_MAGIC ||
+        ntohs(probe->flow) >= emu->num_flows)
+    { return; }
+
+    f = &emu->flows[ntohs(probe->flow)];
+    seq = ntohl(probe->seq);
+    now = emu_now();
+    f->last_rx = now;
+
+    /* -- warmup datagrams only prime the caches -- */
+    if (seq & EMU_PROBE_PRIME)
+    { return; }
+
+    f->rx++;
+    f->rx_bytes += len;
+    if (seq < f->highest_seq)
+    { f->reordered++; }
+    else
+    { f->highest_seq = seq; }
+
+    if (f->num_samples < EMU_MAX_SAMPLES)
+    {
+        uint64_t lat = now - probe->tx_ns;
+        f->samples[f->num_samples++] = lat > 0xffffffffULL ? 0xffffffff : (uint32_t)lat;
+    }
+} /* -- emu_host_receive -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_flow_send(..)
+ * Scope: Local
+ *
+ * Build one datagram of the flow and hand it to the router the source
+ * host sits behind.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_flow_send(struct emu_state* emu, struct emu_flow* f,
+                          uint32_t seq, uint64_t now)
+{
+    uint8_t frame[1514];
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+    struct ip* ip_hdr = (struct ip*)(frame + sizeof(struct sr_ethernet_hdr));
+    struct udp_hdr* udp = (struct udp_hdr*)(ip_hdr + 1);
+    struct emu_probe* probe = (struct emu_probe*)(udp + 1);
+    unsigned int ip_len = f->size - sizeof(struct sr_ethernet_hdr);
+
+    memset(frame, 0, f->size);
+    memcpy(eth->ether_dhost, f->src->iface->addr, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, f->src->addr, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = 5;
+    ip_hdr->ip_len = htons(ip_len);
+    ip_hdr->ip_id = htons((uint16_t)seq);
+    ip_hdr->ip_ttl = 64;
+    ip_hdr->ip_p = IPPROTO_UDP;
+    ip_hdr->ip_src.s_addr = f->src->ip;
+    ip_hdr->ip_dst.s_addr = f->dst->ip;
+    ip_hdr->ip_sum = emu_cksum(ip_hdr, sizeof(struct ip));
+
+    udp->uh_sport = htons(EMU_PROBE_PORT + (f - emu->flows));
+    udp->uh_dport = htons(EMU_PROBE_PORT);
+    udp->uh_ulen = htons(ip_len - sizeof(struct ip));
+
+    probe->magic = htonl(EMU_PROBE_MAGIC);
+    probe->flow = htons(f - emu->flows);
+    probe->seq = htonl(seq);
+    probe->tx_ns = now;
+
+    if (emu_send_frame(emu, f->src->iface, frame, f->size) != 0)
+    { f->dropped++; }
+} /* -- emu_flow_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_generate(..)
+ * Scope: Local
+ *
+ * Run the traffic generators.  Returns the ns until the next datagram is
+ * due so the poll loop can sleep.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint64_t emu_generate(struct emu_state* emu, uint64_t now)
+{
+    uint64_t wait = 100000000ULL;
+    int i, burst;
+
+    for (i = 0; i < emu->num_flows; i++)
+    {
+        struct emu_flow* f = &emu->flows[i];
+
+        if (emu->phase == EMU_WARMUP)
+        {
+            /* -- a trickle to resolve ARP and wake the routes up -- */
+            if (now >= f->next_tx)
+            {
+                emu_flow_send(emu, f, EMU_PROBE_PRIME, now);
+                f->next_tx = now + 100000000ULL;
+            }
+        }
+        else if (emu->phase == EMU_RUN)
+        {
+            for (burst = 0; burst < EMU_TX_BURST && now >= f->next_tx; burst++)
+            {
+                if (f->tx - f->rx - f->dropped >= f->window)
+                {
+                    /* -- window full, give up on datagrams lost for 50ms -- */
+                    if (now - f->last_rx < 50000000ULL)
+                    { break; }
+                    f->dropped = f->tx - f->rx;
+                    f->last_rx = now;
+                }
+
+                emu_flow_send(emu, f, f->next_seq++, now);
+                f->tx++;
+
+                if (f->pps)
+                { f->next_tx += 1000000000ULL / f->pps; }
+                else
+                { f->next_tx = now; }
+            }
+        }
+        else
+        { continue; }
+
+        if (f->next_tx > now && f->next_tx - now < wait)
+        { wait = f->next_tx - now; }
+        else if (f->next_tx <= now && (f->pps || f->tx - f->rx - f->dropped < f->window))
+        { wait = 0; }
+    }
+
+    return wait;
+} /* -- emu_generate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_switch_frame(..)
+ * Scope: Local
+ *
+ * A frame a router sent out of iface: carry it over the wire to the
+ * neighbor router, or to the hosts of the segment.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_switch_frame(struct emu_state* emu, struct emu_iface* iface,
+                             uint8_t* frame, unsigned int len)
+{
+    struct sr_ethernet_hdr* eth = (struct sr_ethernet_hdr*)frame;
+
+    if (len < sizeof(struct sr_ethernet_hdr))
+    { return; }
+
+    if (iface->peer)
+    {
+        if (emu_send_frame(emu, iface->peer, frame, len) == 0)
+        { emu->frames_switched++; }
+        return;
+    }
+
+    if (ntohs(eth->ether_type) == ETHERTYPE_ARP)
+    { emu_host_arp(emu, iface, frame, len); }
+    else if (ntohs(eth->ether_type) == ETHERTYPE_IP)
+    { emu_host_receive(emu, iface, frame, len); }
+} /* -- emu_switch_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_handle_message(..)
+ * Scope: Local
+ *
+ * One complete VNS message from a client.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_handle_message(struct emu_state* emu, struct emu_client* c,
+                               uint8_t* msg, unsigned int len)
+{
+    c_packet_header* pkt = (c_packet_header*)msg;
+    char name[17];
+    int i;
+
+    switch (c->state)
+    {
+        case EMU_AUTH:
+            emu_handle_auth_reply(emu, c, msg, len);
+            break;
+
+        case EMU_OPEN:
+            emu_handle_open(emu, c, msg, len);
+            break;
+
+        case EMU_RUNNING:
+            if (ntohl(pkt->mType) == VNSCLOSE)
+            {
+                c->state = EMU_CLOSED;
+                break;
+            }
+            if (ntohl(pkt->mType) != VNSPACKET || len < sizeof(c_packet_header))
+            { break; }
+
+            memcpy(name, pkt->mInterfaceName, 16);
+            name[16] = 0;
+            for (i = 0; i < c->router->num_ifaces; i++)
+            {
+                if (strcmp(c->router->ifaces[i].name, name) == 0)
+                {
+                    emu_switch_frame(emu, &c->router->ifaces[i],
+                                     msg + sizeof(c_packet_header),
+                                     len - sizeof(c_packet_header));
+                    break;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+} /* -- emu_handle_message -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_read(..)
+ * Scope: Local
+ *
+ * Read what the client sent and dispatch every complete message.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_read(struct emu_state* emu, struct emu_client* c)
+{
+    ssize_t ret;
+    unsigned int off = 0;
+    uint32_t len;
+
+    ret = read(c->fd, c->inbuf + c->inlen, EMU_INBUF_SIZE - c->inlen);
+    if (ret <= 0)
+    {
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+        { return; }
+        c->state = EMU_CLOSED;
+        return;
+    }
+    c->inlen += ret;
+
+    while (c->inlen - off >= 4 && c->state != EMU_CLOSED)
+    {
+        memcpy(&len, c->inbuf + off, 4);
+        len = ntohl(len);
+        if (len < 8 || len > 10000)
+        {
+            fprintf(stderr, "vns_emu: bad message length %u, dropping client\n", len);
+            c->state = EMU_CLOSED;
+            return;
+        }
+        if (c->inlen - off < len)
+        { break; }
+
+        emu_handle_message(emu, c, c->inbuf + off, len);
+        off += len;
+    }
+
+    memmove(c->inbuf, c->inbuf + off, c->inlen - off);
+    c->inlen -= off;
+} /* -- emu_read -- */
+
+static void emu_drop_client(struct emu_state* emu, int idx)
+{
+    struct emu_client* c = &emu->clients[idx];
+
+    if (c->router)
+    {
+        fprintf(stderr, "vns_emu: %s disconnected\n", c->router->name);
+        c->router->client = 0;
+    }
+    close(c->fd);
+    free(c->inbuf);
+    free(c->outbuf);
+
+    /* -- keep the array dense, fix up the back pointer of the moved one -- */
+    emu->num_clients--;
+    if (idx != emu->num_clients)
+    {
+        emu->clients[idx] = emu->clients[emu->num_clients];
+        if (emu->clients[idx].router)
+        { emu->clients[idx].router->client = &emu->clients[idx]; }
+    }
+}
+
+static void emu_accept(struct emu_state* emu, int lfd)
+{
+    struct emu_client* c;
+    int fd;
+
+    if ((fd = accept(lfd, 0, 0)) < 0)
+    { return; }
+
+    if (emu->num_clients == EMU_MAX_CLIENTS)
+    {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    c = &emu->clients[emu->num_clients++];
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->state = EMU_AUTH;
+    c->inbuf = (uint8_t*)malloc(EMU_INBUF_SIZE);
+    assert(c->inbuf);
+
+    emu_send_auth_request(c);
+    emu_flush(c);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_advance_phase(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_advance_phase(struct emu_state* emu, uint64_t now)
+{
+    int i;
+
+    switch (emu->phase)
+    {
+        case EMU_WAIT:
+            for (i = 0; i < emu->num_routers; i++)
+            {
+                if (emu->routers[i].client == 0)
+                { return; }
+            }
+            fprintf(stderr, "vns_emu: all routers up, warming up for %us\n", emu->warmup);
+            emu->phase = EMU_WARMUP;
+            emu->phase_end = now + emu->warmup * 1000000000ULL;
+            for (i = 0; i < emu->num_flows; i++)
+            { emu->flows[i].next_tx = now; }
+            break;
+
+        case EMU_WARMUP:
+            if (now < emu->phase_end)
+            { return; }
+            fprintf(stderr, "vns_emu: measuring for %us\n", emu->duration);
+            emu->phase = EMU_RUN;
+            emu->run_start = now;
+            emu->phase_end = now + emu->duration * 1000000000ULL;
+            for (i = 0; i < emu->num_flows; i++)
+            {
+                emu->flows[i].next_tx = now;
+                emu->flows[i].last_rx = now;
+            }
+            break;
+
+        case EMU_RUN:
+            if (now < emu->phase_end && !emu_stop)
+            { return; }
+            emu->phase = EMU_DRAIN;
+            emu->run_end = now;
+            emu->phase_end = now + 1000000000ULL;
+            break;
+
+        case EMU_DRAIN:
+            if (now < emu->phase_end && !emu_stop)
+            { return; }
+            emu->phase = EMU_DONE;
+            break;
+
+        default:
+            break;
+    }
+} /* -- emu_advance_phase -- */
+
+/*-----------------------------------------------------------------------------
+ * reporting
+ *---------------------------------------------------------------------------*/
+
+static int emu_cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double emu_pct(struct emu_flow* f, double p)
+{
+    uint32_t idx;
+    if (f->num_samples == 0)
+    { return 0.0; }
+    idx = (uint32_t)(p * (f->num_samples - 1));
+    return f->samples[idx] / 1000.0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: emu_report(..)
+ * Scope: Local
+ *
+ * Print rate, loss and latency (in microseconds) of every flow.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void emu_report(struct emu_state* emu)
+{
+    double secs = (emu->run_end - emu->run_start) / 1e9;
+    uint64_t total_tx = 0, total_rx = 0;
+    int i;
+
+    if (secs <= 0)
+    {
+        printf("vns_emu: no measurement was taken\n");
+        return;
+    }
+
+    printf("%-20s %10s %10s %8s %10s %9s %9s %9s %9s %9s\n",
+           "flow", "tx", "rx", "loss%", "rx pps", "Mbit/s",
+           "min us", "p50 us", "p99 us", "max us");
+
+    for (i = 0; i < emu->num_flows; i++)
+    {
+        struct emu_flow* f = &emu->flows[i];
+        char name[2*IDSIZE+4];
+        double loss = f->tx ? 100.0 * (f->tx - f->rx) / f->tx : 0.0;
+
+        qsort(f->samples, f->num_samples, sizeof(uint32_t), emu_cmp_u32);
+        snprintf(name, sizeof(name), "%s->%s", f->src->name, f->dst->name);
+
+        printf("%-20s %10llu %10llu %8.2f %10.0f %9.2f %9.1f %9.1f %9.1f %9.1f\n",
+               name, (unsigned long long)f->tx, (unsigned long long)f->rx, loss,
+               f->rx / secs, f->rx_bytes * 8 / secs / 1e6,
+               emu_pct(f, 0.0), emu_pct(f, 0.5), emu_pct(f, 0.99), emu_pct(f, 1.0));
+
+        total_tx += f->tx;
+        total_rx += f->rx;
+    }
+
+    printf("total: %llu tx, %llu rx, %.0f pps forwarded over %.2fs, "
+           "%llu frames switched between routers, %llu dropped on full queues\n",
+           (unsigned long long)total_tx, (unsigned long long)total_rx,
+           total_rx / secs, secs,
+           (unsigned long long)emu->frames_switched,
+           (unsigned long long)emu->frames_dropped);
+} /* -- emu_report -- */
+
+/*-----------------------------------------------------------------------------
+ * listening sockets
+ *---------------------------------------------------------------------------*/
+
+static int emu_listen_tcp(unsigned short port)
+{
+    struct sockaddr_in addr;
+    int fd, one = 1;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int emu_listen_unix(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static char* emu_read_key(const char* filename)
+{
+    char* key = (char*)calloc(1, EMU_AUTH_KEY_LEN + 1);
+    FILE* fp = fopen(filename, "r");
+
+    if (fp == 0 || fgets(key, EMU_AUTH_KEY_LEN + 1, fp) != key)
+    {
+        perror("unable to read the authentication key file");
+        exit(1);
+    }
+    fclose(fp);
+    return key;
+}
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+    struct emu_state* emu;
+    struct pollfd pfds[EMU_MAX_CLIENTS + 2];
+    int lfds[2] = { -1, -1 };
+    int num_lfds = 0;
+    unsigned int port = DEFAULT_PORT;
+    char* unix_path = 0;
+    int tcp = 1;
+    int c, i;
+
+    emu = (struct emu_state*)calloc(1, sizeof(struct emu_state));
+    assert(emu);
+    emu->warmup = DEFAULT_WARMUP;
+    emu->duration = DEFAULT_DURATION;
+
+    while ((c = getopt(argc, argv, "hp:u:Ua:w:d:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 'p':
+                port = atoi((char *) optarg);
+                break;
+            case 'u':
+                unix_path = optarg;
+                break;
+            case 'U':
+                tcp = 0;
+                break;
+            case 'a':
+                emu->auth_key = emu_read_key(optarg);
+                break;
+            case 'w':
+                emu->warmup = atoi((char *) optarg);
+                break;
+            case 'd':
+                emu->duration = atoi((char *) optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        } /* switch */
+    } /* -- while -- */
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if (emu_load_topology(emu, argv[optind]) != 0)
+    { exit(1); }
+
+    if (tcp)
+    {
+        if ((lfds[num_lfds] = emu_listen_tcp(port)) < 0)
+        { exit(1); }
+        fprintf(stderr, "vns_emu: listening on 127.0.0.1:%u\n", port);
+        num_lfds++;
+    }
+    if (unix_path)
+    {
+        if ((lfds[num_lfds] = emu_listen_unix(unix_path)) < 0)
+        { exit(1); }
+        fprintf(stderr, "vns_emu: listening on %s\n", unix_path);
+        num_lfds++;
+    }
+    if (num_lfds == 0)
+    {
+        fprintf(stderr, "vns_emu: nothing to listen on\n");
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, emu_sigint);
+    srandom(time(0) ^ getpid());
+
+    fprintf(stderr, "vns_emu: waiting for %d router(s)\n", emu->num_routers);
+
+    while (emu->phase != EMU_DONE)
+    {
+        uint64_t now = emu_now();
+        uint64_t wait;
+        int nfds = 0;
+
+        if (emu_stop && emu->phase < EMU_RUN)
+        { break; }
+
+        emu_advance_phase(emu, now);
+        wait = emu_generate(emu, now);
+
+        for (i = 0; i < num_lfds; i++)
+        {
+            pfds[nfds].fd = lfds[i];
+            pfds[nfds].events = POLLIN;
+            nfds++;
+        }
+        for (i = 0; i < emu->num_clients; i++)
+        {
+            struct emu_client* cl = &emu->clients[i];
+            if (cl->outlen)
+            { emu_flush(cl); }
+            pfds[nfds].fd = cl->fd;
+            pfds[nfds].events = POLLIN | (cl->outlen ? POLLOUT : 0);
+            nfds++;
+        }
+
+        if (poll(pfds, nfds, (int)(wait / 1000000ULL)) < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("poll");
+            break;
+        }
+
+        for (i = 0; i < num_lfds; i++)
+        {
+            if (pfds[i].revents & POLLIN)
+            { emu_accept(emu, lfds[i]); }
+        }
+
+        /* -- clients accepted above are polled on the next round -- */
+        for (i = nfds - 1; i >= num_lfds; i--)
+        {
+            struct emu_client* cl = &emu->clients[i - num_lfds];
+
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            { emu_read(emu, cl); }
+            if (cl->state != EMU_CLOSED && cl->outlen)
+            { emu_flush(cl); }
+            if (cl->state == EMU_CLOSED)
+            { emu_drop_client(emu, i - num_lfds); }
+        }
+    }
+
+    for (i = 0; i < emu->num_clients; i++)
+    { emu_send_close(&emu->clients[i], "vns_emu run complete"); }
+
+    emu_report(emu);
+
+    if (unix_path)
+    { unlink(unix_path); }
+
+    return 0;
+}/* -- main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: usage(..)
+ * Scope: local
+ *---------------------------------------------------------------------------*/
+
+static void usage(char* argv0)
+{
+    printf("VNS server emulator\n");
+    printf("Format: %s [-h] [-p port] [-u unix socket] [-U] [-a auth_key_filename]\n", argv0);
+    printf("           [-w warmup seconds] [-d duration seconds] topology\n");
+    printf("   -U does not listen on TCP, routers connect with sr -s <unix socket>\n");
+    printf("   defaults port=%d warmup=%d duration=%d\n",
+           DEFAULT_PORT, DEFAULT_WARMUP, DEFAULT_DURATION);
+} /* -- usage -- */